@@ -0,0 +1,240 @@
+/* PipeWire
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <time.h>
+
+#include "pipewire-jack.c"
+
+/* Measures what a session manager does when it restores a saved session
+ * of N_LINKS connections between the ports of N_NODES capture and
+ * playback nodes:
+ *
+ *  ports:   the registry port events, each checks for a duplicate name
+ *  links:   the registry link events
+ *  restore: find both ports of a connection on their name and check
+ *           if they are connected, like jack_connect() does
+ *  alias:   the same with the alias of the ports
+ *  get:     list the physical audio outputs, the ports of a node and
+ *           the ports matching a regex with jack_get_ports()
+ *
+ * The registry events are fed directly to the client, no server is used.
+ */
+
+#define N_NODES		20
+#define N_LINKS		2000
+#define PORTS_PER_NODE	(N_LINKS / N_NODES)
+
+static inline uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void report(const char *name, uint32_t n_ops, uint64_t t)
+{
+	fprintf(stderr, "%-8s ops:%5u time:%8"PRIu64"us ns/op:%6"PRIu64"\n",
+			name, n_ops, (uint64_t)(t / SPA_NSEC_PER_USEC), t / n_ops);
+}
+
+static void add_node(struct client *c, uint32_t id, const char *name)
+{
+	struct spa_dict_item items[1];
+	struct spa_dict dict;
+
+	items[0] = SPA_DICT_ITEM_INIT(PW_KEY_NODE_NAME, name);
+	dict = SPA_DICT_INIT(items, 1);
+
+	registry_event_global(c, id, PW_PERM_RWX, PW_TYPE_INTERFACE_Node, 0, &dict);
+}
+
+static void add_port(struct client *c, uint32_t id, uint32_t node_id,
+		const char *direction, const char *name, const char *path)
+{
+	struct spa_dict_item items[6];
+	struct spa_dict dict;
+	char str[16];
+
+	snprintf(str, sizeof(str), "%u", node_id);
+	items[0] = SPA_DICT_ITEM_INIT(PW_KEY_FORMAT_DSP, JACK_DEFAULT_AUDIO_TYPE);
+	items[1] = SPA_DICT_ITEM_INIT(PW_KEY_NODE_ID, str);
+	items[2] = SPA_DICT_ITEM_INIT(PW_KEY_PORT_NAME, name);
+	items[3] = SPA_DICT_ITEM_INIT(PW_KEY_PORT_DIRECTION, direction);
+	items[4] = SPA_DICT_ITEM_INIT(PW_KEY_OBJECT_PATH, path);
+	items[5] = SPA_DICT_ITEM_INIT(PW_KEY_PORT_PHYSICAL, "true");
+	dict = SPA_DICT_INIT(items, 6);
+
+	registry_event_global(c, id, PW_PERM_RWX, PW_TYPE_INTERFACE_Port, 0, &dict);
+}
+
+static void add_link(struct client *c, uint32_t id, uint32_t src, uint32_t dst)
+{
+	struct spa_dict_item items[2];
+	struct spa_dict dict;
+	char s[16], d[16];
+
+	snprintf(s, sizeof(s), "%u", src);
+	snprintf(d, sizeof(d), "%u", dst);
+	items[0] = SPA_DICT_ITEM_INIT(PW_KEY_LINK_OUTPUT_PORT, s);
+	items[1] = SPA_DICT_ITEM_INIT(PW_KEY_LINK_INPUT_PORT, d);
+	dict = SPA_DICT_INIT(items, 2);
+
+	registry_event_global(c, id, PW_PERM_RWX, PW_TYPE_INTERFACE_Link, 0, &dict);
+}
+
+/* the globals of a node, its ports and their links */
+#define NODE_ID(n,in)		(1 + (n) * 2 + (in))
+#define PORT_ID(n,p,in)		(100 + ((n) * PORTS_PER_NODE + (p)) * 2 + (in))
+#define LINK_ID(n,p)		(100 + N_LINKS * 2 + (n) * PORTS_PER_NODE + (p))
+
+static void restore(struct client *c, bool alias)
+{
+	jack_client_t *client = (jack_client_t *) c;
+	jack_port_t *src;
+	char src_name[REAL_JACK_PORT_NAME_SIZE+1];
+	char dst_name[REAL_JACK_PORT_NAME_SIZE+1];
+	uint32_t n, p;
+
+	for (n = 0; n < N_NODES; n++) {
+		for (p = 0; p < PORTS_PER_NODE; p++) {
+			if (alias) {
+				snprintf(src_name, sizeof(src_name), "capture.%u:out_%u", n, p);
+				snprintf(dst_name, sizeof(dst_name), "playback.%u:in_%u", n, p);
+			} else {
+				snprintf(src_name, sizeof(src_name), "capture-%u:output_%u", n, p);
+				snprintf(dst_name, sizeof(dst_name), "playback-%u:input_%u", n, p);
+			}
+			src = jack_port_by_name(client, src_name);
+			spa_assert(src != NULL);
+			spa_assert(jack_port_by_name(client, dst_name) != NULL);
+			spa_assert(jack_port_connected_to(src, dst_name) == 1);
+		}
+	}
+}
+
+static void get_ports(struct client *c, const char *name, const char *type,
+		unsigned long flags, uint32_t expected)
+{
+	const char **ports;
+	uint32_t i;
+
+	ports = jack_get_ports((jack_client_t *) c, name, type, flags);
+	spa_assert(ports != NULL);
+	for (i = 0; ports[i]; i++);
+	spa_assert(i == expected);
+	jack_free(ports);
+}
+
+int main(int argc, char *argv[])
+{
+	struct client *c;
+	char name[REAL_JACK_PORT_NAME_SIZE+1], path[REAL_JACK_PORT_NAME_SIZE+1];
+	uint64_t t1, t2;
+	uint32_t i, n, p;
+
+	pw_init(&argc, &argv);
+
+	c = calloc(1, sizeof(struct client));
+	spa_assert(c != NULL);
+
+	snprintf(c->name, sizeof(c->name), "benchmark");
+	c->node_id = SPA_ID_INVALID;
+	c->context.loop = pw_thread_loop_new("benchmark", NULL);
+	spa_assert(c->context.loop != NULL);
+	spa_list_init(&c->context.free_objects);
+	pthread_mutex_init(&c->context.lock, NULL);
+	pw_map_init(&c->context.globals, 64, 64);
+	spa_list_init(&c->context.nodes);
+	spa_list_init(&c->context.ports);
+	spa_list_init(&c->context.links);
+	for (i = 0; i < HASH_SIZE; i++) {
+		spa_list_init(&c->context.port_names[i]);
+		spa_list_init(&c->context.port_links[i]);
+	}
+	for (i = 0; i <= TYPE_ID_OTHER; i++) {
+		spa_list_init(&c->context.type_ports[i][SPA_DIRECTION_INPUT]);
+		spa_list_init(&c->context.type_ports[i][SPA_DIRECTION_OUTPUT]);
+	}
+
+	pw_thread_loop_lock(c->context.loop);
+
+	for (n = 0; n < N_NODES; n++) {
+		snprintf(name, sizeof(name), "capture-%u", n);
+		add_node(c, NODE_ID(n, 0), name);
+		snprintf(name, sizeof(name), "playback-%u", n);
+		add_node(c, NODE_ID(n, 1), name);
+	}
+
+	t1 = get_time_ns();
+	for (n = 0; n < N_NODES; n++) {
+		for (p = 0; p < PORTS_PER_NODE; p++) {
+			snprintf(name, sizeof(name), "output_%u", p);
+			snprintf(path, sizeof(path), "capture.%u:out_%u", n, p);
+			add_port(c, PORT_ID(n, p, 0), NODE_ID(n, 0), "out", name, path);
+			snprintf(name, sizeof(name), "input_%u", p);
+			snprintf(path, sizeof(path), "playback.%u:in_%u", n, p);
+			add_port(c, PORT_ID(n, p, 1), NODE_ID(n, 1), "in", name, path);
+		}
+	}
+	t2 = get_time_ns();
+	report("ports", N_LINKS * 2, t2 - t1);
+
+	t1 = get_time_ns();
+	for (n = 0; n < N_NODES; n++) {
+		for (p = 0; p < PORTS_PER_NODE; p++)
+			add_link(c, LINK_ID(n, p), PORT_ID(n, p, 0), PORT_ID(n, p, 1));
+	}
+	t2 = get_time_ns();
+	report("links", N_LINKS, t2 - t1);
+
+	t1 = get_time_ns();
+	restore(c, false);
+	t2 = get_time_ns();
+	report("restore", N_LINKS, t2 - t1);
+
+	t1 = get_time_ns();
+	restore(c, true);
+	t2 = get_time_ns();
+	report("alias", N_LINKS, t2 - t1);
+
+	t1 = get_time_ns();
+	for (i = 0; i < 100; i++) {
+		get_ports(c, NULL, JACK_DEFAULT_AUDIO_TYPE,
+				JackPortIsPhysical | JackPortIsOutput, N_LINKS);
+		get_ports(c, "^capture-1:", NULL, 0, PORTS_PER_NODE);
+		get_ports(c, "capture-1:output_[0-9]$", NULL, JackPortIsOutput, 10);
+	}
+	t2 = get_time_ns();
+	report("get", 300, t2 - t1);
+
+	pw_thread_loop_unlock(c->context.loop);
+	pw_thread_loop_destroy(c->context.loop);
+	for (i = 0; i < MAX_PATTERNS; i++)
+		clear_pattern(&c->context.patterns[i]);
+	pw_map_clear(&c->context.globals);
+	pthread_mutex_destroy(&c->context.lock);
+	free(c);
+
+	return 0;
+}
@@ -0,0 +1,154 @@
+/* PipeWire
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <time.h>
+
+#include "pipewire-jack.c"
+
+/* Measures the work of the process thread in a cycle of a client with
+ * N input and N output ports. Each input port has N_MIX connections and
+ * each output port is linked to N_MIX peers:
+ *
+ *  cycle:   take the graph, get the buffers of all ports and do the tee
+ *           for the outputs that were not written, like a process callback
+ *           that only writes half of its outputs
+ *
+ * The ports and mixes are made directly, no server is used.
+ */
+
+#define N_MIX		2
+#define N_FRAMES	256
+#define N_CYCLES	1000
+
+static const uint32_t port_counts[] = { 16, 128, 1024 };
+
+static float samples[N_FRAMES];
+
+static inline uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void add_port(struct client *c, enum spa_direction direction,
+		struct spa_io_buffers *io)
+{
+	struct port *p;
+	struct mix *mix;
+	uint32_t i;
+
+	p = alloc_port(c, direction);
+	spa_assert(p != NULL);
+
+	p->object->port.type_id = TYPE_ID_AUDIO;
+	p->object->port.flags = direction == SPA_DIRECTION_INPUT ?
+		JackPortIsInput : JackPortIsOutput;
+	p->get_buffer = direction == SPA_DIRECTION_INPUT ?
+		get_buffer_input_float : get_buffer_output_float;
+	init_buffer(p);
+
+	for (i = 0; i < N_MIX; i++) {
+		mix = ensure_mix(c, p, i);
+		spa_assert(mix != NULL);
+		mix->io = &io[i];
+		mix->n_buffers = 1;
+		mix->buffers[0].datas[0].data = samples;
+	}
+}
+
+static void cycle(struct client *c, struct spa_io_buffers *io, uint32_t n_io)
+{
+	struct port *p;
+	uint32_t i;
+
+	for (i = 0; i < n_io; i++) {
+		io[i].status = SPA_STATUS_HAVE_DATA;
+		io[i].buffer_id = 0;
+	}
+
+	cycle_graph(c);
+
+	spa_list_for_each(p, &c->ports[SPA_DIRECTION_INPUT], link)
+		spa_assert(p->get_buffer(p, N_FRAMES) != NULL);
+	i = 0;
+	spa_list_for_each(p, &c->ports[SPA_DIRECTION_OUTPUT], link) {
+		if (i++ & 1)
+			spa_assert(p->get_buffer(p, N_FRAMES) != NULL);
+		else
+			p->empty_out = true;
+	}
+	process_tee(c, N_FRAMES);
+}
+
+int main(int argc, char *argv[])
+{
+	struct client *c;
+	struct spa_io_buffers *io;
+	uint32_t i, j, n_ports = 0;
+	uint64_t t1, t2;
+
+	pw_init(&argc, &argv);
+
+	c = calloc(1, sizeof(struct client));
+	io = calloc(MAX_PORTS * 2 * N_MIX, sizeof(struct spa_io_buffers));
+	spa_assert(c != NULL && io != NULL);
+
+	spa_list_init(&c->context.free_objects);
+	pthread_mutex_init(&c->context.lock, NULL);
+	spa_list_init(&c->context.ports);
+	spa_list_init(&c->free_mix);
+	init_port_pool(c, SPA_DIRECTION_INPUT);
+	init_port_pool(c, SPA_DIRECTION_OUTPUT);
+
+	c->mix_ops.fmt = SPA_AUDIO_FORMAT_F32;
+	c->mix_ops.n_channels = 1;
+	spa_assert(mix_ops_init(&c->mix_ops) == 0);
+
+	for (i = 0; i < SPA_N_ELEMENTS(port_counts); i++) {
+		for (; n_ports < port_counts[i]; n_ports++) {
+			add_port(c, SPA_DIRECTION_INPUT, &io[n_ports * 2 * N_MIX]);
+			add_port(c, SPA_DIRECTION_OUTPUT, &io[(n_ports * 2 + 1) * N_MIX]);
+		}
+		cycle(c, io, n_ports * 2 * N_MIX);
+
+		t1 = get_time_ns();
+		for (j = 0; j < N_CYCLES; j++)
+			cycle(c, io, n_ports * 2 * N_MIX);
+		t2 = get_time_ns();
+
+		fprintf(stderr, "cycle    ports:%5u time:%8"PRIu64"us ns/cycle:%8"PRIu64" ns/port:%5"PRIu64"\n",
+				n_ports * 2, (uint64_t)((t2 - t1) / SPA_NSEC_PER_USEC), (t2 - t1) / N_CYCLES,
+				(t2 - t1) / N_CYCLES / (n_ports * 2));
+	}
+
+	free_graphs(c->rt.graph);
+	free_graphs(c->pending_graph);
+	free_graphs(c->retired_graphs);
+	pthread_mutex_destroy(&c->context.lock);
+	free(io);
+	free(c);
+
+	return 0;
+}
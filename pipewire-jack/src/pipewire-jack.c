@@ -53,13 +53,15 @@
 #include "extensions/metadata.h"
 #include "pipewire-jack-extensions.h"
 
+#include "mix-ops.h"
+
 #define JACK_DEFAULT_VIDEO_TYPE	"32 bit float RGBA video"
 
 #define JACK_CLIENT_NAME_SIZE		64
 #define JACK_PORT_NAME_SIZE		256
 #define JACK_PORT_MAX			4096
 #define JACK_PORT_TYPE_SIZE             32
-#define CONNECTION_NUM_FOR_PORT		1024
+#define CONNECTION_NUM_FOR_PORT		1024u
 
 #define MAX_BUFFER_FRAMES		8192
 
@@ -67,6 +69,8 @@
 #define MAX_PORTS			1024
 #define MAX_BUFFERS			2
 #define MAX_BUFFER_DATAS		1u
+#define MAX_MIX				1024
+#define MAX_FUTEX_SPIN_USEC		10000
 
 #define REAL_JACK_PORT_NAME_SIZE (JACK_CLIENT_NAME_SIZE + JACK_PORT_NAME_SIZE)
 
@@ -91,9 +95,15 @@ static bool mlock_warned = false;
 
 #define OBJECT_CHUNK	8
 
-typedef void (*mix2_func) (float *dst, float *src1, float *src2, int n_samples);
+#define HASH_SIZE	1024
+#define HASH_MASK	(HASH_SIZE-1)
 
-static mix2_func mix2;
+struct hash_entry {
+	struct spa_list link;
+	struct object *object;		/* NULL when not in a hash table */
+	const char *name;
+	uint32_t hash;
+};
 
 struct object {
 	struct spa_list link;
@@ -106,6 +116,12 @@ struct object {
 	uint32_t type;
 	uint32_t id;
 
+	/* ports are hashed on their name and aliases, links on their ports */
+	struct hash_entry hash[3];
+	/* ports are also in the context type_ports list of their type and
+	 * direction, next is NULL when not in a list */
+	struct spa_list type_link;
+
 	union {
 		struct {
 			char name[JACK_CLIENT_NAME_SIZE+1];
@@ -204,6 +220,23 @@ struct port {
 	void *(*get_buffer) (struct port *p, jack_nframes_t frames);
 };
 
+struct graph_port {
+	struct mix **mix;
+	uint32_t n_mix;
+};
+
+/* The ports and their mixes as seen by the process thread. A graph is not
+ * changed after it is published, a new one is made instead. The process
+ * thread takes the pending graph at the start of a cycle and puts the old
+ * one on the retired list, which is freed on the next update. */
+struct graph {
+	struct graph *next;		/* in the retired list */
+	struct graph_port *ports[2];	/* indexed with the port id */
+	uint32_t n_ports[2];
+	struct port **outputs;
+	uint32_t n_outputs;
+};
+
 struct link {
 	struct spa_list link;
 	struct spa_list target_link;
@@ -212,6 +245,24 @@ struct link {
 	struct pw_memmap *mem;
 	struct pw_node_activation *activation;
 	int signalfd;
+	unsigned int futex:1;		/* the activation has the futex fields */
+};
+
+#define MAX_PATTERNS	16
+
+struct pattern {
+	char *str;
+#define PATTERN_REGEX		0
+#define PATTERN_SUBSTRING	1	/* literal, matches anywhere like the regex */
+#define PATTERN_PREFIX		2	/* ^literal */
+#define PATTERN_SUFFIX		3	/* literal$ */
+#define PATTERN_EXACT		4	/* ^literal$ */
+	uint32_t kind;
+	const char *literal;		/* in str, not terminated for SUFFIX and EXACT */
+	size_t len;
+	regex_t regex;
+	char *filter;			/* literal part that a regex match must contain */
+	uint64_t stamp;
 };
 
 struct context {
@@ -226,6 +277,14 @@ struct context {
 	struct spa_list ports;
 	struct spa_list nodes;
 	struct spa_list links;
+	struct spa_list port_names[HASH_SIZE];
+	struct spa_list port_links[HASH_SIZE];
+	struct spa_list type_ports[TYPE_ID_OTHER+1][2];
+	uint32_t n_type_ports;
+
+	/* compiled jack_get_ports() patterns, least recently used is replaced */
+	struct pattern patterns[MAX_PATTERNS];
+	uint64_t pattern_stamp;
 };
 
 #define GET_DIRECTION(f)	((f) & JackPortIsInput ? SPA_DIRECTION_INPUT : SPA_DIRECTION_OUTPUT)
@@ -330,13 +389,22 @@ struct client {
 	struct pw_node_activation *activation;
 	uint32_t xrun_count;
 
+	struct graph *pending_graph;
+	struct graph *retired_graphs;
+
 	struct {
 		struct spa_io_position *position;
 		struct pw_node_activation *driver_activation;
 		struct spa_list target_links;
+		struct graph *graph;
+		uint32_t signal_seq;
+		bool sleeping;
 	} rt;
 
 	int pending;
+	uint64_t spin_nsec;
+
+	struct mix_ops mix_ops;
 
 	unsigned int started:1;
 	unsigned int active:1;
@@ -344,6 +412,7 @@ struct client {
 	unsigned int first:1;
 	unsigned int thread_entered:1;
 	unsigned int has_transport:1;
+	unsigned int has_futex:1;	/* the server knows the futex fields */
 	unsigned int allow_mlock:1;
 	unsigned int timeowner_pending:1;
 	unsigned int timeowner_conditional:1;
@@ -383,10 +452,28 @@ static struct object * alloc_object(struct client *c)
 	return o;
 }
 
+static void unhash_object(struct object *o)
+{
+	uint32_t i;
+
+	for (i = 0; i < SPA_N_ELEMENTS(o->hash); i++) {
+		if (o->hash[i].object == NULL)
+			continue;
+		spa_list_remove(&o->hash[i].link);
+		o->hash[i].object = NULL;
+	}
+}
+
 static void free_object(struct client *c, struct object *o)
 {
 	pthread_mutex_lock(&c->context.lock);
         spa_list_remove(&o->link);
+	unhash_object(o);
+	if (o->type_link.next != NULL) {
+		spa_list_remove(&o->type_link);
+		o->type_link.next = NULL;
+		c->context.n_type_ports--;
+	}
 	pthread_mutex_unlock(&c->context.lock);
 	spa_list_append(&c->context.free_objects, &o->link);
 }
@@ -402,40 +489,120 @@ static void init_mix(struct mix *mix, uint32_t mix_id, struct port *port)
 		port->global_mix = mix;
 }
 
-static struct mix *find_mix(struct client *c, struct port *port, uint32_t mix_id)
+static void free_graphs(struct graph *g)
 {
-	struct mix *mix;
+	struct graph *next;
 
-	spa_list_for_each(mix, &port->mix, port_link) {
-		if (mix->id == mix_id)
-			return mix;
+	for (; g != NULL; g = next) {
+		next = g->next;
+		free(g);
 	}
-	return NULL;
 }
 
-static struct mix *ensure_mix(struct client *c, struct port *port, uint32_t mix_id)
+/* publish a new graph after the ports or mixes changed,
+ * call from the main thread */
+static int update_graph(struct client *c)
 {
-	struct mix *mix;
-	uint32_t i;
+	struct graph *g;
+	struct graph_port *gp;
+	struct mix **mix, *m;
+	struct port *p;
+	uint32_t d, n_mix = 0, n_outputs = 0;
 
-	if ((mix = find_mix(c, port, mix_id)) != NULL)
-		return mix;
+	free_graphs(ATOMIC_XCHG(c->retired_graphs, NULL));
 
-	if (spa_list_is_empty(&c->free_mix)) {
-		mix = calloc(OBJECT_CHUNK, sizeof(struct mix));
-		if (mix == NULL)
-			return NULL;
-		for (i = 0; i < OBJECT_CHUNK; i++)
-			spa_list_append(&c->free_mix, &mix[i].link);
+	for (d = 0; d < 2; d++) {
+		spa_list_for_each(p, &c->ports[d], link) {
+			spa_list_for_each(m, &p->mix, port_link)
+				n_mix++;
+			if (d == SPA_DIRECTION_OUTPUT)
+				n_outputs++;
+		}
 	}
-	mix = spa_list_first(&c->free_mix, struct mix, link);
-	spa_list_remove(&mix->link);
+	g = calloc(1, sizeof(struct graph) +
+			(c->n_port_pool[0] + c->n_port_pool[1]) * sizeof(struct graph_port) +
+			n_mix * sizeof(struct mix *) +
+			n_outputs * sizeof(struct port *));
+	if (g == NULL) {
+		pw_log_error(NAME" %p: can't allocate graph: %m", c);
+		return -errno;
+	}
+	g->ports[0] = SPA_MEMBER(g, sizeof(struct graph), struct graph_port);
+	g->ports[1] = g->ports[0] + c->n_port_pool[0];
+	mix = (struct mix **) (g->ports[1] + c->n_port_pool[1]);
+	g->outputs = (struct port **) (mix + n_mix);
+
+	for (d = 0; d < 2; d++) {
+		g->n_ports[d] = c->n_port_pool[d];
+		spa_list_for_each(p, &c->ports[d], link) {
+			gp = &g->ports[d][p->id];
+			gp->mix = mix;
+			spa_list_for_each(m, &p->mix, port_link)
+				gp->mix[gp->n_mix++] = m;
+			mix += gp->n_mix;
+
+			if (d == SPA_DIRECTION_OUTPUT)
+				g->outputs[g->n_outputs++] = p;
+		}
+	}
+	/* a pending graph was not seen by the process thread */
+	free_graphs(ATOMIC_XCHG(c->pending_graph, g));
+	return 0;
+}
 
-	spa_list_append(&port->mix, &mix->port_link);
+/* take the latest graph, call from the process thread or from the
+ * main thread when the data loop is not running */
+static inline void cycle_graph(struct client *c)
+{
+	struct graph *old = c->rt.graph;
 
-	init_mix(mix, mix_id, port);
+	if (SPA_LIKELY(ATOMIC_LOAD(c->pending_graph) == NULL))
+		return;
 
-	return mix;
+	c->rt.graph = ATOMIC_XCHG(c->pending_graph, NULL);
+	if (old != NULL) {
+		do {
+			old->next = ATOMIC_LOAD(c->retired_graphs);
+		} while (!ATOMIC_CAS(c->retired_graphs, old->next, old));
+	}
+}
+
+static int
+do_sync_graph(struct spa_loop *loop,
+		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct client *c = user_data;
+	cycle_graph(c);
+	return 0;
+}
+
+/* make the process thread take the latest graph so that the ports and
+ * mixes that are only in older graphs can go back to the pools. This
+ * runs the function directly when the data loop is not running. */
+static void sync_graph(struct client *c)
+{
+	pw_data_loop_invoke(c->loop,
+			do_sync_graph, 1, NULL, 0, true, c);
+}
+
+static inline struct graph_port *get_graph_port(struct port *p)
+{
+	struct graph *g = p->client->rt.graph;
+
+	if (SPA_UNLIKELY(g == NULL || p->id >= g->n_ports[p->direction]))
+		return NULL;
+	return &g->ports[p->direction][p->id];
+}
+
+static struct mix *find_mix(struct client *c, struct port *port, uint32_t mix_id)
+{
+	struct mix *mix;
+
+	spa_list_for_each(mix, &port->mix, port_link) {
+		if (mix->id == mix_id)
+			return mix;
+	}
+	return NULL;
 }
 
 static int clear_buffers(struct client *c, struct mix *mix)
@@ -468,6 +635,36 @@ static void free_mix(struct client *c, struct mix *mix)
 	spa_list_append(&c->free_mix, &mix->link);
 }
 
+static struct mix *ensure_mix(struct client *c, struct port *port, uint32_t mix_id)
+{
+	struct mix *mix;
+	uint32_t i;
+
+	if ((mix = find_mix(c, port, mix_id)) != NULL)
+		return mix;
+
+	if (spa_list_is_empty(&c->free_mix)) {
+		mix = calloc(OBJECT_CHUNK, sizeof(struct mix));
+		if (mix == NULL)
+			return NULL;
+		for (i = 0; i < OBJECT_CHUNK; i++)
+			spa_list_append(&c->free_mix, &mix[i].link);
+	}
+	mix = spa_list_first(&c->free_mix, struct mix, link);
+	spa_list_remove(&mix->link);
+
+	spa_list_append(&port->mix, &mix->port_link);
+
+	init_mix(mix, mix_id, port);
+
+	/* the mix is not in a published graph when this fails */
+	if (update_graph(c) < 0) {
+		free_mix(c, mix);
+		return NULL;
+	}
+	return mix;
+}
+
 static struct port * alloc_port(struct client *c, enum spa_direction direction)
 {
 	struct port *p;
@@ -514,22 +711,41 @@ static struct port * alloc_port(struct client *c, enum spa_direction direction)
 	return p;
 }
 
-static void free_port(struct client *c, struct port *p)
+/* put a port that is not in the ports list back in the pool, the port
+ * must not be in the graph of the process thread anymore */
+static void release_port(struct client *c, struct port *p)
 {
 	struct mix *m;
 
-	if (!p->valid)
-		return;
-
 	spa_list_consume(m, &p->mix, port_link)
 		free_mix(c, m);
 
-	spa_list_remove(&p->link);
 	p->valid = false;
 	free_object(c, p->object);
 	spa_list_append(&c->free_ports[p->direction], &p->link);
 }
 
+static int free_port(struct client *c, struct port *p)
+{
+	int res;
+
+	if (!p->valid)
+		return 0;
+
+	/* the port and its mixes stay valid when the graph without
+	 * them can't be made, the process thread still uses them */
+	spa_list_remove(&p->link);
+	if ((res = update_graph(c)) < 0) {
+		spa_list_append(&c->ports[p->direction], &p->link);
+		return res;
+	}
+	/* the buffers of the mixes are unmapped and the port can be
+	 * reused right away, wait until the old graph is dropped */
+	sync_graph(c);
+	release_port(c, p);
+	return 0;
+}
+
 static struct object *find_node(struct client *c, const char *name)
 {
 	struct object *o;
@@ -541,80 +757,212 @@ static struct object *find_node(struct client *c, const char *name)
 	return NULL;
 }
 
+static inline uint32_t hash_name(const char *name)
+{
+	uint32_t h = 2166136261u;
+
+	while (*name)
+		h = (h ^ (uint8_t)*name++) * 16777619u;
+	return h;
+}
+
+static inline uint32_t hash_link(uint32_t src, uint32_t dst)
+{
+	uint32_t h = (src * 0x9e3779b1u) ^ dst;
+
+	h *= 0x85ebca6bu;
+	return h ^ (h >> 16);
+}
+
+/* (re)add the port to the name hash after its name or aliases changed,
+ * call with the context lock */
+static void hash_port(struct client *c, struct object *o)
+{
+	const char *names[] = { o->port.name, o->port.alias1, o->port.alias2 };
+	struct hash_entry *e;
+	uint32_t i;
+
+	unhash_object(o);
+
+	for (i = 0; i < SPA_N_ELEMENTS(names); i++) {
+		if (names[i][0] == '\0')
+			continue;
+		e = &o->hash[i];
+		e->object = o;
+		e->name = names[i];
+		e->hash = hash_name(names[i]);
+		spa_list_append(&c->context.port_names[e->hash & HASH_MASK], &e->link);
+	}
+}
+
+/* call with the context lock */
+static void hash_port_link(struct client *c, struct object *l)
+{
+	struct hash_entry *e = &l->hash[0];
+
+	unhash_object(l);
+
+	e->object = l;
+	e->name = NULL;
+	e->hash = hash_link(l->port_link.src, l->port_link.dst);
+	spa_list_append(&c->context.port_links[e->hash & HASH_MASK], &e->link);
+}
+
+/* (re)add the port to the list of its type and direction,
+ * call with the context lock */
+static void type_port(struct client *c, struct object *o)
+{
+	if (o->type_link.next != NULL)
+		spa_list_remove(&o->type_link);
+	else
+		c->context.n_type_ports++;
+
+	spa_list_append(&c->context.type_ports[o->port.type_id][GET_DIRECTION(o->port.flags)],
+			&o->type_link);
+}
+
 static struct object *find_port(struct client *c, const char *name)
 {
-	struct object *o;
+	struct hash_entry *e;
+	uint32_t h = hash_name(name);
 
-	spa_list_for_each(o, &c->context.ports, link) {
-		if (strcmp(o->port.name, name) == 0 ||
-		    strcmp(o->port.alias1, name) == 0 ||
-		    strcmp(o->port.alias2, name) == 0)
-			return o;
+	spa_list_for_each(e, &c->context.port_names[h & HASH_MASK], link) {
+		if (e->hash == h && strcmp(e->name, name) == 0)
+			return e->object;
 	}
 	return NULL;
 }
 
 static struct object *find_link(struct client *c, uint32_t src, uint32_t dst)
 {
-	struct object *l;
+	struct hash_entry *e;
+	uint32_t h = hash_link(src, dst);
 
-	spa_list_for_each(l, &c->context.links, link) {
-		if (l->port_link.src == src &&
-		    l->port_link.dst == dst) {
-			return l;
-		}
+	spa_list_for_each(e, &c->context.port_links[h & HASH_MASK], link) {
+		if (e->object->port_link.src == src &&
+		    e->object->port_link.dst == dst)
+			return e->object;
 	}
 	return NULL;
 }
 
-static struct buffer *dequeue_buffer(struct mix *mix)
+static void clear_pattern(struct pattern *p)
 {
-	struct buffer *b;
+	if (p->str == NULL)
+		return;
+	if (p->kind == PATTERN_REGEX)
+		regfree(&p->regex);
+	free(p->filter);
+	p->filter = NULL;
+	free(p->str);
+	p->str = NULL;
+}
 
-	if (SPA_UNLIKELY(spa_list_is_empty(&mix->queue)))
-		return NULL;
+static int init_pattern(struct pattern *p, const char *str)
+{
+	const char *lit = str;
+	size_t len = strlen(str);
+	uint32_t kind = PATTERN_SUBSTRING;
 
-	b = spa_list_first(&mix->queue, struct buffer, link);
-	spa_list_remove(&b->link);
-	SPA_FLAG_SET(b->flags, BUFFER_FLAG_OUT);
+	if ((p->str = strdup(str)) == NULL)
+		return -errno;
 
-	return b;
+	/* patterns without special chars are matched without regex */
+	if (lit[0] == '^') {
+		lit++;
+		len--;
+		kind = PATTERN_PREFIX;
+	}
+	if (len > 0 && lit[len-1] == '$') {
+		len--;
+		kind = kind == PATTERN_PREFIX ? PATTERN_EXACT : PATTERN_SUFFIX;
+	}
+	if (strcspn(lit, "\\^$.[]|()?*+{}") < len)
+		kind = PATTERN_REGEX;
+
+	p->kind = kind;
+	p->literal = p->str + (lit - str);
+	p->len = len;
+
+	if (kind != PATTERN_REGEX)
+		return 0;
+
+	if (regcomp(&p->regex, str, REG_EXTENDED | REG_NOSUB) != 0) {
+		free(p->str);
+		p->str = NULL;
+		return -EINVAL;
+	}
+	/* without alternatives, the literal chars before the first special
+	 * char must be in the string. A quantifier applies to the last one. */
+	if (strchr(lit, '|') == NULL) {
+		len = strcspn(lit, "\\^$.[]|()?*+{}");
+		if (len > 0 && strchr("?*{", lit[len]) != NULL)
+			len--;
+		if (len > 0)
+			p->filter = strndup(lit, len);
+	}
+	return 0;
 }
 
-#if defined (__SSE__)
-#include <xmmintrin.h>
-static void mix2_sse(float *dst, float *src1, float *src2, int n_samples)
+/* call with the context lock */
+static struct pattern *get_pattern(struct client *c, const char *str)
 {
-	int n, unrolled;
-	__m128 in[2];
-
-	if (SPA_IS_ALIGNED(src1, 16) &&
-	    SPA_IS_ALIGNED(src2, 16) &&
-	    SPA_IS_ALIGNED(dst, 16))
-		unrolled = n_samples / 4;
-	else
-		unrolled = 0;
+	struct pattern *p, *best = NULL;
+	uint32_t i;
+	int res;
 
-	for (n = 0; unrolled--; n += 4) {
-		in[0] = _mm_load_ps(&src1[n]),
-		in[1] = _mm_load_ps(&src2[n]),
-		in[0] = _mm_add_ps(in[0], in[1]);
-		_mm_store_ps(&dst[n], in[0]);
+	for (i = 0; i < MAX_PATTERNS; i++) {
+		p = &c->context.patterns[i];
+		if (p->str != NULL && strcmp(p->str, str) == 0) {
+			best = p;
+			goto done;
+		}
+		if (best == NULL || p->stamp < best->stamp)
+			best = p;
 	}
-	for (; n < n_samples; n++) {
-		in[0] = _mm_load_ss(&src1[n]),
-		in[1] = _mm_load_ss(&src2[n]),
-		in[0] = _mm_add_ss(in[0], in[1]);
-		_mm_store_ss(&dst[n], in[0]);
+	clear_pattern(best);
+	if ((res = init_pattern(best, str)) < 0) {
+		pw_log_warn(NAME" %p: invalid pattern '%s': %s", c, str, spa_strerror(res));
+		return NULL;
 	}
+done:
+	best->stamp = ++c->context.pattern_stamp;
+	return best;
 }
-#endif
 
-static void mix2_c(float *dst, float *src1, float *src2, int n_samples)
+static bool match_pattern(const struct pattern *p, const char *str)
 {
-	int i;
-	for (i = 0; i < n_samples; i++)
-		dst[i] = src1[i] + src2[i];
+	size_t len;
+
+	switch (p->kind) {
+	case PATTERN_SUBSTRING:
+		return strstr(str, p->literal) != NULL;
+	case PATTERN_PREFIX:
+		return strncmp(str, p->literal, p->len) == 0;
+	case PATTERN_SUFFIX:
+		len = strlen(str);
+		return len >= p->len && memcmp(str + len - p->len, p->literal, p->len) == 0;
+	case PATTERN_EXACT:
+		return strncmp(str, p->literal, p->len) == 0 && str[p->len] == '\0';
+	default:
+		if (p->filter && strstr(str, p->filter) == NULL)
+			return false;
+		return regexec(&p->regex, str, 0, NULL, 0) != REG_NOMATCH;
+	}
+}
+
+static struct buffer *dequeue_buffer(struct mix *mix)
+{
+	struct buffer *b;
+
+	if (SPA_UNLIKELY(spa_list_is_empty(&mix->queue)))
+		return NULL;
+
+	b = spa_list_first(&mix->queue, struct buffer, link);
+	spa_list_remove(&b->link);
+	SPA_FLAG_SET(b->flags, BUFFER_FLAG_OUT);
+
+	return b;
 }
 
 SPA_EXPORT
@@ -821,7 +1169,9 @@ static inline void *get_buffer_output(struct port *p, uint32_t frames, uint32_t
 {
 	struct mix *mix;
 	struct client *c = p->client;
+	struct graph_port *gp;
 	void *ptr = NULL;
+	uint32_t i;
 
 	p->io.status = -EPIPE;
 	p->io.buffer_id = SPA_ID_INVALID;
@@ -853,24 +1203,33 @@ static inline void *get_buffer_output(struct port *p, uint32_t frames, uint32_t
 		p->io.buffer_id = b->id;
 	}
 done:
-	spa_list_for_each(mix, &p->mix, port_link) {
-		struct spa_io_buffers *mio = mix->io;
-		if (SPA_UNLIKELY(mio == NULL))
-			continue;
-		pw_log_trace_fp(NAME" %p: port %p tee %d.%d get buffer %d io:%p",
-				c, p, p->id, mix->id, frames, mio);
-		*mio = p->io;
+	if (SPA_LIKELY((gp = get_graph_port(p)) != NULL)) {
+		for (i = 0; i < gp->n_mix; i++) {
+			struct spa_io_buffers *mio = gp->mix[i]->io;
+			if (SPA_UNLIKELY(mio == NULL))
+				continue;
+			pw_log_trace_fp(NAME" %p: port %p tee %d.%d get buffer %d io:%p",
+					c, p, p->id, gp->mix[i]->id, frames, mio);
+			*mio = p->io;
+		}
 	}
 	return ptr;
 }
 
 static void process_tee(struct client *c, uint32_t frames)
 {
+	struct graph *g = c->rt.graph;
 	struct port *p;
+	uint32_t i;
+
+	if (SPA_UNLIKELY(g == NULL))
+		return;
 
-	spa_list_for_each(p, &c->ports[SPA_DIRECTION_OUTPUT], link) {
+	for (i = 0; i < g->n_outputs; i++) {
 		void *ptr;
 
+		p = g->outputs[i];
+
 		if (SPA_LIKELY(!p->empty_out))
 			continue;
 
@@ -1071,28 +1430,16 @@ static inline void check_sample_rate(struct client *c, struct spa_io_position *p
 	}
 }
 
-static inline uint32_t cycle_run(struct client *c)
+static inline uint32_t cycle_awake(struct client *c)
 {
-	uint64_t cmd;
 	struct timespec ts;
-	int fd = c->socket_source->fd;
 	struct spa_io_position *pos = c->rt.position;
 	struct pw_node_activation *activation = c->activation;
 	struct pw_node_activation *driver = c->rt.driver_activation;
 
-	/* this is blocking if nothing ready */
-	while (true) {
-		if (SPA_UNLIKELY(read(fd, &cmd, sizeof(cmd)) != sizeof(cmd))) {
-			if (errno == EINTR)
-				continue;
-			if (errno == EWOULDBLOCK || errno == EAGAIN)
-				return 0;
-			pw_log_warn(NAME" %p: read failed %m", c);
-		}
-		break;
-	}
-	if (SPA_UNLIKELY(cmd > 1))
-		pw_log_warn(NAME" %p: missed %"PRIu64" wakeups", c, cmd - 1);
+	c->rt.signal_seq = ATOMIC_LOAD(activation->signal_seq);
+
+	cycle_graph(c);
 
 	clock_gettime(CLOCK_MONOTONIC, &ts);
 	activation->status = PW_NODE_ACTIVATION_AWAKE;
@@ -1132,10 +1479,77 @@ static inline uint32_t cycle_run(struct client *c)
 	return c->buffer_frames;
 }
 
+static inline uint32_t cycle_run(struct client *c)
+{
+	uint64_t cmd;
+	int fd = c->socket_source->fd;
+
+	/* this is blocking if nothing ready */
+	while (true) {
+		if (SPA_UNLIKELY(read(fd, &cmd, sizeof(cmd)) != sizeof(cmd))) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EWOULDBLOCK || errno == EAGAIN)
+				return 0;
+			pw_log_warn(NAME" %p: read failed %m", c);
+		}
+		break;
+	}
+	if (SPA_UNLIKELY(cmd > 1))
+		pw_log_warn(NAME" %p: missed %"PRIu64" wakeups", c, cmd - 1);
+
+	c->rt.sleeping = false;
+
+	return cycle_awake(c);
+}
+
+/* spin on the futex word for a signal, this does not need any syscalls */
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield" ::: "memory");
+#endif
+}
+
+static inline uint64_t get_monotonic_nsec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static inline bool cycle_spin(struct client *c)
+{
+	struct pw_node_activation *activation = c->activation;
+	uint64_t end;
+
+	end = get_monotonic_nsec() + c->spin_nsec;
+	do {
+		if (ATOMIC_LOAD(activation->signal_seq) != c->rt.signal_seq)
+			return true;
+		cpu_relax();
+	} while (get_monotonic_nsec() < end);
+
+	return false;
+}
+
 static inline uint32_t cycle_wait(struct client *c)
 {
 	int res;
 
+	if (c->activation->wait_mode == PW_NODE_ACTIVATION_WAIT_FUTEX &&
+	    !c->rt.sleeping) {
+		if (cycle_spin(c))
+			return cycle_awake(c);
+		/* when a signal arrived while going to sleep, there
+		 * will be no eventfd write */
+		if (!pw_node_activation_sleep(c->activation, c->rt.signal_seq))
+			return cycle_awake(c);
+		c->rt.sleeping = true;
+	}
+
 	res = pw_data_loop_wait(c->loop, -1);
 	if (SPA_UNLIKELY(res <= 0)) {
 		pw_log_warn(NAME" %p: wait error %m", c);
@@ -1176,7 +1590,8 @@ static inline void signal_sync(struct client *c)
 
 			pw_log_trace_fp(NAME" %p: signal %p %p", c, l, state);
 
-			if (SPA_UNLIKELY(write(l->signalfd, &cmd, sizeof(cmd)) != sizeof(cmd)))
+			if ((!l->futex || pw_node_activation_signal(l->activation)) &&
+			    SPA_UNLIKELY(write(l->signalfd, &cmd, sizeof(cmd)) != sizeof(cmd)))
 				pw_log_warn(NAME" %p: write failed %m", c);
 		}
 	}
@@ -1296,6 +1711,7 @@ static int client_node_transport(void *object,
 					  true, on_rtsocket_condition, c);
 
 	c->has_transport = true;
+	c->has_futex = size >= PW_NODE_ACTIVATION_FUTEX_SIZE;
 	c->position = &c->activation->position;
 	pw_thread_loop_signal(c->context.loop, false);
 
@@ -1948,6 +2364,7 @@ static int client_node_set_activation(void *object,
 		link->mem = mm;
 		link->activation = ptr;
 		link->signalfd = signalfd;
+		link->futex = size >= PW_NODE_ACTIVATION_FUTEX_SIZE;
 		spa_list_append(&c->links, &link->link);
 
 		pw_data_loop_invoke(c->loop,
@@ -2208,6 +2625,11 @@ static void registry_event_global(void *data, uint32_t id,
 			snprintf(o->port.name, sizeof(o->port.name), "%.*s-%d",
 					(int)(sizeof(op->port.name)-11), op->port.name, id);
 
+		pthread_mutex_lock(&c->context.lock);
+		hash_port(c, o);
+		type_port(c, o);
+		pthread_mutex_unlock(&c->context.lock);
+
 		pw_log_debug(NAME" %p: add port %d name:%s %d", c, id,
 				o->port.name, type_id);
 	}
@@ -2227,6 +2649,10 @@ static void registry_event_global(void *data, uint32_t id,
 			goto exit_free;
 		o->port_link.dst = pw_properties_parse_int(str);
 
+		pthread_mutex_lock(&c->context.lock);
+		hash_port_link(c, o);
+		pthread_mutex_unlock(&c->context.lock);
+
 		pw_log_debug(NAME" %p: add link %d %d->%d", c, id,
 				o->port_link.src, o->port_link.dst);
 	}
@@ -2370,7 +2796,7 @@ jack_client_t * jack_client_open (const char *client_name,
 	struct spa_dict props;
 	struct spa_dict_item items[1];
 	const struct spa_support *support;
-	uint32_t n_support;
+	uint32_t n_support, i;
 	const char *str;
 	struct spa_cpu *cpu_iface;
 	struct spa_node_info ni;
@@ -2409,18 +2835,23 @@ jack_client_t * jack_client_open (const char *client_name,
 	spa_list_init(&client->context.nodes);
 	spa_list_init(&client->context.ports);
 	spa_list_init(&client->context.links);
+	for (i = 0; i < HASH_SIZE; i++) {
+		spa_list_init(&client->context.port_names[i]);
+		spa_list_init(&client->context.port_links[i]);
+	}
+	for (i = 0; i <= TYPE_ID_OTHER; i++) {
+		spa_list_init(&client->context.type_ports[i][SPA_DIRECTION_INPUT]);
+		spa_list_init(&client->context.type_ports[i][SPA_DIRECTION_OUTPUT]);
+	}
 
 	support = pw_context_get_support(client->context.context, &n_support);
 
-	mix2 = mix2_c;
 	cpu_iface = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_CPU);
-	if (cpu_iface) {
-#if defined (__SSE__)
-		uint32_t flags = spa_cpu_get_flags(cpu_iface);
-		if (flags & SPA_CPU_FLAG_SSE)
-			mix2 = mix2_sse;
-#endif
-	}
+	client->mix_ops.fmt = SPA_AUDIO_FORMAT_F32;
+	client->mix_ops.n_channels = 1;
+	client->mix_ops.cpu_flags = cpu_iface ? spa_cpu_get_flags(cpu_iface) : 0;
+	if (mix_ops_init(&client->mix_ops) < 0)
+		goto init_failed;
 
 	props = SPA_DICT_INIT(items, 0);
 	items[props.n_items++] = SPA_DICT_ITEM_INIT("loop.cancel", "true");
@@ -2488,6 +2919,12 @@ jack_client_t * jack_client_open (const char *client_name,
 		pw_properties_set(client->props, PW_KEY_NODE_LATENCY, str);
 	if (pw_properties_get(client->props, PW_KEY_NODE_ALWAYS_PROCESS) == NULL)
 		pw_properties_set(client->props, PW_KEY_NODE_ALWAYS_PROCESS, "true");
+	if ((str = pw_properties_get(client->props, "jack.futex-spin")) != NULL) {
+		/* usec, negative values disable the spin */
+		int64_t spin = pw_properties_parse_int64(str);
+		client->spin_nsec = (uint64_t) SPA_CLAMP(spin, 0, MAX_FUTEX_SPIN_USEC) *
+			SPA_NSEC_PER_USEC;
+	}
 
 	client->node = pw_core_create_object(client->core,
 				"client-node",
@@ -2570,6 +3007,7 @@ SPA_EXPORT
 int jack_client_close (jack_client_t *client)
 {
 	struct client *c = (struct client *) client;
+	uint32_t i;
 	int res;
 
 	spa_return_val_if_fail(c != NULL, -EINVAL);
@@ -2593,6 +3031,11 @@ int jack_client_close (jack_client_t *client)
 	pw_thread_loop_destroy(c->context.loop);
 
 	pw_log_debug(NAME" %p: free", client);
+	for (i = 0; i < MAX_PATTERNS; i++)
+		clear_pattern(&c->context.patterns[i]);
+	free_graphs(c->rt.graph);
+	free_graphs(c->pending_graph);
+	free_graphs(c->retired_graphs);
 	pthread_mutex_destroy(&c->context.lock);
 	pw_data_loop_destroy(c->loop);
 	pw_properties_free(c->props);
@@ -2690,6 +3133,15 @@ static int do_activate(struct client *c)
 
 	pw_thread_loop_lock(c->context.loop);
 
+	/* with a process thread we wait in jack_cycle_wait() and can spin
+	 * on the futex word before sleeping on the eventfd */
+	if (c->thread_callback && c->spin_nsec > 0 && c->has_futex) {
+		c->rt.signal_seq = c->activation->signal_seq;
+		c->rt.sleeping = true;
+		c->activation->sleeping = 1;
+		c->activation->wait_mode = PW_NODE_ACTIVATION_WAIT_FUTEX;
+	}
+
 	if ((res = pw_data_loop_start(c->loop)) < 0)
 		goto done;
 
@@ -2743,6 +3195,9 @@ int jack_deactivate (jack_client_t *client)
 
 	pw_client_node_set_active(c->node, false);
 
+	c->activation->wait_mode = PW_NODE_ACTIVATION_WAIT_EVENTFD;
+	c->activation->sleeping = 0;
+
 	c->activation->pending_new_pos = false;
 	c->activation->pending_sync = false;
 
@@ -3231,6 +3686,11 @@ jack_port_t * jack_port_register (jack_client_t *client,
 	snprintf(o->port.name, sizeof(o->port.name), "%s:%s", c->name, port_name);
 	o->port.type_id = type_id;
 
+	pthread_mutex_lock(&c->context.lock);
+	hash_port(c, o);
+	type_port(c, o);
+	pthread_mutex_unlock(&c->context.lock);
+
 	init_buffer(p);
 
 	if (direction == SPA_DIRECTION_INPUT) {
@@ -3287,6 +3747,13 @@ jack_port_t * jack_port_register (jack_client_t *client,
 
 	pw_thread_loop_lock(c->context.loop);
 
+	if ((res = update_graph(c)) < 0) {
+		spa_list_remove(&p->link);
+		release_port(c, p);
+		pw_thread_loop_unlock(c->context.loop);
+		return NULL;
+	}
+
 	pw_client_node_port_update(c->node,
 					 direction,
 					 p->id,
@@ -3328,7 +3795,12 @@ int jack_port_unregister (jack_client_t *client, jack_port_t *port)
 
 	p = GET_PORT(c, GET_DIRECTION(o->port.flags), o->port.port_id);
 
-	free_port(c, p);
+	if ((res = free_port(c, p)) < 0) {
+		pw_log_error(NAME" %p: can't unregister port %p: %s", client, port,
+				spa_strerror(res));
+		pw_thread_loop_unlock(c->context.loop);
+		return res;
+	}
 
 	pw_client_node_port_update(c->node,
 					 p->direction,
@@ -3344,13 +3816,20 @@ int jack_port_unregister (jack_client_t *client, jack_port_t *port)
 
 static void *get_buffer_input_float(struct port *p, jack_nframes_t frames)
 {
+	struct client *c = p->client;
+	struct graph_port *gp;
 	struct mix *mix;
 	struct buffer *b;
 	struct spa_io_buffers *io;
-	int layer = 0;
-	void *ptr = NULL;
+	const void *src[MAX_MIX];
+	uint32_t i, n_src = 0;
+
+	if (SPA_UNLIKELY((gp = get_graph_port(p)) == NULL))
+		return init_buffer(p);
 
-	spa_list_for_each(mix, &p->mix, port_link) {
+	/* collect the buffers of all connections and mix them in one pass */
+	for (i = 0; i < gp->n_mix; i++) {
+		mix = gp->mix[i];
 		pw_log_trace_fp(NAME" %p: port %p mix %d.%d get buffer %d",
 				p->client, p, p->id, mix->id, frames);
 		io = mix->io;
@@ -3361,33 +3840,43 @@ static void *get_buffer_input_float(struct port *p, jack_nframes_t frames)
 
 		io->status = SPA_STATUS_NEED_DATA;
 		b = &mix->buffers[io->buffer_id];
-		if (layer++ == 0)
-			ptr = b->datas[0].data;
-		else  {
-			mix2(p->emptyptr, ptr, b->datas[0].data, frames);
-			ptr = p->emptyptr;
-			p->zeroed = false;
+
+		if (SPA_UNLIKELY(n_src == MAX_MIX)) {
+			mix_ops_process(&c->mix_ops, p->emptyptr, src, n_src, frames);
+			src[0] = p->emptyptr;
+			n_src = 1;
 		}
+		src[n_src++] = b->datas[0].data;
 	}
-	if (ptr == NULL)
-		ptr = init_buffer(p);
-	return ptr;
+	if (n_src == 0)
+		return init_buffer(p);
+	if (n_src == 1 && src[0] != p->emptyptr)
+		return (void *) src[0];
+
+	mix_ops_process(&c->mix_ops, p->emptyptr, src, n_src, frames);
+	p->zeroed = false;
+	return p->emptyptr;
 }
 
 static void *get_buffer_input_midi(struct port *p, jack_nframes_t frames)
 {
+	struct graph_port *gp;
 	struct mix *mix;
 	struct spa_io_buffers *io;
 	void *ptr = p->emptyptr;
 	struct spa_pod_sequence *seq[CONNECTION_NUM_FOR_PORT];
-	uint32_t n_seq = 0;
+	uint32_t i, n_mix, n_seq = 0;
 
 	jack_midi_clear_buffer(ptr);
 
-	spa_list_for_each(mix, &p->mix, port_link) {
+	gp = get_graph_port(p);
+	n_mix = gp ? SPA_MIN(gp->n_mix, CONNECTION_NUM_FOR_PORT) : 0;
+
+	for (i = 0; i < n_mix; i++) {
 		struct spa_data *d;
 		void *pod;
 
+		mix = gp->mix[i];
 		pw_log_trace_fp(NAME" %p: port %p mix %d.%d get buffer %d",
 				p->client, p, p->id, mix->id, frames);
 
@@ -3710,6 +4199,10 @@ int jack_port_set_alias (jack_port_t *port, const char *alias)
 	else
 		goto error;
 
+	pthread_mutex_lock(&c->context.lock);
+	hash_port(c, o);
+	pthread_mutex_unlock(&c->context.lock);
+
 	p = GET_PORT(c, GET_DIRECTION(o->port.flags), o->port.port_id);
 
 	port_info = SPA_PORT_INFO_INIT();
@@ -4206,12 +4699,11 @@ const char ** jack_get_ports (jack_client_t *client,
                               unsigned long flags)
 {
 	struct client *c = (struct client *) client;
-	const char **res;
-	struct object *o;
-	struct object *tmp[JACK_PORT_MAX];
+	const char **res = NULL;
+	struct object *o, **ports;
+	struct pattern *port_pattern = NULL, *type_pattern;
 	const char *str;
-	uint32_t i, count, id;
-	regex_t port_regex, type_regex;
+	uint32_t i, d, count, id;
 
 	spa_return_val_if_fail(c != NULL, NULL);
 
@@ -4220,60 +4712,66 @@ const char ** jack_get_ports (jack_client_t *client,
 	else
 		id = SPA_ID_INVALID;
 
-	if (port_name_pattern && port_name_pattern[0])
-		regcomp(&port_regex, port_name_pattern, REG_EXTENDED | REG_NOSUB);
-	if (type_name_pattern && type_name_pattern[0])
-		regcomp(&type_regex, type_name_pattern, REG_EXTENDED | REG_NOSUB);
-
-
 	pw_log_debug(NAME" %p: ports id:%d name:%s type:%s flags:%08lx", c, id,
 			port_name_pattern, type_name_pattern, flags);
 
 	pthread_mutex_lock(&c->context.lock);
+
+	if (port_name_pattern && port_name_pattern[0]) {
+		if ((port_pattern = get_pattern(c, port_name_pattern)) == NULL)
+			goto exit;
+	}
+	if (type_name_pattern && type_name_pattern[0]) {
+		if ((type_pattern = get_pattern(c, type_name_pattern)) == NULL)
+			goto exit;
+	} else {
+		type_pattern = NULL;
+	}
+
+	/* the ports are sorted in place and then replaced with their names */
+	ports = malloc(sizeof(char*) * (c->context.n_type_ports + 1));
+	if (ports == NULL)
+		goto exit;
+
 	count = 0;
-	spa_list_for_each(o, &c->context.ports, link) {
-		pw_log_debug(NAME" %p: check port type:%d flags:%08lx name:%s", c,
-				o->port.type_id, o->port.flags, o->port.name);
-		if (count == JACK_PORT_MAX)
-			break;
-		if (o->port.type_id > TYPE_ID_VIDEO)
-			continue;
-		if (!SPA_FLAG_IS_SET(o->port.flags, flags))
-			continue;
-		if (id != SPA_ID_INVALID && o->port.node_id != id)
+	for (i = 0; i <= TYPE_ID_VIDEO; i++) {
+		if (type_pattern && !match_pattern(type_pattern, type_to_string(i)))
 			continue;
 
-		if (port_name_pattern && port_name_pattern[0]) {
-			if (regexec(&port_regex, o->port.name, 0, NULL, 0) == REG_NOMATCH)
+		for (d = 0; d < 2; d++) {
+			if ((flags & JackPortIsInput) && d != SPA_DIRECTION_INPUT)
 				continue;
-		}
-		if (type_name_pattern && type_name_pattern[0]) {
-			if (regexec(&type_regex, type_to_string(o->port.type_id),
-						0, NULL, 0) == REG_NOMATCH)
+			if ((flags & JackPortIsOutput) && d != SPA_DIRECTION_OUTPUT)
 				continue;
-		}
 
-		pw_log_debug(NAME" %p: port %s prio:%d matches (%d)",
-				c, o->port.name, o->port.priority, count);
-		tmp[count++] = o;
+			spa_list_for_each(o, &c->context.type_ports[i][d], type_link) {
+				pw_log_debug(NAME" %p: check port type:%d flags:%08lx name:%s", c,
+						o->port.type_id, o->port.flags, o->port.name);
+				if (!SPA_FLAG_IS_SET(o->port.flags, flags))
+					continue;
+				if (id != SPA_ID_INVALID && o->port.node_id != id)
+					continue;
+				if (port_pattern && !match_pattern(port_pattern, o->port.name))
+					continue;
+
+				pw_log_debug(NAME" %p: port %s prio:%d matches (%d)",
+						c, o->port.name, o->port.priority, count);
+				ports[count++] = o;
+			}
+		}
 	}
-	pthread_mutex_unlock(&c->context.lock);
-
 	if (count > 0) {
-		qsort(tmp, count, sizeof(struct object *), port_compare_func);
+		qsort(ports, count, sizeof(struct object *), port_compare_func);
 
-		res = malloc(sizeof(char*) * (count + 1));
+		res = (const char **)ports;
 		for (i = 0; i < count; i++)
-			res[i] = tmp[i]->port.name;
+			res[i] = ports[i]->port.name;
 		res[count] = NULL;
 	} else {
-		res = NULL;
+		free(ports);
 	}
-
-	if (port_name_pattern && port_name_pattern[0])
-		regfree(&port_regex);
-	if (type_name_pattern && type_name_pattern[0])
-		regfree(&type_regex);
+exit:
+	pthread_mutex_unlock(&c->context.lock);
 
 	return res;
 }
@@ -0,0 +1,186 @@
+/* Spa
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SPA_POD_LAYOUT_H
+#define SPA_POD_LAYOUT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <errno.h>
+
+#include <spa/pod/builder.h>
+#include <spa/pod/iter.h>
+
+/**
+ * Object layouts
+ *
+ * An object layout declares the properties of an object once and generates
+ * a builder and a parser for it that don't go through the varargs and format
+ * strings of spa_pod_builder_add() and spa_pod_parse_object().
+ *
+ * The properties are given as a list macro with one F(key, Type, field) entry
+ * for each property, where Type is one of Bool, Id, Int, Long, Float, Double,
+ * Rectangle or Fraction, with at most 64 properties in one layout:
+ *
+ * \code{.c}
+ * #define META_FIELDS(F)					\
+ *	F(SPA_PARAM_META_type,	Id,	type)			\
+ *	F(SPA_PARAM_META_size,	Int,	size)
+ *
+ * SPA_POD_OBJECT_LAYOUT(meta, SPA_TYPE_OBJECT_ParamMeta, META_FIELDS);
+ * \endcode
+ *
+ * This defines:
+ *
+ *  - struct meta with a field for the value of each property
+ *  - meta_build(builder, id, &values) that adds the object with all
+ *    properties with one write to the builder and returns the object or
+ *    NULL when the builder overflowed.
+ *  - meta_parse(pod, &id, &values) that walks the properties of the object
+ *    once. The fields of the properties that are found with the right type,
+ *    plain or in a None choice, are set and the others are not touched.
+ *    Returns the number of distinct fields that were set, a property that
+ *    is repeated counts once and the last value wins, or -EPROTO when the
+ *    pod is not an object of the given type. \a id can be NULL.
+ *
+ * The generated functions are plain static inline functions and can be used
+ * from C++ as well.
+ */
+
+#define SPA_POD_LAYOUT_CTYPE_Bool	bool
+#define SPA_POD_LAYOUT_CTYPE_Id		uint32_t
+#define SPA_POD_LAYOUT_CTYPE_Int	int32_t
+#define SPA_POD_LAYOUT_CTYPE_Long	int64_t
+#define SPA_POD_LAYOUT_CTYPE_Float	float
+#define SPA_POD_LAYOUT_CTYPE_Double	double
+#define SPA_POD_LAYOUT_CTYPE_Rectangle	struct spa_rectangle
+#define SPA_POD_LAYOUT_CTYPE_Fraction	struct spa_fraction
+
+#define SPA_POD_LAYOUT_POD_Bool		struct spa_pod_bool
+#define SPA_POD_LAYOUT_POD_Id		struct spa_pod_id
+#define SPA_POD_LAYOUT_POD_Int		struct spa_pod_int
+#define SPA_POD_LAYOUT_POD_Long		struct spa_pod_long
+#define SPA_POD_LAYOUT_POD_Float	struct spa_pod_float
+#define SPA_POD_LAYOUT_POD_Double	struct spa_pod_double
+#define SPA_POD_LAYOUT_POD_Rectangle	struct spa_pod_rectangle
+#define SPA_POD_LAYOUT_POD_Fraction	struct spa_pod_fraction
+
+#define SPA_POD_LAYOUT_GET_Bool		spa_pod_get_bool
+#define SPA_POD_LAYOUT_GET_Id		spa_pod_get_id
+#define SPA_POD_LAYOUT_GET_Int		spa_pod_get_int
+#define SPA_POD_LAYOUT_GET_Long		spa_pod_get_long
+#define SPA_POD_LAYOUT_GET_Float	spa_pod_get_float
+#define SPA_POD_LAYOUT_GET_Double	spa_pod_get_double
+#define SPA_POD_LAYOUT_GET_Rectangle	spa_pod_get_rectangle
+#define SPA_POD_LAYOUT_GET_Fraction	spa_pod_get_fraction
+
+#define SPA_POD_LAYOUT_FIELD(_key,_type,_field)					\
+	SPA_POD_LAYOUT_CTYPE_##_type _field;
+
+#define SPA_POD_LAYOUT_PROP(_key,_type,_field)					\
+	struct {								\
+		uint32_t key;							\
+		uint32_t flags;							\
+		SPA_POD_LAYOUT_POD_##_type value;				\
+	} _field;
+
+#define SPA_POD_LAYOUT_INIT(_key,_type,_field)					\
+	_p._field.key = _key;							\
+	_p._field.flags = 0;							\
+	_p._field.value = SPA_POD_INIT_##_type(values->_field);
+
+#define SPA_POD_LAYOUT_BIT(_key,_type,_field)					\
+	_spa_layout_bit_##_field,
+
+#define SPA_POD_LAYOUT_CASE(_key,_type,_field)					\
+	case _key:								\
+		if (SPA_POD_LAYOUT_GET_##_type(pod, &values->_field) >= 0)	\
+			found |= 1ull << _spa_layout_bit_##_field;		\
+		break;
+
+#define SPA_POD_OBJECT_LAYOUT(name,object_type,FIELDS)				\
+struct name {									\
+	FIELDS(SPA_POD_LAYOUT_FIELD)						\
+};										\
+										\
+static inline struct spa_pod *							\
+name##_build(struct spa_pod_builder *b, uint32_t id,				\
+		const struct name *values)					\
+{										\
+	struct {								\
+		struct spa_pod_object obj;					\
+		FIELDS(SPA_POD_LAYOUT_PROP)					\
+	} _p;									\
+	uint32_t offset = b->state.offset;					\
+										\
+	_p.obj = SPA_POD_INIT_Object(sizeof(_p) - sizeof(struct spa_pod),	\
+			object_type, id);					\
+	FIELDS(SPA_POD_LAYOUT_INIT)						\
+										\
+	if (spa_pod_builder_raw(b, &_p, sizeof(_p)) < 0)			\
+		return NULL;							\
+	return spa_pod_builder_deref(b, offset);				\
+}										\
+										\
+static inline int								\
+name##_parse(const struct spa_pod *object, uint32_t *id,			\
+		struct name *values)						\
+{										\
+	enum { FIELDS(SPA_POD_LAYOUT_BIT) };					\
+	const struct spa_pod_prop *prop;					\
+	uint64_t found = 0;							\
+	int count = 0;								\
+										\
+	if (!spa_pod_is_object_type(object, object_type))			\
+		return -EPROTO;							\
+	if (id)									\
+		*id = SPA_POD_OBJECT_ID(object);				\
+										\
+	SPA_POD_OBJECT_FOREACH((const struct spa_pod_object *)object, prop) {	\
+		const struct spa_pod *pod = &prop->value;			\
+										\
+		if (spa_pod_is_choice(pod) &&					\
+		    SPA_POD_CHOICE_TYPE(pod) == SPA_CHOICE_None &&		\
+		    SPA_POD_BODY_SIZE(pod) - sizeof(struct spa_pod_choice_body) >=	\
+		    SPA_POD_CHOICE_VALUE_SIZE(pod))				\
+			pod = SPA_POD_CHOICE_CHILD(pod);			\
+										\
+		switch (prop->key) {						\
+		FIELDS(SPA_POD_LAYOUT_CASE)					\
+		default:							\
+			break;							\
+		}								\
+	}									\
+	for (; found; found &= found - 1)					\
+		count++;							\
+	return count;								\
+}
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* SPA_POD_LAYOUT_H */
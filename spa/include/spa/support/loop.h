@@ -87,7 +87,9 @@ struct spa_loop_methods {
 	int (*remove_source) (void *object,
 			struct spa_source *source);
 
-	/** invoke a function in the context of this loop */
+	/** invoke a function in the context of this loop. The functions
+	 * invoked from one thread are called in order, there is no order
+	 * between the functions invoked from different threads. */
 	int (*invoke) (void *object,
 		       spa_invoke_func_t func,
 		       uint32_t seq,
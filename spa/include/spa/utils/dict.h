@@ -75,13 +75,19 @@ static inline const struct spa_dict_item *spa_dict_lookup_item(const struct spa_
 	const struct spa_dict_item *item;
 
 	if (SPA_FLAG_IS_SET(dict->flags, SPA_DICT_FLAG_SORTED)) {
-		struct spa_dict_item k = SPA_DICT_ITEM_INIT(key, NULL);
-		item = (const struct spa_dict_item *)bsearch(&k,
-				(const void *) dict->items, dict->n_items,
-				sizeof(struct spa_dict_item),
-				spa_dict_item_compare);
-		if (item != NULL)
-			return item;
+		uint32_t lo = 0, hi = dict->n_items;
+		while (lo < hi) {
+			uint32_t mid = (lo + hi) / 2;
+			int cmp;
+			item = &dict->items[mid];
+			cmp = strcmp(item->key, key);
+			if (cmp == 0)
+				return item;
+			if (cmp < 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
 	} else {
 		spa_dict_for_each(item, dict) {
 			if (!strcmp(item->key, key))
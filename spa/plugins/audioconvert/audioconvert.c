@@ -113,6 +113,7 @@ struct impl {
 
 	unsigned int started:1;
 	unsigned int add_listener:1;
+	unsigned int interleaved:1;
 };
 
 #define IS_MONITOR_PORT(this,dir,port_id) (dir == SPA_DIRECTION_OUTPUT && port_id > 0 &&	\
@@ -204,6 +205,15 @@ static int debug_params(struct impl *this, struct spa_node *node,
 	return 0;
 }
 
+static struct spa_pod *build_interleaved_filter(struct spa_pod_builder *b)
+{
+	return spa_pod_builder_add_object(b,
+			SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat,
+			SPA_FORMAT_mediaType,      SPA_POD_Id(SPA_MEDIA_TYPE_audio),
+			SPA_FORMAT_mediaSubtype,   SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+			SPA_FORMAT_AUDIO_format,   SPA_POD_Id(SPA_AUDIO_FORMAT_F32));
+}
+
 static int negotiate_link_format(struct impl *this, struct link *link)
 {
 	struct spa_pod_builder b = { 0 };
@@ -218,7 +228,7 @@ static int negotiate_link_format(struct impl *this, struct link *link)
 	spa_pod_builder_init(&b, buffer, sizeof(buffer));
 
 	state = 0;
-	filter = NULL;
+	filter = this->interleaved ? build_interleaved_filter(&b) : NULL;
 	if ((res = spa_node_port_enum_params_sync(link->out_node,
 			       SPA_DIRECTION_OUTPUT, link->out_port,
 			       SPA_PARAM_EnumFormat, &state,
@@ -258,6 +268,60 @@ static int negotiate_link_format(struct impl *this, struct link *link)
 	return 0;
 }
 
+static int get_port_format(struct impl *this, enum spa_direction direction,
+		struct spa_audio_info_raw *info)
+{
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[4096];
+	uint32_t state = 0;
+	struct spa_pod *format;
+	int res;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	if ((res = spa_node_port_enum_params_sync(this->fmt[direction],
+			       direction, 0, SPA_PARAM_Format, &state,
+			       NULL, &format, &b)) != 1)
+		return res < 0 ? res : -EIO;
+
+	spa_zero(*info);
+	return spa_format_audio_raw_parse(format, info);
+}
+
+/* When both sides are interleaved f32 with the same channel layout, only
+ * the rate and the volume can change. The samples can then stay
+ * interleaved through all nodes and the converters pass them through. */
+static bool can_interleave(struct impl *this)
+{
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[1024];
+	struct spa_audio_info_raw info[2];
+	struct spa_pod *format, *filter;
+	uint32_t state = 0;
+
+	if (this->mode[SPA_DIRECTION_INPUT] != SPA_PARAM_PORT_CONFIG_MODE_convert ||
+	    this->mode[SPA_DIRECTION_OUTPUT] != SPA_PARAM_PORT_CONFIG_MODE_convert)
+		return false;
+
+	if (get_port_format(this, SPA_DIRECTION_INPUT, &info[0]) < 0 ||
+	    get_port_format(this, SPA_DIRECTION_OUTPUT, &info[1]) < 0)
+		return false;
+
+	if (info[0].format != SPA_AUDIO_FORMAT_F32 ||
+	    info[1].format != SPA_AUDIO_FORMAT_F32 ||
+	    info[0].channels != info[1].channels ||
+	    info[0].flags != info[1].flags ||
+	    memcmp(info[0].position, info[1].position,
+		    info[0].channels * sizeof(uint32_t)) != 0)
+		return false;
+
+	/* the peaks resampler only does planar */
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	filter = build_interleaved_filter(&b);
+	return spa_node_port_enum_params_sync(this->resample,
+			SPA_DIRECTION_INPUT, 0, SPA_PARAM_EnumFormat, &state,
+			filter, &format, &b) == 1;
+}
+
 static int setup_convert(struct impl *this)
 {
 	int i, j, res;
@@ -267,6 +331,9 @@ static int setup_convert(struct impl *this)
 	if (this->n_links > 0)
 		return 0;
 
+	this->interleaved = can_interleave(this);
+	spa_log_debug(this->log, NAME " %p: interleaved:%d", this, this->interleaved);
+
 	this->n_nodes = 0;
 	/* unpack */
 	this->nodes[this->n_nodes++] = this->fmt[SPA_DIRECTION_INPUT];
@@ -623,8 +690,20 @@ static struct spa_node_events channelmix_events = {
 	.result = on_node_result,
 };
 
+static void on_resample_info(void *data, const struct spa_node_info *info)
+{
+	struct impl *this = data;
+
+	if (info->change_mask & SPA_NODE_CHANGE_MASK_PROPS) {
+		this->info.change_mask |= SPA_NODE_CHANGE_MASK_PROPS;
+		this->info.props = info->props;
+		emit_node_info(this, false);
+	}
+}
+
 static struct spa_node_events resample_events = {
 	SPA_VERSION_NODE_EVENTS,
+	.info = on_resample_info,
 	.result = on_node_result,
 };
 
@@ -1239,6 +1318,7 @@ impl_init(const struct spa_handle_factory *factory,
 	spa_hook_list_init(&this->hooks);
 
 	this->info_all = SPA_NODE_CHANGE_MASK_FLAGS |
+			SPA_NODE_CHANGE_MASK_PROPS |
 			SPA_NODE_CHANGE_MASK_PARAMS;
 	this->info = SPA_NODE_INFO_INIT();
 	this->info.max_input_ports = MAX_PORTS;
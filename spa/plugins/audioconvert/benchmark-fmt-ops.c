@@ -48,7 +48,7 @@ struct stats {
 };
 
 #define MAX_SAMPLES	4096
-#define MAX_CHANNELS	11
+#define MAX_CHANNELS	64
 
 #define MAX_COUNT 100
 
@@ -56,9 +56,9 @@ static uint8_t samp_in[MAX_SAMPLES * MAX_CHANNELS * 4];
 static uint8_t samp_out[MAX_SAMPLES * MAX_CHANNELS * 4];
 
 static const int sample_sizes[] = { 0, 1, 128, 513, 4096 };
-static const int channel_counts[] = { 1, 2, 4, 6, 8, 11 };
+static const int channel_counts[] = { 1, 2, 4, 6, 8, 11, 64 };
 
-#define MAX_RESULTS	SPA_N_ELEMENTS(sample_sizes) * SPA_N_ELEMENTS(channel_counts) * 70
+#define MAX_RESULTS	SPA_N_ELEMENTS(sample_sizes) * SPA_N_ELEMENTS(channel_counts) * 90
 
 static uint32_t n_results = 0;
 static struct stats results[MAX_RESULTS];
@@ -73,7 +73,9 @@ static void run_test1(const char *name, const char *impl, bool in_packed, bool o
 	uint64_t count, t1, t2;
 	struct convert conv;
 
+	spa_zero(conv);
 	conv.n_channels = n_channels;
+	convert_reset_dither(&conv);
 
 	for (j = 0; j < n_channels; j++) {
 		ip[j] = &samp_in[j * n_samples * 4];
@@ -156,6 +158,25 @@ static void test_f32_s16(void)
 		run_testc("test_f32d_s16_2", "avx2", false, true, conv_f32d_to_s16_2_avx2, 2);
 		run_testc("test_f32d_s16_4", "avx2", false, true, conv_f32d_to_s16_4_avx2, 4);
 	}
+#endif
+#if defined (HAVE_AVX512F)
+	if (cpu_flags & SPA_CPU_FLAG_AVX512) {
+		run_test("test_f32d_s16", "avx512", false, true, conv_f32d_to_s16_avx512);
+	}
+#endif
+	run_test("test_f32d_s16_dither", "c", false, true, conv_f32d_to_s16_dither_c);
+	run_test("test_f32d_s16_shaped", "c", false, true, conv_f32d_to_s16_shaped_c);
+#if defined (HAVE_SSE2)
+	if (cpu_flags & SPA_CPU_FLAG_SSE2) {
+		run_test("test_f32d_s16_dither", "sse2", false, true, conv_f32d_to_s16_dither_sse2);
+		run_test("test_f32d_s16_shaped", "sse2", false, true, conv_f32d_to_s16_shaped_sse2);
+	}
+#endif
+#if defined (HAVE_AVX2)
+	if (cpu_flags & SPA_CPU_FLAG_AVX2) {
+		run_test("test_f32d_s16_dither", "avx2", false, true, conv_f32d_to_s16_dither_avx2);
+		run_test("test_f32d_s16_shaped", "avx2", false, true, conv_f32d_to_s16_shaped_avx2);
+	}
 #endif
 	run_test("test_f32_s16d", "c", true, false, conv_f32_to_s16d_c);
 	run_test("test_f32d_s16d", "c", false, false, conv_f32d_to_s16d_c);
@@ -177,6 +198,11 @@ static void test_s16_f32(void)
 		run_test("test_s16_f32d", "avx2", true, false, conv_s16_to_f32d_avx2);
 		run_testc("test_s16_f32d_2", "avx2", true, false, conv_s16_to_f32d_2_avx2, 2);
 	}
+#endif
+#if defined (HAVE_AVX512F)
+	if (cpu_flags & SPA_CPU_FLAG_AVX512) {
+		run_test("test_s16_f32d", "avx512", true, false, conv_s16_to_f32d_avx512);
+	}
 #endif
 	run_test("test_s16d_f32d", "c", false, false, conv_s16d_to_f32d_c);
 }
@@ -194,6 +220,11 @@ static void test_f32_s32(void)
 	if (cpu_flags & SPA_CPU_FLAG_AVX2) {
 		run_test("test_f32d_s32", "avx2", false, true, conv_f32d_to_s32_avx2);
 	}
+#endif
+#if defined (HAVE_AVX512F)
+	if (cpu_flags & SPA_CPU_FLAG_AVX512) {
+		run_test("test_f32d_s32", "avx512", false, true, conv_f32d_to_s32_avx512);
+	}
 #endif
 	run_test("test_f32_s32d", "c", true, false, conv_f32_to_s32d_c);
 	run_test("test_f32d_s32d", "c", false, false, conv_f32d_to_s32d_c);
@@ -212,6 +243,11 @@ static void test_s32_f32(void)
 	if (cpu_flags & SPA_CPU_FLAG_AVX2) {
 		run_test("test_s32_f32d", "avx2", true, false, conv_s32_to_f32d_avx2);
 	}
+#endif
+#if defined (HAVE_AVX512F)
+	if (cpu_flags & SPA_CPU_FLAG_AVX512) {
+		run_test("test_s32_f32d", "avx512", true, false, conv_s32_to_f32d_avx512);
+	}
 #endif
 	run_test("test_s32_f32d", "c", true, false, conv_s32_to_f32d_c);
 	run_test("test_s32d_f32d", "c", false, false, conv_s32d_to_f32d_c);
@@ -221,6 +257,11 @@ static void test_f32_s24(void)
 {
 	run_test("test_f32_s24", "c", true, true, conv_f32_to_s24_c);
 	run_test("test_f32d_s24", "c", false, true, conv_f32d_to_s24_c);
+#if defined (HAVE_AVX512F)
+	if (cpu_flags & SPA_CPU_FLAG_AVX512) {
+		run_test("test_f32d_s24", "avx512", false, true, conv_f32d_to_s24_avx512);
+	}
+#endif
 	run_test("test_f32_s24d", "c", true, false, conv_f32_to_s24d_c);
 	run_test("test_f32d_s24d", "c", false, false, conv_f32d_to_s24d_c);
 }
@@ -240,6 +281,11 @@ static void test_s24_f32(void)
 		run_test("test_s24_f32d", "avx2", true, false, conv_s24_to_f32d_avx2);
 	}
 #endif
+#if defined (HAVE_AVX512F)
+	if (cpu_flags & SPA_CPU_FLAG_AVX512) {
+		run_test("test_s24_f32d", "avx512", true, false, conv_s24_to_f32d_avx512);
+	}
+#endif
 #if defined (HAVE_SSSE3)
 	if (cpu_flags & SPA_CPU_FLAG_SSSE3) {
 		run_test("test_s24_f32d", "ssse3", true, false, conv_s24_to_f32d_ssse3);
@@ -275,6 +321,11 @@ static void test_interleave(void)
 	run_test("test_interleave_16", "c", false, true, conv_interleave_16_c);
 	run_test("test_interleave_24", "c", false, true, conv_interleave_24_c);
 	run_test("test_interleave_32", "c", false, true, conv_interleave_32_c);
+#if defined (HAVE_AVX512F)
+	if (cpu_flags & SPA_CPU_FLAG_AVX512) {
+		run_test("test_interleave_32", "avx512", false, true, conv_interleave_32_avx512);
+	}
+#endif
 }
 
 static void test_deinterleave(void)
@@ -283,6 +334,11 @@ static void test_deinterleave(void)
 	run_test("test_deinterleave_16", "c", true, false, conv_deinterleave_16_c);
 	run_test("test_deinterleave_24", "c", true, false, conv_deinterleave_24_c);
 	run_test("test_deinterleave_32", "c", true, false, conv_deinterleave_32_c);
+#if defined (HAVE_AVX512F)
+	if (cpu_flags & SPA_CPU_FLAG_AVX512) {
+		run_test("test_deinterleave_32", "avx512", true, false, conv_deinterleave_32_avx512);
+	}
+#endif
 }
 
 static int compare_func(const void *_a, const void *_b)
@@ -296,6 +352,40 @@ static int compare_func(const void *_a, const void *_b)
 	return 0;
 }
 
+/* Average throughput in samples per second of every implementation of a
+ * conversion over all sample sizes and channel counts. */
+static void print_throughput(void)
+{
+	uint32_t i, j, n;
+	double total;
+
+	fprintf(stderr, "\nthroughput (Msamples/sec):\n");
+	for (i = 0; i < n_results; i++) {
+		struct stats *s = &results[i];
+
+		for (j = 0; j < i; j++) {
+			if (strcmp(results[j].name, s->name) == 0 &&
+			    strcmp(results[j].impl, s->impl) == 0)
+				break;
+		}
+		if (j < i)
+			continue;
+
+		for (total = 0.0, n = 0, j = i; j < n_results; j++) {
+			struct stats *r = &results[j];
+			if (r->n_samples == 0 ||
+			    strcmp(r->name, s->name) != 0 ||
+			    strcmp(r->impl, s->impl) != 0)
+				continue;
+			total += (double)r->perf * r->n_samples * r->n_channels;
+			n++;
+		}
+		if (n > 0)
+			fprintf(stderr, "%-32.32s %-8s %10.1f\n", s->name, s->impl,
+					total / n / 1e6);
+	}
+}
+
 int main(int argc, char *argv[])
 {
 	uint32_t i;
@@ -323,5 +413,6 @@ int main(int argc, char *argv[])
 		fprintf(stderr, "%-12."PRIu64" \t%-32.32s %s \t samples %d, channels %d\n",
 				s->perf, s->name, s->impl, s->n_samples, s->n_channels);
 	}
+	print_throughput();
 	return 0;
 }
@@ -33,9 +33,10 @@
 
 #include "test-helper.h"
 #include "resample.h"
+#include "resample-native-impl.h"
 
 #define MAX_SAMPLES	4096
-#define MAX_CHANNELS	11
+#define MAX_CHANNELS	32
 
 #define MAX_COUNT 200
 
@@ -57,12 +58,17 @@ static float samp_out[MAX_SAMPLES * MAX_CHANNELS];
 static const int sample_sizes[] = { 0, 1, 128, 513, 4096 };
 static const int in_rates[] = { 44100, 44100, 48000, 96000, 22050, 96000 };
 static const int out_rates[] = { 44100, 48000, 44100, 48000, 48000, 44100 };
-
+static const int channel_counts[] = { 2, 8, 32 };
+/* the rates of the drift tests */
+static const int drift_in_rates[] = { 48000, 44100 };
+static const int drift_out_rates[] = { 48000, 48000 };
 
 #define MAX_RESAMPLER	5
 #define MAX_SIZES	SPA_N_ELEMENTS(sample_sizes)
 #define MAX_RATES	SPA_N_ELEMENTS(in_rates)
-#define MAX_RESULTS	MAX_RESAMPLER * MAX_SIZES * MAX_RATES
+#define MAX_CHANNEL_COUNTS	SPA_N_ELEMENTS(channel_counts)
+#define MAX_DRIFT_RATES	SPA_N_ELEMENTS(drift_in_rates)
+#define MAX_RESULTS	MAX_RESAMPLER * MAX_SIZES * (MAX_RATES + MAX_DRIFT_RATES) * MAX_CHANNEL_COUNTS * 2
 
 static uint32_t n_results = 0;
 static struct stats results[MAX_RESULTS];
@@ -76,9 +82,14 @@ static void run_test1(const char *name, const char *impl, struct resample *r, in
 	uint64_t count, t1, t2;
 	uint32_t in_len, out_len;
 
-	for (j = 0; j < r->channels; j++) {
-		ip[j] = &samp_in[j * MAX_SAMPLES];
-		op[j] = &samp_out[j * MAX_SAMPLES];
+	if (SPA_FLAG_IS_SET(r->options, RESAMPLE_OPTION_INTERLEAVED)) {
+		ip[0] = samp_in;
+		op[0] = samp_out;
+	} else {
+		for (j = 0; j < r->channels; j++) {
+			ip[j] = &samp_in[j * MAX_SAMPLES];
+			op[j] = &samp_out[j * MAX_SAMPLES];
+		}
 	}
 
 	clock_gettime(CLOCK_MONOTONIC, &ts);
@@ -114,6 +125,52 @@ static void run_test(const char *name, const char *impl, struct resample *r)
 		run_test1(name, impl, r, sample_sizes[i]);
 }
 
+static void run_tests(const char *impl, uint32_t flags)
+{
+	struct resample r;
+	size_t i, j;
+
+	for (i = 0; i < SPA_N_ELEMENTS(in_rates); i++) {
+		for (j = 0; j < SPA_N_ELEMENTS(channel_counts); j++) {
+			spa_zero(r);
+			r.channels = channel_counts[j];
+			r.cpu_flags = flags;
+			r.i_rate = in_rates[i];
+			r.o_rate = out_rates[i];
+			r.quality = RESAMPLE_DEFAULT_QUALITY;
+			resample_native_init(&r);
+			run_test("native", impl, &r);
+			resample_free(&r);
+
+			r.options = RESAMPLE_OPTION_INTERLEAVED;
+			resample_native_init(&r);
+			run_test("interleaved", impl, &r);
+			resample_free(&r);
+		}
+	}
+	/* a small rate correction, like an adaptive follower makes, with the
+	 * drift resampler and with the interpolating resampler */
+	for (i = 0; i < SPA_N_ELEMENTS(drift_in_rates); i++) {
+		for (j = 0; j < SPA_N_ELEMENTS(channel_counts); j++) {
+			struct native_data *d;
+
+			spa_zero(r);
+			r.channels = channel_counts[j];
+			r.cpu_flags = flags;
+			r.i_rate = drift_in_rates[i];
+			r.o_rate = drift_out_rates[i];
+			r.quality = RESAMPLE_DEFAULT_QUALITY;
+			resample_native_init(&r);
+			resample_update_rate(&r, 1.0001);
+			run_test("drift", impl, &r);
+			d = r.data;
+			d->func = d->info->process_inter;
+			run_test("inter", impl, &r);
+			resample_free(&r);
+		}
+	}
+}
+
 static int compare_func(const void *_a, const void *_b)
 {
 	const struct stats *a = _a, *b = _b;
@@ -129,67 +186,23 @@ static int compare_func(const void *_a, const void *_b)
 
 int main(int argc, char *argv[])
 {
-	struct resample r;
 	uint32_t i;
 
 	cpu_flags = get_cpu_flags();
 	printf("got get CPU flags %d\n", cpu_flags);
 
-	for (i = 0; i < SPA_N_ELEMENTS(in_rates); i++) {
-		spa_zero(r);
-		r.channels = 2;
-		r.cpu_flags = 0;
-		r.i_rate = in_rates[i];
-		r.o_rate = out_rates[i];
-		r.quality = RESAMPLE_DEFAULT_QUALITY;
-		resample_native_init(&r);
-		run_test("native", "c", &r);
-		resample_free(&r);
-	}
+	run_tests("c", 0);
 #if defined (HAVE_SSE)
-	if (cpu_flags & SPA_CPU_FLAG_SSE) {
-		for (i = 0; i < SPA_N_ELEMENTS(in_rates); i++) {
-			spa_zero(r);
-			r.channels = 2;
-			r.cpu_flags = SPA_CPU_FLAG_SSE;
-			r.i_rate = in_rates[i];
-			r.o_rate = out_rates[i];
-			r.quality = RESAMPLE_DEFAULT_QUALITY;
-			resample_native_init(&r);
-			run_test("native", "sse", &r);
-			resample_free(&r);
-		}
-	}
+	if (cpu_flags & SPA_CPU_FLAG_SSE)
+		run_tests("sse", SPA_CPU_FLAG_SSE);
 #endif
 #if defined (HAVE_SSSE3)
-	if (cpu_flags & SPA_CPU_FLAG_SSSE3) {
-		for (i = 0; i < SPA_N_ELEMENTS(in_rates); i++) {
-			spa_zero(r);
-			r.channels = 2;
-			r.cpu_flags = SPA_CPU_FLAG_SSSE3 | SPA_CPU_FLAG_SLOW_UNALIGNED;
-			r.i_rate = in_rates[i];
-			r.o_rate = out_rates[i];
-			r.quality = RESAMPLE_DEFAULT_QUALITY;
-			resample_native_init(&r);
-			run_test("native", "ssse3", &r);
-			resample_free(&r);
-		}
-	}
+	if (cpu_flags & SPA_CPU_FLAG_SSSE3)
+		run_tests("ssse3", SPA_CPU_FLAG_SSSE3 | SPA_CPU_FLAG_SLOW_UNALIGNED);
 #endif
 #if defined (HAVE_AVX) && defined(HAVE_FMA)
-	if (SPA_FLAG_IS_SET(cpu_flags, SPA_CPU_FLAG_AVX | SPA_CPU_FLAG_FMA3)) {
-		for (i = 0; i < SPA_N_ELEMENTS(in_rates); i++) {
-			spa_zero(r);
-			r.channels = 2;
-			r.cpu_flags = SPA_CPU_FLAG_AVX | SPA_CPU_FLAG_FMA3;
-			r.i_rate = in_rates[i];
-			r.o_rate = out_rates[i];
-			r.quality = RESAMPLE_DEFAULT_QUALITY;
-			resample_native_init(&r);
-			run_test("native", "avx", &r);
-			resample_free(&r);
-		}
-	}
+	if (SPA_FLAG_IS_SET(cpu_flags, SPA_CPU_FLAG_AVX | SPA_CPU_FLAG_FMA3))
+		run_tests("avx", SPA_CPU_FLAG_AVX | SPA_CPU_FLAG_FMA3);
 #endif
 
 	qsort(results, n_results, sizeof(struct stats), compare_func);
@@ -0,0 +1,83 @@
+/* Spa
+ *
+ * Copyright © 2018 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <string.h>
+
+#include "channelmix-ops.h"
+
+#include <immintrin.h>
+
+void
+channelmix_f32_n_m_avx512(struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT dst[n_dst],
+		uint32_t n_src, const void * SPA_RESTRICT src[n_src], uint32_t n_samples)
+{
+	uint32_t i, j, n, unrolled;
+	float **d = (float **) dst;
+	const float **s = (const float **) src;
+
+	if (SPA_FLAG_IS_SET(mix->flags, CHANNELMIX_FLAG_ZERO)) {
+		for (i = 0; i < n_dst; i++)
+			memset(d[i], 0, n_samples * sizeof(float));
+		return;
+	}
+	if (SPA_FLAG_IS_SET(mix->flags, CHANNELMIX_FLAG_COPY)) {
+		uint32_t copy = SPA_MIN(n_dst, n_src);
+		for (i = 0; i < copy; i++)
+			spa_memcpy(d[i], s[i], n_samples * sizeof(float));
+		for (; i < n_dst; i++)
+			memset(d[i], 0, n_samples * sizeof(float));
+		return;
+	}
+
+	unrolled = n_samples & ~63;
+
+	for (i = 0; i < n_dst; i++) {
+		const float *m = mix->matrix[i];
+		float *di = d[i];
+
+		for (n = 0; n < unrolled; n += 64) {
+			__m512 acc[4], v;
+
+			acc[0] = acc[1] = acc[2] = acc[3] = _mm512_setzero_ps();
+			for (j = 0; j < n_src; j++) {
+				v = _mm512_set1_ps(m[j]);
+				acc[0] = _mm512_add_ps(acc[0], _mm512_mul_ps(_mm512_loadu_ps(&s[j][n +  0]), v));
+				acc[1] = _mm512_add_ps(acc[1], _mm512_mul_ps(_mm512_loadu_ps(&s[j][n + 16]), v));
+				acc[2] = _mm512_add_ps(acc[2], _mm512_mul_ps(_mm512_loadu_ps(&s[j][n + 32]), v));
+				acc[3] = _mm512_add_ps(acc[3], _mm512_mul_ps(_mm512_loadu_ps(&s[j][n + 48]), v));
+			}
+			_mm512_storeu_ps(&di[n +  0], acc[0]);
+			_mm512_storeu_ps(&di[n + 16], acc[1]);
+			_mm512_storeu_ps(&di[n + 32], acc[2]);
+			_mm512_storeu_ps(&di[n + 48], acc[3]);
+		}
+		for (n = unrolled; n < n_samples; n++) {
+			float sum = 0.0f;
+			for (j = 0; j < n_src; j++)
+				sum += s[j][n] * m[j];
+			di[n] = sum;
+		}
+	}
+}
@@ -48,6 +48,31 @@ channelmix_copy_c(struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT ds
 	}
 }
 
+void
+channelmix_copy_interleaved_c(struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT dst[n_dst],
+		uint32_t n_src, const void * SPA_RESTRICT src[n_src], uint32_t n_samples)
+{
+	uint32_t i, n, n_chan = mix->dst_chan;
+	float *d = dst[0];
+	const float *s = src[0];
+	float v[SPA_AUDIO_MAX_CHANNELS];
+
+	if (SPA_FLAG_IS_SET(mix->flags, CHANNELMIX_FLAG_ZERO)) {
+		memset(d, 0, n_samples * n_chan * sizeof(float));
+	}
+	else if (SPA_FLAG_IS_SET(mix->flags, CHANNELMIX_FLAG_IDENTITY)) {
+		spa_memcpy(d, s, n_samples * n_chan * sizeof(float));
+	}
+	else {
+		for (i = 0; i < n_chan; i++)
+			v[i] = mix->matrix[i][i];
+		for (n = 0; n < n_samples; n++, d += n_chan, s += n_chan) {
+			for (i = 0; i < n_chan; i++)
+				d[i] = s[i] * v[i];
+		}
+	}
+}
+
 #define _M(ch)		(1UL << SPA_AUDIO_CHANNEL_ ## ch)
 
 void
@@ -97,9 +97,15 @@ static const struct channelmix_info {
 	{ 8, MASK_7_1, 4, MASK_QUAD, channelmix_f32_7p1_4_c, 0 },
 	{ 8, MASK_7_1, 4, MASK_3_1, channelmix_f32_7p1_3p1_c, 0 },
 
+#if defined (HAVE_AVX512F)
+	{ ANY, 0, ANY, 0, channelmix_f32_n_m_avx512, SPA_CPU_FLAG_AVX512 },
+#endif
 	{ ANY, 0, ANY, 0, channelmix_f32_n_m_c, 0 },
 };
 
+static const struct channelmix_info interleaved_info =
+	{ EQ, 0, EQ, 0, channelmix_copy_interleaved_c, 0 };
+
 #define MATCH_CHAN(a,b)		((a) == ANY || (a) == (b))
 #define MATCH_CPU_FLAGS(a,b)	((a) == 0 || ((a) & (b)) == a)
 #define MATCH_MASK(a,b)		((a) == 0 || ((a) & (b)) == (b))
@@ -445,10 +451,17 @@ int channelmix_init(struct channelmix *mix)
 {
 	const struct channelmix_info *info;
 
-	info = find_channelmix_info(mix->src_chan, mix->src_mask, mix->dst_chan, mix->dst_mask,
-			mix->cpu_flags);
-	if (info == NULL)
-		return -ENOTSUP;
+	if (SPA_FLAG_IS_SET(mix->options, CHANNELMIX_OPTION_INTERLEAVED)) {
+		/* interleaved samples can only be copied with a volume */
+		if (mix->src_chan != mix->dst_chan || mix->src_mask != mix->dst_mask)
+			return -ENOTSUP;
+		info = &interleaved_info;
+	} else {
+		info = find_channelmix_info(mix->src_chan, mix->src_mask,
+				mix->dst_chan, mix->dst_mask, mix->cpu_flags);
+		if (info == NULL)
+			return -ENOTSUP;
+	}
 
 	mix->free = impl_channelmix_free;
 	mix->process = info->process;
@@ -48,6 +48,7 @@ struct channelmix {
 	uint32_t cpu_flags;
 #define CHANNELMIX_OPTION_MIX_LFE	(1<<0)		/**< mix LFE */
 #define CHANNELMIX_OPTION_NORMALIZE	(1<<1)		/**< normalize volumes */
+#define CHANNELMIX_OPTION_INTERLEAVED	(1<<2)		/**< samples are interleaved in one block */
 	uint32_t options;
 
 	struct spa_log *log;
@@ -82,6 +83,7 @@ void channelmix_##name##_##arch(struct channelmix *mix,			\
 		uint32_t n_samples);
 
 DEFINE_FUNCTION(copy, c);
+DEFINE_FUNCTION(copy_interleaved, c);
 DEFINE_FUNCTION(f32_n_m, c);
 DEFINE_FUNCTION(f32_1_2, c);
 DEFINE_FUNCTION(f32_2_1, c);
@@ -105,3 +107,6 @@ DEFINE_FUNCTION(f32_5p1_3p1, sse);
 DEFINE_FUNCTION(f32_5p1_4, sse);
 DEFINE_FUNCTION(f32_7p1_4, sse);
 #endif
+#if defined (HAVE_AVX512F)
+DEFINE_FUNCTION(f32_n_m, avx512);
+#endif
@@ -270,9 +270,13 @@ static int setup_convert(struct impl *this,
 			dst_info->info.raw.rate,
 			src_mask, dst_mask);
 
-	if (src_info->info.raw.rate != dst_info->info.raw.rate)
+	if (src_info->info.raw.rate != dst_info->info.raw.rate ||
+	    src_info->info.raw.format != dst_info->info.raw.format)
 		return -EINVAL;
 
+	SPA_FLAG_UPDATE(this->mix.options, CHANNELMIX_OPTION_INTERLEAVED,
+			src_info->info.raw.format == SPA_AUDIO_FORMAT_F32);
+
 	this->mix.src_chan = src_chan;
 	this->mix.src_mask = src_mask;
 	this->mix.dst_chan = dst_chan;
@@ -591,14 +595,20 @@ static int port_enum_formats(void *object,
 			spa_pod_builder_add(builder,
 				SPA_FORMAT_mediaType,      SPA_POD_Id(SPA_MEDIA_TYPE_audio),
 				SPA_FORMAT_mediaSubtype,   SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
-				SPA_FORMAT_AUDIO_format,   SPA_POD_Id(SPA_AUDIO_FORMAT_F32P),
 				0);
 			if (other->have_format) {
 				spa_pod_builder_add(builder,
+					SPA_FORMAT_AUDIO_format, SPA_POD_Id(other->format.info.raw.format),
 					SPA_FORMAT_AUDIO_rate, SPA_POD_Int(other->format.info.raw.rate),
 					0);
 			} else {
+				/* interleaved is only possible when the channels
+				 * are not mixed */
 				spa_pod_builder_add(builder,
+					SPA_FORMAT_AUDIO_format, SPA_POD_CHOICE_ENUM_Id(3,
+								SPA_AUDIO_FORMAT_F32P,
+								SPA_AUDIO_FORMAT_F32P,
+								SPA_AUDIO_FORMAT_F32),
 					SPA_FORMAT_AUDIO_rate, SPA_POD_CHOICE_RANGE_Int(DEFAULT_RATE, 1, INT32_MAX),
 					0);
 			}
@@ -801,12 +811,15 @@ static int port_set_format(void *object,
 			if (spa_format_audio_raw_parse(format, &info.info.raw) < 0)
 				return -EINVAL;
 
-			if (info.info.raw.format != SPA_AUDIO_FORMAT_F32P)
+			if (info.info.raw.format == SPA_AUDIO_FORMAT_F32P) {
+				port->stride = sizeof(float);
+				port->blocks = info.info.raw.channels;
+			} else if (info.info.raw.format == SPA_AUDIO_FORMAT_F32) {
+				port->stride = sizeof(float) * info.info.raw.channels;
+				port->blocks = 1;
+			} else
 				return -EINVAL;
 
-			port->stride = sizeof(float);
-			port->blocks = info.info.raw.channels;
-
 			if (other->have_format) {
 				if ((res = setup_convert(this, direction, &info)) < 0)
 					return res;
@@ -987,6 +1000,8 @@ static int channelmix_process_control(struct impl *this, struct port *ctrlport,
 	struct spa_pod_control *c, *prev = NULL;
 	uint32_t avail_samples = n_samples;
 	uint32_t i;
+	uint32_t s_stride = GET_IN_PORT(this, 0)->stride / sizeof(float);
+	uint32_t d_stride = GET_OUT_PORT(this, 0)->stride / sizeof(float);
 	const float **s = (const float **)src;
 	float **d = (float **)dst;
 
@@ -1026,9 +1041,9 @@ static int channelmix_process_control(struct impl *this, struct port *ctrlport,
 
 		channelmix_process(&this->mix, n_dst, dst, n_src, src, chunk);
 		for (i = 0; i < n_src; i++)
-			s[i] += chunk;
+			s[i] += chunk * s_stride;
 		for (i = 0; i < n_dst; i++)
-			d[i] += chunk;
+			d[i] += chunk * d_stride;
 
 		avail_samples -= chunk;
 		ctrlport->ctrl_offset += chunk;
@@ -1060,3 +1060,146 @@ conv_f32d_to_s16_2_avx2(struct convert *conv, void * SPA_RESTRICT dst[], const v
 		d += 2;
 	}
 }
+
+/* 8 lanes of xorshift32, returns TPDF dither in (-1.0, 1.0) */
+static inline __m256 dither_tpdf_avx2(__m256i *state)
+{
+	__m256i x = *state;
+	x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 13));
+	x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 17));
+	x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 5));
+	*state = x;
+	x = _mm256_sub_epi32(_mm256_and_si256(x, _mm256_set1_epi32(0xffff)), _mm256_srli_epi32(x, 16));
+	return _mm256_mul_ps(_mm256_cvtepi32_ps(x), _mm256_set1_ps(DITHER_SCALE));
+}
+
+static void
+conv_f32d_to_s16_dither_1s_avx2(void *data, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_channels, uint32_t n_samples)
+{
+	struct convert *conv = data;
+	const float *s0 = src[0];
+	int16_t *d = dst;
+	uint32_t n, unrolled;
+	__m256 in[2];
+	__m256i out[2], rnd;
+	__m128i t[2];
+	__m256 int_max = _mm256_set1_ps(S16_MAX_F);
+	__m256 int_min = _mm256_sub_ps(_mm256_setzero_ps(), int_max);
+
+	unrolled = n_samples & ~15;
+
+	rnd = _mm256_loadu_si256((__m256i*)conv->random);
+	for(n = 0; n < unrolled; n += 16) {
+		in[0] = _mm256_mul_ps(_mm256_loadu_ps(&s0[n]), int_max);
+		in[1] = _mm256_mul_ps(_mm256_loadu_ps(&s0[n+8]), int_max);
+		in[0] = _mm256_add_ps(in[0], dither_tpdf_avx2(&rnd));
+		in[1] = _mm256_add_ps(in[1], dither_tpdf_avx2(&rnd));
+		in[0] = _mm256_min_ps(int_max, _mm256_max_ps(in[0], int_min));
+		in[1] = _mm256_min_ps(int_max, _mm256_max_ps(in[1], int_min));
+		out[0] = _mm256_cvtps_epi32(in[0]);
+		out[1] = _mm256_cvtps_epi32(in[1]);
+		t[0] = _mm_packs_epi32(_mm256_castsi256_si128(out[0]), _mm256_extracti128_si256(out[0], 1));
+		t[1] = _mm_packs_epi32(_mm256_castsi256_si128(out[1]), _mm256_extracti128_si256(out[1], 1));
+
+		d[0*n_channels] = _mm_extract_epi16(t[0], 0);
+		d[1*n_channels] = _mm_extract_epi16(t[0], 1);
+		d[2*n_channels] = _mm_extract_epi16(t[0], 2);
+		d[3*n_channels] = _mm_extract_epi16(t[0], 3);
+		d[4*n_channels] = _mm_extract_epi16(t[0], 4);
+		d[5*n_channels] = _mm_extract_epi16(t[0], 5);
+		d[6*n_channels] = _mm_extract_epi16(t[0], 6);
+		d[7*n_channels] = _mm_extract_epi16(t[0], 7);
+		d[8*n_channels] = _mm_extract_epi16(t[1], 0);
+		d[9*n_channels] = _mm_extract_epi16(t[1], 1);
+		d[10*n_channels] = _mm_extract_epi16(t[1], 2);
+		d[11*n_channels] = _mm_extract_epi16(t[1], 3);
+		d[12*n_channels] = _mm_extract_epi16(t[1], 4);
+		d[13*n_channels] = _mm_extract_epi16(t[1], 5);
+		d[14*n_channels] = _mm_extract_epi16(t[1], 6);
+		d[15*n_channels] = _mm_extract_epi16(t[1], 7);
+		d += 16*n_channels;
+	}
+	_mm256_storeu_si256((__m256i*)conv->random, rnd);
+
+	for(; n < n_samples; n++) {
+		*d = f32_to_s16_dither(s0[n], &conv->random[0]);
+		d += n_channels;
+	}
+}
+
+void
+conv_f32d_to_s16_dither_avx2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	int16_t *d = dst[0];
+	uint32_t i, n_channels = conv->n_channels;
+
+	for(i = 0; i < n_channels; i++)
+		conv_f32d_to_s16_dither_1s_avx2(conv, &d[i], &src[i], n_channels, n_samples);
+}
+
+/* The error feedback makes every sample depend on the previous one so the
+ * lanes hold up to 8 channels of the same frame instead. */
+static void
+conv_f32d_to_s16_shaped_8s_avx2(void *data, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		float *err, uint32_t n_lanes, uint32_t n_channels, uint32_t n_samples)
+{
+	struct convert *conv = data;
+	const float *s[8];
+	int16_t *d = dst;
+	uint32_t i, n;
+	__m256 in, e;
+	__m256i out, rnd;
+	__m128i t;
+	__m256 int_max = _mm256_set1_ps(S16_MAX_F);
+	__m256 int_min = _mm256_sub_ps(_mm256_setzero_ps(), int_max);
+	float t_err[8];
+	int16_t t_out[8];
+
+	/* unused lanes repeat the first channel and are not stored */
+	for (i = 0; i < 8; i++) {
+		s[i] = src[i < n_lanes ? i : 0];
+		t_err[i] = i < n_lanes ? err[i] : 0.0f;
+	}
+	e = _mm256_loadu_ps(t_err);
+
+	rnd = _mm256_loadu_si256((__m256i*)conv->random);
+	for(n = 0; n < n_samples; n++) {
+		in = _mm256_setr_ps(s[0][n], s[1][n], s[2][n], s[3][n],
+				s[4][n], s[5][n], s[6][n], s[7][n]);
+		in = _mm256_sub_ps(_mm256_mul_ps(in, int_max), e);
+		in = _mm256_min_ps(int_max, _mm256_max_ps(in, int_min));
+		e = _mm256_add_ps(in, dither_tpdf_avx2(&rnd));
+		e = _mm256_min_ps(int_max, _mm256_max_ps(e, int_min));
+		out = _mm256_cvtps_epi32(e);
+		e = _mm256_sub_ps(_mm256_cvtepi32_ps(out), in);
+		t = _mm_packs_epi32(_mm256_castsi256_si128(out), _mm256_extracti128_si256(out, 1));
+
+		if (n_lanes == 8) {
+			_mm_storeu_si128((__m128i*)d, t);
+		} else {
+			_mm_storeu_si128((__m128i*)t_out, t);
+			for (i = 0; i < n_lanes; i++)
+				d[i] = t_out[i];
+		}
+		d += n_channels;
+	}
+	_mm256_storeu_si256((__m256i*)conv->random, rnd);
+
+	_mm256_storeu_ps(t_err, e);
+	for (i = 0; i < n_lanes; i++)
+		err[i] = t_err[i];
+}
+
+void
+conv_f32d_to_s16_shaped_avx2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	int16_t *d = dst[0];
+	uint32_t i, n_channels = conv->n_channels;
+
+	for(i = 0; i < n_channels; i += 8)
+		conv_f32d_to_s16_shaped_8s_avx2(conv, &d[i], &src[i], &conv->ns_data[i],
+				SPA_MIN(n_channels - i, 8u), n_channels, n_samples);
+}
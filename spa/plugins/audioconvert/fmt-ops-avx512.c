@@ -0,0 +1,597 @@
+/* Spa
+ *
+ * Copyright © 2018 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "fmt-ops.h"
+
+#include <immintrin.h>
+
+/* The planar buffers are only guaranteed to be 16 bytes aligned so all
+ * vector loads and stores are unaligned. Interleaved samples are accessed
+ * with gather and scatter on a stride of n_channels. */
+
+static inline __m512i stride_index(uint32_t stride)
+{
+	return _mm512_mullo_epi32(
+			_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7,
+				8, 9, 10, 11, 12, 13, 14, 15),
+			_mm512_set1_epi32(stride));
+}
+
+static void
+conv_s16_to_f32d_1s_avx512(void *data, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src,
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const int16_t *s = src;
+	float *d0 = dst[0];
+	uint32_t n, unrolled;
+	__m512i in, idx = stride_index(n_channels);
+	__m512 factor = _mm512_set1_ps(1.0f / S16_SCALE);
+
+	/* the gather reads 32 bits, keep the last frame out of it */
+	unrolled = n_samples > 0 ? (n_samples - 1) & ~15 : 0;
+
+	for(n = 0; n < unrolled; n += 16) {
+		in = _mm512_i32gather_epi32(idx, s, 2);
+		in = _mm512_srai_epi32(_mm512_slli_epi32(in, 16), 16);
+		_mm512_storeu_ps(&d0[n], _mm512_mul_ps(_mm512_cvtepi32_ps(in), factor));
+		s += 16*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		d0[n] = S16_TO_F32(*s);
+		s += n_channels;
+	}
+}
+
+static void
+conv_s16_to_f32d_2s_avx512(void *data, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src,
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const int16_t *s = src;
+	float *d0 = dst[0], *d1 = dst[1];
+	uint32_t n, unrolled;
+	__m512i in, lo, hi, idx = stride_index(n_channels);
+	__m512 factor = _mm512_set1_ps(1.0f / S16_SCALE);
+
+	unrolled = n_samples & ~15;
+
+	for(n = 0; n < unrolled; n += 16) {
+		in = _mm512_i32gather_epi32(idx, s, 2);
+		lo = _mm512_srai_epi32(_mm512_slli_epi32(in, 16), 16);
+		hi = _mm512_srai_epi32(in, 16);
+		_mm512_storeu_ps(&d0[n], _mm512_mul_ps(_mm512_cvtepi32_ps(lo), factor));
+		_mm512_storeu_ps(&d1[n], _mm512_mul_ps(_mm512_cvtepi32_ps(hi), factor));
+		s += 16*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		d0[n] = S16_TO_F32(s[0]);
+		d1[n] = S16_TO_F32(s[1]);
+		s += n_channels;
+	}
+}
+
+void
+conv_s16_to_f32d_avx512(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const int16_t *s = src[0];
+	uint32_t i = 0, n_channels = conv->n_channels;
+
+	for(; i + 1 < n_channels; i += 2)
+		conv_s16_to_f32d_2s_avx512(conv, &dst[i], &s[i], n_channels, n_samples);
+	for(; i < n_channels; i++)
+		conv_s16_to_f32d_1s_avx512(conv, &dst[i], &s[i], n_channels, n_samples);
+}
+
+static void
+conv_s24_to_f32d_1s_avx512(void *data, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src,
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const uint8_t *s = src;
+	float *d0 = dst[0];
+	uint32_t n, unrolled;
+	__m512i in, idx = stride_index(n_channels * 3);
+	__m512 factor = _mm512_set1_ps(1.0f / S24_SCALE);
+
+	/* the gather reads 32 bits, keep the last frame out of it */
+	unrolled = n_samples > 0 ? (n_samples - 1) & ~15 : 0;
+
+	for(n = 0; n < unrolled; n += 16) {
+		in = _mm512_i32gather_epi32(idx, s, 1);
+		in = _mm512_srai_epi32(_mm512_slli_epi32(in, 8), 8);
+		_mm512_storeu_ps(&d0[n], _mm512_mul_ps(_mm512_cvtepi32_ps(in), factor));
+		s += 16*n_channels*3;
+	}
+	for(; n < n_samples; n++) {
+		d0[n] = S24_TO_F32(read_s24(s));
+		s += n_channels*3;
+	}
+}
+
+void
+conv_s24_to_f32d_avx512(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const int8_t *s = src[0];
+	uint32_t i, n_channels = conv->n_channels;
+
+	for(i = 0; i < n_channels; i++)
+		conv_s24_to_f32d_1s_avx512(conv, &dst[i], &s[i*3], n_channels, n_samples);
+}
+
+static void
+conv_s32_to_f32d_1s_avx512(void *data, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src,
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const int32_t *s = src;
+	float *d0 = dst[0];
+	uint32_t n, unrolled;
+	__m512i in, idx = stride_index(n_channels);
+	__m512 factor = _mm512_set1_ps(1.0f / S24_SCALE);
+
+	unrolled = n_samples & ~15;
+
+	for(n = 0; n < unrolled; n += 16) {
+		in = _mm512_i32gather_epi32(idx, s, 4);
+		in = _mm512_srai_epi32(in, 8);
+		_mm512_storeu_ps(&d0[n], _mm512_mul_ps(_mm512_cvtepi32_ps(in), factor));
+		s += 16*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		d0[n] = S32_TO_F32(*s);
+		s += n_channels;
+	}
+}
+
+void
+conv_s32_to_f32d_avx512(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const int32_t *s = src[0];
+	uint32_t i, n_channels = conv->n_channels;
+
+	for(i = 0; i < n_channels; i++)
+		conv_s32_to_f32d_1s_avx512(conv, &dst[i], &s[i], n_channels, n_samples);
+}
+
+static void
+conv_f32d_to_s32_1s_avx512(void *data, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const float *s0 = src[0];
+	int32_t *d = dst;
+	uint32_t n, unrolled;
+	uint32_t i;
+	__m512 in;
+	__m512 scale = _mm512_set1_ps(S32_SCALE);
+	__m512 int_min = _mm512_set1_ps(S32_MIN);
+	int32_t t[16];
+	__m128 v;
+
+	unrolled = n_samples & ~15;
+
+	for(n = 0; n < unrolled; n += 16) {
+		in = _mm512_mul_ps(_mm512_loadu_ps(&s0[n]), scale);
+		in = _mm512_min_ps(in, int_min);
+		/* a 32 bit scatter is slower than plain stores here */
+		_mm512_storeu_si512((__m512i*)t, _mm512_cvtps_epi32(in));
+		for (i = 0; i < 16; i++) {
+			*d = t[i];
+			d += n_channels;
+		}
+	}
+	for(; n < n_samples; n++) {
+		v = _mm_mul_ss(_mm_load_ss(&s0[n]), _mm512_castps512_ps128(scale));
+		v = _mm_min_ss(v, _mm512_castps512_ps128(int_min));
+		*d = _mm_cvtss_si32(v);
+		d += n_channels;
+	}
+}
+
+static inline void store_4x16_avx512(int32_t *d, uint32_t stride, __m512i in[4])
+{
+	__m512i t[4], r[4];
+	uint32_t k;
+
+	/* transpose the 4x4 blocks in each 128 bit lane, lane l of r[k] then
+	 * holds the 4 channels of frame 4*l + k */
+	t[0] = _mm512_unpacklo_epi32(in[0], in[1]);
+	t[1] = _mm512_unpackhi_epi32(in[0], in[1]);
+	t[2] = _mm512_unpacklo_epi32(in[2], in[3]);
+	t[3] = _mm512_unpackhi_epi32(in[2], in[3]);
+	r[0] = _mm512_unpacklo_epi64(t[0], t[2]);
+	r[1] = _mm512_unpackhi_epi64(t[0], t[2]);
+	r[2] = _mm512_unpacklo_epi64(t[1], t[3]);
+	r[3] = _mm512_unpackhi_epi64(t[1], t[3]);
+
+	for (k = 0; k < 4; k++) {
+		_mm_storeu_si128((__m128i*)&d[(k + 0) * stride], _mm512_extracti32x4_epi32(r[k], 0));
+		_mm_storeu_si128((__m128i*)&d[(k + 4) * stride], _mm512_extracti32x4_epi32(r[k], 1));
+		_mm_storeu_si128((__m128i*)&d[(k + 8) * stride], _mm512_extracti32x4_epi32(r[k], 2));
+		_mm_storeu_si128((__m128i*)&d[(k + 12) * stride], _mm512_extracti32x4_epi32(r[k], 3));
+	}
+}
+
+static void
+conv_f32d_to_s32_4s_avx512(void *data, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const float *s0 = src[0], *s1 = src[1], *s2 = src[2], *s3 = src[3];
+	int32_t *d = dst;
+	uint32_t n, unrolled;
+	__m512 scale = _mm512_set1_ps(S32_SCALE);
+	__m512 int_min = _mm512_set1_ps(S32_MIN);
+	__m512i out[4];
+	__m128 v[4];
+
+	unrolled = n_samples & ~15;
+
+	for(n = 0; n < unrolled; n += 16) {
+		out[0] = _mm512_cvtps_epi32(_mm512_min_ps(_mm512_mul_ps(_mm512_loadu_ps(&s0[n]), scale), int_min));
+		out[1] = _mm512_cvtps_epi32(_mm512_min_ps(_mm512_mul_ps(_mm512_loadu_ps(&s1[n]), scale), int_min));
+		out[2] = _mm512_cvtps_epi32(_mm512_min_ps(_mm512_mul_ps(_mm512_loadu_ps(&s2[n]), scale), int_min));
+		out[3] = _mm512_cvtps_epi32(_mm512_min_ps(_mm512_mul_ps(_mm512_loadu_ps(&s3[n]), scale), int_min));
+		store_4x16_avx512(d, n_channels, out);
+		d += 16*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		v[0] = _mm_load_ss(&s0[n]);
+		v[1] = _mm_load_ss(&s1[n]);
+		v[2] = _mm_load_ss(&s2[n]);
+		v[3] = _mm_load_ss(&s3[n]);
+		v[0] = _mm_min_ss(_mm_mul_ss(v[0], _mm512_castps512_ps128(scale)), _mm512_castps512_ps128(int_min));
+		v[1] = _mm_min_ss(_mm_mul_ss(v[1], _mm512_castps512_ps128(scale)), _mm512_castps512_ps128(int_min));
+		v[2] = _mm_min_ss(_mm_mul_ss(v[2], _mm512_castps512_ps128(scale)), _mm512_castps512_ps128(int_min));
+		v[3] = _mm_min_ss(_mm_mul_ss(v[3], _mm512_castps512_ps128(scale)), _mm512_castps512_ps128(int_min));
+		d[0] = _mm_cvtss_si32(v[0]);
+		d[1] = _mm_cvtss_si32(v[1]);
+		d[2] = _mm_cvtss_si32(v[2]);
+		d[3] = _mm_cvtss_si32(v[3]);
+		d += n_channels;
+	}
+}
+
+void
+conv_f32d_to_s32_avx512(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	int32_t *d = dst[0];
+	uint32_t i = 0, n_channels = conv->n_channels;
+
+	for(; i + 3 < n_channels; i += 4)
+		conv_f32d_to_s32_4s_avx512(conv, &d[i], &src[i], n_channels, n_samples);
+	for(; i < n_channels; i++)
+		conv_f32d_to_s32_1s_avx512(conv, &d[i], &src[i], n_channels, n_samples);
+}
+
+static inline __m512i f32_to_s24_avx512(__m512 in, __m512 scale, __m512 max, __m512 min)
+{
+	in = _mm512_min_ps(max, _mm512_max_ps(in, min));
+	/* truncate like F32_TO_S24 */
+	return _mm512_cvttps_epi32(_mm512_mul_ps(in, scale));
+}
+
+/* convert n_samples, a multiple of 16, from offset to interleaved 32 bits */
+static void
+conv_f32d_to_s24_32_avx512(int32_t *d, const float *src[], uint32_t offset,
+		uint32_t n_channels, uint32_t n_samples)
+{
+	uint32_t i = 0, n, k;
+	__m512 scale = _mm512_set1_ps(S24_SCALE);
+	__m512 max = _mm512_set1_ps(1.0f);
+	__m512 min = _mm512_set1_ps(-1.0f);
+	__m512i out[4];
+	int32_t t[16];
+
+	for(; i + 3 < n_channels; i += 4) {
+		const float *s0 = &src[i][offset], *s1 = &src[i+1][offset];
+		const float *s2 = &src[i+2][offset], *s3 = &src[i+3][offset];
+
+		for(n = 0; n < n_samples; n += 16) {
+			out[0] = f32_to_s24_avx512(_mm512_loadu_ps(&s0[n]), scale, max, min);
+			out[1] = f32_to_s24_avx512(_mm512_loadu_ps(&s1[n]), scale, max, min);
+			out[2] = f32_to_s24_avx512(_mm512_loadu_ps(&s2[n]), scale, max, min);
+			out[3] = f32_to_s24_avx512(_mm512_loadu_ps(&s3[n]), scale, max, min);
+			store_4x16_avx512(&d[n * n_channels + i], n_channels, out);
+		}
+	}
+	for(; i < n_channels; i++) {
+		const float *s0 = &src[i][offset];
+
+		for(n = 0; n < n_samples; n += 16) {
+			_mm512_storeu_si512((__m512i*)t,
+					f32_to_s24_avx512(_mm512_loadu_ps(&s0[n]), scale, max, min));
+			for (k = 0; k < 16; k++)
+				d[(n + k) * n_channels + i] = t[k];
+		}
+	}
+}
+
+/* pack n_samples 32 bit samples to 24 bits */
+static void pack_s24_avx512(uint8_t *d, const int32_t *s, uint32_t n_samples)
+{
+	const __m128i mask = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14,
+			-1, -1, -1, -1);
+	uint32_t n = 0;
+
+	/* each store writes 4 bytes past the 4 samples, the next store
+	 * overwrites them. Keep 2 samples for the end so that they stay
+	 * in the buffer. */
+	for(; n + 6 <= n_samples; n += 4) {
+		__m128i in = _mm_loadu_si128((const __m128i*)&s[n]);
+		_mm_storeu_si128((__m128i*)d, _mm_shuffle_epi8(in, mask));
+		d += 12;
+	}
+	for(; n < n_samples; n++) {
+		write_s24(d, s[n]);
+		d += 3;
+	}
+}
+
+void
+conv_f32d_to_s24_avx512(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const float **s = (const float **) src;
+	uint8_t *d = dst[0];
+	uint32_t i, n, chunk, todo, unrolled, n_channels = conv->n_channels;
+	int32_t t[1024];
+
+	chunk = (SPA_N_ELEMENTS(t) / n_channels) & ~15;
+	if (SPA_UNLIKELY(chunk == 0)) {
+		conv_f32d_to_s24_c(conv, dst, src, n_samples);
+		return;
+	}
+	unrolled = n_samples & ~15;
+
+	for(n = 0; n < unrolled; n += todo) {
+		todo = SPA_MIN(unrolled - n, chunk);
+		conv_f32d_to_s24_32_avx512(t, s, n, n_channels, todo);
+		pack_s24_avx512(d, t, todo * n_channels);
+		d += todo * n_channels * 3;
+	}
+	for(; n < n_samples; n++) {
+		for (i = 0; i < n_channels; i++) {
+			write_s24(d, F32_TO_S24(s[i][n]));
+			d += 3;
+		}
+	}
+}
+
+static inline __m512i f32_to_s16_avx512(__m512 in, __m512 int_max, __m512 int_min)
+{
+	in = _mm512_mul_ps(in, int_max);
+	in = _mm512_min_ps(int_max, _mm512_max_ps(in, int_min));
+	return _mm512_cvtps_epi32(in);
+}
+
+static inline int16_t f32_to_s16_avx512_ss(float v)
+{
+	__m128 int_max = _mm_set1_ps(S16_MAX_F);
+	__m128 int_min = _mm_sub_ps(_mm_setzero_ps(), int_max);
+	__m128 in = _mm_mul_ss(_mm_load_ss(&v), int_max);
+	in = _mm_min_ss(int_max, _mm_max_ss(in, int_min));
+	return _mm_cvtss_si32(in);
+}
+
+static void
+conv_f32d_to_s16_1s_avx512(void *data, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const float *s0 = src[0];
+	int16_t *d = dst;
+	uint32_t n, i, unrolled;
+	__m512 int_max = _mm512_set1_ps(S16_MAX_F);
+	__m512 int_min = _mm512_sub_ps(_mm512_setzero_ps(), int_max);
+	int16_t t[16];
+
+	unrolled = n_samples & ~15;
+
+	for(n = 0; n < unrolled; n += 16) {
+		_mm256_storeu_si256((__m256i*)t, _mm512_cvtepi32_epi16(
+				f32_to_s16_avx512(_mm512_loadu_ps(&s0[n]), int_max, int_min)));
+		for (i = 0; i < 16; i++) {
+			*d = t[i];
+			d += n_channels;
+		}
+	}
+	for(; n < n_samples; n++) {
+		*d = f32_to_s16_avx512_ss(s0[n]);
+		d += n_channels;
+	}
+}
+
+static void
+conv_f32d_to_s16_2s_avx512(void *data, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const float *s0 = src[0], *s1 = src[1];
+	int16_t *d = dst;
+	uint32_t n, unrolled;
+	__m512i out[2];
+	__m512 int_max = _mm512_set1_ps(S16_MAX_F);
+	__m512 int_min = _mm512_sub_ps(_mm512_setzero_ps(), int_max);
+	__m512i mask = _mm512_set1_epi32(0xffff);
+	__m512i idx = stride_index(n_channels);
+
+	unrolled = n_samples & ~15;
+
+	for(n = 0; n < unrolled; n += 16) {
+		out[0] = f32_to_s16_avx512(_mm512_loadu_ps(&s0[n]), int_max, int_min);
+		out[1] = f32_to_s16_avx512(_mm512_loadu_ps(&s1[n]), int_max, int_min);
+		/* both channels of a frame are written with one 32 bit store */
+		out[0] = _mm512_or_si512(_mm512_and_si512(out[0], mask),
+				_mm512_slli_epi32(out[1], 16));
+		_mm512_i32scatter_epi32(d, idx, out[0], 2);
+		d += 16*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		d[0] = f32_to_s16_avx512_ss(s0[n]);
+		d[1] = f32_to_s16_avx512_ss(s1[n]);
+		d += n_channels;
+	}
+}
+
+void
+conv_f32d_to_s16_avx512(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	int16_t *d = dst[0];
+	uint32_t i = 0, n_channels = conv->n_channels;
+
+	for(; i + 1 < n_channels; i += 2)
+		conv_f32d_to_s16_2s_avx512(conv, &d[i], &src[i], n_channels, n_samples);
+	for(; i < n_channels; i++)
+		conv_f32d_to_s16_1s_avx512(conv, &d[i], &src[i], n_channels, n_samples);
+}
+
+static void
+conv_deinterleave_32_2_avx512(void *data, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src,
+		uint32_t n_samples)
+{
+	const float *s = src;
+	float *d0 = dst[0], *d1 = dst[1];
+	uint32_t n, unrolled;
+	__m512 in[2];
+	__m512i even = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14,
+			16, 18, 20, 22, 24, 26, 28, 30);
+	__m512i odd = _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15,
+			17, 19, 21, 23, 25, 27, 29, 31);
+
+	unrolled = n_samples & ~15;
+
+	for(n = 0; n < unrolled; n += 16) {
+		in[0] = _mm512_loadu_ps(&s[0]);
+		in[1] = _mm512_loadu_ps(&s[16]);
+		_mm512_storeu_ps(&d0[n], _mm512_permutex2var_ps(in[0], even, in[1]));
+		_mm512_storeu_ps(&d1[n], _mm512_permutex2var_ps(in[0], odd, in[1]));
+		s += 32;
+	}
+	for(; n < n_samples; n++) {
+		d0[n] = s[0];
+		d1[n] = s[1];
+		s += 2;
+	}
+}
+
+static void
+conv_deinterleave_32_1s_avx512(void *data, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src,
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const float *s = src;
+	float *d0 = dst[0];
+	uint32_t n, unrolled;
+	__m512i idx = stride_index(n_channels);
+
+	unrolled = n_samples & ~15;
+
+	for(n = 0; n < unrolled; n += 16) {
+		_mm512_storeu_ps(&d0[n], _mm512_i32gather_ps(idx, s, 4));
+		s += 16*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		d0[n] = *s;
+		s += n_channels;
+	}
+}
+
+void
+conv_deinterleave_32_avx512(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const float *s = src[0];
+	uint32_t i, n_channels = conv->n_channels;
+
+	if (n_channels == 2) {
+		conv_deinterleave_32_2_avx512(conv, dst, s, n_samples);
+		return;
+	}
+	for(i = 0; i < n_channels; i++)
+		conv_deinterleave_32_1s_avx512(conv, &dst[i], &s[i], n_channels, n_samples);
+}
+
+static void
+conv_interleave_32_2_avx512(void *data, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const float *s0 = src[0], *s1 = src[1];
+	float *d = dst;
+	uint32_t n, unrolled;
+	__m512 in[2];
+	__m512i lo = _mm512_setr_epi32(0, 16, 1, 17, 2, 18, 3, 19,
+			4, 20, 5, 21, 6, 22, 7, 23);
+	__m512i hi = _mm512_setr_epi32(8, 24, 9, 25, 10, 26, 11, 27,
+			12, 28, 13, 29, 14, 30, 15, 31);
+
+	unrolled = n_samples & ~15;
+
+	for(n = 0; n < unrolled; n += 16) {
+		in[0] = _mm512_loadu_ps(&s0[n]);
+		in[1] = _mm512_loadu_ps(&s1[n]);
+		_mm512_storeu_ps(&d[0], _mm512_permutex2var_ps(in[0], lo, in[1]));
+		_mm512_storeu_ps(&d[16], _mm512_permutex2var_ps(in[0], hi, in[1]));
+		d += 32;
+	}
+	for(; n < n_samples; n++) {
+		d[0] = s0[n];
+		d[1] = s1[n];
+		d += 2;
+	}
+}
+
+static void
+conv_interleave_32_1s_avx512(void *data, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const float *s0 = src[0];
+	float *d = dst;
+	uint32_t n, unrolled;
+	__m512i idx = stride_index(n_channels);
+
+	unrolled = n_samples & ~15;
+
+	for(n = 0; n < unrolled; n += 16) {
+		_mm512_i32scatter_ps(d, idx, _mm512_loadu_ps(&s0[n]), 4);
+		d += 16*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		*d = s0[n];
+		d += n_channels;
+	}
+}
+
+void
+conv_interleave_32_avx512(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	float *d = dst[0];
+	uint32_t i, n_channels = conv->n_channels;
+
+	if (n_channels == 2) {
+		conv_interleave_32_2_avx512(conv, d, src, n_samples);
+		return;
+	}
+	for(i = 0; i < n_channels; i++)
+		conv_interleave_32_1s_avx512(conv, &d[i], &src[i], n_channels, n_samples);
+}
@@ -812,3 +812,134 @@ conv_f32d_to_s16_2_sse2(struct convert *conv, void * SPA_RESTRICT dst[], const v
 		d += 2;
 	}
 }
+
+/* 4 lanes of xorshift32, returns TPDF dither in (-1.0, 1.0) */
+static inline __m128 dither_tpdf_sse2(__m128i *state)
+{
+	__m128i x = *state;
+	x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+	x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+	x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+	*state = x;
+	x = _mm_sub_epi32(_mm_and_si128(x, _mm_set1_epi32(0xffff)), _mm_srli_epi32(x, 16));
+	return _mm_mul_ps(_mm_cvtepi32_ps(x), _mm_set1_ps(DITHER_SCALE));
+}
+
+static void
+conv_f32d_to_s16_dither_1s_sse2(void *data, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_channels, uint32_t n_samples)
+{
+	struct convert *conv = data;
+	const float *s0 = src[0];
+	int16_t *d = dst;
+	uint32_t n, unrolled;
+	__m128 in[2];
+	__m128i out[2], rnd;
+	__m128 int_max = _mm_set1_ps(S16_MAX_F);
+	__m128 int_min = _mm_sub_ps(_mm_setzero_ps(), int_max);
+
+	unrolled = n_samples & ~7;
+
+	rnd = _mm_loadu_si128((__m128i*)conv->random);
+	for(n = 0; n < unrolled; n += 8) {
+		in[0] = _mm_mul_ps(_mm_loadu_ps(&s0[n]), int_max);
+		in[1] = _mm_mul_ps(_mm_loadu_ps(&s0[n+4]), int_max);
+		in[0] = _mm_add_ps(in[0], dither_tpdf_sse2(&rnd));
+		in[1] = _mm_add_ps(in[1], dither_tpdf_sse2(&rnd));
+		in[0] = _mm_min_ps(int_max, _mm_max_ps(in[0], int_min));
+		in[1] = _mm_min_ps(int_max, _mm_max_ps(in[1], int_min));
+		out[0] = _mm_cvtps_epi32(in[0]);
+		out[1] = _mm_cvtps_epi32(in[1]);
+		out[0] = _mm_packs_epi32(out[0], out[1]);
+
+		d[0*n_channels] = _mm_extract_epi16(out[0], 0);
+		d[1*n_channels] = _mm_extract_epi16(out[0], 1);
+		d[2*n_channels] = _mm_extract_epi16(out[0], 2);
+		d[3*n_channels] = _mm_extract_epi16(out[0], 3);
+		d[4*n_channels] = _mm_extract_epi16(out[0], 4);
+		d[5*n_channels] = _mm_extract_epi16(out[0], 5);
+		d[6*n_channels] = _mm_extract_epi16(out[0], 6);
+		d[7*n_channels] = _mm_extract_epi16(out[0], 7);
+		d += 8*n_channels;
+	}
+	_mm_storeu_si128((__m128i*)conv->random, rnd);
+
+	for(; n < n_samples; n++) {
+		*d = f32_to_s16_dither(s0[n], &conv->random[0]);
+		d += n_channels;
+	}
+}
+
+void
+conv_f32d_to_s16_dither_sse2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	int16_t *d = dst[0];
+	uint32_t i, n_channels = conv->n_channels;
+
+	for(i = 0; i < n_channels; i++)
+		conv_f32d_to_s16_dither_1s_sse2(conv, &d[i], &src[i], n_channels, n_samples);
+}
+
+/* The error feedback makes every sample depend on the previous one so the
+ * lanes hold up to 4 channels of the same frame instead. */
+static void
+conv_f32d_to_s16_shaped_4s_sse2(void *data, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		float *err, uint32_t n_lanes, uint32_t n_channels, uint32_t n_samples)
+{
+	struct convert *conv = data;
+	const float *s[4];
+	int16_t *d = dst;
+	uint32_t i, n;
+	__m128 in, e;
+	__m128i out, rnd;
+	__m128 int_max = _mm_set1_ps(S16_MAX_F);
+	__m128 int_min = _mm_sub_ps(_mm_setzero_ps(), int_max);
+	float t_err[4];
+	int16_t t[8];
+
+	/* unused lanes repeat the first channel and are not stored */
+	for (i = 0; i < 4; i++) {
+		s[i] = src[i < n_lanes ? i : 0];
+		t_err[i] = i < n_lanes ? err[i] : 0.0f;
+	}
+	e = _mm_loadu_ps(t_err);
+
+	rnd = _mm_loadu_si128((__m128i*)conv->random);
+	for(n = 0; n < n_samples; n++) {
+		in = _mm_setr_ps(s[0][n], s[1][n], s[2][n], s[3][n]);
+		in = _mm_sub_ps(_mm_mul_ps(in, int_max), e);
+		in = _mm_min_ps(int_max, _mm_max_ps(in, int_min));
+		e = _mm_add_ps(in, dither_tpdf_sse2(&rnd));
+		e = _mm_min_ps(int_max, _mm_max_ps(e, int_min));
+		out = _mm_cvtps_epi32(e);
+		e = _mm_sub_ps(_mm_cvtepi32_ps(out), in);
+		out = _mm_packs_epi32(out, out);
+
+		if (n_lanes == 4) {
+			_mm_storel_epi64((__m128i*)d, out);
+		} else {
+			_mm_storeu_si128((__m128i*)t, out);
+			for (i = 0; i < n_lanes; i++)
+				d[i] = t[i];
+		}
+		d += n_channels;
+	}
+	_mm_storeu_si128((__m128i*)conv->random, rnd);
+
+	_mm_storeu_ps(t_err, e);
+	for (i = 0; i < n_lanes; i++)
+		err[i] = t_err[i];
+}
+
+void
+conv_f32d_to_s16_shaped_sse2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	int16_t *d = dst[0];
+	uint32_t i, n_channels = conv->n_channels;
+
+	for(i = 0; i < n_channels; i += 4)
+		conv_f32d_to_s16_shaped_4s_sse2(conv, &d[i], &src[i], &conv->ns_data[i],
+				SPA_MIN(n_channels - i, 4u), n_channels, n_samples);
+}
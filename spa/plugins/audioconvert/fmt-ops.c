@@ -42,6 +42,7 @@ struct conv_info {
 	uint32_t cpu_flags;
 
 	convert_func_t process;
+	uint32_t dither_method;
 };
 
 static struct conv_info conv_table[] =
@@ -58,6 +59,9 @@ static struct conv_info conv_table[] =
 #if defined (HAVE_NEON)
 	{ SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_NEON, conv_s16_to_f32d_neon },
 #endif
+#if defined (HAVE_AVX512F)
+	{ SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_AVX512, conv_s16_to_f32d_avx512 },
+#endif
 #if defined (HAVE_AVX2)
 	{ SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_F32P, 2, SPA_CPU_FLAG_AVX2, conv_s16_to_f32d_2_avx2 },
 	{ SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_AVX2, conv_s16_to_f32d_avx2 },
@@ -71,9 +75,18 @@ static struct conv_info conv_table[] =
 
 	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_F32, 0, 0, conv_copy32_c },
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F32P, 0, 0, conv_copy32d_c },
+#if defined (HAVE_AVX512F)
+	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_AVX512, conv_deinterleave_32_avx512 },
+#endif
 	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_F32P, 0, 0, conv_deinterleave_32_c },
+#if defined (HAVE_AVX512F)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F32, 0, SPA_CPU_FLAG_AVX512, conv_interleave_32_avx512 },
+#endif
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F32, 0, 0, conv_interleave_32_c },
 
+#if defined (HAVE_AVX512F)
+	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_AVX512, conv_s32_to_f32d_avx512 },
+#endif
 #if defined (HAVE_AVX2)
 	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_AVX2, conv_s32_to_f32d_avx2 },
 #endif
@@ -87,6 +100,9 @@ static struct conv_info conv_table[] =
 
 	{ SPA_AUDIO_FORMAT_S24, SPA_AUDIO_FORMAT_F32, 0, 0, conv_s24_to_f32_c },
 	{ SPA_AUDIO_FORMAT_S24P, SPA_AUDIO_FORMAT_F32P, 0, 0, conv_s24d_to_f32d_c },
+#if defined (HAVE_AVX512F)
+	{ SPA_AUDIO_FORMAT_S24, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_AVX512, conv_s24_to_f32d_avx512 },
+#endif
 #if defined (HAVE_AVX2)
 	{ SPA_AUDIO_FORMAT_S24, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_AVX2, conv_s24_to_f32d_avx2 },
 #endif
@@ -130,6 +146,9 @@ static struct conv_info conv_table[] =
 #if defined (HAVE_NEON)
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16, 0, SPA_CPU_FLAG_NEON, conv_f32d_to_s16_neon },
 #endif
+#if defined (HAVE_AVX512F)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16, 0, SPA_CPU_FLAG_AVX512, conv_f32d_to_s16_avx512 },
+#endif
 #if defined (HAVE_AVX2)
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16, 4, SPA_CPU_FLAG_AVX2, conv_f32d_to_s16_4_avx2 },
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16, 2, SPA_CPU_FLAG_AVX2, conv_f32d_to_s16_2_avx2 },
@@ -140,10 +159,29 @@ static struct conv_info conv_table[] =
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16, 0, SPA_CPU_FLAG_SSE2, conv_f32d_to_s16_sse2 },
 #endif
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16, 0, 0, conv_f32d_to_s16_c },
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16, 0, SPA_CPU_FLAG_AVX2, conv_f32d_to_s16_dither_avx2,
+		DITHER_METHOD_TRIANGULAR },
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16, 0, SPA_CPU_FLAG_AVX2, conv_f32d_to_s16_shaped_avx2,
+		DITHER_METHOD_SHAPED },
+#endif
+#if defined (HAVE_SSE2)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16, 0, SPA_CPU_FLAG_SSE2, conv_f32d_to_s16_dither_sse2,
+		DITHER_METHOD_TRIANGULAR },
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16, 0, SPA_CPU_FLAG_SSE2, conv_f32d_to_s16_shaped_sse2,
+		DITHER_METHOD_SHAPED },
+#endif
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16, 0, 0, conv_f32d_to_s16_dither_c,
+		DITHER_METHOD_TRIANGULAR },
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16, 0, 0, conv_f32d_to_s16_shaped_c,
+		DITHER_METHOD_SHAPED },
 
 	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_S32, 0, 0, conv_f32_to_s32_c },
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S32P, 0, 0, conv_f32d_to_s32d_c },
 	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_S32P, 0, 0, conv_f32_to_s32d_c },
+#if defined (HAVE_AVX512F)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S32, 0, SPA_CPU_FLAG_AVX512, conv_f32d_to_s32_avx512 },
+#endif
 #if defined (HAVE_AVX2)
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S32, 0, SPA_CPU_FLAG_AVX2, conv_f32d_to_s32_avx2 },
 #endif
@@ -155,6 +193,9 @@ static struct conv_info conv_table[] =
 	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_S24, 0, 0, conv_f32_to_s24_c },
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24P, 0, 0, conv_f32d_to_s24d_c },
 	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_S24P, 0, 0, conv_f32_to_s24d_c },
+#if defined (HAVE_AVX512F)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24, 0, SPA_CPU_FLAG_AVX512, conv_f32d_to_s24_avx512 },
+#endif
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24, 0, 0, conv_f32d_to_s24_c },
 
 	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_S24_32, 0, 0, conv_f32_to_s24_32_c },
@@ -177,7 +218,13 @@ static struct conv_info conv_table[] =
 	/* s32 */
 	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_S32, 0, 0, conv_copy32_c },
 	{ SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_S32P, 0, 0, conv_copy32d_c },
+#if defined (HAVE_AVX512F)
+	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_S32P, 0, SPA_CPU_FLAG_AVX512, conv_deinterleave_32_avx512 },
+#endif
 	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_S32P, 0, 0, conv_deinterleave_32_c },
+#if defined (HAVE_AVX512F)
+	{ SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_S32, 0, SPA_CPU_FLAG_AVX512, conv_interleave_32_avx512 },
+#endif
 	{ SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_S32, 0, 0, conv_interleave_32_c },
 
 	/* s24 */
@@ -189,7 +236,13 @@ static struct conv_info conv_table[] =
 	/* s24_32 */
 	{ SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_S24_32, 0, 0, conv_copy32_c },
 	{ SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_S24_32P, 0, 0, conv_copy32d_c },
+#if defined (HAVE_AVX512F)
+	{ SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_S24_32P, 0, SPA_CPU_FLAG_AVX512, conv_deinterleave_32_avx512 },
+#endif
 	{ SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_S24_32P, 0, 0, conv_deinterleave_32_c },
+#if defined (HAVE_AVX512F)
+	{ SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_S24_32, 0, SPA_CPU_FLAG_AVX512, conv_interleave_32_avx512 },
+#endif
 	{ SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_S24_32, 0, 0, conv_interleave_32_c },
 };
 
@@ -197,13 +250,14 @@ static struct conv_info conv_table[] =
 #define MATCH_CPU_FLAGS(a,b)	((a) == 0 || ((a) & (b)) == a)
 
 static const struct conv_info *find_conv_info(uint32_t src_fmt, uint32_t dst_fmt,
-		uint32_t n_channels, uint32_t cpu_flags)
+		uint32_t n_channels, uint32_t cpu_flags, uint32_t dither_method)
 {
 	size_t i;
 
 	for (i = 0; i < SPA_N_ELEMENTS(conv_table); i++) {
 		if (conv_table[i].src_fmt == src_fmt &&
 		    conv_table[i].dst_fmt == dst_fmt &&
+		    conv_table[i].dither_method == dither_method &&
 		    MATCH_CHAN(conv_table[i].n_channels, n_channels) &&
 		    MATCH_CPU_FLAGS(conv_table[i].cpu_flags, cpu_flags))
 			return &conv_table[i];
@@ -220,14 +274,32 @@ int convert_init(struct convert *conv)
 {
 	const struct conv_info *info;
 
-	info = find_conv_info(conv->src_fmt, conv->dst_fmt, conv->n_channels, conv->cpu_flags);
+	info = find_conv_info(conv->src_fmt, conv->dst_fmt, conv->n_channels,
+			conv->cpu_flags, conv->dither_method);
+	/* only some conversions can dither, the others are used as is */
+	if (info == NULL && conv->dither_method != DITHER_METHOD_NONE)
+		info = find_conv_info(conv->src_fmt, conv->dst_fmt, conv->n_channels,
+				conv->cpu_flags, DITHER_METHOD_NONE);
 	if (info == NULL)
 		return -ENOTSUP;
 
 	conv->is_passthrough = conv->src_fmt == conv->dst_fmt;
 	conv->cpu_flags = info->cpu_flags;
+	conv->dither_method = info->dither_method;
 	conv->process = info->process;
 	conv->free = impl_convert_free;
 
+	convert_reset_dither(conv);
+
 	return 0;
 }
+
+void convert_reset_dither(struct convert *conv)
+{
+	uint32_t i;
+
+	for (i = 0; i < SPA_N_ELEMENTS(conv->random); i++)
+		conv->random[i] = 0x9e3779b9u * (i + 1);
+	for (i = 0; i < SPA_N_ELEMENTS(conv->ns_data); i++)
+		conv->ns_data[i] = 0.0f;
+}
@@ -101,25 +101,68 @@ static inline void write_s24s(void *dst, int32_t val)
 #endif
 }
 
+/* xorshift32, good enough for dither and cheap to run in vector lanes */
+static inline uint32_t dither_random(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+/* two 16 bit uniform values from one random word give a triangular
+ * distribution in (-1.0, 1.0) */
+#define DITHER_SCALE	(1.0f / 65536.0f)
+#define DITHER_TPDF(r)	(((int32_t)((r) & 0xffff) - (int32_t)((r) >> 16)) * DITHER_SCALE)
+
+static inline int16_t f32_to_s16_dither(float v, uint32_t *state)
+{
+	v = v * S16_SCALE + DITHER_TPDF(dither_random(state));
+	return lrintf(SPA_CLAMP(v, -S16_MAX_F, S16_MAX_F));
+}
+
+/* feed back the quantization error of the previous sample, this moves the
+ * noise up to the less audible frequencies */
+static inline int16_t f32_to_s16_shaped(float v, float *err, uint32_t *state)
+{
+	int32_t q;
+	v = SPA_CLAMP(v * S16_SCALE - *err, -S16_MAX_F, S16_MAX_F);
+	q = lrintf(SPA_CLAMP(v + DITHER_TPDF(dither_random(state)), -S16_MAX_F, S16_MAX_F));
+	*err = q - v;
+	return q;
+}
+
 #define MAX_NS	64
 
+#define DITHER_METHOD_NONE		0	/**< no dither, the C versions truncate and
+					  *  the SIMD versions round to nearest */
+#define DITHER_METHOD_TRIANGULAR	1	/**< +-1 LSB TPDF dither */
+#define DITHER_METHOD_SHAPED		2	/**< TPDF dither with 1st order noise shaping */
+
+#define DITHER_LANES	8
+
 struct convert {
 	uint32_t src_fmt;
 	uint32_t dst_fmt;
 	uint32_t n_channels;
 	uint32_t cpu_flags;
+	uint32_t dither_method;
 
 	unsigned int is_passthrough:1;
 	float ns_data[MAX_NS];
 	uint32_t ns_idx;
 	uint32_t ns_size;
 
+	uint32_t random[DITHER_LANES];
+
 	void (*process) (struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
 			uint32_t n_samples);
 	void (*free) (struct convert *conv);
 };
 
 int convert_init(struct convert *conv);
+void convert_reset_dither(struct convert *conv);
 
 #define convert_process(conv,...)	(conv)->process(conv, __VA_ARGS__)
 #define convert_free(conv)		(conv)->free(conv)
@@ -165,6 +208,8 @@ DEFINE_FUNCTION(f32d_to_s16d, c);
 DEFINE_FUNCTION(f32_to_s16, c);
 DEFINE_FUNCTION(f32_to_s16d, c);
 DEFINE_FUNCTION(f32d_to_s16, c);
+DEFINE_FUNCTION(f32d_to_s16_dither, c);
+DEFINE_FUNCTION(f32d_to_s16_shaped, c);
 DEFINE_FUNCTION(f32d_to_s32d, c);
 DEFINE_FUNCTION(f32_to_s32, c);
 DEFINE_FUNCTION(f32_to_s32d, c);
@@ -200,6 +245,8 @@ DEFINE_FUNCTION(f32_to_s16, sse2);
 DEFINE_FUNCTION(f32d_to_s16_2, sse2);
 DEFINE_FUNCTION(f32d_to_s16, sse2);
 DEFINE_FUNCTION(f32d_to_s16d, sse2);
+DEFINE_FUNCTION(f32d_to_s16_dither, sse2);
+DEFINE_FUNCTION(f32d_to_s16_shaped, sse2);
 #endif
 #if defined(HAVE_SSSE3)
 DEFINE_FUNCTION(s24_to_f32d, ssse3);
@@ -216,4 +263,16 @@ DEFINE_FUNCTION(f32d_to_s32, avx2);
 DEFINE_FUNCTION(f32d_to_s16_4, avx2);
 DEFINE_FUNCTION(f32d_to_s16_2, avx2);
 DEFINE_FUNCTION(f32d_to_s16, avx2);
+DEFINE_FUNCTION(f32d_to_s16_dither, avx2);
+DEFINE_FUNCTION(f32d_to_s16_shaped, avx2);
+#endif
+#if defined(HAVE_AVX512F)
+DEFINE_FUNCTION(s16_to_f32d, avx512);
+DEFINE_FUNCTION(s24_to_f32d, avx512);
+DEFINE_FUNCTION(s32_to_f32d, avx512);
+DEFINE_FUNCTION(f32d_to_s32, avx512);
+DEFINE_FUNCTION(f32d_to_s24, avx512);
+DEFINE_FUNCTION(f32d_to_s16, avx512);
+DEFINE_FUNCTION(deinterleave_32, avx512);
+DEFINE_FUNCTION(interleave_32, avx512);
 #endif
@@ -90,5 +90,127 @@ static void inner_product_ip_avx(float *d, const float * SPA_RESTRICT s,
 	_mm_store_ss(d, sx[0]);
 }
 
+static inline __m256 load_taps2_avx(const float *taps)
+{
+	__m128 t = _mm_load_ps(taps);
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_unpacklo_ps(t, t)),
+			_mm_unpackhi_ps(t, t), 1);
+}
+
+static void inner_product_interleaved_avx(float *d, const float * SPA_RESTRICT s,
+		const float * SPA_RESTRICT taps, uint32_t n_taps, uint32_t n_channels)
+{
+	__m256 sy[2], ty;
+	__m128 sx;
+	const float *p;
+	uint32_t i, c = 0;
+
+	if (n_channels == 2) {
+		/* duplicate the taps so that four frames are done at once */
+		sy[0] = sy[1] = _mm256_setzero_ps();
+		for (i = 0; i < n_taps; i += 8) {
+			sy[0] = _mm256_fmadd_ps(_mm256_loadu_ps(s + 2 * i + 0),
+					load_taps2_avx(taps + i + 0), sy[0]);
+			sy[1] = _mm256_fmadd_ps(_mm256_loadu_ps(s + 2 * i + 8),
+					load_taps2_avx(taps + i + 4), sy[1]);
+		}
+		sy[0] = _mm256_add_ps(sy[0], sy[1]);
+		sx = _mm_add_ps(_mm256_extractf128_ps(sy[0], 0), _mm256_extractf128_ps(sy[0], 1));
+		sx = _mm_add_ps(sx, _mm_movehl_ps(sx, sx));
+		_mm_storel_pi((__m64*)d, sx);
+		return;
+	}
+	for (; c + 16 <= n_channels; c += 16) {
+		sy[0] = sy[1] = _mm256_setzero_ps();
+		for (i = 0, p = s + c; i < n_taps; i++, p += n_channels) {
+			ty = _mm256_broadcast_ss(taps + i);
+			sy[0] = _mm256_fmadd_ps(_mm256_loadu_ps(p + 0), ty, sy[0]);
+			sy[1] = _mm256_fmadd_ps(_mm256_loadu_ps(p + 8), ty, sy[1]);
+		}
+		_mm256_storeu_ps(d + c + 0, sy[0]);
+		_mm256_storeu_ps(d + c + 8, sy[1]);
+	}
+	for (; c + 8 <= n_channels; c += 8) {
+		sy[0] = _mm256_setzero_ps();
+		for (i = 0, p = s + c; i < n_taps; i++, p += n_channels)
+			sy[0] = _mm256_fmadd_ps(_mm256_loadu_ps(p),
+					_mm256_broadcast_ss(taps + i), sy[0]);
+		_mm256_storeu_ps(d + c, sy[0]);
+	}
+	for (; c + 4 <= n_channels; c += 4) {
+		sx = _mm_setzero_ps();
+		for (i = 0, p = s + c; i < n_taps; i++, p += n_channels)
+			sx = _mm_fmadd_ps(_mm_loadu_ps(p), _mm_broadcast_ss(taps + i), sx);
+		_mm_storeu_ps(d + c, sx);
+	}
+	for (; c < n_channels; c++) {
+		sx = _mm_setzero_ps();
+		for (i = 0, p = s + c; i < n_taps; i++, p += n_channels)
+			sx = _mm_fmadd_ss(_mm_load_ss(p), _mm_load_ss(taps + i), sx);
+		_mm_store_ss(d + c, sx);
+	}
+}
+
+static void inner_product_ip_interleaved_avx(float *d, const float * SPA_RESTRICT s,
+	const float * SPA_RESTRICT t0, const float * SPA_RESTRICT t1, float x,
+	uint32_t n_taps, uint32_t n_channels)
+{
+	__m256 sy[2], ty;
+	__m128 sx[2], tx, vx = _mm_set1_ps(x);
+	const float *p;
+	uint32_t i, c = 0;
+
+	if (n_channels == 2) {
+		sy[0] = sy[1] = _mm256_setzero_ps();
+		for (i = 0; i < n_taps; i += 4) {
+			ty = _mm256_loadu_ps(s + 2 * i);
+			sy[0] = _mm256_fmadd_ps(ty, load_taps2_avx(t0 + i), sy[0]);
+			sy[1] = _mm256_fmadd_ps(ty, load_taps2_avx(t1 + i), sy[1]);
+		}
+		sx[0] = _mm_add_ps(_mm256_extractf128_ps(sy[0], 0), _mm256_extractf128_ps(sy[0], 1));
+		sx[1] = _mm_add_ps(_mm256_extractf128_ps(sy[1], 0), _mm256_extractf128_ps(sy[1], 1));
+		sx[0] = _mm_add_ps(sx[0], _mm_movehl_ps(sx[0], sx[0]));
+		sx[1] = _mm_add_ps(sx[1], _mm_movehl_ps(sx[1], sx[1]));
+		sx[0] = _mm_fmadd_ps(_mm_sub_ps(sx[1], sx[0]), vx, sx[0]);
+		_mm_storel_pi((__m64*)d, sx[0]);
+		return;
+	}
+	for (; c + 8 <= n_channels; c += 8) {
+		sy[0] = sy[1] = _mm256_setzero_ps();
+		for (i = 0, p = s + c; i < n_taps; i++, p += n_channels) {
+			ty = _mm256_loadu_ps(p);
+			sy[0] = _mm256_fmadd_ps(ty, _mm256_broadcast_ss(t0 + i), sy[0]);
+			sy[1] = _mm256_fmadd_ps(ty, _mm256_broadcast_ss(t1 + i), sy[1]);
+		}
+		sy[0] = _mm256_fmadd_ps(_mm256_sub_ps(sy[1], sy[0]),
+				_mm256_set1_ps(x), sy[0]);
+		_mm256_storeu_ps(d + c, sy[0]);
+	}
+	for (; c + 4 <= n_channels; c += 4) {
+		sx[0] = sx[1] = _mm_setzero_ps();
+		for (i = 0, p = s + c; i < n_taps; i++, p += n_channels) {
+			tx = _mm_loadu_ps(p);
+			sx[0] = _mm_fmadd_ps(tx, _mm_broadcast_ss(t0 + i), sx[0]);
+			sx[1] = _mm_fmadd_ps(tx, _mm_broadcast_ss(t1 + i), sx[1]);
+		}
+		sx[0] = _mm_fmadd_ps(_mm_sub_ps(sx[1], sx[0]), vx, sx[0]);
+		_mm_storeu_ps(d + c, sx[0]);
+	}
+	for (; c < n_channels; c++) {
+		sx[0] = sx[1] = _mm_setzero_ps();
+		for (i = 0, p = s + c; i < n_taps; i++, p += n_channels) {
+			tx = _mm_load_ss(p);
+			sx[0] = _mm_fmadd_ss(tx, _mm_load_ss(t0 + i), sx[0]);
+			sx[1] = _mm_fmadd_ss(tx, _mm_load_ss(t1 + i), sx[1]);
+		}
+		sx[0] = _mm_fmadd_ss(_mm_sub_ss(sx[1], sx[0]), vx, sx[0]);
+		_mm_store_ss(d + c, sx[0]);
+	}
+}
+
 MAKE_RESAMPLER_FULL(avx);
 MAKE_RESAMPLER_INTER(avx);
+MAKE_RESAMPLER_FULL_INTERLEAVED(avx);
+MAKE_RESAMPLER_INTER_INTERLEAVED(avx);
+MAKE_RESAMPLER_DRIFT(avx);
+MAKE_RESAMPLER_DRIFT_INTERLEAVED(avx);
@@ -38,8 +38,15 @@ struct resample_info {
 	resample_func_t process_copy;
 	resample_func_t process_full;
 	resample_func_t process_inter;
+	resample_func_t process_full_interleaved;
+	resample_func_t process_inter_interleaved;
+	resample_func_t process_drift;
+	resample_func_t process_drift_interleaved;
 };
 
+/* number of steps between two filter phases in the drift resampler */
+#define DRIFT_STEPS	256
+
 struct native_data {
 	double rate;
 	uint32_t n_taps;
@@ -51,10 +58,17 @@ struct native_data {
 	uint32_t frac;
 	uint32_t filter_stride;
 	uint32_t filter_stride_os;
+	uint32_t blocks;		/* data blocks, 1 when interleaved */
+	uint32_t stride;		/* samples per frame in a block */
 	uint32_t hist;
 	float **history;
 	resample_func_t func;
+	struct filter_bank *bank;
 	float *filter;
+	double drift_scale;		/* phase to drift position */
+	uint32_t drift_pos;		/* drift position of drift_ptr */
+	const float *drift_ptr;
+	float *drift_taps;
 	float *hist_mem;
 	const struct resample_info *info;
 };
@@ -69,7 +83,7 @@ DEFINE_RESAMPLER(copy,arch)							\
 {										\
 	struct native_data *data = r->data;					\
 	uint32_t index, n_taps = data->n_taps, n_taps2 = n_taps/2;		\
-	uint32_t c, olen = *out_len, ilen = *in_len;				\
+	uint32_t c, olen = *out_len, ilen = *in_len, stride = data->stride;	\
 										\
 	if (r->channels == 0)							\
 		return;								\
@@ -78,11 +92,12 @@ DEFINE_RESAMPLER(copy,arch)							\
 	if (ooffs < olen && index + n_taps <= ilen) {				\
 		uint32_t to_copy = SPA_MIN(olen - ooffs,			\
 				ilen - (index + n_taps) + 1);			\
-		for (c = 0; c < r->channels; c++) {				\
+		for (c = 0; c < data->blocks; c++) {				\
 			const float *s = src[c];				\
 			float *d = dst[c];					\
-			spa_memcpy(&d[ooffs], &s[index + n_taps2],		\
-					to_copy * sizeof(float));		\
+			spa_memcpy(&d[ooffs * stride],				\
+					&s[(index + n_taps2) * stride],		\
+					to_copy * stride * sizeof(float));	\
 		}								\
 		index += to_copy;						\
 		ooffs += to_copy;						\
@@ -175,24 +190,230 @@ DEFINE_RESAMPLER(inter,arch)							\
 	data->phase = phase;							\
 }
 
+/* The interleaved resamplers apply one filter phase to all channels of
+ * a frame at once, the inner products work on n_channels samples spaced
+ * n_channels apart. */
+#define MAKE_RESAMPLER_FULL_INTERLEAVED(arch)					\
+DEFINE_RESAMPLER(full_interleaved,arch)						\
+{										\
+	struct native_data *data = r->data;					\
+	uint32_t n_taps = data->n_taps, stride = data->filter_stride_os;	\
+	uint32_t index, phase, n_phases = data->out_rate;			\
+	uint32_t o, olen = *out_len, ilen = *in_len;				\
+	uint32_t inc = data->inc, frac = data->frac;				\
+	uint32_t n_channels = r->channels;					\
+	const float *s = src[0];						\
+	float *d = dst[0];							\
+										\
+	if (n_channels == 0)							\
+		return;								\
+										\
+	index = ioffs;								\
+	phase = data->phase;							\
+										\
+	for (o = ooffs; o < olen && index + n_taps <= ilen; o++) {		\
+		const float *ip, *taps;						\
+										\
+		ip = &s[index * n_channels];					\
+		taps = &data->filter[phase * stride];				\
+		index += inc;							\
+		phase += frac;							\
+		if (phase >= n_phases) {					\
+			phase -= n_phases;					\
+			index += 1;						\
+		}								\
+		inner_product_interleaved_##arch(&d[o * n_channels], ip,	\
+				taps, n_taps, n_channels);			\
+	}									\
+	*in_len = index;							\
+	*out_len = o;								\
+	data->phase = phase;							\
+}
+
+#define MAKE_RESAMPLER_INTER_INTERLEAVED(arch)					\
+DEFINE_RESAMPLER(inter_interleaved,arch)					\
+{										\
+	struct native_data *data = r->data;					\
+	uint32_t index, phase, stride = data->filter_stride;			\
+	uint32_t n_phases = data->n_phases, out_rate = data->out_rate;		\
+	uint32_t n_taps = data->n_taps;						\
+	uint32_t o, olen = *out_len, ilen = *in_len;				\
+	uint32_t inc = data->inc, frac = data->frac;				\
+	uint32_t n_channels = r->channels;					\
+	const float *s = src[0];						\
+	float *d = dst[0];							\
+										\
+	if (n_channels == 0)							\
+		return;								\
+										\
+	index = ioffs;								\
+	phase = data->phase;							\
+										\
+	for (o = ooffs; o < olen && index + n_taps <= ilen; o++) {		\
+		const float *ip, *t0, *t1;					\
+		float ph, x;							\
+		uint32_t offset;						\
+										\
+		ip = &s[index * n_channels];					\
+		ph = (float)phase * n_phases / out_rate;			\
+		offset = floor(ph);						\
+		x = ph - (float)offset;						\
+										\
+		t0 = &data->filter[(offset + 0) * stride];			\
+		t1 = &data->filter[(offset + 1) * stride];			\
+		index += inc;							\
+		phase += frac;							\
+		if (phase >= out_rate) {					\
+			phase -= out_rate;					\
+			index += 1;						\
+		}								\
+		inner_product_ip_interleaved_##arch(&d[o * n_channels], ip,	\
+				t0, t1, x, n_taps, n_channels);			\
+	}									\
+	*in_len = index;							\
+	*out_len = o;								\
+	data->phase = phase;							\
+}
+
+/* Small rate corrections move the phase slowly. The drift resamplers
+ * quantize the phase to DRIFT_STEPS steps between two filter phases and
+ * only interpolate new taps when the quantized phase changes. The taps
+ * are shared by all channels of a frame. */
+static inline void interpolate_taps(float * SPA_RESTRICT d, const float * SPA_RESTRICT t0,
+		const float * SPA_RESTRICT t1, float x, uint32_t n_taps)
+{
+	uint32_t i;
+	for (i = 0; i < n_taps; i++)
+		d[i] = t0[i] + (t1[i] - t0[i]) * x;
+}
+
+static inline const float *drift_taps(struct native_data *data, uint32_t phase)
+{
+	uint32_t pos, offset;
+	const float *t0, *t1;
+	float x;
+
+	pos = (uint32_t)(phase * data->drift_scale);
+	if (SPA_LIKELY(pos == data->drift_pos))
+		return data->drift_ptr;
+
+	offset = pos / DRIFT_STEPS;
+	t0 = &data->filter[(offset + 0) * data->filter_stride];
+	t1 = &data->filter[(offset + 1) * data->filter_stride];
+	x = (float)(pos % DRIFT_STEPS) / DRIFT_STEPS;
+
+	if (x == 0.0f) {
+		data->drift_ptr = t0;
+	} else {
+		interpolate_taps(data->drift_taps, t0, t1, x, data->n_taps);
+		data->drift_ptr = data->drift_taps;
+	}
+	data->drift_pos = pos;
+	return data->drift_ptr;
+}
+
+#define MAKE_RESAMPLER_DRIFT(arch)						\
+DEFINE_RESAMPLER(drift,arch)							\
+{										\
+	struct native_data *data = r->data;					\
+	uint32_t index, phase, out_rate = data->out_rate;			\
+	uint32_t n_taps = data->n_taps;						\
+	uint32_t c, o, olen = *out_len, ilen = *in_len;				\
+	uint32_t inc = data->inc, frac = data->frac;				\
+										\
+	if (r->channels == 0)							\
+		return;								\
+										\
+	index = ioffs;								\
+	phase = data->phase;							\
+										\
+	for (o = ooffs; o < olen && index + n_taps <= ilen; o++) {		\
+		const float *taps = drift_taps(data, phase);			\
+										\
+		for (c = 0; c < r->channels; c++) {				\
+			const float *s = src[c];				\
+			float *d = dst[c];					\
+			inner_product_##arch(&d[o], &s[index], taps, n_taps);	\
+		}								\
+		index += inc;							\
+		phase += frac;							\
+		if (phase >= out_rate) {					\
+			phase -= out_rate;					\
+			index += 1;						\
+		}								\
+	}									\
+	*in_len = index;							\
+	*out_len = o;								\
+	data->phase = phase;							\
+}
+
+#define MAKE_RESAMPLER_DRIFT_INTERLEAVED(arch)					\
+DEFINE_RESAMPLER(drift_interleaved,arch)					\
+{										\
+	struct native_data *data = r->data;					\
+	uint32_t index, phase, out_rate = data->out_rate;			\
+	uint32_t n_taps = data->n_taps;						\
+	uint32_t o, olen = *out_len, ilen = *in_len;				\
+	uint32_t inc = data->inc, frac = data->frac;				\
+	uint32_t n_channels = r->channels;					\
+	const float *s = src[0];						\
+	float *d = dst[0];							\
+										\
+	if (n_channels == 0)							\
+		return;								\
+										\
+	index = ioffs;								\
+	phase = data->phase;							\
+										\
+	for (o = ooffs; o < olen && index + n_taps <= ilen; o++) {		\
+		const float *taps = drift_taps(data, phase);			\
+										\
+		inner_product_interleaved_##arch(&d[o * n_channels],		\
+				&s[index * n_channels], taps, n_taps,		\
+				n_channels);					\
+		index += inc;							\
+		phase += frac;							\
+		if (phase >= out_rate) {					\
+			phase -= out_rate;					\
+			index += 1;						\
+		}								\
+	}									\
+	*in_len = index;							\
+	*out_len = o;								\
+	data->phase = phase;							\
+}
 
 DEFINE_RESAMPLER(copy,c);
 DEFINE_RESAMPLER(full,c);
 DEFINE_RESAMPLER(inter,c);
+DEFINE_RESAMPLER(full_interleaved,c);
+DEFINE_RESAMPLER(inter_interleaved,c);
+DEFINE_RESAMPLER(drift,c);
+DEFINE_RESAMPLER(drift_interleaved,c);
 
 #if defined (HAVE_NEON)
 DEFINE_RESAMPLER(full,neon);
 DEFINE_RESAMPLER(inter,neon);
+DEFINE_RESAMPLER(drift,neon);
 #endif
 #if defined (HAVE_SSE)
 DEFINE_RESAMPLER(full,sse);
 DEFINE_RESAMPLER(inter,sse);
+DEFINE_RESAMPLER(full_interleaved,sse);
+DEFINE_RESAMPLER(inter_interleaved,sse);
+DEFINE_RESAMPLER(drift,sse);
+DEFINE_RESAMPLER(drift_interleaved,sse);
 #endif
 #if defined (HAVE_SSSE3)
 DEFINE_RESAMPLER(full,ssse3);
 DEFINE_RESAMPLER(inter,ssse3);
+DEFINE_RESAMPLER(drift,ssse3);
 #endif
 #if defined (HAVE_AVX) && defined(HAVE_FMA)
 DEFINE_RESAMPLER(full,avx);
 DEFINE_RESAMPLER(inter,avx);
+DEFINE_RESAMPLER(full_interleaved,avx);
+DEFINE_RESAMPLER(inter_interleaved,avx);
+DEFINE_RESAMPLER(drift,avx);
+DEFINE_RESAMPLER(drift_interleaved,avx);
 #endif
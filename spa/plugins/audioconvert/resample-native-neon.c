@@ -216,3 +216,4 @@ static void inner_product_ip_neon(float *d, const float * SPA_RESTRICT s,
 
 MAKE_RESAMPLER_FULL(neon);
 MAKE_RESAMPLER_INTER(neon);
+MAKE_RESAMPLER_DRIFT(neon);
@@ -90,5 +90,107 @@ static void inner_product_ip_sse(float *d, const float * SPA_RESTRICT s,
 	_mm_store_ss(d, sum[0]);
 }
 
+static void inner_product_interleaved_sse(float *d, const float * SPA_RESTRICT s,
+		const float * SPA_RESTRICT taps, uint32_t n_taps, uint32_t n_channels)
+{
+	__m128 sum[2], t;
+	const float *p;
+	uint32_t i, c = 0;
+
+	if (n_channels == 2) {
+		/* duplicate the taps so that two frames are done at once */
+		sum[0] = sum[1] = _mm_setzero_ps();
+		for (i = 0; i < n_taps; i += 4) {
+			t = _mm_load_ps(taps + i);
+			sum[0] = _mm_add_ps(sum[0],
+				_mm_mul_ps(_mm_loadu_ps(s + 2 * i + 0), _mm_unpacklo_ps(t, t)));
+			sum[1] = _mm_add_ps(sum[1],
+				_mm_mul_ps(_mm_loadu_ps(s + 2 * i + 4), _mm_unpackhi_ps(t, t)));
+		}
+		sum[0] = _mm_add_ps(sum[0], sum[1]);
+		sum[0] = _mm_add_ps(sum[0], _mm_movehl_ps(sum[0], sum[0]));
+		_mm_storel_pi((__m64*)d, sum[0]);
+		return;
+	}
+	for (; c + 8 <= n_channels; c += 8) {
+		sum[0] = sum[1] = _mm_setzero_ps();
+		for (i = 0, p = s + c; i < n_taps; i++, p += n_channels) {
+			t = _mm_load1_ps(taps + i);
+			sum[0] = _mm_add_ps(sum[0], _mm_mul_ps(_mm_loadu_ps(p + 0), t));
+			sum[1] = _mm_add_ps(sum[1], _mm_mul_ps(_mm_loadu_ps(p + 4), t));
+		}
+		_mm_storeu_ps(d + c + 0, sum[0]);
+		_mm_storeu_ps(d + c + 4, sum[1]);
+	}
+	for (; c + 4 <= n_channels; c += 4) {
+		sum[0] = _mm_setzero_ps();
+		for (i = 0, p = s + c; i < n_taps; i++, p += n_channels)
+			sum[0] = _mm_add_ps(sum[0],
+				_mm_mul_ps(_mm_loadu_ps(p), _mm_load1_ps(taps + i)));
+		_mm_storeu_ps(d + c, sum[0]);
+	}
+	for (; c < n_channels; c++) {
+		sum[0] = _mm_setzero_ps();
+		for (i = 0, p = s + c; i < n_taps; i++, p += n_channels)
+			sum[0] = _mm_add_ss(sum[0],
+				_mm_mul_ss(_mm_load_ss(p), _mm_load_ss(taps + i)));
+		_mm_store_ss(d + c, sum[0]);
+	}
+}
+
+static void inner_product_ip_interleaved_sse(float *d, const float * SPA_RESTRICT s,
+	const float * SPA_RESTRICT t0, const float * SPA_RESTRICT t1, float x,
+	uint32_t n_taps, uint32_t n_channels)
+{
+	__m128 sum[4], t, a, b, vx = _mm_load1_ps(&x);
+	const float *p;
+	uint32_t i, c = 0;
+
+	if (n_channels == 2) {
+		sum[0] = sum[1] = sum[2] = sum[3] = _mm_setzero_ps();
+		for (i = 0; i < n_taps; i += 4) {
+			a = _mm_loadu_ps(s + 2 * i + 0);
+			b = _mm_loadu_ps(s + 2 * i + 4);
+			t = _mm_load_ps(t0 + i);
+			sum[0] = _mm_add_ps(sum[0], _mm_mul_ps(a, _mm_unpacklo_ps(t, t)));
+			sum[1] = _mm_add_ps(sum[1], _mm_mul_ps(b, _mm_unpackhi_ps(t, t)));
+			t = _mm_load_ps(t1 + i);
+			sum[2] = _mm_add_ps(sum[2], _mm_mul_ps(a, _mm_unpacklo_ps(t, t)));
+			sum[3] = _mm_add_ps(sum[3], _mm_mul_ps(b, _mm_unpackhi_ps(t, t)));
+		}
+		sum[0] = _mm_add_ps(sum[0], sum[1]);
+		sum[2] = _mm_add_ps(sum[2], sum[3]);
+		sum[0] = _mm_add_ps(sum[0], _mm_movehl_ps(sum[0], sum[0]));
+		sum[2] = _mm_add_ps(sum[2], _mm_movehl_ps(sum[2], sum[2]));
+		sum[0] = _mm_add_ps(sum[0], _mm_mul_ps(_mm_sub_ps(sum[2], sum[0]), vx));
+		_mm_storel_pi((__m64*)d, sum[0]);
+		return;
+	}
+	for (; c + 4 <= n_channels; c += 4) {
+		sum[0] = sum[1] = _mm_setzero_ps();
+		for (i = 0, p = s + c; i < n_taps; i++, p += n_channels) {
+			t = _mm_loadu_ps(p);
+			sum[0] = _mm_add_ps(sum[0], _mm_mul_ps(t, _mm_load1_ps(t0 + i)));
+			sum[1] = _mm_add_ps(sum[1], _mm_mul_ps(t, _mm_load1_ps(t1 + i)));
+		}
+		sum[0] = _mm_add_ps(sum[0], _mm_mul_ps(_mm_sub_ps(sum[1], sum[0]), vx));
+		_mm_storeu_ps(d + c, sum[0]);
+	}
+	for (; c < n_channels; c++) {
+		sum[0] = sum[1] = _mm_setzero_ps();
+		for (i = 0, p = s + c; i < n_taps; i++, p += n_channels) {
+			t = _mm_load_ss(p);
+			sum[0] = _mm_add_ss(sum[0], _mm_mul_ss(t, _mm_load_ss(t0 + i)));
+			sum[1] = _mm_add_ss(sum[1], _mm_mul_ss(t, _mm_load_ss(t1 + i)));
+		}
+		sum[0] = _mm_add_ss(sum[0], _mm_mul_ss(_mm_sub_ss(sum[1], sum[0]), vx));
+		_mm_store_ss(d + c, sum[0]);
+	}
+}
+
 MAKE_RESAMPLER_FULL(sse);
 MAKE_RESAMPLER_INTER(sse);
+MAKE_RESAMPLER_FULL_INTERLEAVED(sse);
+MAKE_RESAMPLER_INTER_INTERLEAVED(sse);
+MAKE_RESAMPLER_DRIFT(sse);
+MAKE_RESAMPLER_DRIFT_INTERLEAVED(sse);
@@ -113,3 +113,4 @@ static void inner_product_ip_ssse3(float *d, const float * SPA_RESTRICT s,
 
 MAKE_RESAMPLER_FULL(ssse3);
 MAKE_RESAMPLER_INTER(ssse3);
+MAKE_RESAMPLER_DRIFT(ssse3);
@@ -23,8 +23,10 @@
  */
 
 #include <errno.h>
+#include <pthread.h>
 
 #include <spa/param/audio/format.h>
+#include <spa/utils/list.h>
 
 #include "resample-native-impl.h"
 
@@ -51,6 +53,24 @@ static const struct quality blackman_qualities[] = {
 	{ 1024, 0.998, },
 };
 
+/* Filter banks only depend on the reduced rates and the quality. They
+ * are shared between all resamplers in the process and freed when the
+ * last user goes away. */
+struct filter_bank {
+	struct spa_list link;
+	uint32_t ref;
+	uint32_t in_rate;
+	uint32_t out_rate;
+	uint32_t quality;
+	uint32_t n_taps;
+	float *taps;
+};
+
+static pthread_mutex_t filter_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct spa_list filter_banks = SPA_LIST_INIT(&filter_banks);
+static uint64_t filter_hits;
+static uint64_t filter_misses;
+
 static inline double sinc(double x)
 {
 	if (x < 1e-6) return 1.0;
@@ -106,30 +126,125 @@ static void inner_product_ip_c(float *d, const float * SPA_RESTRICT s,
 	*d = (sum[1] - sum[0]) * x + sum[0];
 }
 
+static struct filter_bank *filter_bank_acquire(uint32_t in_rate, uint32_t out_rate,
+		uint32_t quality, uint32_t n_taps, uint32_t stride, uint32_t n_phases,
+		double cutoff)
+{
+	struct filter_bank *b;
+
+	pthread_mutex_lock(&filter_lock);
+	spa_list_for_each(b, &filter_banks, link) {
+		if (b->in_rate == in_rate && b->out_rate == out_rate &&
+		    b->quality == quality && b->n_taps == n_taps) {
+			b->ref++;
+			filter_hits++;
+			goto done;
+		}
+	}
+	b = calloc(1, sizeof(struct filter_bank) + stride * (n_phases + 1) + 64);
+	if (b == NULL)
+		goto done;
+
+	b->ref = 1;
+	b->in_rate = in_rate;
+	b->out_rate = out_rate;
+	b->quality = quality;
+	b->n_taps = n_taps;
+	b->taps = SPA_MEMBER_ALIGN(b, sizeof(struct filter_bank), 64, float);
+	build_filter(b->taps, stride / sizeof(float), n_taps, n_phases, cutoff);
+
+	spa_list_append(&filter_banks, &b->link);
+	filter_misses++;
+done:
+	pthread_mutex_unlock(&filter_lock);
+	return b;
+}
+
+static void filter_bank_release(struct filter_bank *b)
+{
+	pthread_mutex_lock(&filter_lock);
+	if (--b->ref == 0) {
+		spa_list_remove(&b->link);
+		free(b);
+	}
+	pthread_mutex_unlock(&filter_lock);
+}
+
+void resample_native_get_stats(uint64_t *hits, uint64_t *misses)
+{
+	pthread_mutex_lock(&filter_lock);
+	*hits = filter_hits;
+	*misses = filter_misses;
+	pthread_mutex_unlock(&filter_lock);
+}
+
+static void inner_product_interleaved_c(float *d, const float * SPA_RESTRICT s,
+		const float * SPA_RESTRICT taps, uint32_t n_taps, uint32_t n_channels)
+{
+	uint32_t i, c;
+
+	for (c = 0; c < n_channels; c++) {
+		float sum = 0.0f;
+		for (i = 0; i < n_taps; i++)
+			sum += s[i * n_channels + c] * taps[i];
+		d[c] = sum;
+	}
+}
+
+static void inner_product_ip_interleaved_c(float *d, const float * SPA_RESTRICT s,
+	const float * SPA_RESTRICT t0, const float * SPA_RESTRICT t1, float x,
+	uint32_t n_taps, uint32_t n_channels)
+{
+	uint32_t i, c;
+
+	for (c = 0; c < n_channels; c++) {
+		float sum[2] = { 0.0f, 0.0f };
+		for (i = 0; i < n_taps; i++) {
+			sum[0] += s[i * n_channels + c] * t0[i];
+			sum[1] += s[i * n_channels + c] * t1[i];
+		}
+		d[c] = (sum[1] - sum[0]) * x + sum[0];
+	}
+}
+
 MAKE_RESAMPLER_COPY(c);
 MAKE_RESAMPLER_FULL(c);
 MAKE_RESAMPLER_INTER(c);
+MAKE_RESAMPLER_FULL_INTERLEAVED(c);
+MAKE_RESAMPLER_INTER_INTERLEAVED(c);
+MAKE_RESAMPLER_DRIFT(c);
+MAKE_RESAMPLER_DRIFT_INTERLEAVED(c);
 
 static struct resample_info resample_table[] =
 {
 #if defined (HAVE_NEON)
 	{ SPA_AUDIO_FORMAT_F32, SPA_CPU_FLAG_NEON,
-		do_resample_copy_c, do_resample_full_neon, do_resample_inter_neon },
+		do_resample_copy_c, do_resample_full_neon, do_resample_inter_neon,
+		do_resample_full_interleaved_c, do_resample_inter_interleaved_c,
+		do_resample_drift_neon, do_resample_drift_interleaved_c },
 #endif
 #if defined(HAVE_AVX) && defined(HAVE_FMA)
 	{ SPA_AUDIO_FORMAT_F32, SPA_CPU_FLAG_AVX | SPA_CPU_FLAG_FMA3,
-		do_resample_copy_c, do_resample_full_avx, do_resample_inter_avx },
+		do_resample_copy_c, do_resample_full_avx, do_resample_inter_avx,
+		do_resample_full_interleaved_avx, do_resample_inter_interleaved_avx,
+		do_resample_drift_avx, do_resample_drift_interleaved_avx },
 #endif
 #if defined (HAVE_SSSE3)
 	{ SPA_AUDIO_FORMAT_F32, SPA_CPU_FLAG_SSSE3 | SPA_CPU_FLAG_SLOW_UNALIGNED,
-		do_resample_copy_c, do_resample_full_ssse3, do_resample_inter_ssse3 },
+		do_resample_copy_c, do_resample_full_ssse3, do_resample_inter_ssse3,
+		do_resample_full_interleaved_sse, do_resample_inter_interleaved_sse,
+		do_resample_drift_ssse3, do_resample_drift_interleaved_sse },
 #endif
 #if defined (HAVE_SSE)
 	{ SPA_AUDIO_FORMAT_F32, SPA_CPU_FLAG_SSE,
-		do_resample_copy_c, do_resample_full_sse, do_resample_inter_sse },
+		do_resample_copy_c, do_resample_full_sse, do_resample_inter_sse,
+		do_resample_full_interleaved_sse, do_resample_inter_interleaved_sse,
+		do_resample_drift_sse, do_resample_drift_interleaved_sse },
 #endif
 	{ SPA_AUDIO_FORMAT_F32, 0,
-		do_resample_copy_c, do_resample_full_c, do_resample_inter_c },
+		do_resample_copy_c, do_resample_full_c, do_resample_inter_c,
+		do_resample_full_interleaved_c, do_resample_inter_interleaved_c,
+		do_resample_drift_c, do_resample_drift_interleaved_c },
 };
 
 #define MATCH_CPU_FLAGS(a,b)	((a) == 0 || ((a) & (b)) == a)
@@ -146,8 +261,14 @@ static const struct resample_info *find_resample_info(uint32_t format, uint32_t
 
 static void impl_native_free(struct resample *r)
 {
+	struct native_data *d = r->data;
+
 	spa_log_debug(r->log, "native %p: free", r);
-	free(r->data);
+	if (d == NULL)
+		return;
+	if (d->bank)
+		filter_bank_release(d->bank);
+	free(d);
 	r->data = NULL;
 }
 
@@ -161,6 +282,16 @@ static inline uint32_t calc_gcd(uint32_t a, uint32_t b)
 	return a;
 }
 
+/* rate corrections of up to 1%, like the ones made by the DLL of adaptive
+ * followers, use the drift resampler. The correction is on top of the
+ * ratio of the filter bank, so this also works for 44100 -> 48000. */
+#define DRIFT_MAX_PERCENT	1
+
+static inline bool is_drift(double rate)
+{
+	return fabs(rate - 1.0) <= DRIFT_MAX_PERCENT / 100.0;
+}
+
 static void impl_native_update_rate(struct resample *r, double rate)
 {
 	struct native_data *data = r->data;
@@ -185,13 +316,23 @@ static void impl_native_update_rate(struct resample *r, double rate)
 
 	data->inc = data->in_rate / data->out_rate;
 	data->frac = data->in_rate % data->out_rate;
+	data->drift_scale = (double)data->n_phases * DRIFT_STEPS / data->out_rate;
+	data->drift_pos = UINT32_MAX;
 
 	if (data->in_rate == data->out_rate)
 		data->func = data->info->process_copy;
 	else if (rate == 1.0)
-		data->func = data->info->process_full;
+		data->func = data->stride > 1 ?
+			data->info->process_full_interleaved :
+			data->info->process_full;
+	else if (is_drift(rate))
+		data->func = data->stride > 1 ?
+			data->info->process_drift_interleaved :
+			data->info->process_drift;
 	else
-		data->func = data->info->process_inter;
+		data->func = data->stride > 1 ?
+			data->info->process_inter_interleaved :
+			data->info->process_inter;
 
 	spa_log_trace_fp(r->log, "native %p: rate:%f in:%d out:%d phase:%d inc:%d frac:%d", r,
 			rate, data->in_rate, data->out_rate, data->phase, data->inc, data->frac);
@@ -216,7 +357,7 @@ static void impl_native_process(struct resample *r,
 		void * SPA_RESTRICT dst[], uint32_t *out_len)
 {
 	struct native_data *data = r->data;
-	uint32_t n_taps = data->n_taps;
+	uint32_t n_taps = data->n_taps, stride = data->stride;
 	float **history = data->history;
 	const float **s = (const float **)src;
 	uint32_t c, refill, hist, in, out, remain;
@@ -231,8 +372,9 @@ static void impl_native_process(struct resample *r,
 			 * history before we can work on the new input. When
 			 * we have less, refill the history. */
 			refill = SPA_MIN(*in_len, n_taps-1);
-			for (c = 0; c < r->channels; c++)
-				spa_memcpy(&history[c][hist], s[c], refill * sizeof(float));
+			for (c = 0; c < data->blocks; c++)
+				spa_memcpy(&history[c][hist * stride], s[c],
+						refill * stride * sizeof(float));
 
 			if (SPA_UNLIKELY(hist + refill < n_taps)) {
 				/* not enough in the history, keep the input in
@@ -268,8 +410,9 @@ static void impl_native_process(struct resample *r,
 		if (remain > 0 && remain < n_taps) {
 			/* not enough input data remaining for more output,
 			 * copy to history */
-			for (c = 0; c < r->channels; c++)
-				spa_memcpy(history[c], &s[c][in], remain * sizeof(float));
+			for (c = 0; c < data->blocks; c++)
+				spa_memcpy(history[c], &s[c][in * stride],
+						remain * stride * sizeof(float));
 		} else {
 			/* we have enough input data remaining to produce
 			 * more output ask to resubmit. */
@@ -292,8 +435,9 @@ static void impl_native_process(struct resample *r,
 		}
 		if (remain) {
 			/* move history */
-			for (c = 0; c < r->channels; c++)
-				spa_memmove(history[c], &history[c][in], remain * sizeof(float));
+			for (c = 0; c < data->blocks; c++)
+				spa_memmove(history[c], &history[c][in * stride],
+						remain * stride * sizeof(float));
 		}
 		spa_log_trace_fp(r->log, "native %p: in:%d remain:%d", r, in, remain);
 
@@ -310,6 +454,7 @@ static void impl_native_reset (struct resample *r)
 	memset(d->hist_mem, 0, r->channels * sizeof(float) * d->n_taps * 2);
 	d->hist = (d->n_taps / 2) - 1;
 	d->phase = 0;
+	d->drift_pos = UINT32_MAX;
 }
 
 static uint32_t impl_native_delay (struct resample *r)
@@ -323,8 +468,8 @@ int resample_native_init(struct resample *r)
 	struct native_data *d;
 	const struct quality *q;
 	double scale;
-	uint32_t c, n_taps, n_phases, filter_size, in_rate, out_rate, gcd, filter_stride;
-	uint32_t history_stride, history_size, oversample;
+	uint32_t c, n_taps, n_phases, in_rate, out_rate, gcd, filter_stride;
+	uint32_t history_stride, history_size, oversample, blocks, stride;
 
 	r->quality = SPA_CLAMP(r->quality, 0, (int) SPA_N_ELEMENTS(blackman_qualities) - 1);
 	r->free = impl_native_free;
@@ -352,14 +497,20 @@ int resample_native_init(struct resample *r)
 	n_phases *= oversample;
 
 	filter_stride = SPA_ROUND_UP_N(n_taps * sizeof(float), 64);
-	filter_size = filter_stride * (n_phases + 1);
-	history_stride = SPA_ROUND_UP_N(2 * n_taps * sizeof(float), 64);
-	history_size = r->channels * history_stride;
+	if (SPA_FLAG_IS_SET(r->options, RESAMPLE_OPTION_INTERLEAVED)) {
+		blocks = 1;
+		stride = r->channels;
+	} else {
+		blocks = r->channels;
+		stride = 1;
+	}
+	history_stride = SPA_ROUND_UP_N(2 * n_taps * stride * sizeof(float), 64);
+	history_size = blocks * history_stride;
 
 	d = calloc(1, sizeof(struct native_data) +
-			filter_size +
 			history_size +
-			(r->channels * sizeof(float*)) +
+			filter_stride +
+			(blocks * sizeof(float*)) +
 			64);
 
 	if (d == NULL)
@@ -370,20 +521,29 @@ int resample_native_init(struct resample *r)
 	d->n_phases = n_phases;
 	d->in_rate = in_rate;
 	d->out_rate = out_rate;
-	d->filter = SPA_MEMBER_ALIGN(d, sizeof(struct native_data), 64, float);
-	d->hist_mem = SPA_MEMBER_ALIGN(d->filter, filter_size, 64, float);
-	d->history = SPA_MEMBER(d->hist_mem, history_size, float*);
+	d->hist_mem = SPA_MEMBER_ALIGN(d, sizeof(struct native_data), 64, float);
+	d->drift_taps = SPA_MEMBER(d->hist_mem, history_size, float);
+	d->history = SPA_MEMBER(d->drift_taps, filter_stride, float*);
 	d->filter_stride = filter_stride / sizeof(float);
 	d->filter_stride_os = d->filter_stride * oversample;
-	for (c = 0; c < r->channels; c++)
+	d->blocks = blocks;
+	d->stride = stride;
+	for (c = 0; c < blocks; c++)
 		d->history[c] = SPA_MEMBER(d->hist_mem, c * history_stride, float);
 
-	build_filter(d->filter, d->filter_stride, n_taps, n_phases, scale);
+	d->bank = filter_bank_acquire(in_rate, out_rate, r->quality,
+			n_taps, filter_stride, n_phases, scale);
+	if (d->bank == NULL) {
+		free(d);
+		r->data = NULL;
+		return -ENOMEM;
+	}
+	d->filter = d->bank->taps;
 
 	d->info = find_resample_info(SPA_AUDIO_FORMAT_F32, r->cpu_flags);
 
-	spa_log_debug(r->log, "native %p: q:%d in:%d out:%d n_taps:%d n_phases:%d features:%08x:%08x",
-			r, r->quality, in_rate, out_rate, n_taps, n_phases,
+	spa_log_debug(r->log, "native %p: q:%d in:%d out:%d n_taps:%d n_phases:%d interleaved:%d features:%08x:%08x",
+			r, r->quality, in_rate, out_rate, n_taps, n_phases, stride > 1,
 			r->cpu_flags, d->info->cpu_flags);
 
 	r->cpu_flags = d->info->cpu_flags;
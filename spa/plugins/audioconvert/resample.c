@@ -105,6 +105,10 @@ struct impl {
 
 	uint64_t info_all;
 	struct spa_node_info info;
+	struct spa_dict_item info_items[2];
+	struct spa_dict info_props;
+	char filter_hits[32];
+	char filter_misses[32];
 	struct props props;
 
 	struct spa_hook_list hooks;
@@ -128,6 +132,16 @@ struct impl {
 #define GET_OUT_PORT(this,id)		(&this->out_port)
 #define GET_PORT(this,d,id)		(d == SPA_DIRECTION_INPUT ? GET_IN_PORT(this,id) : GET_OUT_PORT(this,id))
 
+static void update_filter_stats(struct impl *this)
+{
+	uint64_t hits, misses;
+
+	resample_native_get_stats(&hits, &misses);
+	snprintf(this->filter_hits, sizeof(this->filter_hits), "%"PRIu64, hits);
+	snprintf(this->filter_misses, sizeof(this->filter_misses), "%"PRIu64, misses);
+	this->info.change_mask |= SPA_NODE_CHANGE_MASK_PROPS;
+}
+
 static int setup_convert(struct impl *this,
 		enum spa_direction direction,
 		const struct spa_audio_info *info)
@@ -151,7 +165,8 @@ static int setup_convert(struct impl *this,
 			dst_info->info.raw.channels,
 			dst_info->info.raw.rate);
 
-	if (src_info->info.raw.channels != dst_info->info.raw.channels)
+	if (src_info->info.raw.channels != dst_info->info.raw.channels ||
+	    src_info->info.raw.format != dst_info->info.raw.format)
 		return -EINVAL;
 
 	if (this->resample.free)
@@ -162,12 +177,17 @@ static int setup_convert(struct impl *this,
 	this->resample.o_rate = dst_info->info.raw.rate;
 	this->resample.log = this->log;
 	this->resample.quality = this->props.quality;
+	this->resample.options = 0;
+	if (src_info->info.raw.format == SPA_AUDIO_FORMAT_F32)
+		this->resample.options |= RESAMPLE_OPTION_INTERLEAVED;
 
 	if (this->peaks)
 		err = resample_peaks_init(&this->resample);
 	else
 		err = resample_native_init(&this->resample);
 
+	update_filter_stats(this);
+
 	return err;
 }
 
@@ -369,7 +389,7 @@ static int port_enum_formats(void *object,
 			spa_pod_builder_add(builder,
 				SPA_FORMAT_mediaType,      SPA_POD_Id(SPA_MEDIA_TYPE_audio),
 				SPA_FORMAT_mediaSubtype,   SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
-				SPA_FORMAT_AUDIO_format,   SPA_POD_Id(SPA_AUDIO_FORMAT_F32P),
+				SPA_FORMAT_AUDIO_format,   SPA_POD_Id(other->format.info.raw.format),
 				SPA_FORMAT_AUDIO_rate,     SPA_POD_CHOICE_RANGE_Int(
 								other->format.info.raw.rate, 1, INT32_MAX),
 				SPA_FORMAT_AUDIO_channels, SPA_POD_Int(other->format.info.raw.channels),
@@ -378,7 +398,7 @@ static int port_enum_formats(void *object,
 			spa_pod_builder_array(builder, sizeof(uint32_t), SPA_TYPE_Id,
 					other->format.info.raw.channels, other->format.info.raw.position);
 			*param = spa_pod_builder_pop(builder, &f);
-		} else {
+		} else if (this->peaks) {
 			*param = spa_pod_builder_add_object(builder,
 				SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat,
 				SPA_FORMAT_mediaType,      SPA_POD_Id(SPA_MEDIA_TYPE_audio),
@@ -386,6 +406,20 @@ static int port_enum_formats(void *object,
 				SPA_FORMAT_AUDIO_format,   SPA_POD_Id(SPA_AUDIO_FORMAT_F32P),
 				SPA_FORMAT_AUDIO_rate,     SPA_POD_CHOICE_RANGE_Int(DEFAULT_RATE, 1, INT32_MAX),
 				SPA_FORMAT_AUDIO_channels, SPA_POD_CHOICE_RANGE_Int(DEFAULT_CHANNELS, 1, INT32_MAX));
+		} else {
+			/* the native resampler can also work on interleaved
+			 * samples, which saves a deinterleave and interleave
+			 * when nothing else needs to be done */
+			*param = spa_pod_builder_add_object(builder,
+				SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat,
+				SPA_FORMAT_mediaType,      SPA_POD_Id(SPA_MEDIA_TYPE_audio),
+				SPA_FORMAT_mediaSubtype,   SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+				SPA_FORMAT_AUDIO_format,   SPA_POD_CHOICE_ENUM_Id(3,
+								SPA_AUDIO_FORMAT_F32P,
+								SPA_AUDIO_FORMAT_F32P,
+								SPA_AUDIO_FORMAT_F32),
+				SPA_FORMAT_AUDIO_rate,     SPA_POD_CHOICE_RANGE_Int(DEFAULT_RATE, 1, INT32_MAX),
+				SPA_FORMAT_AUDIO_channels, SPA_POD_CHOICE_RANGE_Int(DEFAULT_CHANNELS, 1, INT32_MAX));
 		}
 		break;
 	default:
@@ -551,15 +585,19 @@ static int port_set_format(void *object,
 		if (spa_format_audio_raw_parse(format, &info.info.raw) < 0)
 			return -EINVAL;
 
-		if (info.info.raw.format != SPA_AUDIO_FORMAT_F32P)
+		if (info.info.raw.format == SPA_AUDIO_FORMAT_F32P) {
+			port->stride = sizeof(float);
+			port->blocks = info.info.raw.channels;
+		} else if (info.info.raw.format == SPA_AUDIO_FORMAT_F32 && !this->peaks) {
+			port->stride = sizeof(float) * info.info.raw.channels;
+			port->blocks = 1;
+		} else
 			return -EINVAL;
 
-		port->stride = sizeof(float);
-		port->blocks = info.info.raw.channels;
-
 		if (other->have_format) {
 			if ((res = setup_convert(this, direction, &info)) < 0)
 				return res;
+			emit_node_info(this, false);
 		}
 		port->format = info;
 		port->have_format = true;
@@ -798,11 +836,11 @@ static int impl_node_process(void *object)
 	if (SPA_LIKELY(this->io_position))
 		max = this->io_position->clock.duration;
 	else
-		max = maxsize / sizeof(float);
+		max = maxsize / outport->stride;
 
 	switch (this->mode) {
 	case MODE_SPLIT:
-		maxsize = SPA_MIN(maxsize, max * sizeof(float));
+		maxsize = SPA_MIN(maxsize, max * outport->stride);
 		flush_out = flush_in = this->io_rate_match != NULL;
 		break;
 	case MODE_MERGE:
@@ -825,8 +863,8 @@ static int impl_node_process(void *object)
 		}
 	}
 
-	in_len = (size - inport->offset) / sizeof(float);
-	out_len = (maxsize - outport->offset) / sizeof(float);
+	in_len = (size - inport->offset) / inport->stride;
+	out_len = (maxsize - outport->offset) / outport->stride;
 
 	src_datas = alloca(sizeof(void*) * this->resample.channels);
 	dst_datas = alloca(sizeof(void*) * this->resample.channels);
@@ -844,30 +882,30 @@ static int impl_node_process(void *object)
 	resample_process(&this->resample, src_datas, &in_len, dst_datas, &out_len);
 
 #ifndef FASTPATH
-	spa_log_trace_fp(this->log, NAME " %p: in %d/%d %zd %d out %d/%d %zd %d max:%d",
-			this, pin_len, in_len, size / sizeof(float), inport->offset,
-			pout_len, out_len, maxsize / sizeof(float), outport->offset,
+	spa_log_trace_fp(this->log, NAME " %p: in %d/%d %d %d out %d/%d %d %d max:%d",
+			this, pin_len, in_len, size / inport->stride, inport->offset,
+			pout_len, out_len, maxsize / outport->stride, outport->offset,
 			max);
 #endif
 
 	for (i = 0; i < db->n_datas; i++) {
-		db->datas[i].chunk->size = outport->offset + (out_len * sizeof(float));
+		db->datas[i].chunk->size = outport->offset + (out_len * outport->stride);
 		db->datas[i].chunk->offset = 0;
 	}
 
-	inport->offset += in_len * sizeof(float);
+	inport->offset += in_len * inport->stride;
 	if (inport->offset >= size || flush_in) {
 		inio->status = SPA_STATUS_NEED_DATA;
 		inport->offset = 0;
 		SPA_FLAG_SET(res, inio->status);
-		spa_log_trace_fp(this->log, NAME " %p: return input buffer of %zd samples", this, size / sizeof(float));
+		spa_log_trace_fp(this->log, NAME " %p: return input buffer of %d samples", this, size / inport->stride);
 	}
 
-	outport->offset += out_len * sizeof(float);
+	outport->offset += out_len * outport->stride;
 	if (outport->offset > 0 && (outport->offset >= maxsize || flush_out)) {
 		outio->status = SPA_STATUS_HAVE_DATA;
 		outio->buffer_id = dbuf->id;
-		spa_log_trace_fp(this->log, NAME " %p: have output buffer of %zd samples", this, outport->offset / sizeof(float));
+		spa_log_trace_fp(this->log, NAME " %p: have output buffer of %d samples", this, outport->offset / outport->stride);
 		dequeue_buffer(this, dbuf);
 		outport->offset = 0;
 		this->drained = draining;
@@ -993,10 +1031,16 @@ impl_init(const struct spa_handle_factory *factory,
 	spa_hook_list_init(&this->hooks);
 
 	this->info = SPA_NODE_INFO_INIT();
-	this->info_all = SPA_NODE_CHANGE_MASK_FLAGS;
+	this->info_all = SPA_NODE_CHANGE_MASK_FLAGS |
+			SPA_NODE_CHANGE_MASK_PROPS;
 	this->info.max_input_ports = 1;
 	this->info.max_output_ports = 1;
 	this->info.flags = SPA_NODE_FLAG_RT;
+	this->info_items[0] = SPA_DICT_ITEM_INIT("resample.filter-cache.hits", this->filter_hits);
+	this->info_items[1] = SPA_DICT_ITEM_INIT("resample.filter-cache.misses", this->filter_misses);
+	this->info_props = SPA_DICT_INIT_ARRAY(this->info_items);
+	this->info.props = &this->info_props;
+	update_filter_stats(this);
 
 	port = GET_OUT_PORT(this, 0);
 	port->direction = SPA_DIRECTION_OUTPUT;
@@ -38,6 +38,8 @@ struct resample {
 	struct spa_log *log;
 	double rate;
 	int quality;
+#define RESAMPLE_OPTION_INTERLEAVED	(1<<0)		/**< samples are interleaved in one block */
+	uint32_t options;
 
 	void (*free)		(struct resample *r);
 	void (*update_rate)	(struct resample *r, double rate);
@@ -60,6 +62,7 @@ struct resample {
 #define resample_delay(r)		(r)->delay(r)
 
 int resample_native_init(struct resample *r);
+void resample_native_get_stats(uint64_t *hits, uint64_t *misses);
 int resample_peaks_init(struct resample *r);
 
 #endif /* RESAMPLE_H */
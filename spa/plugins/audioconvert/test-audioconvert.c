@@ -28,6 +28,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <time.h>
+#include <math.h>
 
 #include <spa/utils/names.h>
 #include <spa/support/plugin.h>
@@ -35,6 +36,8 @@
 #include <spa/param/audio/format.h>
 #include <spa/param/audio/format-utils.h>
 #include <spa/node/node.h>
+#include <spa/node/io.h>
+#include <spa/buffer/buffer.h>
 #include <spa/debug/mem.h>
 #include <spa/support/log-impl.h>
 
@@ -509,6 +512,132 @@ static int test_set_in_format2(struct context *ctx)
 	return 0;
 }
 
+static void set_port_config(struct context *ctx, enum spa_direction direction)
+{
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[1024];
+	struct spa_pod *param;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	param = spa_pod_builder_add_object(&b,
+		SPA_TYPE_OBJECT_ParamPortConfig, SPA_PARAM_PortConfig,
+		SPA_PARAM_PORT_CONFIG_direction,	SPA_POD_Id(direction),
+		SPA_PARAM_PORT_CONFIG_mode,		SPA_POD_Id(SPA_PARAM_PORT_CONFIG_MODE_convert));
+	spa_assert(spa_node_set_param(ctx->convert_node, SPA_PARAM_PortConfig, 0, param) == 0);
+}
+
+static void set_port_format(struct context *ctx, enum spa_direction direction,
+		struct spa_audio_info_raw *info)
+{
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[1024];
+	struct spa_pod *param;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	param = spa_format_audio_raw_build(&b, SPA_PARAM_Format, info);
+	spa_assert(spa_node_port_set_param(ctx->convert_node, direction, 0,
+			SPA_PARAM_Format, 0, param) == 0);
+}
+
+#define N_FRAMES	1024
+#define N_CHANNELS	8
+
+/* f32 in and out with only a rate change keeps the samples interleaved
+ * through all the internal nodes, check that the channels arrive
+ * unmodified and in the right order. */
+static int test_process_interleaved(void)
+{
+	struct context ctx;
+	struct spa_audio_info_raw info;
+	static float samples[2][N_FRAMES * 2 * N_CHANNELS];
+	struct spa_data datas[2];
+	struct spa_chunk chunks[2];
+	struct spa_buffer buffers[2], *bufs[2];
+	struct spa_io_buffers io[2];
+	uint32_t i, j, c, n_frames, n_out;
+	const float *d;
+	int res;
+
+	spa_zero(ctx);
+	setup_context(&ctx);
+
+	set_port_config(&ctx, SPA_DIRECTION_INPUT);
+	set_port_config(&ctx, SPA_DIRECTION_OUTPUT);
+
+	info = (struct spa_audio_info_raw) {
+		.format = SPA_AUDIO_FORMAT_F32,
+		.rate = 44100,
+		.channels = N_CHANNELS,
+		.position = { SPA_AUDIO_CHANNEL_FL, SPA_AUDIO_CHANNEL_FR,
+			SPA_AUDIO_CHANNEL_FC, SPA_AUDIO_CHANNEL_LFE,
+			SPA_AUDIO_CHANNEL_SL, SPA_AUDIO_CHANNEL_SR,
+			SPA_AUDIO_CHANNEL_RL, SPA_AUDIO_CHANNEL_RR, }
+	};
+	set_port_format(&ctx, SPA_DIRECTION_INPUT, &info);
+	info.rate = 48000;
+	set_port_format(&ctx, SPA_DIRECTION_OUTPUT, &info);
+
+	for (i = 0; i < 2; i++) {
+		datas[i] = (struct spa_data) {
+			.type = SPA_DATA_MemPtr,
+			.maxsize = sizeof(samples[i]),
+			.data = samples[i],
+			.chunk = &chunks[i],
+		};
+		buffers[i] = (struct spa_buffer) {
+			.n_datas = 1,
+			.datas = &datas[i],
+		};
+		bufs[i] = &buffers[i];
+		io[i] = SPA_IO_BUFFERS_INIT;
+
+		res = spa_node_port_use_buffers(ctx.convert_node, i, 0, 0, &bufs[i], 1);
+		spa_assert(res == 0);
+		res = spa_node_port_set_io(ctx.convert_node, i, 0, SPA_IO_Buffers,
+				&io[i], sizeof(io[i]));
+		spa_assert(res == 0);
+	}
+	res = spa_node_send_command(ctx.convert_node,
+			&SPA_NODE_COMMAND_INIT(SPA_NODE_COMMAND_Start));
+	spa_assert(res == 0);
+
+	for (j = 0; j < N_FRAMES; j++)
+		for (c = 0; c < N_CHANNELS; c++)
+			samples[0][j * N_CHANNELS + c] = (c + 1) * 0.1f;
+
+	for (i = 0, n_out = 0; i < 8; i++) {
+		chunks[0].offset = 0;
+		chunks[0].size = N_FRAMES * N_CHANNELS * sizeof(float);
+		io[0].status = SPA_STATUS_HAVE_DATA;
+		io[0].buffer_id = 0;
+		io[1].status = SPA_STATUS_NEED_DATA;
+
+		res = spa_node_process(ctx.convert_node);
+		spa_assert(res >= 0);
+		if (!(res & SPA_STATUS_HAVE_DATA))
+			continue;
+
+		spa_assert(io[1].status == SPA_STATUS_HAVE_DATA);
+		spa_assert(io[1].buffer_id == 0);
+
+		d = SPA_MEMBER(datas[1].data, datas[1].chunk->offset, float);
+		n_frames = datas[1].chunk->size / (N_CHANNELS * sizeof(float));
+		spa_assert(n_frames > 0);
+
+		/* skip the start of the filter, after that all channels
+		 * keep their level */
+		for (j = n_out == 0 ? 64 : 0; j < n_frames; j++)
+			for (c = 0; c < N_CHANNELS; c++)
+				spa_assert(fabsf(d[j * N_CHANNELS + c] - (c + 1) * 0.1f) < 0.005f);
+		n_out++;
+	}
+	spa_assert(n_out >= 2);
+
+	clean_context(&ctx);
+
+	return 0;
+}
+
 int main(int argc, char *argv[])
 {
 	struct context ctx;
@@ -532,5 +661,7 @@ int main(int argc, char *argv[])
 
 	clean_context(&ctx);
 
+	test_process_interleaved();
+
 	return 0;
 }
@@ -57,9 +57,43 @@ static void compare_mem(int i, int j, const void *m1, const void *m2, size_t siz
 //	spa_assert(res == 0);
 }
 
-static void run_test(const char *name,
+static int32_t read_sample(const uint8_t *m, size_t size)
+{
+	switch (size) {
+	case 1:
+		return *m;
+	case 2:
+		return *(int16_t*)m;
+	case 3:
+		return (int32_t)(((uint32_t)m[2] << 24) | (m[1] << 16) | (m[0] << 8)) >> 8;
+	default:
+		return *(int32_t*)m;
+	}
+}
+
+/* The samples may differ by tolerance. Floats are compared on their bits,
+ * a tolerance of 1 is then one unit in the last place. */
+static void check_mem(int i, int j, const void *m1, const void *m2, size_t size,
+		size_t sample_size, int32_t tolerance)
+{
+	const uint8_t *s1 = m1, *s2 = m2;
+	size_t k;
+
+	for (k = 0; k < size; k += sample_size) {
+		int64_t v1 = read_sample(&s1[k], sample_size);
+		int64_t v2 = read_sample(&s2[k], sample_size);
+		if (v1 < v2 - tolerance || v1 > v2 + tolerance) {
+			fprintf(stderr, "%d %d: sample %zd %"PRIi64" != %"PRIi64"\n",
+					i, j, k / sample_size, v1, v2);
+			spa_assert_not_reached();
+		}
+	}
+}
+
+/* a tolerance < 0 only reports the differences */
+static void run_test_tolerance(const char *name,
 		const void *in, size_t in_size, const void *out, size_t out_size, size_t n_samples,
-		bool in_packed, bool out_packed, convert_func_t func)
+		bool in_packed, bool out_packed, convert_func_t func, int32_t tolerance)
 {
 	const void *ip[N_CHANNELS];
 	void *tp[N_CHANNELS];
@@ -110,18 +144,33 @@ static void run_test(const char *name,
 		const uint8_t *d = tp[0], *s = samp_out;
 		for (i = 0; i < N_SAMPLES; i++) {
 			for (j = 0; j < N_CHANNELS; j++) {
-				compare_mem(i, j, d, s, out_size);
+				if (tolerance < 0)
+					compare_mem(i, j, d, s, out_size);
+				else
+					check_mem(i, j, d, s, out_size, out_size, tolerance);
 				d += out_size;
 			}
 			s += out_size;
 		}
 	} else {
 		for (j = 0; j < N_CHANNELS; j++) {
-			compare_mem(0, j, tp[j], samp_out, N_SAMPLES * out_size);
+			if (tolerance < 0)
+				compare_mem(0, j, tp[j], samp_out, N_SAMPLES * out_size);
+			else
+				check_mem(0, j, tp[j], samp_out, N_SAMPLES * out_size,
+						out_size, tolerance);
 		}
 	}
 }
 
+static void run_test(const char *name,
+		const void *in, size_t in_size, const void *out, size_t out_size, size_t n_samples,
+		bool in_packed, bool out_packed, convert_func_t func)
+{
+	run_test_tolerance(name, in, in_size, out, out_size, n_samples,
+			in_packed, out_packed, func, -1);
+}
+
 static void test_f32_u8(void)
 {
 	const float in[] = { 0.0f, 1.0f, -1.0f, 0.5f, -0.5f, 1.1f, -1.1f };
@@ -171,6 +220,71 @@ static void test_f32_s16(void)
 			false, true, conv_f32d_to_s16_sse2);
 	}
 #endif
+#if defined(HAVE_AVX512F)
+	if (cpu_flags & SPA_CPU_FLAG_AVX512) {
+		run_test_tolerance("test_f32d_s16_avx512", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			false, true, conv_f32d_to_s16_avx512, 1);
+	}
+#endif
+}
+
+static void run_test_dither(const char *name, uint32_t method, convert_func_t func)
+{
+	const float *ip[N_CHANNELS];
+	void *op[1];
+	float *in = (float *) samp_in;
+	int16_t *out = (int16_t *) temp_out;
+	struct convert conv;
+	double sum = 0.0, diff;
+	int i, j;
+
+	spa_zero(conv);
+	conv.n_channels = N_CHANNELS;
+	conv.dither_method = method;
+	convert_reset_dither(&conv);
+
+	for (i = 0; i < N_SAMPLES; i++)
+		in[i] = sinf(i * 0.05f) * 0.25f;
+	for (j = 0; j < N_CHANNELS; j++)
+		ip[j] = in;
+	op[0] = out;
+
+	fprintf(stderr, "test %s:\n", name);
+	func(&conv, op, (const void **) ip, N_SAMPLES);
+
+	for (i = 0; i < N_SAMPLES; i++) {
+		for (j = 0; j < N_CHANNELS; j++) {
+			diff = out[i * N_CHANNELS + j] - in[i] * S16_SCALE;
+			/* TPDF dither adds at most 1 LSB before rounding, the shaped
+			 * error feedback can add up to 1.5 LSB more */
+			spa_assert(fabs(diff) <= (method == DITHER_METHOD_SHAPED ? 3.0 : 1.5));
+			sum += diff;
+		}
+	}
+	/* the dither must not add a DC offset */
+	spa_assert(fabs(sum / (N_SAMPLES * N_CHANNELS)) < 0.1);
+}
+
+static void test_f32_s16_dither(void)
+{
+	run_test_dither("test_f32d_s16_dither", DITHER_METHOD_TRIANGULAR, conv_f32d_to_s16_dither_c);
+	run_test_dither("test_f32d_s16_shaped", DITHER_METHOD_SHAPED, conv_f32d_to_s16_shaped_c);
+#if defined(HAVE_SSE2)
+	if (cpu_flags & SPA_CPU_FLAG_SSE2) {
+		run_test_dither("test_f32d_s16_dither_sse2", DITHER_METHOD_TRIANGULAR,
+				conv_f32d_to_s16_dither_sse2);
+		run_test_dither("test_f32d_s16_shaped_sse2", DITHER_METHOD_SHAPED,
+				conv_f32d_to_s16_shaped_sse2);
+	}
+#endif
+#if defined(HAVE_AVX2)
+	if (cpu_flags & SPA_CPU_FLAG_AVX2) {
+		run_test_dither("test_f32d_s16_dither_avx2", DITHER_METHOD_TRIANGULAR,
+				conv_f32d_to_s16_dither_avx2);
+		run_test_dither("test_f32d_s16_shaped_avx2", DITHER_METHOD_SHAPED,
+				conv_f32d_to_s16_shaped_avx2);
+	}
+#endif
 }
 
 static void test_s16_f32(void)
@@ -192,6 +306,12 @@ static void test_s16_f32(void)
 			true, false, conv_s16_to_f32d_sse2);
 	}
 #endif
+#if defined(HAVE_AVX512F)
+	if (cpu_flags & SPA_CPU_FLAG_AVX512) {
+		run_test_tolerance("test_s16_f32d_avx512", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			true, false, conv_s16_to_f32d_avx512, 1);
+	}
+#endif
 }
 
 static void test_f32_s32(void)
@@ -214,6 +334,13 @@ static void test_f32_s32(void)
 			false, true, conv_f32d_to_s32_sse2);
 	}
 #endif
+#if defined(HAVE_AVX512F)
+	if (cpu_flags & SPA_CPU_FLAG_AVX512) {
+		/* the C version has 24 bits, one LSB of those */
+		run_test_tolerance("test_f32d_s32_avx512", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			false, true, conv_f32d_to_s32_avx512, 1 << 8);
+	}
+#endif
 }
 
 static void test_s32_f32(void)
@@ -235,6 +362,12 @@ static void test_s32_f32(void)
 			true, false, conv_s32_to_f32d_sse2);
 	}
 #endif
+#if defined(HAVE_AVX512F)
+	if (cpu_flags & SPA_CPU_FLAG_AVX512) {
+		run_test_tolerance("test_s32_f32d_avx512", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			true, false, conv_s32_to_f32d_avx512, 1);
+	}
+#endif
 }
 
 static void test_f32_s24(void)
@@ -256,6 +389,12 @@ static void test_f32_s24(void)
 			true, false, conv_f32_to_s24d_c);
 	run_test("test_f32d_s24d", in, sizeof(in[0]), out, 3, SPA_N_ELEMENTS(in),
 			false, false, conv_f32d_to_s24d_c);
+#if defined(HAVE_AVX512F)
+	if (cpu_flags & SPA_CPU_FLAG_AVX512) {
+		run_test_tolerance("test_f32d_s24_avx512", in, sizeof(in[0]), out, 3, SPA_N_ELEMENTS(in),
+			false, true, conv_f32d_to_s24_avx512, 1);
+	}
+#endif
 }
 
 static void test_s24_f32(void)
@@ -295,6 +434,12 @@ static void test_s24_f32(void)
 			true, false, conv_s24_to_f32d_sse41);
 	}
 #endif
+#if defined(HAVE_AVX512F)
+	if (cpu_flags & SPA_CPU_FLAG_AVX512) {
+		run_test_tolerance("test_s24_f32d_avx512", in, 3, out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			true, false, conv_s24_to_f32d_avx512, 1);
+	}
+#endif
 }
 
 static void test_f32_s24_32(void)
@@ -328,6 +473,25 @@ static void test_s24_32_f32(void)
 			false, false, conv_s24_32d_to_f32d_c);
 }
 
+static void test_f32_f32(void)
+{
+	const float in[] = { 0.0f, 1.0f, -1.0f, 0.5f, -0.5f, 1.1f, -1.1f };
+	const float out[] = { 0.0f, 1.0f, -1.0f, 0.5f, -0.5f, 1.1f, -1.1f };
+
+	run_test("test_f32_f32d", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			true, false, conv_deinterleave_32_c);
+	run_test("test_f32d_f32", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			false, true, conv_interleave_32_c);
+#if defined(HAVE_AVX512F)
+	if (cpu_flags & SPA_CPU_FLAG_AVX512) {
+		run_test_tolerance("test_f32_f32d_avx512", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			true, false, conv_deinterleave_32_avx512, 0);
+		run_test_tolerance("test_f32d_f32_avx512", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			false, true, conv_interleave_32_avx512, 0);
+	}
+#endif
+}
+
 int main(int argc, char *argv[])
 {
 	cpu_flags = get_cpu_flags();
@@ -336,6 +500,7 @@ int main(int argc, char *argv[])
 	test_f32_u8();
 	test_u8_f32();
 	test_f32_s16();
+	test_f32_s16_dither();
 	test_s16_f32();
 	test_f32_s32();
 	test_s32_f32();
@@ -343,5 +508,6 @@ int main(int argc, char *argv[])
 	test_s24_f32();
 	test_f32_s24_32();
 	test_s24_32_f32();
+	test_f32_f32();
 	return 0;
 }
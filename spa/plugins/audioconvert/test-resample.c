@@ -22,6 +22,8 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include "config.h"
+
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -34,7 +36,9 @@
 
 SPA_LOG_IMPL(logger);
 
+#include "test-helper.h"
 #include "resample.h"
+#include "resample-native-impl.h"
 
 #define N_SAMPLES	253
 #define N_CHANNELS	11
@@ -155,12 +159,279 @@ static void test_in_len(void)
 	resample_free(&r);
 }
 
+static void init_native(struct resample *r, uint32_t i_rate, uint32_t o_rate, int quality)
+{
+	spa_zero(*r);
+	r->log = &logger.log;
+	r->channels = 2;
+	r->i_rate = i_rate;
+	r->o_rate = o_rate;
+	r->quality = quality;
+	spa_assert(resample_native_init(r) == 0);
+}
+
+#define IL_SAMPLES	1024
+#define IL_CHANNELS	32
+
+static float il_in[IL_SAMPLES * IL_CHANNELS];
+static float il_out[IL_SAMPLES * 2 * IL_CHANNELS];
+static float pl_in[IL_CHANNELS][IL_SAMPLES];
+static float pl_out[IL_CHANNELS][IL_SAMPLES * 2];
+
+static uint32_t run_blocks(struct resample *r, const void *src[], void *dst[],
+		uint32_t stride, uint32_t block, double rate)
+{
+	uint32_t c, i, n_src, in_len, out_len, in_done = 0, out_done = 0;
+	const void *s[IL_CHANNELS];
+	void *d[IL_CHANNELS];
+
+	n_src = SPA_FLAG_IS_SET(r->options, RESAMPLE_OPTION_INTERLEAVED) ? 1 : r->channels;
+
+	for (i = 0; in_done < IL_SAMPLES; i++) {
+		for (c = 0; c < n_src; c++) {
+			s[c] = SPA_MEMBER(src[c], in_done * stride, void);
+			d[c] = SPA_MEMBER(dst[c], out_done * stride, void);
+		}
+		in_len = SPA_MIN(block, IL_SAMPLES - in_done);
+		out_len = IL_SAMPLES * 2 - out_done;
+		resample_process(r, s, &in_len, d, &out_len);
+		in_done += in_len;
+		out_done += out_len;
+		/* change the rate halfway to run the interpolating resampler */
+		if (i == 2)
+			resample_update_rate(r, rate);
+	}
+	return out_done;
+}
+
+static void test_interleaved(uint32_t flags, uint32_t n_channels)
+{
+	struct resample r[2];
+	const void *src[IL_CHANNELS];
+	void *dst[IL_CHANNELS];
+	uint32_t c, i, n_pl, n_il;
+
+	for (c = 0; c < n_channels; c++) {
+		for (i = 0; i < IL_SAMPLES; i++)
+			il_in[i * n_channels + c] = pl_in[c][i] = drand48() * 2.0 - 1.0;
+		src[c] = pl_in[c];
+		dst[c] = pl_out[c];
+	}
+
+	spa_zero(r[0]);
+	r[0].log = &logger.log;
+	r[0].channels = n_channels;
+	r[0].cpu_flags = flags;
+	r[0].i_rate = 44100;
+	r[0].o_rate = 48000;
+	r[0].quality = RESAMPLE_DEFAULT_QUALITY;
+	spa_assert(resample_native_init(&r[0]) == 0);
+
+	r[1] = r[0];
+	r[1].options = RESAMPLE_OPTION_INTERLEAVED;
+	spa_assert(resample_native_init(&r[1]) == 0);
+	spa_assert(r[0].cpu_flags == r[1].cpu_flags);
+
+	n_pl = run_blocks(&r[0], src, dst, sizeof(float), 97, 1.01);
+
+	src[0] = il_in;
+	dst[0] = il_out;
+	n_il = run_blocks(&r[1], src, dst, n_channels * sizeof(float), 97, 1.01);
+
+	spa_assert(n_pl == n_il);
+	for (c = 0; c < n_channels; c++) {
+		for (i = 0; i < n_pl; i++) {
+			float diff = fabsf(il_out[i * n_channels + c] - pl_out[c][i]);
+			if (diff > 1e-5f)
+				fprintf(stderr, "%08x %d %d %d: %f != %f\n", flags, n_channels, c, i,
+						il_out[i * n_channels + c], pl_out[c][i]);
+			spa_assert(diff <= 1e-5f);
+		}
+	}
+	resample_free(&r[0]);
+	resample_free(&r[1]);
+}
+
+static void test_interleaved_all(void)
+{
+	static const uint32_t channels[] = { 1, 2, 3, 4, 5, 6, 8, 11, 16, 24, 32 };
+	static const uint32_t flags[] = {
+		0,
+		SPA_CPU_FLAG_SSE,
+		SPA_CPU_FLAG_AVX | SPA_CPU_FLAG_FMA3,
+	};
+	uint32_t cpu_flags = get_cpu_flags();
+	size_t i, j;
+
+	for (i = 0; i < SPA_N_ELEMENTS(flags); i++) {
+		if ((cpu_flags & flags[i]) != flags[i])
+			continue;
+		for (j = 0; j < SPA_N_ELEMENTS(channels); j++)
+			test_interleaved(flags[i], channels[j]);
+	}
+}
+
+static float drift_out[IL_SAMPLES * 2 * IL_CHANNELS];
+
+static void test_drift(uint32_t flags, uint32_t in_rate, uint32_t out_rate, double drift,
+		uint32_t options)
+{
+	struct resample r[2];
+	struct native_data *d[2];
+	const void *src[IL_CHANNELS];
+	void *dst[2][IL_CHANNELS];
+	uint32_t c, i, n_ref, n_drift, n_channels = 6, stride;
+	bool interleaved = SPA_FLAG_IS_SET(options, RESAMPLE_OPTION_INTERLEAVED);
+
+	for (c = 0; c < n_channels; c++) {
+		for (i = 0; i < IL_SAMPLES; i++)
+			il_in[i * n_channels + c] = pl_in[c][i] =
+				0.5f * sinf(2.0f * M_PI * (c + 1) * 997.0f * i / in_rate);
+		src[c] = pl_in[c];
+		dst[0][c] = pl_out[c];
+		dst[1][c] = &drift_out[c * IL_SAMPLES * 2];
+	}
+	if (interleaved) {
+		src[0] = il_in;
+		dst[0][0] = il_out;
+		dst[1][0] = drift_out;
+	}
+	stride = interleaved ? n_channels : 1;
+
+	spa_zero(r[0]);
+	r[0].log = &logger.log;
+	r[0].channels = n_channels;
+	r[0].cpu_flags = flags;
+	r[0].i_rate = in_rate;
+	r[0].o_rate = out_rate;
+	r[0].quality = RESAMPLE_DEFAULT_QUALITY;
+	r[0].options = options;
+	spa_assert(resample_native_init(&r[0]) == 0);
+	r[1] = r[0];
+	spa_assert(resample_native_init(&r[1]) == 0);
+	d[0] = r[0].data;
+	d[1] = r[1].data;
+
+	/* small corrections select the drift resampler, the interpolating
+	 * resampler is used as the reference */
+	resample_update_rate(&r[0], drift);
+	resample_update_rate(&r[1], drift);
+	if (interleaved) {
+		spa_assert(d[1]->func == d[1]->info->process_drift_interleaved);
+		d[0]->func = d[0]->info->process_inter_interleaved;
+	} else {
+		spa_assert(d[1]->func == d[1]->info->process_drift);
+		d[0]->func = d[0]->info->process_inter;
+	}
+
+	n_ref = run_blocks(&r[0], src, dst[0], stride * sizeof(float), 128, drift);
+	n_drift = run_blocks(&r[1], src, dst[1], stride * sizeof(float), 128, drift);
+	spa_assert(n_ref == n_drift);
+
+	for (c = 0; c < n_channels; c++) {
+		for (i = 0; i < n_drift; i++) {
+			float a, b;
+
+			if (interleaved) {
+				a = il_out[i * n_channels + c];
+				b = drift_out[i * n_channels + c];
+			} else {
+				a = pl_out[c][i];
+				b = drift_out[c * IL_SAMPLES * 2 + i];
+			}
+			if (fabsf(a - b) > 1e-4f)
+				fprintf(stderr, "%08x %d %d %f %d %d: %f != %f\n", flags,
+						in_rate, out_rate, drift, c, i, a, b);
+			spa_assert(fabsf(a - b) <= 1e-4f);
+		}
+	}
+
+	/* larger changes use the interpolating resampler */
+	resample_update_rate(&r[1], 1.05);
+	spa_assert(d[1]->func == (interleaved ?
+				d[1]->info->process_inter_interleaved :
+				d[1]->info->process_inter));
+
+	resample_free(&r[0]);
+	resample_free(&r[1]);
+}
+
+static void test_drift_all(void)
+{
+	static const uint32_t flags[] = {
+		0,
+		SPA_CPU_FLAG_SSE,
+		SPA_CPU_FLAG_AVX | SPA_CPU_FLAG_FMA3,
+	};
+	static const double drifts[] = { 1.00001, 0.9998, 1.003, 0.991 };
+	uint32_t cpu_flags = get_cpu_flags();
+	size_t i, j;
+
+	for (i = 0; i < SPA_N_ELEMENTS(flags); i++) {
+		if ((cpu_flags & flags[i]) != flags[i])
+			continue;
+		for (j = 0; j < SPA_N_ELEMENTS(drifts); j++) {
+			test_drift(flags[i], 48000, 48000, drifts[j], 0);
+			test_drift(flags[i], 44100, 44100, drifts[j], RESAMPLE_OPTION_INTERLEAVED);
+			/* corrections on top of a rate conversion */
+			test_drift(flags[i], 44100, 48000, drifts[j], 0);
+			test_drift(flags[i], 48000, 44100, drifts[j], RESAMPLE_OPTION_INTERLEAVED);
+		}
+	}
+}
+
+static void test_filter_cache(void)
+{
+	struct resample r[3];
+	struct native_data *d[3];
+	uint64_t hits, misses, hits0, misses0;
+
+	resample_native_get_stats(&hits0, &misses0);
+
+	init_native(&r[0], 44100, 48000, RESAMPLE_DEFAULT_QUALITY);
+	init_native(&r[1], 44100, 48000, RESAMPLE_DEFAULT_QUALITY);
+	init_native(&r[2], 44100, 48000, RESAMPLE_DEFAULT_QUALITY + 1);
+	d[0] = r[0].data;
+	d[1] = r[1].data;
+	d[2] = r[2].data;
+
+	/* same rates and quality share the filter */
+	spa_assert(d[0]->filter == d[1]->filter);
+	spa_assert(d[0]->filter != d[2]->filter);
+	spa_assert(d[0]->history != d[1]->history);
+
+	resample_native_get_stats(&hits, &misses);
+	spa_assert(hits == hits0 + 1);
+	spa_assert(misses == misses0 + 2);
+
+	/* the filter stays alive while it is used */
+	resample_free(&r[0]);
+	init_native(&r[0], 88200, 96000, RESAMPLE_DEFAULT_QUALITY);
+	resample_native_get_stats(&hits, &misses);
+	spa_assert(hits == hits0 + 2);
+	spa_assert(misses == misses0 + 2);
+
+	resample_free(&r[0]);
+	resample_free(&r[1]);
+	resample_free(&r[2]);
+
+	/* and is rebuilt when the last user went away */
+	init_native(&r[0], 44100, 48000, RESAMPLE_DEFAULT_QUALITY);
+	resample_native_get_stats(&hits, &misses);
+	spa_assert(hits == hits0 + 2);
+	spa_assert(misses == misses0 + 3);
+	resample_free(&r[0]);
+}
+
 int main(int argc, char *argv[])
 {
 	logger.log.level = SPA_LOG_LEVEL_TRACE;
 
 	test_native();
 	test_in_len();
+	test_filter_cache();
+	test_interleaved_all();
+	test_drift_all();
 
 	return 0;
 }
@@ -0,0 +1,140 @@
+/* Spa
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+
+#include <spa/param/audio/raw.h>
+
+#include "../audioconvert/test-helper.h"
+#include "mix-ops.h"
+
+/* Mixes many sources into one buffer, like an input port of a JACK client
+ * with many connections. The pairwise mix adds one source at a time to the
+ * destination, the way the JACK client used to mix. */
+
+#define MAX_SAMPLES	1024
+#define MAX_SRC		32
+#define MAX_COUNT	20000
+
+static uint32_t cpu_flags;
+
+static float samples[MAX_SRC][MAX_SAMPLES] __attribute__ ((aligned (64)));
+static float dst[MAX_SAMPLES] __attribute__ ((aligned (64)));
+
+static const uint32_t src_counts[] = { 2, 4, 8, 16, 32 };
+static const uint32_t sample_counts[] = { 256, 1024 };
+
+static inline uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void mix_pairwise(struct mix_ops *ops, void * SPA_RESTRICT d,
+		const void * SPA_RESTRICT src[], uint32_t n_src, uint32_t n_samples)
+{
+	const void *s[2];
+	uint32_t i;
+
+	mix_ops_process(ops, d, src, 1, n_samples);
+	for (i = 1; i < n_src; i++) {
+		s[0] = d;
+		s[1] = src[i];
+		mix_ops_process(ops, d, s, 2, n_samples);
+	}
+}
+
+static void run(const char *name, struct mix_ops *ops, bool pairwise,
+		uint32_t n_src, uint32_t n_samples)
+{
+	const void *src[MAX_SRC];
+	uint64_t t1, t2;
+	uint32_t i;
+
+	for (i = 0; i < n_src; i++)
+		src[i] = samples[i];
+
+	t1 = get_time_ns();
+	for (i = 0; i < MAX_COUNT; i++) {
+		if (pairwise)
+			mix_pairwise(ops, dst, src, n_src, n_samples);
+		else
+			mix_ops_process(ops, dst, src, n_src, n_samples);
+	}
+	t2 = get_time_ns();
+
+	fprintf(stderr, "%-8s %-8s sources:%3u samples:%5u ns/mix:%7"PRIu64" Msamples/sec:%6"PRIu64"\n",
+			name, pairwise ? "pairwise" : "single",
+			n_src, n_samples, (t2 - t1) / MAX_COUNT,
+			(uint64_t)MAX_COUNT * n_src * n_samples * 1000 / SPA_MAX(t2 - t1, 1u));
+}
+
+int main(int argc, char *argv[])
+{
+	static const struct {
+		const char *name;
+		uint32_t flags;
+	} levels[] = {
+		{ "c", 0 },
+		{ "sse", SPA_CPU_FLAG_SSE },
+		{ "avx", SPA_CPU_FLAG_SSE | SPA_CPU_FLAG_AVX },
+		{ "avx512", SPA_CPU_FLAG_SSE | SPA_CPU_FLAG_AVX | SPA_CPU_FLAG_AVX512 },
+	};
+	struct mix_ops ops;
+	size_t i, j, k;
+
+	cpu_flags = get_cpu_flags();
+
+	for (i = 0; i < MAX_SRC; i++)
+		for (j = 0; j < MAX_SAMPLES; j++)
+			samples[i][j] = (float)(i + j) / (MAX_SRC + MAX_SAMPLES);
+
+	for (i = 0; i < SPA_N_ELEMENTS(levels); i++) {
+		if ((levels[i].flags & cpu_flags) != levels[i].flags)
+			continue;
+
+		spa_zero(ops);
+		ops.fmt = SPA_AUDIO_FORMAT_F32;
+		ops.n_channels = 1;
+		ops.cpu_flags = levels[i].flags;
+		if (mix_ops_init(&ops) < 0)
+			continue;
+
+		for (j = 0; j < SPA_N_ELEMENTS(sample_counts); j++) {
+			for (k = 0; k < SPA_N_ELEMENTS(src_counts); k++) {
+				run(levels[i].name, &ops, true, src_counts[k], sample_counts[j]);
+				run(levels[i].name, &ops, false, src_counts[k], sample_counts[j]);
+			}
+		}
+		mix_ops_free(&ops);
+	}
+	return 0;
+}
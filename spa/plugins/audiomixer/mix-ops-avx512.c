@@ -0,0 +1,79 @@
+/* Spa
+ *
+ * Copyright © 2019 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <spa/utils/defs.h>
+
+#include "mix-ops.h"
+
+#include <immintrin.h>
+
+void
+mix_f32_avx512(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_src, uint32_t n_samples)
+{
+	const float **s = (const float **)src;
+	float *d = dst;
+	uint32_t i, n, unrolled;
+
+	if (n_src == 0) {
+		memset(dst, 0, n_samples * sizeof(float));
+		return;
+	}
+	if (n_src == 1) {
+		if (dst != src[0])
+			memcpy(dst, src[0], n_samples * sizeof(float));
+		return;
+	}
+
+	unrolled = n_samples & ~63;
+
+	for (n = 0; n < unrolled; n += 64) {
+		__m512 acc[4];
+
+		acc[0] = _mm512_loadu_ps(&s[0][n +  0]);
+		acc[1] = _mm512_loadu_ps(&s[0][n + 16]);
+		acc[2] = _mm512_loadu_ps(&s[0][n + 32]);
+		acc[3] = _mm512_loadu_ps(&s[0][n + 48]);
+		for (i = 1; i < n_src; i++) {
+			acc[0] = _mm512_add_ps(acc[0], _mm512_loadu_ps(&s[i][n +  0]));
+			acc[1] = _mm512_add_ps(acc[1], _mm512_loadu_ps(&s[i][n + 16]));
+			acc[2] = _mm512_add_ps(acc[2], _mm512_loadu_ps(&s[i][n + 32]));
+			acc[3] = _mm512_add_ps(acc[3], _mm512_loadu_ps(&s[i][n + 48]));
+		}
+		_mm512_storeu_ps(&d[n +  0], acc[0]);
+		_mm512_storeu_ps(&d[n + 16], acc[1]);
+		_mm512_storeu_ps(&d[n + 32], acc[2]);
+		_mm512_storeu_ps(&d[n + 48], acc[3]);
+	}
+	for (; n < n_samples; n++) {
+		float sum = s[0][n];
+		for (i = 1; i < n_src; i++)
+			sum += s[i][n];
+		d[n] = sum;
+	}
+}
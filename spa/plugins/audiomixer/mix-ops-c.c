@@ -30,22 +30,41 @@
 
 #include "mix-ops.h"
 
+#define MIX_CHUNK	256
+
+/* Sum the sources in chunks that stay in the cache so that every source
+ * is read once and the destination is written once. */
 void
 mix_f32_c(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
 		uint32_t n_src, uint32_t n_samples)
 {
-	uint32_t i, n;
+	const float **s = (const float **)src;
 	float *d = dst;
+	uint32_t i, n, j, chunk;
 
-	if (n_src == 0)
+	if (n_src == 0) {
 		memset(dst, 0, n_samples * sizeof(float));
-	else if (dst != src[0])
-		memcpy(dst, src[0], n_samples * sizeof(float));
+		return;
+	}
+	if (n_src == 1) {
+		if (dst != src[0])
+			memcpy(dst, src[0], n_samples * sizeof(float));
+		return;
+	}
 
-	for (i = 1; i < n_src; i++) {
-		const float *s = src[i];
-		for (n = 0; n < n_samples; n++)
-			d[n] += s[n];
+	for (n = 0; n < n_samples; n += chunk) {
+		float acc[MIX_CHUNK];
+
+		chunk = SPA_MIN(n_samples - n, (uint32_t)MIX_CHUNK);
+
+		for (j = 0; j < chunk; j++)
+			acc[j] = s[0][n + j];
+		for (i = 1; i < n_src; i++) {
+			const float *si = &s[i][n];
+			for (j = 0; j < chunk; j++)
+				acc[j] += si[j];
+		}
+		memcpy(&d[n], acc, chunk * sizeof(float));
 	}
 }
 
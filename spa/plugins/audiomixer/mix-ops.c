@@ -46,6 +46,10 @@ struct mix_info {
 static struct mix_info mix_table[] =
 {
 	/* f32 */
+#if defined(HAVE_AVX512F)
+	{ SPA_AUDIO_FORMAT_F32, 1, SPA_CPU_FLAG_AVX512, 4, mix_f32_avx512 },
+	{ SPA_AUDIO_FORMAT_F32P, 1, SPA_CPU_FLAG_AVX512, 4, mix_f32_avx512 },
+#endif
 #if defined(HAVE_AVX)
 	{ SPA_AUDIO_FORMAT_F32, 1, SPA_CPU_FLAG_AVX, 4, mix_f32_avx },
 	{ SPA_AUDIO_FORMAT_F32P, 1, SPA_CPU_FLAG_AVX, 4, mix_f32_avx },
@@ -53,6 +53,8 @@ void mix_##name##_##arch(struct mix_ops *ops, void * SPA_RESTRICT dst,	\
 DEFINE_FUNCTION(f32, c);
 DEFINE_FUNCTION(f64, c);
 
+/* The SIMD f32 versions sum all sources in registers so that every source
+ * is read once and the destination is written once. */
 #if defined(HAVE_SSE)
 DEFINE_FUNCTION(f32, sse);
 #endif
@@ -62,3 +64,6 @@ DEFINE_FUNCTION(f64, sse2);
 #if defined(HAVE_AVX)
 DEFINE_FUNCTION(f32, avx);
 #endif
+#if defined(HAVE_AVX512F)
+DEFINE_FUNCTION(f32, avx512);
+#endif
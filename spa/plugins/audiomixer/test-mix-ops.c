@@ -0,0 +1,132 @@
+/* Spa
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <spa/param/audio/raw.h>
+
+#include "../audioconvert/test-helper.h"
+#include "mix-ops.h"
+
+#define MAX_SAMPLES	1024
+#define MAX_SRC		40
+
+static uint32_t cpu_flags;
+
+static float samples[MAX_SRC][MAX_SAMPLES + 16];
+static float dst[MAX_SAMPLES + 16];
+static float ref[MAX_SAMPLES + 16];
+
+static const uint32_t sample_counts[] = { 0, 1, 15, 16, 31, 33, 64, 255, 1024 };
+static const uint32_t src_counts[] = { 0, 1, 2, 3, 4, 5, 16, 32, 40 };
+
+static void gen_samples(void)
+{
+	uint32_t i, n;
+
+	for (i = 0; i < MAX_SRC; i++)
+		for (n = 0; n < MAX_SAMPLES + 16; n++)
+			samples[i][n] = (float)((int)((i * 7919 + n * 104729) % 2001) - 1000) / 1000.0f;
+}
+
+static void run_test(struct mix_ops *ops, uint32_t n_src, uint32_t n_samples,
+		uint32_t offset, bool in_place)
+{
+	const void *src[MAX_SRC];
+	float *d;
+	uint32_t i, n;
+
+	for (n = 0; n < n_samples; n++) {
+		float sum = 0.0f;
+		for (i = 0; i < n_src; i++)
+			sum = i == 0 ? samples[i][n + offset] : sum + samples[i][n + offset];
+		ref[n] = sum;
+	}
+	d = &dst[offset];
+	memset(dst, 0xff, sizeof(dst));
+	for (i = 0; i < n_src; i++)
+		src[i] = &samples[i][offset];
+	if (in_place && n_src > 0) {
+		memcpy(d, src[0], n_samples * sizeof(float));
+		src[0] = d;
+	}
+
+	mix_ops_process(ops, d, src, n_src, n_samples);
+
+	spa_assert(memcmp(d, ref, n_samples * sizeof(float)) == 0);
+	/* nothing is written after the samples */
+	spa_assert(*(uint32_t *)&d[n_samples] == 0xffffffff);
+}
+
+static void test_f32(uint32_t flags)
+{
+	struct mix_ops ops;
+	size_t i, j;
+	uint32_t offset;
+
+	spa_zero(ops);
+	ops.fmt = SPA_AUDIO_FORMAT_F32;
+	ops.n_channels = 1;
+	ops.cpu_flags = flags;
+	spa_assert(mix_ops_init(&ops) == 0);
+
+	fprintf(stderr, "test f32 cpu_flags:%08x\n", ops.cpu_flags);
+
+	for (i = 0; i < SPA_N_ELEMENTS(src_counts); i++) {
+		for (j = 0; j < SPA_N_ELEMENTS(sample_counts); j++) {
+			for (offset = 0; offset < 4; offset++) {
+				run_test(&ops, src_counts[i], sample_counts[j], offset, false);
+				run_test(&ops, src_counts[i], sample_counts[j], offset, true);
+			}
+		}
+	}
+	mix_ops_free(&ops);
+}
+
+int main(int argc, char *argv[])
+{
+	static const uint32_t levels[] = {
+		0,
+		SPA_CPU_FLAG_SSE,
+		SPA_CPU_FLAG_SSE | SPA_CPU_FLAG_AVX,
+		SPA_CPU_FLAG_SSE | SPA_CPU_FLAG_AVX | SPA_CPU_FLAG_AVX512,
+	};
+	size_t i;
+
+	cpu_flags = get_cpu_flags();
+	printf("got get CPU flags %d\n", cpu_flags);
+
+	gen_samples();
+
+	for (i = 0; i < SPA_N_ELEMENTS(levels); i++) {
+		if ((levels[i] & cpu_flags) == levels[i])
+			test_f32(levels[i]);
+	}
+	return 0;
+}
@@ -423,6 +423,7 @@ static int codec_increase_bitpool(void *data)
 }
 
 const struct a2dp_codec a2dp_codec_aac = {
+	.flags = A2DP_CODEC_FLAG_ENCODE_THREAD,
 	.codec_id = A2DP_CODEC_MPEG24,
 	.name = "aac",
 	.description = "AAC",
@@ -481,6 +481,7 @@ static int codec_encode(void *data,
 }
 
 const struct a2dp_codec a2dp_codec_ldac = {
+	.flags = A2DP_CODEC_FLAG_ENCODE_THREAD,
 	.codec_id = A2DP_CODEC_VENDOR,
 	.vendor = { .vendor_id = LDAC_VENDOR_ID,
 		.codec_id = LDAC_CODEC_ID },
@@ -325,6 +325,11 @@ static inline int a2dp_sbc_get_frequency(a2dp_sbc_t *config)
 struct a2dp_codec_handle;
 
 struct a2dp_codec {
+/** encoding is too expensive for the data thread. The sink then calls
+ * start_encode, encode, abr_process and the bitpool functions from
+ * a separate encoder thread and only sends the finished packets from
+ * the data thread. */
+#define A2DP_CODEC_FLAG_ENCODE_THREAD	(1<<0)
 	uint32_t flags;
 
 	uint8_t codec_id;
@@ -25,6 +25,7 @@
 #include <unistd.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <pthread.h>
 #include <arpa/inet.h>
 #include <sys/ioctl.h>
 
@@ -36,6 +37,7 @@
 #include <spa/utils/keys.h>
 #include <spa/utils/names.h>
 #include <spa/utils/result.h>
+#include <spa/utils/ringbuffer.h>
 #include <spa/monitor/device.h>
 
 #include <spa/node/node.h>
@@ -63,6 +65,9 @@ struct props {
 #define FILL_FRAMES 2
 #define MAX_BUFFERS 32
 
+#define PCM_RING_SIZE		(64 * 1024)
+#define PACKET_RING_SIZE	(32 * 1024)
+
 struct buffer {
 	uint32_t id;
 #define BUFFER_FLAG_OUT	(1<<0)
@@ -141,6 +146,22 @@ struct impl {
 	uint8_t tmp_buffer[4096];
 	uint32_t tmp_buffer_used;
 	uint32_t fd_buffer_size;
+
+	/* with A2DP_CODEC_FLAG_ENCODE_THREAD, flush_data queues the samples
+	 * in pcm_ring and the encode thread queues the finished packets,
+	 * a uint32_t size followed by the data, in packet_ring */
+	unsigned int use_thread:1;
+	int thread_running;
+	pthread_t thread;
+	int encode_fd;
+	struct spa_source packet_source;
+	struct spa_ringbuffer pcm_ring;
+	uint8_t pcm_data[PCM_RING_SIZE];
+	struct spa_ringbuffer packet_ring;
+	uint8_t packet_data[PACKET_RING_SIZE];
+	uint8_t packet[4096];
+	int32_t abr_unsent;
+	int32_t bitpool_change;
 };
 
 #define NAME "a2dp-sink"
@@ -471,12 +492,262 @@ static void enable_flush(struct impl *this, bool enabled)
 	}
 }
 
+/* apply the changes asked for by the data thread, called from the encode
+ * thread before it starts a new packet */
+static void update_codec(struct impl *this)
+{
+	int32_t unsent, change;
+
+	unsent = __atomic_exchange_n(&this->abr_unsent, -1, __ATOMIC_SEQ_CST);
+	if (unsent >= 0)
+		this->codec->abr_process(this->codec_data, unsent);
+
+	change = __atomic_exchange_n(&this->bitpool_change, 0, __ATOMIC_SEQ_CST);
+	for (; change < 0; change++)
+		this->codec->reduce_bitpool(this->codec_data);
+	for (; change > 0; change--)
+		this->codec->increase_bitpool(this->codec_data);
+
+	update_num_blocks(this);
+}
+
+static void queue_packet(struct impl *this)
+{
+	uint32_t index, size = this->buffer_used;
+	int32_t filled;
+
+	filled = spa_ringbuffer_get_write_index(&this->packet_ring, &index);
+	if (filled < 0 || PACKET_RING_SIZE - (uint32_t) filled < sizeof(size) + size) {
+		spa_log_debug(this->log, NAME " %p: packet ring full, drop packet of %u bytes",
+				this, size);
+	} else {
+		spa_log_trace(this->log, NAME " %p: queue %d %u %u %u",
+				this, this->frame_count, this->seqnum, this->timestamp, size);
+
+		spa_ringbuffer_write_data(&this->packet_ring, this->packet_data, PACKET_RING_SIZE,
+				index & (PACKET_RING_SIZE - 1), &size, sizeof(size));
+		index += sizeof(size);
+		spa_ringbuffer_write_data(&this->packet_ring, this->packet_data, PACKET_RING_SIZE,
+				index & (PACKET_RING_SIZE - 1), this->buffer, size);
+		spa_ringbuffer_write_update(&this->packet_ring, index + size);
+
+		spa_system_eventfd_write(this->data_system, this->packet_source.fd, 1);
+	}
+	reset_buffer(this);
+	update_codec(this);
+}
+
+/* encode the whole blocks in pcm_ring. Like the forced flush of
+ * flush_data, a partial packet is sent when the samples run out */
+static void encode_samples(struct impl *this)
+{
+	struct port *port = &this->port;
+	uint32_t index, offs, empty = this->buffer_used;
+	int32_t avail;
+	int processed;
+	size_t out_encoded;
+	const void *src;
+
+	while (true) {
+		avail = spa_ringbuffer_get_read_index(&this->pcm_ring, &index);
+		if (avail < (int32_t) this->block_size)
+			break;
+
+		offs = index & (PCM_RING_SIZE - 1);
+		avail = SPA_MIN((uint32_t) avail, PCM_RING_SIZE - offs);
+		if (avail >= (int32_t) this->block_size) {
+			src = &this->pcm_data[offs];
+			avail -= avail % this->block_size;
+		} else {
+			/* the block wraps around the end of the ring */
+			spa_ringbuffer_read_data(&this->pcm_ring, this->pcm_data, PCM_RING_SIZE,
+					offs, this->tmp_buffer, this->block_size);
+			src = this->tmp_buffer;
+			avail = this->block_size;
+		}
+
+		processed = this->codec->encode(this->codec_data,
+				src, avail,
+				this->buffer + this->buffer_used,
+				sizeof(this->buffer) - this->buffer_used,
+				&out_encoded);
+		if (processed <= 0 && this->buffer_used > empty) {
+			/* no space left, try again in a new packet */
+			queue_packet(this);
+			empty = this->buffer_used;
+			continue;
+		}
+		if (processed <= 0) {
+			spa_log_warn(this->log, NAME " %p: error %s, drop %d bytes",
+					this, spa_strerror(processed), avail);
+			spa_ringbuffer_read_update(&this->pcm_ring, index + avail);
+			continue;
+		}
+		spa_ringbuffer_read_update(&this->pcm_ring, index + processed);
+
+		this->sample_count += processed / port->frame_size;
+		this->frame_count += processed / this->block_size;
+		this->buffer_used += out_encoded;
+
+		spa_log_trace(this->log, NAME " %p: processed %d %zd used %d",
+				this, processed, out_encoded, this->buffer_used);
+
+		if (need_flush(this) || this->buffer_used >= sizeof(this->buffer)) {
+			queue_packet(this);
+			empty = this->buffer_used;
+		}
+	}
+	if (this->buffer_used > empty)
+		queue_packet(this);
+}
+
+static void *encode_thread(void *data)
+{
+	struct impl *this = data;
+	uint64_t count;
+	int res;
+
+	spa_log_debug(this->log, NAME " %p: enter encode thread", this);
+
+	while (__atomic_load_n(&this->thread_running, __ATOMIC_SEQ_CST)) {
+		if ((res = spa_system_eventfd_read(this->data_system, this->encode_fd, &count)) < 0) {
+			if (res == -EINTR)
+				continue;
+			spa_log_error(this->log, NAME " %p: read failed: %s",
+					this, spa_strerror(res));
+			break;
+		}
+		encode_samples(this);
+	}
+
+	spa_log_debug(this->log, NAME " %p: leave encode thread", this);
+	return NULL;
+}
+
+/* queue the samples of the ready buffers for the encode thread */
+static void queue_data(struct impl *this)
+{
+	struct port *port = &this->port;
+	uint32_t index, total = 0;
+	int32_t filled;
+
+	filled = spa_ringbuffer_get_write_index(&this->pcm_ring, &index);
+	if (filled < 0 || filled > PCM_RING_SIZE) {
+		spa_log_warn(this->log, NAME " %p: pcm ring xrun %d", this, filled);
+		return;
+	}
+
+	while (!spa_list_is_empty(&port->ready)) {
+		uint8_t *src;
+		uint32_t n_bytes;
+		struct buffer *b;
+		struct spa_data *d;
+		uint32_t offs, avail, l0, l1;
+
+		b = spa_list_first(&port->ready, struct buffer, link);
+		d = b->buf->datas;
+
+		src = d[0].data;
+
+		offs = (d[0].chunk->offset + port->ready_offset) % d[0].maxsize;
+		avail = d[0].chunk->size - port->ready_offset;
+
+		n_bytes = SPA_MIN(avail, PCM_RING_SIZE - (uint32_t) filled);
+		n_bytes -= n_bytes % port->frame_size;
+		if (n_bytes == 0)
+			break;
+
+		l0 = SPA_MIN(n_bytes, d[0].maxsize - offs);
+		l1 = n_bytes - l0;
+
+		spa_ringbuffer_write_data(&this->pcm_ring, this->pcm_data, PCM_RING_SIZE,
+				index & (PCM_RING_SIZE - 1), src + offs, l0);
+		if (l1 > 0)
+			spa_ringbuffer_write_data(&this->pcm_ring, this->pcm_data, PCM_RING_SIZE,
+					(index + l0) & (PCM_RING_SIZE - 1), src, l1);
+
+		index += n_bytes;
+		filled += n_bytes;
+		total += n_bytes;
+
+		port->ready_offset += n_bytes;
+
+		if (port->ready_offset >= d[0].chunk->size) {
+			spa_list_remove(&b->link);
+			SPA_FLAG_SET(b->flags, BUFFER_FLAG_OUT);
+			spa_log_trace(this->log, NAME " %p: reuse buffer %u", this, b->id);
+			this->port.io->buffer_id = b->id;
+
+			spa_node_call_reuse_buffer(&this->callbacks, 0, b->id);
+			port->ready_offset = 0;
+		}
+	}
+	if (total > 0) {
+		spa_log_trace(this->log, NAME " %p: queued %u bytes", this, total);
+		spa_ringbuffer_write_update(&this->pcm_ring, index);
+		spa_system_eventfd_write(this->data_system, this->encode_fd, 1);
+	}
+}
+
+/* send the packets that the encode thread finished. A packet stays in
+ * the ring until it is sent, on EAGAIN it is sent again from the flush
+ * source when the socket has space */
+static int send_packets(struct impl *this, uint64_t now_time)
+{
+	uint32_t index, size;
+	int written, unsent;
+
+	while (spa_ringbuffer_get_read_index(&this->packet_ring, &index) > 0) {
+		spa_ringbuffer_read_data(&this->packet_ring, this->packet_data, PACKET_RING_SIZE,
+				index & (PACKET_RING_SIZE - 1), &size, sizeof(size));
+		index += sizeof(size);
+		spa_ringbuffer_read_data(&this->packet_ring, this->packet_data, PACKET_RING_SIZE,
+				index & (PACKET_RING_SIZE - 1), this->packet, size);
+
+		unsent = get_transport_unused_size(this);
+		if (unsent >= 0)
+			__atomic_store_n(&this->abr_unsent, this->fd_buffer_size - unsent,
+					__ATOMIC_SEQ_CST);
+
+		written = send(this->flush_source.fd, this->packet, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+		spa_log_debug(this->log, NAME " %p: send %d", this, written);
+		if (written < 0 && errno == EAGAIN) {
+			spa_log_trace(this->log, NAME" %p: delay flush", this);
+			if (now_time - this->last_error > SPA_NSEC_PER_SEC / 2) {
+				__atomic_sub_fetch(&this->bitpool_change, 1, __ATOMIC_SEQ_CST);
+				this->last_error = now_time;
+			}
+			enable_flush(this, true);
+			return 0;
+		}
+		/* the packet is dropped on other errors */
+		spa_ringbuffer_read_update(&this->packet_ring, index + size);
+
+		if (written < 0) {
+			spa_log_trace(this->log, NAME" %p: error flushing %m", this);
+			return -errno;
+		}
+		if (now_time - this->last_error > SPA_NSEC_PER_SEC) {
+			__atomic_add_fetch(&this->bitpool_change, 1, __ATOMIC_SEQ_CST);
+			this->last_error = now_time;
+		}
+	}
+	enable_flush(this, false);
+	return 0;
+}
+
 static int flush_data(struct impl *this, uint64_t now_time)
 {
 	int written;
 	uint32_t total_frames, iter_buffer_used;
 	struct port *port = &this->port;
 
+	if (this->use_thread) {
+		queue_data(this);
+		return send_packets(this, now_time);
+	}
+
 	total_frames = 0;
 again:
 	iter_buffer_used = this->buffer_used;
@@ -587,6 +858,50 @@ static void a2dp_on_flush(struct spa_source *source)
 	flush_data(this, this->current_time);
 }
 
+static void a2dp_on_packet(struct spa_source *source)
+{
+	struct impl *this = source->data;
+	uint64_t count;
+	int res;
+
+	if ((res = spa_system_eventfd_read(this->data_system, source->fd, &count)) < 0) {
+		if (res != -EAGAIN)
+			spa_log_warn(this->log, NAME " %p: read failed: %s",
+					this, spa_strerror(res));
+		return;
+	}
+	send_packets(this, this->current_time);
+}
+
+static int start_thread(struct impl *this)
+{
+	int res;
+
+	spa_ringbuffer_init(&this->pcm_ring);
+	spa_ringbuffer_init(&this->packet_ring);
+	this->abr_unsent = -1;
+	this->bitpool_change = 0;
+
+	this->thread_running = true;
+	if ((res = pthread_create(&this->thread, NULL, encode_thread, this)) != 0) {
+		spa_log_error(this->log, NAME " %p: can't create encode thread: %s",
+				this, strerror(res));
+		this->thread_running = false;
+		return -res;
+	}
+	return 0;
+}
+
+static void stop_thread(struct impl *this)
+{
+	if (!this->thread_running)
+		return;
+
+	__atomic_store_n(&this->thread_running, false, __ATOMIC_SEQ_CST);
+	spa_system_eventfd_write(this->data_system, this->encode_fd, 1);
+	pthread_join(this->thread, NULL);
+}
+
 static void a2dp_on_timeout(struct spa_source *source)
 {
 	struct impl *this = source->data;
@@ -709,6 +1024,12 @@ static int do_start(struct impl *this)
 
 	reset_buffer(this);
 
+	this->use_thread = SPA_FLAG_IS_SET(this->codec->flags, A2DP_CODEC_FLAG_ENCODE_THREAD);
+	if (this->use_thread && (res = start_thread(this)) < 0)
+		return res;
+
+	spa_log_debug(this->log, NAME " %p: encode thread:%d", this, this->use_thread);
+
 	this->source.data = this;
 	this->source.fd = this->timerfd;
 	this->source.func = a2dp_on_timeout;
@@ -723,6 +1044,14 @@ static int do_start(struct impl *this)
 	this->flush_source.rmask = 0;
 	spa_loop_add_source(this->data_loop, &this->flush_source);
 
+	if (this->use_thread) {
+		this->packet_source.data = this;
+		this->packet_source.func = a2dp_on_packet;
+		this->packet_source.mask = SPA_IO_IN;
+		this->packet_source.rmask = 0;
+		spa_loop_add_source(this->data_loop, &this->packet_source);
+	}
+
 	set_timers(this);
 	this->started = true;
 
@@ -748,6 +1077,8 @@ static int do_remove_source(struct spa_loop *loop,
 	spa_system_timerfd_settime(this->data_system, this->timerfd, 0, &ts, NULL);
 	if (this->flush_source.loop)
 		spa_loop_remove_source(this->data_loop, &this->flush_source);
+	if (this->packet_source.loop)
+		spa_loop_remove_source(this->data_loop, &this->packet_source);
 
 	return 0;
 }
@@ -763,6 +1094,8 @@ static int do_stop(struct impl *this)
 
 	spa_loop_invoke(this->data_loop, do_remove_source, 0, NULL, 0, true, this);
 
+	stop_thread(this);
+
 	this->started = false;
 
 	if (this->transport)
@@ -1269,11 +1602,14 @@ static int impl_clear(struct spa_handle *handle)
 {
 	struct impl *this = (struct impl *) handle;
 
+	stop_thread(this);
 	if (this->codec_data)
 		this->codec->deinit(this->codec_data);
 	if (this->transport)
 		spa_hook_remove(&this->transport_listener);
 	spa_system_close(this->data_system, this->timerfd);
+	spa_system_close(this->data_system, this->encode_fd);
+	spa_system_close(this->data_system, this->packet_source.fd);
 	return 0;
 }
 
@@ -1294,6 +1630,7 @@ impl_init(const struct spa_handle_factory *factory,
 	struct impl *this;
 	struct port *port;
 	const char *str;
+	int res;
 
 	spa_return_val_if_fail(factory != NULL, -EINVAL);
 	spa_return_val_if_fail(handle != NULL, -EINVAL);
@@ -1363,13 +1700,32 @@ impl_init(const struct spa_handle_factory *factory,
 	}
 	this->codec = this->transport->a2dp_codec;
 
+	if ((res = spa_system_timerfd_create(this->data_system,
+			CLOCK_MONOTONIC, SPA_FD_CLOEXEC | SPA_FD_NONBLOCK)) < 0)
+		goto error;
+	this->timerfd = res;
+	/* the encode thread blocks on encode_fd */
+	if ((res = spa_system_eventfd_create(this->data_system,
+			SPA_FD_CLOEXEC)) < 0)
+		goto error_close_timerfd;
+	this->encode_fd = res;
+	if ((res = spa_system_eventfd_create(this->data_system,
+			SPA_FD_CLOEXEC | SPA_FD_NONBLOCK)) < 0)
+		goto error_close_encode_fd;
+	this->packet_source.fd = res;
+
 	spa_bt_transport_add_listener(this->transport,
 			&this->transport_listener, &transport_events, this);
 
-	this->timerfd = spa_system_timerfd_create(this->data_system,
-			CLOCK_MONOTONIC, SPA_FD_CLOEXEC | SPA_FD_NONBLOCK);
-
 	return 0;
+
+error_close_encode_fd:
+	spa_system_close(this->data_system, this->encode_fd);
+error_close_timerfd:
+	spa_system_close(this->data_system, this->timerfd);
+error:
+	spa_log_error(this->log, NAME " %p: can't create fds: %s", this, spa_strerror(res));
+	return res;
 }
 
 static const struct spa_interface_info impl_interfaces[] = {
@@ -0,0 +1,247 @@
+/* Spa A2DP codecs benchmark
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+
+#include <spa/utils/defs.h>
+#include <spa/utils/result.h>
+#include <spa/param/audio/format-utils.h>
+#include <spa/pod/iter.h>
+
+#include "a2dp-codecs.h"
+
+/* Encodes N_SECONDS of the same PCM with each codec and packs the blocks
+ * in packets like the sink does, for a link with an MTU of MTU bytes.
+ * The codecs use the config they select from their own caps and the
+ * default of the formats they enumerate. */
+
+#define MTU		895
+#define N_SECONDS	10
+
+static inline uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+/* a tone per channel with some noise, the same for every run */
+static int fill_corpus(void *data, const struct spa_audio_info_raw *info, uint32_t n_frames)
+{
+	uint32_t i, c, seed = 0x12345678;
+	uint8_t *d = data;
+
+	for (i = 0; i < n_frames; i++) {
+		for (c = 0; c < info->channels; c++) {
+			float v;
+			int32_t s;
+
+			seed = seed * 1103515245 + 12345;
+			v = 0.5f * sinf(2.0f * M_PI * (440.0f * (c + 1)) * i / info->rate) +
+				0.1f * ((int32_t) seed / (float) INT32_MAX);
+			s = (int32_t) (v * 0x7fffff00);
+
+			switch (info->format) {
+			case SPA_AUDIO_FORMAT_S16:
+				*(int16_t*)d = s >> 16;
+				d += 2;
+				break;
+			case SPA_AUDIO_FORMAT_S24:
+				d[0] = s >> 8;
+				d[1] = s >> 16;
+				d[2] = s >> 24;
+				d += 3;
+				break;
+			case SPA_AUDIO_FORMAT_S32:
+				*(int32_t*)d = s;
+				d += 4;
+				break;
+			case SPA_AUDIO_FORMAT_F32:
+				*(float*)d = v;
+				d += 4;
+				break;
+			default:
+				return -ENOTSUP;
+			}
+		}
+	}
+	return 0;
+}
+
+static const char *format_name(uint32_t format)
+{
+	switch (format) {
+	case SPA_AUDIO_FORMAT_S16:
+		return "S16";
+	case SPA_AUDIO_FORMAT_S24:
+		return "S24";
+	case SPA_AUDIO_FORMAT_S32:
+		return "S32";
+	case SPA_AUDIO_FORMAT_F32:
+		return "F32";
+	default:
+		return "?";
+	}
+}
+
+static int get_frame_size(const struct spa_audio_info_raw *info)
+{
+	switch (info->format) {
+	case SPA_AUDIO_FORMAT_S16:
+		return 2 * info->channels;
+	case SPA_AUDIO_FORMAT_S24:
+		return 3 * info->channels;
+	case SPA_AUDIO_FORMAT_S32:
+	case SPA_AUDIO_FORMAT_F32:
+		return 4 * info->channels;
+	default:
+		return -ENOTSUP;
+	}
+}
+
+static int get_format(const struct a2dp_codec *codec, const uint8_t *config, size_t config_size,
+		struct spa_audio_info *info)
+{
+	uint8_t buffer[4096];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct spa_pod *param;
+	int res;
+
+	if ((res = codec->enum_config(codec, config, config_size,
+				SPA_PARAM_EnumFormat, 0, &b, &param)) != 1)
+		return res < 0 ? res : -EINVAL;
+
+	spa_pod_fixate(param);
+
+	spa_zero(*info);
+	info->media_type = SPA_MEDIA_TYPE_audio;
+	info->media_subtype = SPA_MEDIA_SUBTYPE_raw;
+	if ((res = spa_format_audio_raw_parse(param, &info->info.raw)) < 0)
+		return res;
+
+	return 0;
+}
+
+static int run_codec(const struct a2dp_codec *codec)
+{
+	uint8_t caps[A2DP_MAX_CAPS_SIZE], config[A2DP_MAX_CAPS_SIZE];
+	uint8_t packet[4096];
+	struct spa_audio_info info;
+	void *data, *corpus = NULL;
+	int res, caps_size, config_size, frame_size, processed;
+	uint32_t block_size, num_blocks, n_frames, frame_count = 0;
+	uint32_t offs, used, header, n_blocks = 0, n_packets = 0;
+	uint64_t t1, t2, n_bytes = 0;
+	uint16_t seqnum = 0;
+	size_t out;
+
+	if (codec->encode == NULL)
+		return 0;
+
+	if ((caps_size = codec->fill_caps(codec, 0, caps)) < 0)
+		return caps_size;
+	if ((config_size = codec->select_config(codec, 0, caps, caps_size, NULL, config)) < 0)
+		return config_size;
+	if ((res = get_format(codec, config, config_size, &info)) < 0)
+		return res;
+	if ((frame_size = get_frame_size(&info.info.raw)) < 0)
+		return frame_size;
+
+	data = codec->init(codec, 0, config, config_size, &info, MTU);
+	if (data == NULL)
+		return -errno;
+
+	block_size = codec->get_block_size(data);
+	num_blocks = codec->get_num_blocks(data);
+
+	n_frames = info.info.raw.rate * N_SECONDS;
+	n_frames -= n_frames % (block_size / frame_size);
+
+	corpus = malloc(n_frames * frame_size);
+	if (corpus == NULL) {
+		res = -errno;
+		goto done;
+	}
+	if ((res = fill_corpus(corpus, &info.info.raw, n_frames)) < 0)
+		goto done;
+
+	t1 = get_time_ns();
+	header = used = codec->start_encode(data, packet, sizeof(packet), seqnum++, 0);
+	for (offs = 0; offs + block_size <= n_frames * frame_size; ) {
+		processed = codec->encode(data,
+				SPA_MEMBER(corpus, offs, void), block_size,
+				packet + used, sizeof(packet) - used, &out);
+		if (processed <= 0 && used == header) {
+			res = processed < 0 ? processed : -EIO;
+			goto done;
+		}
+		if (processed > 0) {
+			offs += processed;
+			used += out;
+			frame_count += processed / block_size;
+			n_blocks += processed / block_size;
+		}
+		/* a full packet or no space left for the next block */
+		if (processed <= 0 || frame_count >= num_blocks) {
+			n_bytes += used;
+			n_packets++;
+			frame_count = 0;
+			header = used = codec->start_encode(data, packet, sizeof(packet),
+					seqnum++, offs / frame_size);
+		}
+	}
+	t2 = get_time_ns();
+
+	fprintf(stderr, "%-8s rate:%6u channels:%u format:%-4s blocks:%6u packets:%6u "
+			"ns/block:%7"PRIu64" kbps:%5"PRIu64" realtime:%6.1fx\n",
+			codec->name, info.info.raw.rate, info.info.raw.channels,
+			format_name(info.info.raw.format),
+			n_blocks, n_packets, (t2 - t1) / SPA_MAX(n_blocks, 1u),
+			n_bytes * 8 / N_SECONDS / 1000,
+			(double) N_SECONDS * SPA_NSEC_PER_SEC / (t2 - t1));
+	res = 0;
+
+done:
+	free(corpus);
+	codec->deinit(data);
+	return res;
+}
+
+int main(int argc, char *argv[])
+{
+	int i, res;
+
+	for (i = 0; a2dp_codecs[i]; i++) {
+		const struct a2dp_codec *codec = a2dp_codecs[i];
+
+		if ((res = run_codec(codec)) < 0)
+			fprintf(stderr, "%-8s error: %s\n", codec->name, spa_strerror(res));
+	}
+	return 0;
+}
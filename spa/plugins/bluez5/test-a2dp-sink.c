@@ -0,0 +1,160 @@
+/* Spa A2DP sink test
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <sys/socket.h>
+
+#include <spa/utils/defs.h>
+
+/* the sink is built into the test to get to the packet ring of the
+ * encode thread path */
+#include "a2dp-sink.c"
+
+#define PACKET_SIZE	100
+#define N_PACKETS	4
+
+/* the node is not started, the transport is not used */
+int spa_bt_transport_acquire(struct spa_bt_transport *t, bool optional)
+{
+	return -ENOTSUP;
+}
+
+int spa_bt_transport_release(struct spa_bt_transport *t)
+{
+	return 0;
+}
+
+static uint32_t flush_mask;
+
+static int loop_update_source(void *object, struct spa_source *source)
+{
+	flush_mask = source->mask;
+	return 0;
+}
+
+static const struct spa_loop_methods loop_methods = {
+	SPA_VERSION_LOOP_METHODS,
+	.update_source = loop_update_source,
+};
+
+static struct spa_loop loop;
+
+/* queue a packet like the encode thread does */
+static void push_packet(struct impl *this, uint8_t val)
+{
+	uint32_t index, size = PACKET_SIZE;
+	int32_t filled;
+
+	memset(this->buffer, val, size);
+	filled = spa_ringbuffer_get_write_index(&this->packet_ring, &index);
+	spa_assert(filled >= 0);
+	spa_assert(PACKET_RING_SIZE - (uint32_t) filled >= sizeof(size) + size);
+
+	spa_ringbuffer_write_data(&this->packet_ring, this->packet_data, PACKET_RING_SIZE,
+			index & (PACKET_RING_SIZE - 1), &size, sizeof(size));
+	index += sizeof(size);
+	spa_ringbuffer_write_data(&this->packet_ring, this->packet_data, PACKET_RING_SIZE,
+			index & (PACKET_RING_SIZE - 1), this->buffer, size);
+	spa_ringbuffer_write_update(&this->packet_ring, index + size);
+}
+
+/* read all the packets from the socket, returns the number of packets */
+static uint32_t drain(int fd, uint8_t *first, uint32_t n_first)
+{
+	uint8_t data[4096];
+	uint32_t n = 0;
+	ssize_t len;
+
+	while ((len = recv(fd, data, sizeof(data), MSG_DONTWAIT)) > 0) {
+		if (n < n_first) {
+			spa_assert(len == PACKET_SIZE);
+			first[n] = data[0];
+		}
+		n++;
+	}
+	spa_assert(len < 0 && errno == EAGAIN);
+	return n;
+}
+
+static void test_send_eagain(void)
+{
+	struct impl *this;
+	uint8_t data[PACKET_SIZE], got[N_PACKETS];
+	uint32_t i, index, n_filled;
+	int fds[2];
+
+	this = calloc(1, sizeof(struct impl));
+	spa_assert(this != NULL);
+
+	spa_assert(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, fds) == 0);
+
+	loop.iface = SPA_INTERFACE_INIT(SPA_TYPE_INTERFACE_Loop, SPA_VERSION_LOOP,
+			&loop_methods, NULL);
+	this->data_loop = &loop;
+	this->flush_source.fd = fds[0];
+	this->flush_source.func = a2dp_on_flush;
+	this->flush_source.data = this;
+	this->use_thread = true;
+	spa_list_init(&this->port.ready);
+	spa_ringbuffer_init(&this->pcm_ring);
+	spa_ringbuffer_init(&this->packet_ring);
+
+	/* fill the socket until it returns EAGAIN */
+	memset(data, 0xff, sizeof(data));
+	for (n_filled = 0; send(fds[0], data, sizeof(data), MSG_DONTWAIT) > 0; n_filled++);
+	spa_assert(errno == EAGAIN);
+	spa_assert(n_filled > 0);
+
+	for (i = 0; i < N_PACKETS; i++)
+		push_packet(this, i);
+
+	/* nothing can be sent, the packets stay queued and the flush
+	 * source waits for the socket to have space */
+	spa_assert(send_packets(this, 0) == 0);
+	spa_assert(SPA_FLAG_IS_SET(flush_mask, SPA_IO_OUT));
+	spa_assert(spa_ringbuffer_get_read_index(&this->packet_ring, &index) ==
+			N_PACKETS * (int32_t)(sizeof(uint32_t) + PACKET_SIZE));
+
+	spa_assert(drain(fds[1], got, 0) == n_filled);
+
+	/* the flush source sends all the packets in order */
+	this->flush_source.rmask = SPA_IO_OUT;
+	a2dp_on_flush(&this->flush_source);
+	spa_assert(!SPA_FLAG_IS_SET(flush_mask, SPA_IO_OUT));
+	spa_assert(spa_ringbuffer_get_read_index(&this->packet_ring, &index) == 0);
+
+	spa_assert(drain(fds[1], got, N_PACKETS) == N_PACKETS);
+	for (i = 0; i < N_PACKETS; i++)
+		spa_assert(got[i] == i);
+
+	close(fds[0]);
+	close(fds[1]);
+	free(this);
+}
+
+int main(int argc, char *argv[])
+{
+	test_send_eagain();
+
+	return 0;
+}
@@ -43,6 +43,9 @@
 #define NAME "loop"
 
 #define DATAS_SIZE (4096 * 8)
+#define MAX_QUEUES 128u
+#define SPIN_REPORT (1u << 14)
+#define MAX_SPIN_USEC 10000
 
 /** \cond */
 
@@ -54,11 +57,40 @@ struct invoke_item {
 	size_t size;
 	bool block;
 	void *user_data;
-	int res;
 };
 
 static int loop_signal_event(void *object, struct spa_source *source);
 
+/* Each thread that invokes into the loop gets its own single producer queue
+ * so that the invokes don't need locks. When the ring of a queue is full, a
+ * larger ring is chained as the overflow and the producer continues there.
+ * The loop drains the rings of a queue in order and frees a ring when it is
+ * drained and the producer moved on to the next one. When all MAX_QUEUES are
+ * taken, the other threads share one more queue that is written with
+ * shared_lock held.
+ *
+ * The invokes of one thread are handled in order. The invokes of different
+ * threads are in different queues and are not ordered: the loop drains the
+ * queues one after the other, so an invoke can be handled before an invoke
+ * that another thread made earlier. */
+struct ring {
+	struct ring *next;	/**< next ring in the chain */
+	uint32_t size;
+	struct spa_ringbuffer buffer;
+	uint8_t *buffer_data;
+	uint8_t buffer_mem[];
+};
+
+struct queue {
+	struct impl *impl;
+	struct ring *first;	/**< ring that is read from, only used by the loop */
+	struct ring *tail;	/**< ring that is written to, only used by the producer */
+	uint32_t owned;		/**< a thread writes to this queue */
+	int ack_fd;		/**< ack of blocking invokes */
+	int res;		/**< result of the blocking invoke */
+	unsigned int shared:1;	/**< shared by the threads without a queue */
+};
+
 struct impl {
 	struct spa_handle handle;
 	struct spa_loop loop;
@@ -75,12 +107,18 @@ struct impl {
 	int poll_fd;
 	pthread_t thread;
 
+	uint64_t spin_nsec;
+	uint32_t spin_hits;
+	uint32_t spin_misses;
+
 	struct spa_source *wakeup;
-	int ack_fd;
+	uint32_t wakeup_pending;
 
-	struct spa_ringbuffer buffer;
-	uint8_t *buffer_data;
-	uint8_t buffer_mem[DATAS_SIZE + 8];
+	pthread_key_t queue_key;
+	pthread_mutex_t queue_lock;
+	uint32_t n_queues;
+	struct queue *queues[MAX_QUEUES + 1];	/**< the last one is the shared queue */
+	pthread_mutex_t shared_lock;
 
 	unsigned int flushing:1;
 };
@@ -124,35 +162,209 @@ static int loop_remove_source(void *object, struct spa_source *source)
 	return spa_system_pollfd_del(impl->system, impl->poll_fd, source->fd);
 }
 
-static void flush_items(struct impl *impl)
+static struct ring *ring_new(uint32_t size)
+{
+	struct ring *ring;
+
+	ring = calloc(1, sizeof(struct ring) + size + 8);
+	if (ring == NULL)
+		return NULL;
+
+	ring->size = size;
+	ring->buffer_data = SPA_PTR_ALIGN(ring->buffer_mem, 8, uint8_t);
+	spa_ringbuffer_init(&ring->buffer);
+
+	return ring;
+}
+
+static struct queue *queue_new(struct impl *impl)
+{
+	struct queue *queue;
+	int res;
+
+	queue = calloc(1, sizeof(struct queue));
+	if (queue == NULL)
+		return NULL;
+
+	if ((queue->first = ring_new(DATAS_SIZE)) == NULL)
+		goto error;
+
+	if ((res = spa_system_eventfd_create(impl->system,
+			SPA_FD_EVENT_SEMAPHORE | SPA_FD_CLOEXEC)) < 0) {
+		errno = -res;
+		goto error_free_ring;
+	}
+	queue->impl = impl;
+	queue->ack_fd = res;
+	queue->tail = queue->first;
+
+	return queue;
+
+error_free_ring:
+	free(queue->first);
+error:
+	free(queue);
+	return NULL;
+}
+
+static void queue_free(struct queue *queue)
+{
+	struct ring *r, *next;
+
+	for (r = queue->first; r; r = next) {
+		next = r->next;
+		free(r);
+	}
+	spa_system_close(queue->impl->system, queue->ack_fd);
+	free(queue);
+}
+
+/* The loop drains the rings in order, so the queue is drained when its
+ * last ring is. Only used when no thread owns the queue, the loop never
+ * frees the last ring. */
+static bool queue_is_empty(struct queue *queue)
 {
 	uint32_t index;
+	return spa_ringbuffer_get_read_index(&queue->tail->buffer, &index) == 0;
+}
+
+/* called when the thread that owns the queue exits */
+static void queue_release(void *data)
+{
+	struct queue *queue = data;
+	if (!queue->shared)
+		__atomic_store_n(&queue->owned, 0, __ATOMIC_SEQ_CST);
+}
+
+/* Get a queue for the current thread. A queue of a thread that exited is
+ * reused when it is drained, else a new queue is added. When there are
+ * MAX_QUEUES already, the thread uses the shared queue. */
+static struct queue *queue_acquire(struct impl *impl)
+{
+	struct queue *queue = NULL;
+	uint32_t i;
 	int res;
 
-	impl->flushing = true;
-	while (spa_ringbuffer_get_read_index(&impl->buffer, &index) > 0) {
+	pthread_mutex_lock(&impl->queue_lock);
+	for (i = 0; i < SPA_MIN(impl->n_queues, MAX_QUEUES); i++) {
+		struct queue *q = impl->queues[i];
+		if (__atomic_load_n(&q->owned, __ATOMIC_SEQ_CST) == 0 &&
+		    queue_is_empty(q)) {
+			queue = q;
+			break;
+		}
+	}
+	if (queue == NULL && impl->n_queues > MAX_QUEUES)
+		queue = impl->queues[MAX_QUEUES];
+
+	if (queue == NULL) {
+		if ((queue = queue_new(impl)) == NULL) {
+			res = -errno;
+			goto error;
+		}
+		queue->shared = impl->n_queues == MAX_QUEUES;
+		if (queue->shared)
+			spa_log_warn(impl->log, NAME " %p: more than %u threads invoke, "
+					"using the shared queue", impl, MAX_QUEUES);
+
+		impl->queues[impl->n_queues] = queue;
+		__atomic_store_n(&impl->n_queues, impl->n_queues + 1, __ATOMIC_RELEASE);
+	}
+	queue->owned = 1;
+	pthread_mutex_unlock(&impl->queue_lock);
+
+	pthread_setspecific(impl->queue_key, queue);
+
+	spa_log_debug(impl->log, NAME " %p: thread %lu queue %p", impl,
+			pthread_self(), queue);
+	return queue;
+
+error:
+	pthread_mutex_unlock(&impl->queue_lock);
+	spa_log_error(impl->log, NAME " %p: can't create queue: %s",
+			impl, spa_strerror(res));
+	errno = -res;
+	return NULL;
+}
+
+static uint32_t flush_ring(struct impl *impl, struct queue *queue, struct ring *ring)
+{
+	uint32_t index, count = 0;
+	int res;
+
+	while (spa_ringbuffer_get_read_index(&ring->buffer, &index) > 0) {
 		struct invoke_item *item;
 		bool block;
+		int ires;
 
-		item = SPA_MEMBER(impl->buffer_data, index & (DATAS_SIZE - 1), struct invoke_item);
+		item = SPA_MEMBER(ring->buffer_data, index & (ring->size - 1), struct invoke_item);
 		block = item->block;
 
 		spa_log_trace(impl->log, NAME " %p: flush item %p", impl, item);
-		item->res = item->func ? item->func(&impl->loop,
+		ires = item->func ? item->func(&impl->loop,
 				true, item->seq, item->data, item->size,
 			   item->user_data) : 0;
 
-		spa_ringbuffer_read_update(&impl->buffer, index + item->item_size);
+		spa_ringbuffer_read_update(&ring->buffer, index + item->item_size);
 
 		if (block) {
-			if ((res = spa_system_eventfd_write(impl->system, impl->ack_fd, 1)) < 0)
+			/* the producer waits for the ack of its blocking
+			 * invoke, there is only one result pending per queue */
+			queue->res = ires;
+			if ((res = spa_system_eventfd_write(impl->system, queue->ack_fd, 1)) < 0)
 				spa_log_warn(impl->log, NAME " %p: failed to write event fd: %s",
 						impl, spa_strerror(res));
 		}
+		count++;
 	}
+	return count;
+}
+
+static void flush_items(struct impl *impl)
+{
+	uint32_t i, n_queues, count;
+
+	impl->flushing = true;
+	/* invokes from now on need a new wakeup */
+	__atomic_store_n(&impl->wakeup_pending, 0, __ATOMIC_SEQ_CST);
+	do {
+		count = 0;
+		n_queues = __atomic_load_n(&impl->n_queues, __ATOMIC_ACQUIRE);
+		for (i = 0; i < n_queues; i++) {
+			struct queue *queue = impl->queues[i];
+			struct ring *r, *next;
+
+			for (r = queue->first; r; r = next) {
+				/* when there is a next ring, nothing is added to
+				 * this ring anymore and it can be drained completely
+				 * and freed before moving on */
+				next = __atomic_load_n(&r->next, __ATOMIC_ACQUIRE);
+				count += flush_ring(impl, queue, r);
+				if (next != NULL) {
+					queue->first = next;
+					free(r);
+				}
+			}
+		}
+		/* invokes from the callbacks are handled in the same flush */
+	} while (count > 0);
 	impl->flushing = false;
 }
 
+static inline uint32_t item_size(uint32_t offset, uint32_t queue_size, size_t size)
+{
+	uint32_t l0 = queue_size - offset, item_size;
+
+	if (l0 > sizeof(struct invoke_item) + size) {
+		item_size = SPA_ROUND_UP_N(sizeof(struct invoke_item) + size, 8);
+		if (l0 < sizeof(struct invoke_item) + item_size)
+			item_size = l0;
+	} else {
+		item_size = SPA_ROUND_UP_N(l0 + size, 8);
+	}
+	return item_size;
+}
+
 static int
 loop_invoke(void *object,
 	    spa_invoke_func_t func,
@@ -164,52 +376,92 @@ loop_invoke(void *object,
 {
 	struct impl *impl = object;
 	bool in_thread = pthread_equal(impl->thread, pthread_self());
+	struct queue *queue;
+	struct ring *ring;
 	struct invoke_item *item;
 	int res;
 	int32_t filled;
-	uint32_t avail, idx, offset, l0;
+	uint32_t avail, idx, offset, l0, isize;
+
+	queue = pthread_getspecific(impl->queue_key);
+	if (SPA_UNLIKELY(queue == NULL) &&
+	    (queue = queue_acquire(impl)) == NULL)
+		return -errno;
+
+	if (SPA_UNLIKELY(queue->shared)) {
+		/* the loop thread never waits for the shared queue, it would
+		 * deadlock with a blocking invoke that holds the lock */
+		if (in_thread)
+			return func ? func(&impl->loop, false, seq, data, size, user_data) : 0;
+		/* held until the ack of a blocking invoke so that the item
+		 * and the ack are not taken by another thread */
+		pthread_mutex_lock(&impl->shared_lock);
+	}
 
-	filled = spa_ringbuffer_get_write_index(&impl->buffer, &idx);
-	if (filled < 0 || filled > DATAS_SIZE) {
+	ring = queue->tail;
+again:
+	filled = spa_ringbuffer_get_write_index(&ring->buffer, &idx);
+	if (filled < 0 || filled > (int32_t)ring->size) {
 		spa_log_warn(impl->log, NAME " %p: queue xrun %d", impl, filled);
-		return -EPIPE;
+		res = -EPIPE;
+		goto done;
 	}
-	avail = DATAS_SIZE - filled;
-	if (avail < sizeof(struct invoke_item)) {
-		spa_log_warn(impl->log, NAME " %p: queue full %d", impl, avail);
-		return -EPIPE;
+	avail = ring->size - filled;
+	offset = idx & (ring->size - 1);
+	isize = item_size(offset, ring->size, size);
+
+	if (SPA_UNLIKELY(avail < isize || avail < sizeof(struct invoke_item) ||
+	    (filled == 0 && ring->size > DATAS_SIZE &&
+	     sizeof(struct invoke_item) + size + 8 <= DATAS_SIZE))) {
+		/* a full ring gets a larger one chained. An empty ring
+		 * that was grown for a burst is replaced by a default one,
+		 * the loop frees it */
+		struct ring *next;
+		uint32_t rsize = filled == 0 ? DATAS_SIZE : ring->size * 2;
+
+		while (rsize < sizeof(struct invoke_item) + size + 8)
+			rsize *= 2;
+
+		if ((next = ring_new(rsize)) == NULL) {
+			spa_log_warn(impl->log, NAME " %p: queue full %d", impl, avail);
+			res = -EPIPE;
+			goto done;
+		}
+		spa_log_debug(impl->log, NAME " %p: ring %p filled %d, next %p size:%u",
+				impl, ring, filled, next, rsize);
+
+		__atomic_store_n(&ring->next, next, __ATOMIC_RELEASE);
+		queue->tail = ring = next;
+		goto again;
 	}
-	offset = idx & (DATAS_SIZE - 1);
 
-	l0 = DATAS_SIZE - offset;
+	l0 = ring->size - offset;
 
-	item = SPA_MEMBER(impl->buffer_data, offset, struct invoke_item);
+	item = SPA_MEMBER(ring->buffer_data, offset, struct invoke_item);
 	item->func = func;
 	item->seq = seq;
 	item->size = size;
 	item->block = block;
 	item->user_data = user_data;
+	item->item_size = isize;
 
 	spa_log_trace(impl->log, NAME " %p: add item %p filled:%d", impl, item, filled);
 
-	if (l0 > sizeof(struct invoke_item) + size) {
+	if (l0 > sizeof(struct invoke_item) + size)
 		item->data = SPA_MEMBER(item, sizeof(struct invoke_item), void);
-		item->item_size = SPA_ROUND_UP_N(sizeof(struct invoke_item) + size, 8);
-		if (l0 < sizeof(struct invoke_item) + item->item_size)
-			item->item_size = l0;
-	} else {
-		item->data = impl->buffer_data;
-		item->item_size = SPA_ROUND_UP_N(l0 + size, 8);
-	}
+	else
+		item->data = ring->buffer_data;
+
 	if (data && size > 0)
 		memcpy(item->data, data, size);
 
-	spa_ringbuffer_write_update(&impl->buffer, idx + item->item_size);
+	spa_ringbuffer_write_update(&ring->buffer, idx + item->item_size);
 
 	if (in_thread) {
 		if (!impl->flushing)
 			flush_items(impl);
-	} else {
+	} else if (__atomic_exchange_n(&impl->wakeup_pending, 1, __ATOMIC_SEQ_CST) == 0) {
+		/* only the first invoke after a flush wakes up the loop */
 		loop_signal_event(impl, impl->wakeup);
 	}
 
@@ -218,13 +470,13 @@ loop_invoke(void *object,
 
 		spa_loop_control_hook_before(&impl->hooks_list);
 
-		if ((res = spa_system_eventfd_read(impl->system, impl->ack_fd, &count)) < 0)
+		if ((res = spa_system_eventfd_read(impl->system, queue->ack_fd, &count)) < 0)
 			spa_log_warn(impl->log, NAME " %p: failed to read event fd: %s",
 					impl, spa_strerror(res));
 
 		spa_loop_control_hook_after(&impl->hooks_list);
 
-		res = item->res;
+		res = queue->res;
 	}
 	else {
 		if (seq != SPA_ID_INVALID)
@@ -232,6 +484,9 @@ loop_invoke(void *object,
 		else
 			res = 0;
 	}
+done:
+	if (SPA_UNLIKELY(queue->shared))
+		pthread_mutex_unlock(&impl->shared_lock);
 	return res;
 }
 
@@ -257,6 +512,49 @@ loop_add_hook(void *object,
 	spa_hook_list_append(&impl->hooks_list, hook, hooks, data);
 }
 
+static void spin_report(struct impl *impl)
+{
+	uint32_t total = impl->spin_hits + impl->spin_misses;
+
+	if (total == 0)
+		return;
+
+	spa_log_info(impl->log, NAME " %p: spin %"PRIu64"us hits:%u misses:%u ratio:%.1f%%",
+			impl, (uint64_t)(impl->spin_nsec / SPA_NSEC_PER_USEC),
+			impl->spin_hits, impl->spin_misses,
+			impl->spin_hits * 100.0 / total);
+	impl->spin_hits = impl->spin_misses = 0;
+}
+
+/* Poll the fds without sleeping for spin_nsec before doing a blocking
+ * wait. This avoids the wakeup latency of the scheduler when events
+ * arrive within the spin time. */
+static int loop_spin(struct impl *impl, struct spa_poll_event *ep, int n_ep)
+{
+	struct timespec ts;
+	uint64_t end;
+	int nfds;
+
+	spa_system_clock_gettime(impl->system, CLOCK_MONOTONIC, &ts);
+	end = (uint64_t)SPA_TIMESPEC_TO_NSEC(&ts) + impl->spin_nsec;
+	do {
+		nfds = spa_system_pollfd_wait(impl->system, impl->poll_fd, ep, n_ep, 0);
+		if (nfds != 0)
+			break;
+		spa_system_clock_gettime(impl->system, CLOCK_MONOTONIC, &ts);
+	} while ((uint64_t)SPA_TIMESPEC_TO_NSEC(&ts) < end);
+
+	if (nfds > 0)
+		impl->spin_hits++;
+	else if (nfds == 0)
+		impl->spin_misses++;
+
+	if (SPA_UNLIKELY(impl->spin_hits + impl->spin_misses >= SPIN_REPORT))
+		spin_report(impl);
+
+	return nfds;
+}
+
 static void loop_enter(void *object)
 {
 	struct impl *impl = object;
@@ -268,6 +566,7 @@ static void loop_leave(void *object)
 {
 	struct impl *impl = object;
 	spa_log_trace(impl->log, NAME" %p: leave %lu", impl, impl->thread);
+	spin_report(impl);
 	impl->thread = 0;
 }
 
@@ -284,11 +583,14 @@ static int loop_iterate(void *object, int timeout)
 	struct impl *impl = object;
 	struct spa_loop *loop = &impl->loop;
 	struct spa_poll_event ep[32];
-	int i, nfds;
+	int i, nfds = 0;
 
 	spa_loop_control_hook_before(&impl->hooks_list);
 
-	nfds = spa_system_pollfd_wait(impl->system, impl->poll_fd, ep, SPA_N_ELEMENTS(ep), timeout);
+	if (impl->spin_nsec > 0 && timeout != 0)
+		nfds = loop_spin(impl, ep, SPA_N_ELEMENTS(ep));
+	if (nfds == 0)
+		nfds = spa_system_pollfd_wait(impl->system, impl->poll_fd, ep, SPA_N_ELEMENTS(ep), timeout);
 
 	spa_loop_control_hook_after(&impl->hooks_list);
 
@@ -722,6 +1024,7 @@ static int impl_clear(struct spa_handle *handle)
 {
 	struct impl *impl;
 	struct source_impl *source;
+	uint32_t i;
 
 	spa_return_val_if_fail(handle != NULL, -EINVAL);
 
@@ -732,7 +1035,12 @@ static int impl_clear(struct spa_handle *handle)
 
 	process_destroy(impl);
 
-	spa_system_close(impl->system, impl->ack_fd);
+	pthread_key_delete(impl->queue_key);
+	for (i = 0; i < impl->n_queues; i++)
+		queue_free(impl->queues[i]);
+	pthread_mutex_destroy(&impl->shared_lock);
+	pthread_mutex_destroy(&impl->queue_lock);
+
 	spa_system_close(impl->system, impl->poll_fd);
 
 	return 0;
@@ -753,6 +1061,7 @@ impl_init(const struct spa_handle_factory *factory,
 	  uint32_t n_support)
 {
 	struct impl *impl;
+	const char *str;
 	int res;
 
 	spa_return_val_if_fail(factory != NULL, -EINVAL);
@@ -778,6 +1087,11 @@ impl_init(const struct spa_handle_factory *factory,
 	impl->log = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_Log);
 	impl->system = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_System);
 
+	if (info && (str = spa_dict_lookup(info, "loop.spin")) != NULL) {
+		int64_t spin = strtoll(str, NULL, 10);
+		impl->spin_nsec = (uint64_t)SPA_CLAMP(spin, 0, MAX_SPIN_USEC) * SPA_NSEC_PER_USEC;
+	}
+
 	if (impl->system == NULL) {
 		spa_log_error(impl->log, NAME " %p: a System is needed", impl);
 		res = -EINVAL;
@@ -795,29 +1109,30 @@ impl_init(const struct spa_handle_factory *factory,
 	spa_list_init(&impl->destroy_list);
 	spa_hook_list_init(&impl->hooks_list);
 
-	impl->buffer_data = SPA_PTR_ALIGN(impl->buffer_mem, 8, uint8_t);
-	spa_ringbuffer_init(&impl->buffer);
+	if ((res = pthread_key_create(&impl->queue_key, queue_release)) != 0) {
+		res = -res;
+		spa_log_error(impl->log, NAME " %p: can't create queue key: %s",
+				impl, spa_strerror(res));
+		goto error_exit_free_poll;
+	}
+	pthread_mutex_init(&impl->queue_lock, NULL);
+	pthread_mutex_init(&impl->shared_lock, NULL);
 
 	impl->wakeup = loop_add_event(impl, wakeup_func, impl);
 	if (impl->wakeup == NULL) {
 		res = -errno;
 		spa_log_error(impl->log, NAME " %p: can't create wakeup event: %m", impl);
-		goto error_exit_free_poll;
-	}
-	if ((res = spa_system_eventfd_create(impl->system,
-			SPA_FD_EVENT_SEMAPHORE | SPA_FD_CLOEXEC)) < 0) {
-		spa_log_error(impl->log, NAME " %p: can't create ack event: %s",
-				impl, spa_strerror(res));
-		goto error_exit_free_wakeup;
+		goto error_exit_free_key;
 	}
-	impl->ack_fd = res;
 
 	spa_log_debug(impl->log, NAME " %p: initialized", impl);
 
 	return 0;
 
-error_exit_free_wakeup:
-	loop_destroy_source(impl, impl->wakeup);
+error_exit_free_key:
+	pthread_mutex_destroy(&impl->shared_lock);
+	pthread_mutex_destroy(&impl->queue_lock);
+	pthread_key_delete(impl->queue_key);
 error_exit_free_poll:
 	spa_system_close(impl->system, impl->poll_fd);
 error_exit:
@@ -137,6 +137,9 @@ int main(int argc, char *argv[])
 	gen_dict(&dict, 100);
 	test_lookup(&dict);
 
+	gen_dict(&dict, 200);
+	test_lookup(&dict);
+
 	gen_dict(&dict, 1000);
 	test_lookup(&dict);
 
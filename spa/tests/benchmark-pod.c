@@ -32,6 +32,9 @@
 #include <spa/pod/pod.h>
 #include <spa/pod/builder.h>
 #include <spa/pod/parser.h>
+#include <spa/pod/layout.h>
+#include <spa/param/param.h>
+#include <spa/param/props.h>
 #include <spa/param/video/format-utils.h>
 #include <spa/debug/pod.h>
 
@@ -284,11 +287,242 @@ static void test_parser()
 			t2 - t1, count, count * (uint64_t)SPA_NSEC_PER_SEC / (t2 - t1));
 }
 
+/* compare the varargs builder and parser with the object layouts */
+#define FORMAT_FIELDS(F)						\
+	F(SPA_FORMAT_mediaType,		Id,		media_type)	\
+	F(SPA_FORMAT_mediaSubtype,	Id,		media_subtype)	\
+	F(SPA_FORMAT_VIDEO_format,	Id,		format)		\
+	F(SPA_FORMAT_VIDEO_size,	Rectangle,	size)		\
+	F(SPA_FORMAT_VIDEO_framerate,	Fraction,	framerate)
+
+SPA_POD_OBJECT_LAYOUT(video_format, SPA_TYPE_OBJECT_Format, FORMAT_FIELDS);
+
+#define BUFFERS_FIELDS(F)						\
+	F(SPA_PARAM_BUFFERS_buffers,	Int,		buffers)	\
+	F(SPA_PARAM_BUFFERS_blocks,	Int,		blocks)		\
+	F(SPA_PARAM_BUFFERS_size,	Int,		size)		\
+	F(SPA_PARAM_BUFFERS_stride,	Int,		stride)		\
+	F(SPA_PARAM_BUFFERS_align,	Int,		align)		\
+	F(SPA_PARAM_BUFFERS_dataType,	Int,		data_type)
+
+SPA_POD_OBJECT_LAYOUT(buffers, SPA_TYPE_OBJECT_ParamBuffers, BUFFERS_FIELDS);
+
+#define PROPS_FIELDS(F)							\
+	F(SPA_PROP_waveType,		Int,		wave_type)	\
+	F(SPA_PROP_frequency,		Float,		frequency)	\
+	F(SPA_PROP_volume,		Float,		volume)		\
+	F(SPA_PROP_mute,		Bool,		mute)
+
+SPA_POD_OBJECT_LAYOUT(props, SPA_TYPE_OBJECT_Props, PROPS_FIELDS);
+
+static const struct video_format format_values = {
+	SPA_MEDIA_TYPE_video, SPA_MEDIA_SUBTYPE_raw, SPA_VIDEO_FORMAT_I420,
+	{ 320, 240 }, { 25, 1 } };
+static const struct buffers buffers_values = { 8, 1, 4096, 64, 16, 1 << SPA_DATA_MemFd };
+static const struct props props_values = { 1, 440.0f, 0.5f, true };
+
+static struct spa_pod *build_varargs(struct spa_pod_builder *b, uint32_t type)
+{
+	switch (type) {
+	case SPA_TYPE_OBJECT_Format:
+		return spa_pod_builder_add_object(b,
+			SPA_TYPE_OBJECT_Format, SPA_PARAM_Format,
+			SPA_FORMAT_mediaType,	    SPA_POD_Id(format_values.media_type),
+			SPA_FORMAT_mediaSubtype,    SPA_POD_Id(format_values.media_subtype),
+			SPA_FORMAT_VIDEO_format,    SPA_POD_Id(format_values.format),
+			SPA_FORMAT_VIDEO_size,      SPA_POD_Rectangle(&format_values.size),
+			SPA_FORMAT_VIDEO_framerate, SPA_POD_Fraction(&format_values.framerate));
+	case SPA_TYPE_OBJECT_ParamBuffers:
+		return spa_pod_builder_add_object(b,
+			SPA_TYPE_OBJECT_ParamBuffers, SPA_PARAM_Buffers,
+			SPA_PARAM_BUFFERS_buffers,  SPA_POD_Int(buffers_values.buffers),
+			SPA_PARAM_BUFFERS_blocks,   SPA_POD_Int(buffers_values.blocks),
+			SPA_PARAM_BUFFERS_size,     SPA_POD_Int(buffers_values.size),
+			SPA_PARAM_BUFFERS_stride,   SPA_POD_Int(buffers_values.stride),
+			SPA_PARAM_BUFFERS_align,    SPA_POD_Int(buffers_values.align),
+			SPA_PARAM_BUFFERS_dataType, SPA_POD_Int(buffers_values.data_type));
+	case SPA_TYPE_OBJECT_Props:
+		return spa_pod_builder_add_object(b,
+			SPA_TYPE_OBJECT_Props, SPA_PARAM_Props,
+			SPA_PROP_waveType,  SPA_POD_Int(props_values.wave_type),
+			SPA_PROP_frequency, SPA_POD_Float(props_values.frequency),
+			SPA_PROP_volume,    SPA_POD_Float(props_values.volume),
+			SPA_PROP_mute,      SPA_POD_Bool(props_values.mute));
+	}
+	return NULL;
+}
+
+static struct spa_pod *build_layout(struct spa_pod_builder *b, uint32_t type)
+{
+	switch (type) {
+	case SPA_TYPE_OBJECT_Format:
+		return video_format_build(b, SPA_PARAM_Format, &format_values);
+	case SPA_TYPE_OBJECT_ParamBuffers:
+		return buffers_build(b, SPA_PARAM_Buffers, &buffers_values);
+	case SPA_TYPE_OBJECT_Props:
+		return props_build(b, SPA_PARAM_Props, &props_values);
+	}
+	return NULL;
+}
+
+static int parse_varargs(const struct spa_pod *pod)
+{
+	switch (SPA_POD_OBJECT_TYPE(pod)) {
+	case SPA_TYPE_OBJECT_Format:
+	{
+		struct video_format v;
+		spa_zero(v);
+		return spa_pod_parse_object(pod,
+			SPA_TYPE_OBJECT_Format, NULL,
+			SPA_FORMAT_mediaType,	    SPA_POD_Id(&v.media_type),
+			SPA_FORMAT_mediaSubtype,    SPA_POD_Id(&v.media_subtype),
+			SPA_FORMAT_VIDEO_format,    SPA_POD_Id(&v.format),
+			SPA_FORMAT_VIDEO_size,      SPA_POD_Rectangle(&v.size),
+			SPA_FORMAT_VIDEO_framerate, SPA_POD_Fraction(&v.framerate));
+	}
+	case SPA_TYPE_OBJECT_ParamBuffers:
+	{
+		struct buffers v;
+		spa_zero(v);
+		return spa_pod_parse_object(pod,
+			SPA_TYPE_OBJECT_ParamBuffers, NULL,
+			SPA_PARAM_BUFFERS_buffers,  SPA_POD_OPT_Int(&v.buffers),
+			SPA_PARAM_BUFFERS_blocks,   SPA_POD_OPT_Int(&v.blocks),
+			SPA_PARAM_BUFFERS_size,     SPA_POD_OPT_Int(&v.size),
+			SPA_PARAM_BUFFERS_stride,   SPA_POD_OPT_Int(&v.stride),
+			SPA_PARAM_BUFFERS_align,    SPA_POD_OPT_Int(&v.align),
+			SPA_PARAM_BUFFERS_dataType, SPA_POD_OPT_Int(&v.data_type));
+	}
+	case SPA_TYPE_OBJECT_Props:
+	{
+		struct props v;
+		spa_zero(v);
+		return spa_pod_parse_object(pod,
+			SPA_TYPE_OBJECT_Props, NULL,
+			SPA_PROP_waveType,  SPA_POD_OPT_Int(&v.wave_type),
+			SPA_PROP_frequency, SPA_POD_OPT_Float(&v.frequency),
+			SPA_PROP_volume,    SPA_POD_OPT_Float(&v.volume),
+			SPA_PROP_mute,      SPA_POD_OPT_Bool(&v.mute));
+	}
+	}
+	return -EINVAL;
+}
+
+static int parse_layout(const struct spa_pod *pod)
+{
+	switch (SPA_POD_OBJECT_TYPE(pod)) {
+	case SPA_TYPE_OBJECT_Format:
+	{
+		struct video_format v;
+		spa_zero(v);
+		return video_format_parse(pod, NULL, &v);
+	}
+	case SPA_TYPE_OBJECT_ParamBuffers:
+	{
+		struct buffers v;
+		spa_zero(v);
+		return buffers_parse(pod, NULL, &v);
+	}
+	case SPA_TYPE_OBJECT_Props:
+	{
+		struct props v;
+		spa_zero(v);
+		return props_parse(pod, NULL, &v);
+	}
+	}
+	return -EINVAL;
+}
+
+static void check_layout(uint32_t type)
+{
+	uint8_t buffer1[1024], buffer2[1024];
+	struct spa_pod_builder b1 = SPA_POD_BUILDER_INIT(buffer1, sizeof(buffer1));
+	struct spa_pod_builder b2 = SPA_POD_BUILDER_INIT(buffer2, sizeof(buffer2));
+	struct spa_pod *p1, *p2;
+	struct video_format f;
+	struct buffers bu;
+	struct props pr;
+
+	p1 = build_varargs(&b1, type);
+	p2 = build_layout(&b2, type);
+	spa_assert(p1 != NULL && p2 != NULL);
+	spa_assert(SPA_POD_SIZE(p1) == SPA_POD_SIZE(p2));
+	spa_assert(memcmp(p1, p2, SPA_POD_SIZE(p1)) == 0);
+
+	switch (type) {
+	case SPA_TYPE_OBJECT_Format:
+		spa_assert(video_format_parse(p1, NULL, &f) == 5);
+		spa_assert(memcmp(&f, &format_values, sizeof(f)) == 0);
+		break;
+	case SPA_TYPE_OBJECT_ParamBuffers:
+		spa_assert(buffers_parse(p1, NULL, &bu) == 6);
+		spa_assert(memcmp(&bu, &buffers_values, sizeof(bu)) == 0);
+		break;
+	case SPA_TYPE_OBJECT_Props:
+		spa_assert(props_parse(p1, NULL, &pr) == 4);
+		spa_assert(pr.wave_type == props_values.wave_type);
+		spa_assert(pr.frequency == props_values.frequency);
+		spa_assert(pr.volume == props_values.volume);
+		spa_assert(pr.mute == props_values.mute);
+		break;
+	}
+	/* a build that doesn't fit fails */
+	spa_pod_builder_init(&b2, buffer2, SPA_POD_SIZE(p1) - 8);
+	spa_assert(build_layout(&b2, type) == NULL);
+}
+
+static void test_layout(const char *name, uint32_t type)
+{
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = { NULL, };
+	struct spa_pod *pod;
+	uint64_t t1, t2, t3, t4, n_varargs, n_layout;
+	int i, mode;
+
+	check_layout(type);
+
+	for (mode = 0; mode < 2; mode++) {
+		struct timespec ts;
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		t1 = SPA_TIMESPEC_TO_NSEC(&ts);
+		for (i = 0; i < MAX_COUNT; i++) {
+			spa_pod_builder_init(&b, buffer, sizeof(buffer));
+			pod = build_varargs(&b, type);
+			if (mode == 1)
+				spa_assert(parse_varargs(pod) >= 0);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		t2 = SPA_TIMESPEC_TO_NSEC(&ts);
+		n_varargs = i;
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		t3 = SPA_TIMESPEC_TO_NSEC(&ts);
+		for (i = 0; i < MAX_COUNT; i++) {
+			spa_pod_builder_init(&b, buffer, sizeof(buffer));
+			pod = build_layout(&b, type);
+			if (mode == 1)
+				spa_assert(parse_layout(pod) >= 0);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		t4 = SPA_TIMESPEC_TO_NSEC(&ts);
+		n_layout = i;
+
+		fprintf(stderr, "test_layout() %-7s %-11s: varargs %"PRIu64"/sec layout %"PRIu64"/sec\n",
+				name, mode == 0 ? "build" : "build+parse",
+				n_varargs * (uint64_t)SPA_NSEC_PER_SEC / (t2 - t1),
+				n_layout * (uint64_t)SPA_NSEC_PER_SEC / (t4 - t3));
+	}
+}
+
 int main(int argc, char *argv[])
 {
 	test_builder();
 	test_builder2();
 	test_parse();
 	test_parser();
+	test_layout("Format", SPA_TYPE_OBJECT_Format);
+	test_layout("Buffers", SPA_TYPE_OBJECT_ParamBuffers);
+	test_layout("Props", SPA_TYPE_OBJECT_Props);
 	return 0;
 }
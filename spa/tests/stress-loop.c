@@ -0,0 +1,343 @@
+/* Simple Plugin API
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <unistd.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <dlfcn.h>
+
+#include <spa/support/plugin.h>
+#include <spa/utils/type.h>
+#include <spa/support/loop.h>
+#include <spa/support/system.h>
+#include <spa/utils/names.h>
+#include <spa/utils/result.h>
+
+#define MAX_PRODUCERS	16
+/* more than the loop has queues for, the others use the shared queue */
+#define MAX_THREADS	160
+#define N_THREAD_INVOKES	100
+#define N_INVOKES	100000
+#define BLOCK_EVERY	1000
+/* enough to grow the queue of a thread a few times */
+#define N_BURST_INVOKES	5000
+
+struct data {
+	struct spa_support support[4];
+	uint32_t n_support;
+	struct spa_system *system;
+	struct spa_loop *loop;
+	struct spa_loop_control *control;
+
+	pthread_t thread;
+	bool running;
+	bool hold;
+
+	uint32_t n_invokes;
+	uint32_t seq[MAX_THREADS];
+	uint64_t count;
+};
+
+struct producer {
+	struct data *data;
+	pthread_t thread;
+	uint32_t id;
+	uint32_t n_invokes;
+	uint32_t errors;
+	pthread_barrier_t *barrier;
+};
+
+struct msg {
+	uint32_t id;
+	uint32_t seq;
+	uint8_t payload[32];
+};
+
+static int load_handle(struct data *data, struct spa_handle **handle, const char *name)
+{
+	const char *dir;
+	char path[PATH_MAX];
+	void *hnd;
+	spa_handle_factory_enum_func_t enum_func;
+	const struct spa_handle_factory *factory;
+	uint32_t i;
+	int res;
+
+	if ((dir = getenv("SPA_PLUGIN_DIR")) == NULL) {
+		printf("SPA_PLUGIN_DIR is not set\n");
+		return -ENOENT;
+	}
+	snprintf(path, sizeof(path), "%s/support/libspa-support.so", dir);
+
+	if ((hnd = dlopen(path, RTLD_NOW)) == NULL) {
+		printf("can't load %s: %s\n", path, dlerror());
+		return -ENOENT;
+	}
+	if ((enum_func = dlsym(hnd, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL) {
+		printf("can't find enum function\n");
+		return -ENOENT;
+	}
+	for (i = 0;;) {
+		if ((res = enum_func(&factory, &i)) <= 0)
+			break;
+		if (strcmp(factory->name, name))
+			continue;
+
+		*handle = calloc(1, spa_handle_factory_get_size(factory, NULL));
+		return spa_handle_factory_init(factory, *handle, NULL,
+				data->support, data->n_support);
+	}
+	return -EBADF;
+}
+
+static int do_msg(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct data *d = user_data;
+	const struct msg *m = data;
+
+	spa_assert(size == sizeof(*m));
+	spa_assert(m->id < MAX_THREADS);
+	/* the invokes of one thread arrive in order */
+	spa_assert(m->seq == d->seq[m->id]);
+	d->seq[m->id]++;
+	d->count++;
+	return m->seq;
+}
+
+static int do_stop(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct data *d = user_data;
+	d->running = false;
+	return 0;
+}
+
+static int do_hold(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct data *d = user_data;
+	while (__atomic_load_n(&d->hold, __ATOMIC_SEQ_CST))
+		usleep(100);
+	return 0;
+}
+
+static void *loop_thread(void *user_data)
+{
+	struct data *d = user_data;
+
+	spa_loop_control_enter(d->control);
+	while (d->running)
+		spa_loop_control_iterate(d->control, -1);
+	spa_loop_control_leave(d->control);
+	return NULL;
+}
+
+static void *producer_thread(void *user_data)
+{
+	struct producer *p = user_data;
+	struct data *d = p->data;
+	struct msg m;
+	uint32_t i;
+	int res;
+
+	spa_zero(m);
+	m.id = p->id;
+
+	for (i = 0; i < p->n_invokes; i++) {
+		bool block = (i % BLOCK_EVERY) == BLOCK_EVERY - 1 || i == p->n_invokes - 1;
+
+		m.seq = i;
+		res = spa_loop_invoke(d->loop, do_msg, 1, &m, sizeof(m), block, d);
+		if (res < 0 || (block && res != (int)i))
+			p->errors++;
+	}
+	/* keep the queue of this thread until all threads have one */
+	if (p->barrier)
+		pthread_barrier_wait(p->barrier);
+	return NULL;
+}
+
+static inline uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void run(struct data *d, uint32_t n_producers)
+{
+	struct producer p[MAX_PRODUCERS];
+	uint64_t t1, t2, total;
+	uint32_t i, errors = 0;
+
+	spa_zero(d->seq);
+	d->count = 0;
+
+	t1 = get_time_ns();
+	for (i = 0; i < n_producers; i++) {
+		p[i].data = d;
+		p[i].id = i;
+		p[i].n_invokes = d->n_invokes;
+		p[i].errors = 0;
+		p[i].barrier = NULL;
+		pthread_create(&p[i].thread, NULL, producer_thread, &p[i]);
+	}
+	for (i = 0; i < n_producers; i++) {
+		pthread_join(p[i].thread, NULL);
+		errors += p[i].errors;
+	}
+	/* wait for all items to be handled */
+	spa_loop_invoke(d->loop, NULL, 0, NULL, 0, true, NULL);
+	t2 = get_time_ns();
+
+	total = (uint64_t)n_producers * d->n_invokes;
+	spa_assert(errors == 0);
+	spa_assert(d->count == total);
+	for (i = 0; i < n_producers; i++)
+		spa_assert(d->seq[i] == d->n_invokes);
+
+	printf("producers:%2u invokes:%"PRIu64" time:%"PRIu64"us invokes/sec:%"PRIu64"\n",
+			n_producers, total, (uint64_t)((t2 - t1) / SPA_NSEC_PER_USEC),
+			(uint64_t)(total * SPA_NSEC_PER_SEC / SPA_MAX(t2 - t1, 1u)));
+}
+
+static void run_threads(struct data *d)
+{
+	struct producer p[MAX_THREADS];
+	pthread_barrier_t barrier;
+	uint32_t i, errors = 0;
+
+	spa_zero(d->seq);
+	d->count = 0;
+
+	pthread_barrier_init(&barrier, NULL, MAX_THREADS);
+	for (i = 0; i < MAX_THREADS; i++) {
+		p[i].data = d;
+		p[i].id = i;
+		p[i].n_invokes = N_THREAD_INVOKES;
+		p[i].errors = 0;
+		p[i].barrier = &barrier;
+		pthread_create(&p[i].thread, NULL, producer_thread, &p[i]);
+	}
+	for (i = 0; i < MAX_THREADS; i++) {
+		pthread_join(p[i].thread, NULL);
+		errors += p[i].errors;
+	}
+	pthread_barrier_destroy(&barrier);
+
+	spa_assert(errors == 0);
+	spa_assert(d->count == (uint64_t)MAX_THREADS * N_THREAD_INVOKES);
+	for (i = 0; i < MAX_THREADS; i++)
+		spa_assert(d->seq[i] == N_THREAD_INVOKES);
+
+	printf("threads:%u invokes:%u\n", MAX_THREADS, MAX_THREADS * N_THREAD_INVOKES);
+}
+
+/* the invokes pile up while the loop is held and the queue of the thread
+ * grows. After the burst, the queue goes back to its normal size. */
+static void run_burst(struct data *d)
+{
+	struct msg m;
+	uint32_t i, j;
+	int res;
+
+	spa_zero(d->seq);
+	d->count = 0;
+	spa_zero(m);
+
+	for (i = 0; i < 2; i++) {
+		__atomic_store_n(&d->hold, true, __ATOMIC_SEQ_CST);
+		res = spa_loop_invoke(d->loop, do_hold, 0, NULL, 0, false, d);
+		spa_assert(res >= 0);
+
+		for (j = 0; j < N_BURST_INVOKES; j++, m.seq++) {
+			res = spa_loop_invoke(d->loop, do_msg, 1, &m, sizeof(m), false, d);
+			spa_assert(res >= 0);
+		}
+		__atomic_store_n(&d->hold, false, __ATOMIC_SEQ_CST);
+
+		res = spa_loop_invoke(d->loop, do_msg, 1, &m, sizeof(m), true, d);
+		spa_assert(res == (int)m.seq);
+		m.seq++;
+	}
+	spa_assert(d->count == m.seq);
+
+	printf("burst invokes:%u\n", m.seq);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data d;
+	struct spa_handle *handle;
+	void *iface;
+	uint32_t i;
+	int res;
+
+	spa_zero(d);
+	d.n_invokes = argc > 1 ? (uint32_t)atoi(argv[1]) : N_INVOKES;
+
+	printf("starting loop invoke stress test\n");
+
+	if ((res = load_handle(&d, &handle, SPA_NAME_SUPPORT_SYSTEM)) < 0 ||
+	    (res = spa_handle_get_interface(handle, SPA_TYPE_INTERFACE_System, &iface)) < 0) {
+		printf("can't make system: %s\n", spa_strerror(res));
+		return -1;
+	}
+	d.system = iface;
+	d.support[d.n_support++] = SPA_SUPPORT_INIT(SPA_TYPE_INTERFACE_System, d.system);
+
+	if ((res = load_handle(&d, &handle, SPA_NAME_SUPPORT_LOOP)) < 0 ||
+	    (res = spa_handle_get_interface(handle, SPA_TYPE_INTERFACE_Loop, &iface)) < 0) {
+		printf("can't make loop: %s\n", spa_strerror(res));
+		return -1;
+	}
+	d.loop = iface;
+	if ((res = spa_handle_get_interface(handle, SPA_TYPE_INTERFACE_LoopControl, &iface)) < 0) {
+		printf("can't get loop control: %s\n", spa_strerror(res));
+		return -1;
+	}
+	d.control = iface;
+
+	d.running = true;
+	pthread_create(&d.thread, NULL, loop_thread, &d);
+
+	for (i = 1; i <= MAX_PRODUCERS; i *= 2)
+		run(&d, i);
+	run_threads(&d);
+	run_burst(&d);
+
+	spa_loop_invoke(d.loop, do_stop, 0, NULL, 0, true, &d);
+	pthread_join(d.thread, NULL);
+
+	spa_handle_clear(handle);
+	free(handle);
+
+	return 0;
+}
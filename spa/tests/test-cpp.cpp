@@ -59,6 +59,7 @@
 #include <spa/pod/event.h>
 #include <spa/pod/filter.h>
 #include <spa/pod/iter.h>
+#include <spa/pod/layout.h>
 #include <spa/pod/parser.h>
 #include <spa/pod/pod.h>
 #include <spa/pod/vararg.h>
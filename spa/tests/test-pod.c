@@ -26,6 +26,7 @@
 #include <spa/pod/command.h>
 #include <spa/pod/event.h>
 #include <spa/pod/iter.h>
+#include <spa/pod/layout.h>
 #include <spa/pod/parser.h>
 #include <spa/pod/vararg.h>
 #include <spa/debug/pod.h>
@@ -1524,6 +1525,114 @@ static void test_overflow(void)
 	spa_debug_pod(0, NULL, pod);
 }
 
+#define TEST_FIELDS(F)						\
+	F(1,	Bool,		b)				\
+	F(2,	Id,		id)				\
+	F(3,	Int,		i)				\
+	F(4,	Long,		l)				\
+	F(5,	Float,		f)				\
+	F(6,	Double,		d)				\
+	F(7,	Rectangle,	r)				\
+	F(8,	Fraction,	fr)
+
+SPA_POD_OBJECT_LAYOUT(test_object, SPA_TYPE_OBJECT_Props, TEST_FIELDS);
+
+static void test_layout(void)
+{
+	uint8_t buffer[1024], buffer2[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct spa_pod_builder b2 = SPA_POD_BUILDER_INIT(buffer2, sizeof(buffer2));
+	const struct test_object v = { true, SPA_VIDEO_FORMAT_I420, 21, 42, 0.5f, 2.5,
+		SPA_RECTANGLE(320, 240), SPA_FRACTION(25, 1) };
+	/* a None choice of a Long without the value */
+	const struct spa_pod_choice short_choice = {
+		SPA_POD_INIT(sizeof(struct spa_pod_choice_body), SPA_TYPE_Choice),
+		{ SPA_CHOICE_None, 0, SPA_POD_INIT(sizeof(int64_t), SPA_TYPE_Long) } };
+	struct test_object o;
+	struct spa_pod_frame f;
+	struct spa_pod *pod, *pod2;
+	uint32_t id;
+
+	pod = test_object_build(&b, SPA_PARAM_Props, &v);
+	spa_assert(pod != NULL);
+
+	/* same as the varargs builder */
+	pod2 = spa_pod_builder_add_object(&b2,
+			SPA_TYPE_OBJECT_Props, SPA_PARAM_Props,
+			1, SPA_POD_Bool(true),
+			2, SPA_POD_Id(SPA_VIDEO_FORMAT_I420),
+			3, SPA_POD_Int(21),
+			4, SPA_POD_Long(42),
+			5, SPA_POD_Float(0.5f),
+			6, SPA_POD_Double(2.5),
+			7, SPA_POD_Rectangle(&SPA_RECTANGLE(320, 240)),
+			8, SPA_POD_Fraction(&SPA_FRACTION(25, 1)));
+	spa_assert(pod2 != NULL);
+	spa_assert(SPA_POD_SIZE(pod) == SPA_POD_SIZE(pod2));
+	spa_assert(memcmp(pod, pod2, SPA_POD_SIZE(pod)) == 0);
+
+	spa_zero(o);
+	spa_assert(test_object_parse(pod, &id, &o) == 8);
+	spa_assert(id == SPA_PARAM_Props);
+	spa_assert(o.b == true);
+	spa_assert(o.id == SPA_VIDEO_FORMAT_I420);
+	spa_assert(o.i == 21);
+	spa_assert(o.l == 42);
+	spa_assert(o.f == 0.5f);
+	spa_assert(o.d == 2.5);
+	spa_assert(o.r.width == 320 && o.r.height == 240);
+	spa_assert(o.fr.num == 25 && o.fr.denom == 1);
+
+	/* None choices are unwrapped, wrong types and missing props are skipped */
+	spa_pod_builder_init(&b2, buffer2, sizeof(buffer2));
+	pod2 = spa_pod_builder_add_object(&b2,
+			SPA_TYPE_OBJECT_Props, SPA_PARAM_Props,
+			3, SPA_POD_CHOICE_RANGE_Int(7, 0, 10),
+			4, SPA_POD_Int(8),
+			9, SPA_POD_Int(9));
+	spa_pod_fixate(pod2);
+	spa_assert(test_object_parse(pod2, NULL, &o) == 1);
+	spa_assert(o.i == 7);
+	spa_assert(o.l == 42);
+
+	/* a repeated prop is counted once */
+	spa_pod_builder_init(&b2, buffer2, sizeof(buffer2));
+	pod2 = spa_pod_builder_add_object(&b2,
+			SPA_TYPE_OBJECT_Props, SPA_PARAM_Props,
+			3, SPA_POD_Int(1),
+			3, SPA_POD_Int(2));
+	spa_assert(test_object_parse(pod2, NULL, &o) == 1);
+	spa_assert(o.i == 2);
+
+	/* choices that are too short for their body or value are skipped */
+	spa_pod_builder_init(&b2, buffer2, sizeof(buffer2));
+	spa_pod_builder_push_object(&b2, &f, SPA_TYPE_OBJECT_Props, SPA_PARAM_Props);
+	spa_pod_builder_prop(&b2, 3, 0);
+	spa_pod_builder_raw(&b2, &SPA_POD_INIT(0, SPA_TYPE_Choice), sizeof(struct spa_pod));
+	spa_pod_builder_prop(&b2, 4, 0);
+	spa_pod_builder_raw(&b2, &short_choice, sizeof(short_choice));
+	spa_pod_builder_prop(&b2, 5, 0);
+	spa_pod_builder_float(&b2, 1.5f);
+	pod2 = spa_pod_builder_pop(&b2, &f);
+	spa_assert(pod2 != NULL);
+	spa_assert(test_object_parse(pod2, NULL, &o) == 1);
+	spa_assert(o.i == 2);
+	spa_assert(o.l == 42);
+	spa_assert(o.f == 1.5f);
+
+	/* wrong object type */
+	spa_pod_builder_init(&b2, buffer2, sizeof(buffer2));
+	pod2 = spa_pod_builder_add_object(&b2,
+			SPA_TYPE_OBJECT_Format, 0,
+			3, SPA_POD_Int(8));
+	spa_assert(test_object_parse(pod2, NULL, &o) == -EPROTO);
+	spa_assert(o.i == 2);
+
+	/* overflow */
+	spa_pod_builder_init(&b2, buffer2, SPA_POD_SIZE(pod) - 1);
+	spa_assert(test_object_build(&b2, SPA_PARAM_Props, &v) == NULL);
+}
+
 int main(int argc, char *argv[])
 {
 	test_abi();
@@ -1535,5 +1644,6 @@ int main(int argc, char *argv[])
 	test_parser2();
 	test_static();
 	test_overflow();
+	test_layout();
 	return 0;
 }
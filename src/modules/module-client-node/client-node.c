@@ -816,7 +816,7 @@ do_port_use_buffers(struct impl *impl,
 
 		mb[i].buffer = &b->buffer;
 		mb[i].mem_id = m->id;
-		mb[i].offset = SPA_PTRDIFF(baseptr, mem->map->ptr);
+		mb[i].offset = SPA_PTRDIFF(baseptr, mem->map->ptr) + mem->offset;
 		mb[i].size = SPA_PTRDIFF(endptr, baseptr);
 		spa_log_debug(this->log, NAME" %p: buffer %d %d %d %d", this, i, mb[i].mem_id,
 				mb[i].offset, mb[i].size);
@@ -921,7 +921,8 @@ static int impl_node_process(void *object)
 	n->rt.activation->status = PW_NODE_ACTIVATION_TRIGGERED;
 	n->rt.activation->signal_time = SPA_TIMESPEC_TO_NSEC(&ts);
 
-	if (SPA_UNLIKELY(spa_system_eventfd_write(this->data_system, this->writefd, 1) < 0))
+	if (pw_node_activation_signal(n->rt.activation) &&
+	    SPA_UNLIKELY(spa_system_eventfd_write(this->data_system, this->writefd, 1) < 0))
 		spa_log_warn(this->log, NAME" %p: error %m", this);
 
 	return SPA_STATUS_OK;
@@ -1282,7 +1283,7 @@ void pw_impl_client_node_registered(struct pw_impl_client_node *this, struct pw_
 					  impl->other_fds[0],
 					  impl->other_fds[1],
 					  impl->activation->id,
-					  0,
+					  node->activation->offset,
 					  sizeof(struct pw_node_activation));
 
 	if (impl->bind_node_id) {
@@ -1596,7 +1597,7 @@ static void node_peer_added(void *data, struct pw_impl_node *peer)
 					  peer->info.id,
 					  peer->source.fd,
 					  m->id,
-					  0,
+					  peer->activation->offset,
 					  sizeof(struct pw_node_activation));
 }
 
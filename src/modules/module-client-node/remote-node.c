@@ -95,6 +95,7 @@ struct link {
 	struct pw_node_target target;
 	uint32_t node_id;
 	int signalfd;
+	unsigned int futex:1;		/* the activation has the futex fields */
 };
 
 /** \endcond */
@@ -827,7 +828,8 @@ static int link_signal_func(void *user_data)
 	link->target.activation->status = PW_NODE_ACTIVATION_TRIGGERED;
 	link->target.activation->signal_time = SPA_TIMESPEC_TO_NSEC(&ts);
 
-	if (SPA_UNLIKELY(spa_system_eventfd_write(data_system, link->signalfd, 1) < 0))
+	if ((!link->futex || pw_node_activation_signal(link->target.activation)) &&
+	    SPA_UNLIKELY(spa_system_eventfd_write(data_system, link->signalfd, 1) < 0))
 		pw_log_warn("link %p: write failed %m", link);
 
 	return 0;
@@ -892,6 +894,7 @@ client_node_set_activation(void *object,
 		link->map = mm;
 		link->target.activation = ptr;
 		link->signalfd = signalfd;
+		link->futex = size >= PW_NODE_ACTIVATION_FUTEX_SIZE;
 		link->target.signal = link_signal_func;
 		link->target.data = link;
 		link->target.node = NULL;
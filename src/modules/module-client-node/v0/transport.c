@@ -203,7 +203,6 @@ pw_client_node0_transport_new(struct pw_context *context,
 	pw_log_debug("transport %p: new %d %d", impl, max_input_ports, max_output_ports);
 
 	trans = &impl->trans;
-	impl->offset = 0;
 
 	impl->mem = pw_mempool_alloc(context->pool,
 			PW_MEMBLOCK_FLAG_READWRITE |
@@ -214,6 +213,7 @@ pw_client_node0_transport_new(struct pw_context *context,
 		free(impl);
 		return NULL;
 	}
+	impl->offset = impl->mem->offset;
 
 	memcpy(impl->mem->map->ptr, &area, sizeof(struct pw_client_node0_area));
 	transport_setup_area(impl->mem->map->ptr, trans);
@@ -142,6 +142,7 @@ struct client_data {
 
 	unsigned int busy:1;
 	unsigned int need_flush:1;
+	unsigned int ring:1;
 
 	struct protocol_compat_v2 compat_v2;
 };
@@ -334,9 +335,27 @@ static void client_free(void *data)
 	pw_map_clear(&this->compat_v2.types);
 }
 
+static void client_info_changed(void *data, const struct pw_client_info *info)
+{
+	struct client_data *this = data;
+	const char *str;
+	int res;
+
+	if (this->ring || this->connection == NULL || info->props == NULL ||
+	    (str = spa_dict_lookup(info->props, PW_PROTOCOL_NATIVE_KEY_RING)) == NULL ||
+	    !pw_properties_parse_bool(str))
+		return;
+
+	this->ring = true;
+	if ((res = pw_protocol_native_connection_start_ring(this->connection)) < 0)
+		pw_log_warn(NAME" %p: can't start ring: %s", this->client->protocol,
+				spa_strerror(res));
+}
+
 static const struct pw_impl_client_events client_events = {
 	PW_VERSION_IMPL_CLIENT_EVENTS,
 	.free = client_free,
+	.info_changed = client_info_changed,
 	.busy_changed = client_busy_changed,
 };
 
@@ -991,6 +1010,13 @@ impl_new_client(struct pw_protocol *protocol,
 		goto error_free;
 	}
 
+	/* the shared memory ring is only used when the client asks for it,
+	 * the property is then sent to the server in the client info */
+	if ((str = pw_properties_get(core->properties, PW_PROTOCOL_NATIVE_KEY_RING)) != NULL &&
+	    pw_properties_parse_bool(str))
+		pw_protocol_native_connection_allow_ring(impl->connection);
+
+	str = NULL;
 	if (props) {
 		str = spa_dict_lookup(props, PW_KEY_REMOTE_INTENTION);
 		if (str == NULL &&
@@ -0,0 +1,259 @@
+/* PipeWire
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <spa/buffer/buffer.h>
+#include <spa/pod/builder.h>
+#include <spa/utils/result.h>
+
+#include <pipewire/pipewire.h>
+
+#include "connection.h"
+
+/* Measures the throughput of messages from a server to a client, like
+ * the info and param events that a server sends to a monitor. The
+ * server queues a burst of messages and flushes, the client reads all
+ * available messages. This is done over the socket and over the
+ * shared memory ring.
+ *
+ * The negotiation benchmark sends the messages of a buffer negotiation
+ * with a client-node with many ports: an add_mem message with a memfd
+ * for each buffer and a use_buffers message for each port. */
+
+#define MAX_SIZE	(16 * 1024)
+#define TOTAL_SIZE	(256 * 1024 * 1024)
+#define MAX_COUNT	200000u
+
+#define N_BUFFERS	2
+#define N_NEGOTIATIONS	200
+
+static const uint32_t burst_sizes[] = { 1, 16, 256 };
+static const uint32_t msg_sizes[] = { 64, 1024, MAX_SIZE };
+static const uint32_t port_counts[] = { 4, 32, 256 };
+
+static inline uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void write_message(struct pw_protocol_native_connection *conn, uint32_t size)
+{
+	static uint8_t data[MAX_SIZE];
+	struct spa_pod_builder *b;
+
+	b = pw_protocol_native_connection_begin(conn, 1, 2, NULL);
+	spa_pod_builder_add_struct(b,
+			SPA_POD_Bytes(data, size));
+	pw_protocol_native_connection_end(conn, b);
+}
+
+static uint32_t read_messages(struct pw_protocol_native_connection *conn)
+{
+	const struct pw_protocol_native_message *msg;
+	uint32_t i, count = 0;
+
+	while (pw_protocol_native_connection_get_next(conn, &msg) == 1) {
+		for (i = 0; i < msg->n_fds; i++)
+			close(msg->fds[i]);
+		count++;
+	}
+	return count;
+}
+
+static int make_pair(struct pw_context *context, bool ring,
+		struct pw_protocol_native_connection *conn[2], int fds[2])
+{
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0)
+		return -errno;
+
+	conn[0] = pw_protocol_native_connection_new(context, fds[0]);
+	conn[1] = pw_protocol_native_connection_new(context, fds[1]);
+	if (conn[0] == NULL || conn[1] == NULL)
+		return -errno;
+
+	if (ring) {
+		int res;
+
+		pw_protocol_native_connection_allow_ring(conn[1]);
+		if ((res = pw_protocol_native_connection_start_ring(conn[0])) < 0)
+			return res;
+		pw_protocol_native_connection_flush(conn[0]);
+		read_messages(conn[1]);
+		pw_protocol_native_connection_flush(conn[1]);
+		read_messages(conn[0]);
+	}
+	return 0;
+}
+
+static void run(struct pw_context *context, bool ring, uint32_t burst, uint32_t size)
+{
+	struct pw_protocol_native_connection *conn[2] = { NULL, NULL };
+	uint32_t i, n_msgs, n_written = 0, n_read = 0;
+	uint64_t t1, t2;
+	int fds[2], res;
+
+	if ((res = make_pair(context, ring, conn, fds)) < 0) {
+		fprintf(stderr, "can't make connections: %s\n", spa_strerror(res));
+		return;
+	}
+
+	n_msgs = SPA_MIN(TOTAL_SIZE / size, MAX_COUNT);
+	n_msgs = SPA_ROUND_DOWN_N(n_msgs, burst);
+
+	t1 = get_time_ns();
+	while (n_read < n_msgs) {
+		for (i = 0; i < burst; i++, n_written++)
+			write_message(conn[0], size);
+
+		while (n_read < n_written) {
+			pw_protocol_native_connection_flush(conn[0]);
+			n_read += read_messages(conn[1]);
+			/* pick up the wakeups of the client */
+			read_messages(conn[0]);
+		}
+	}
+	t2 = get_time_ns();
+
+	fprintf(stderr, "%-6s burst:%3u size:%5u messages:%6u time:%6"PRIu64"us "
+			"messages/sec:%8"PRIu64" MB/sec:%6"PRIu64"\n",
+			ring ? "ring" : "socket", burst, size, n_msgs,
+			(uint64_t)((t2 - t1) / SPA_NSEC_PER_USEC),
+			(uint64_t)(n_msgs * SPA_NSEC_PER_SEC / SPA_MAX(t2 - t1, 1u)),
+			(uint64_t)((uint64_t)n_msgs * size * SPA_NSEC_PER_SEC /
+				SPA_MAX(t2 - t1, 1u) / (1024 * 1024)));
+
+	pw_protocol_native_connection_destroy(conn[0]);
+	pw_protocol_native_connection_destroy(conn[1]);
+	close(fds[0]);
+	close(fds[1]);
+}
+
+static void write_negotiation(struct pw_protocol_native_connection *conn,
+		uint32_t n_ports, int fd)
+{
+	struct spa_pod_builder *b;
+	struct spa_pod_frame f;
+	uint32_t i, j;
+
+	for (i = 0; i < n_ports * N_BUFFERS; i++) {
+		b = pw_protocol_native_connection_begin(conn, 1, 4, NULL);
+		spa_pod_builder_add_struct(b,
+				SPA_POD_Int(i),
+				SPA_POD_Id(SPA_DATA_MemFd),
+				SPA_POD_Fd(pw_protocol_native_connection_add_fd(conn, fd)),
+				SPA_POD_Int(0));
+		pw_protocol_native_connection_end(conn, b);
+	}
+	for (i = 0; i < n_ports; i++) {
+		b = pw_protocol_native_connection_begin(conn, 1, 8, NULL);
+		spa_pod_builder_push_struct(b, &f);
+		spa_pod_builder_add(b,
+				SPA_POD_Int(SPA_DIRECTION_OUTPUT),
+				SPA_POD_Int(i),
+				SPA_POD_Int(0),
+				SPA_POD_Int(N_BUFFERS), NULL);
+		for (j = 0; j < N_BUFFERS; j++) {
+			spa_pod_builder_add(b,
+					SPA_POD_Int(i * N_BUFFERS + j),
+					SPA_POD_Int(0),
+					SPA_POD_Int(4096),
+					SPA_POD_Int(0),
+					SPA_POD_Int(0), NULL);
+		}
+		spa_pod_builder_pop(b, &f);
+		pw_protocol_native_connection_end(conn, b);
+	}
+}
+
+static void run_negotiation(struct pw_context *context, uint32_t n_ports)
+{
+	struct pw_protocol_native_connection *conn[2] = { NULL, NULL };
+	uint32_t i, n_msgs = n_ports * (N_BUFFERS + 1), n_read;
+	uint64_t t1, t2;
+	int fds[2], fd, res;
+
+	if ((res = make_pair(context, false, conn, fds)) < 0) {
+		fprintf(stderr, "can't make connections: %s\n", spa_strerror(res));
+		return;
+	}
+	if ((fd = dup(fds[0])) < 0) {
+		fprintf(stderr, "can't dup: %m\n");
+		return;
+	}
+
+	t1 = get_time_ns();
+	for (i = 0; i < N_NEGOTIATIONS; i++) {
+		write_negotiation(conn[0], n_ports, fd);
+		for (n_read = 0; n_read < n_msgs;) {
+			pw_protocol_native_connection_flush(conn[0]);
+			n_read += read_messages(conn[1]);
+		}
+	}
+	t2 = get_time_ns();
+
+	fprintf(stderr, "negotiation ports:%3u messages:%4u fds:%3u time:%6"PRIu64"us "
+			"negotiations/sec:%6"PRIu64"\n",
+			n_ports, n_msgs, n_ports * N_BUFFERS,
+			(uint64_t)((t2 - t1) / SPA_NSEC_PER_USEC),
+			(uint64_t)(N_NEGOTIATIONS * SPA_NSEC_PER_SEC / SPA_MAX(t2 - t1, 1u)));
+
+	close(fd);
+	pw_protocol_native_connection_destroy(conn[0]);
+	pw_protocol_native_connection_destroy(conn[1]);
+	close(fds[0]);
+	close(fds[1]);
+}
+
+int main(int argc, char *argv[])
+{
+	struct pw_main_loop *loop;
+	struct pw_context *context;
+	size_t i, j;
+
+	pw_init(&argc, &argv);
+
+	loop = pw_main_loop_new(NULL);
+	context = pw_context_new(pw_main_loop_get_loop(loop), NULL, 0);
+
+	for (i = 0; i < SPA_N_ELEMENTS(msg_sizes); i++) {
+		for (j = 0; j < SPA_N_ELEMENTS(burst_sizes); j++) {
+			run(context, false, burst_sizes[j], msg_sizes[i]);
+			run(context, true, burst_sizes[j], msg_sizes[i]);
+		}
+	}
+	for (i = 0; i < SPA_N_ELEMENTS(port_counts); i++)
+		run_negotiation(context, port_counts[i]);
+
+	pw_context_destroy(context);
+	pw_main_loop_destroy(loop);
+
+	return 0;
+}
@@ -32,7 +32,9 @@
 #include <sys/socket.h>
 
 #include <spa/utils/result.h>
+#include <spa/utils/ringbuffer.h>
 #include <spa/pod/builder.h>
+#include <spa/pod/parser.h>
 
 #include <pipewire/pipewire.h>
 
@@ -43,11 +45,26 @@
 
 #define MAX_BUFFER_SIZE (1024 * 32)
 #define MAX_FDS 1024
-#define MAX_FDS_MSG 28
+#define MAX_FDS_MSG 28u
+
+/* batching of the socket reads and writes */
+#define MAX_SLICES	8u
+#define SLICE_SIZE	4096
+#define MAX_BATCH	16
+#define MAX_PART_SIZE	(16 * 1024)
 
 #define HDR_SIZE_V0	8
 #define HDR_SIZE	16
 
+/* messages for this id are handled by the connection itself */
+#define RING_ID		SPA_ID_INVALID
+#define RING_OFFER	0
+#define RING_ACCEPT	1
+
+#define RING_SIZE	(256 * 1024)
+#define RING_MAX_SIZE	(16 * 1024 * 1024)
+#define RING_HDR_SIZE	4096
+
 static bool debug_messages = 0;
 
 struct buffer {
@@ -58,11 +75,30 @@ struct buffer {
 	uint32_t n_fds;
 
 	uint32_t seq;
-	size_t offset;
-	size_t fds_offset;
+	size_t offset;		/* in: next message, out: next message header */
+	size_t fds_offset;	/* in: fds of the next message, out: fds that the
+				 * partially sent message still needs */
 	struct pw_protocol_native_message msg;
 };
 
+/* The control area of a ring in shared memory. The memfd has two of
+ * them, ring 0 carries server to client messages and ring 1 client to
+ * server messages. */
+struct ring_area {
+	struct spa_ringbuffer rb;
+	uint32_t sleeping;	/* the reader waits for a wakeup on the socket */
+	uint32_t waiting;	/* the writer waits for free space */
+	uint32_t padding[12];
+};
+
+struct ring {
+	struct ring_area *area;
+	uint8_t *data;
+	uint32_t size;
+	uint32_t index;		/* our own read or write index, the one in
+				 * the shared area is only updated by us */
+};
+
 struct impl {
 	struct pw_protocol_native_connection this;
 	struct pw_context *context;
@@ -72,6 +108,17 @@ struct impl {
 
 	uint32_t version;
 	size_t hdr_size;
+
+	struct pw_mempool *pool;
+	struct pw_memblock *ring_mem;
+	struct pw_memmap *ring_map;
+	struct ring in_ring, out_ring;
+	size_t sock_size;	/* queued bytes that still go over the socket */
+	uint32_t sock_fds;	/* queued fds that still go over the socket */
+	unsigned int batch_in:1;	/* fds are coming in, read with recvmmsg */
+	unsigned int allow_ring:1;
+	unsigned int ring_in:1;
+	unsigned int ring_out:1;
 };
 
 /** \endcond */
@@ -155,19 +202,59 @@ static void *connection_ensure_size(struct pw_protocol_native_connection *conn,
 	return (uint8_t *) buf->buffer_data + buf->buffer_size;
 }
 
-static int refill_buffer(struct pw_protocol_native_connection *conn, struct buffer *buf)
+static void close_fds(struct msghdr *msg)
+{
+	struct cmsghdr *cmsg;
+	int i, n_fds, *fds;
+
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+		n_fds =
+		    (cmsg->cmsg_len - ((char *) CMSG_DATA(cmsg) - (char *) cmsg)) / sizeof(int);
+		fds = (int*)CMSG_DATA(cmsg);
+		for (i = 0; i < n_fds; i++)
+			close(fds[i]);
+	}
+}
+
+static int read_fds(struct pw_protocol_native_connection *conn, struct buffer *buf,
+		struct msghdr *msg)
 {
-	ssize_t len;
 	struct cmsghdr *cmsg;
+	int i, n_fds, *fds, res = 0;
+
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+
+		n_fds =
+		    (cmsg->cmsg_len - ((char *) CMSG_DATA(cmsg) - (char *) cmsg)) / sizeof(int);
+		fds = (int*)CMSG_DATA(cmsg);
+		if (res < 0 || buf->n_fds + n_fds > MAX_FDS) {
+			for (i = 0; i < n_fds; i++)
+				close(fds[i]);
+			pw_log_error("connection %p: too many fds received", conn);
+			res = -EPROTO;
+			continue;
+		}
+		memcpy(&buf->fds[buf->n_fds], fds, n_fds * sizeof(int));
+		buf->n_fds += n_fds;
+		res += n_fds;
+	}
+	return res;
+}
+
+static int read_socket(struct pw_protocol_native_connection *conn, struct buffer *buf,
+		void *data, size_t avail)
+{
+	ssize_t len;
 	struct msghdr msg = { 0 };
 	struct iovec iov[1];
 	char cmsgbuf[CMSG_SPACE(MAX_FDS_MSG * sizeof(int))];
-	int n_fds = 0;
-	size_t avail;
+	int n_fds;
 
-	avail = buf->buffer_maxsize - buf->buffer_size;
-
-	iov[0].iov_base = buf->buffer_data + buf->buffer_size;
+	iov[0].iov_base = data;
 	iov[0].iov_len = avail;
 	msg.msg_iov = iov;
 	msg.msg_iovlen = 1;
@@ -189,22 +276,13 @@ static int refill_buffer(struct pw_protocol_native_connection *conn, struct buff
 		break;
 	}
 
-	buf->buffer_size += len;
+	if ((n_fds = read_fds(conn, buf, &msg)) < 0)
+		return n_fds;
 
-	/* handle control messages */
-	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
-		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
-			continue;
-
-		n_fds =
-		    (cmsg->cmsg_len - ((char *) CMSG_DATA(cmsg) - (char *) cmsg)) / sizeof(int);
-		memcpy(&buf->fds[buf->n_fds], CMSG_DATA(cmsg), n_fds * sizeof(int));
-		buf->n_fds += n_fds;
-	}
 	pw_log_trace("connection %p: %d read %zd bytes and %d fds", conn, conn->fd, len,
 		     n_fds);
 
-	return 0;
+	return len;
 
 	/* ERRORS */
 recv_error:
@@ -212,14 +290,202 @@ recv_error:
 	return -errno;
 }
 
+/* Read as much as possible from the socket with one syscall. A recvmsg
+ * stops after each part of the stream that carried fds so when fds are
+ * coming in, the free space is split into slices, one for each recvmsg of
+ * a recvmmsg. */
+static int refill_buffer(struct pw_protocol_native_connection *conn, struct buffer *buf)
+{
+	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
+	struct mmsghdr msgs[MAX_SLICES];
+	struct iovec iov[MAX_SLICES];
+	char cmsgbuf[MAX_SLICES][CMSG_SPACE(MAX_FDS_MSG * sizeof(int))];
+	uint8_t *data;
+	size_t avail, slice, len, size;
+	uint32_t prev_fds = buf->n_fds;
+	int i, n_msgs, n_fds, res = 0;
+
+	if (!impl->batch_in) {
+		data = buf->buffer_data + buf->buffer_size;
+		avail = buf->buffer_maxsize - buf->buffer_size;
+		if ((res = read_socket(conn, buf, data, avail)) < 0)
+			return res;
+		buf->buffer_size += res;
+		impl->batch_in = buf->n_fds > prev_fds;
+		return 0;
+	}
+
+	if (connection_ensure_size(conn, buf, 2 * MAX_SLICES * SLICE_SIZE) == NULL)
+		return -errno;
+	data = buf->buffer_data + buf->buffer_size;
+	avail = buf->buffer_maxsize - buf->buffer_size;
+
+	/* the first slice is for the data up to the next fds, the others
+	 * receive the parts after that */
+	n_msgs = 1 + SPA_MIN(avail / 2 / SLICE_SIZE, MAX_SLICES - 1);
+	slice = avail - (n_msgs - 1) * SLICE_SIZE;
+
+	for (i = 0; i < n_msgs; i++) {
+		iov[i].iov_base = i == 0 ? data : data + slice + (i - 1) * SLICE_SIZE;
+		iov[i].iov_len = i == 0 ? slice : SLICE_SIZE;
+		spa_zero(msgs[i]);
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_control = cmsgbuf[i];
+		msgs[i].msg_hdr.msg_controllen = sizeof(cmsgbuf[i]);
+	}
+
+	while (true) {
+		n_msgs = recvmmsg(conn->fd, msgs, n_msgs, MSG_CMSG_CLOEXEC | MSG_DONTWAIT, NULL);
+		if (n_msgs < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				goto recv_error;
+			return -EAGAIN;
+		}
+		break;
+	}
+	if (n_msgs == 0 || (msgs[0].msg_len == 0 && avail != 0))
+		return -EPIPE;
+
+	/* collect the fds of all messages and close the gaps between the slices */
+	for (i = 0, size = 0, n_fds = 0; i < n_msgs; i++) {
+		if ((len = msgs[i].msg_len) == 0)
+			break;
+		if ((res = read_fds(conn, buf, &msgs[i].msg_hdr)) < 0) {
+			while (++i < n_msgs)
+				close_fds(&msgs[i].msg_hdr);
+			return res;
+		}
+		if (data + size != iov[i].iov_base)
+			memmove(data + size, iov[i].iov_base, len);
+		size += len;
+		n_fds += res;
+	}
+	pw_log_trace("connection %p: %d read %zd bytes and %d fds in %d parts", conn,
+			conn->fd, size, n_fds, i);
+
+	buf->buffer_size += size;
+	impl->batch_in = n_fds > 0;
+	return 0;
+
+	/* ERRORS */
+recv_error:
+	pw_log_error("connection %p: could not recvmmsg on fd:%d: %m", conn, conn->fd);
+	return -errno;
+}
+
+static int send_wakeup(struct pw_protocol_native_connection *conn, const int *fds, uint32_t n_fds)
+{
+	struct msghdr msg = { 0 };
+	struct iovec iov[1];
+	struct cmsghdr *cmsg;
+	char cmsgbuf[CMSG_SPACE(MAX_FDS_MSG * sizeof(int))];
+	uint8_t data = 0;
+	uint32_t fds_len;
+
+	n_fds = SPA_MIN(n_fds, MAX_FDS_MSG);
+	fds_len = n_fds * sizeof(int);
+
+	iov[0].iov_base = &data;
+	iov[0].iov_len = 1;
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 1;
+
+	if (n_fds > 0) {
+		msg.msg_control = cmsgbuf;
+		msg.msg_controllen = CMSG_SPACE(fds_len);
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(fds_len);
+		memcpy(CMSG_DATA(cmsg), fds, fds_len);
+		msg.msg_controllen = cmsg->cmsg_len;
+	}
+	while (sendmsg(conn->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT) < 0) {
+		if (errno != EINTR)
+			return -errno;
+	}
+	pw_log_trace("connection %p: %d wakeup with %u fds", conn, conn->fd, n_fds);
+	return n_fds;
+}
+
+/* In ring mode the socket only carries wakeups and fds. Drain the socket
+ * and then copy what the peer wrote in the ring to the buffer. */
+static int refill_ring(struct pw_protocol_native_connection *conn, struct buffer *buf)
+{
+	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
+	struct ring *r = &impl->in_ring;
+	uint8_t junk[256];
+	int32_t filled;
+	uint32_t n_fds = buf->n_fds, prev_fds, len;
+	bool woken = false;
+	int res;
+
+	/* a short read without fds means the socket is drained */
+	do {
+		prev_fds = buf->n_fds;
+		if ((res = read_socket(conn, buf, junk, sizeof(junk))) < 0)
+			break;
+		woken = true;
+	} while (res == sizeof(junk) || buf->n_fds > prev_fds);
+	if (res < 0 && res != -EAGAIN)
+		return res;
+
+	/* the peer made room for our pending data */
+	if (woken && impl->out.buffer_size > 0)
+		spa_hook_list_call(&conn->listener_list,
+				struct pw_protocol_native_connection_events,
+				need_flush, 0);
+
+	while (true) {
+		filled = __atomic_load_n(&r->area->rb.writeindex, __ATOMIC_SEQ_CST) - r->index;
+		if (filled < 0 || filled > (int32_t)r->size) {
+			pw_log_error("connection %p: invalid ring index %d", conn, filled);
+			return -EPROTO;
+		}
+		if (filled > 0)
+			break;
+		/* go to sleep, check again to not miss a write */
+		if (__atomic_exchange_n(&r->area->sleeping, 1, __ATOMIC_SEQ_CST) == 1)
+			return buf->n_fds > n_fds ? 0 : -EAGAIN;
+	}
+	__atomic_store_n(&r->area->sleeping, 0, __ATOMIC_RELAXED);
+
+	len = SPA_MIN((uint32_t)filled, buf->buffer_maxsize - buf->buffer_size);
+	if (len == 0)
+		return buf->n_fds > n_fds ? 0 : -EAGAIN;
+
+	spa_ringbuffer_read_data(&r->area->rb, r->data, r->size,
+			r->index & (r->size - 1),
+			buf->buffer_data + buf->buffer_size, len);
+	r->index += len;
+	__atomic_store_n(&r->area->rb.readindex, r->index, __ATOMIC_SEQ_CST);
+
+	if (__atomic_exchange_n(&r->area->waiting, 0, __ATOMIC_SEQ_CST) &&
+	    (res = send_wakeup(conn, NULL, 0)) < 0 && res != -EAGAIN)
+		return res;
+
+	buf->buffer_size += len;
+	pw_log_trace("connection %p: %d read %u bytes from ring", conn, conn->fd, len);
+	return 0;
+}
+
 static void clear_buffer(struct buffer *buf, bool fds)
 {
 	uint32_t i;
 	if (fds) {
 		for (i = 0; i < buf->n_fds; i++)
 			close(buf->fds[i]);
+		buf->n_fds = 0;
+	} else if (buf->fds_offset < buf->n_fds) {
+		/* keep the fds that arrived before their message */
+		buf->n_fds -= buf->fds_offset;
+		memmove(buf->fds, &buf->fds[buf->fds_offset], buf->n_fds * sizeof(int));
+	} else {
+		buf->n_fds = 0;
 	}
-	buf->n_fds = 0;
 	buf->buffer_size = 0;
 	buf->offset = 0;
 	buf->fds_offset = 0;
@@ -298,6 +564,8 @@ void pw_protocol_native_connection_destroy(struct pw_protocol_native_connection
 	clear_buffer(&impl->in, true);
 	free(impl->out.buffer_data);
 	free(impl->in.buffer_data);
+	if (impl->pool)
+		pw_mempool_destroy(impl->pool);
 	free(impl);
 }
 
@@ -345,6 +613,10 @@ static int prepare_packet(struct pw_protocol_native_connection *conn, struct buf
 	size -= impl->hdr_size;
 	buf->msg.fds = &buf->fds[buf->fds_offset];
 
+	/* in ring mode the fds come separately over the socket */
+	if (impl->ring_in && buf->msg.n_fds > buf->n_fds - buf->fds_offset)
+		return impl->hdr_size;
+
 	if (size < len)
 		return len;
 
@@ -360,6 +632,9 @@ static int prepare_packet(struct pw_protocol_native_connection *conn, struct buf
 	return 0;
 }
 
+static int handle_ring_message(struct pw_protocol_native_connection *conn,
+		const struct pw_protocol_native_message *msg);
+
 /** Move to the next packet in the connection
  *
  * \param conn the connection
@@ -388,12 +663,21 @@ pw_protocol_native_connection_get_next(struct pw_protocol_native_connection *con
 		len = prepare_packet(conn, buf);
 		if (len < 0)
 			return len;
-		if (len == 0)
-			break;
+		if (len == 0) {
+			if (SPA_LIKELY(buf->msg.id != RING_ID || impl->version < 3))
+				break;
+			if ((res = handle_ring_message(conn, &buf->msg)) < 0)
+				return res;
+			continue;
+		}
 
 		if (connection_ensure_size(conn, buf, len) == NULL)
 			return -errno;
-		if ((res = refill_buffer(conn, buf)) < 0)
+		if (impl->ring_in)
+			res = refill_ring(conn, buf);
+		else
+			res = refill_buffer(conn, buf);
+		if (res < 0)
 			return res;
 	}
 	*msg = &buf->msg;
@@ -494,102 +778,453 @@ pw_protocol_native_connection_end(struct pw_protocol_native_connection *conn,
 	return res;
 }
 
-/** Flush the connection object
+static int setup_ring(struct impl *impl, struct pw_memblock *mem, uint32_t size, bool server)
+{
+	struct ring_area *area;
+	uint8_t *data;
+
+	impl->ring_map = pw_memblock_map(mem, PW_MEMMAP_FLAG_READWRITE,
+			0, RING_HDR_SIZE + 2 * size, NULL);
+	if (impl->ring_map == NULL)
+		return -errno;
+
+	impl->ring_mem = mem;
+	area = impl->ring_map->ptr;
+	data = SPA_MEMBER(area, RING_HDR_SIZE, uint8_t);
+
+	impl->in_ring.area = &area[server ? 1 : 0];
+	impl->in_ring.data = &data[server ? size : 0];
+	impl->in_ring.size = size;
+	impl->in_ring.index = 0;
+	impl->out_ring.area = &area[server ? 0 : 1];
+	impl->out_ring.data = &data[server ? 0 : size];
+	impl->out_ring.size = size;
+	impl->out_ring.index = 0;
+
+	return 0;
+}
+
+static void switch_out_to_ring(struct impl *impl)
+{
+	/* everything queued so far still goes over the socket */
+	impl->sock_size = impl->out.buffer_size;
+	impl->sock_fds = impl->out.n_fds;
+	impl->ring_out = true;
+}
+
+static void switch_in_to_ring(struct impl *impl)
+{
+	struct buffer *buf = &impl->in;
+
+	/* after the switch the socket only has wakeups, drop them */
+	if (buf->offset < buf->buffer_size)
+		buf->buffer_size = buf->offset;
+	if (buf->offset >= buf->buffer_size)
+		clear_buffer(buf, false);
+	impl->ring_in = true;
+}
+
+static int write_ring_message(struct pw_protocol_native_connection *conn,
+		uint8_t opcode, uint32_t size, int fd)
+{
+	struct spa_pod_builder *b;
+
+	b = pw_protocol_native_connection_begin(conn, RING_ID, opcode, NULL);
+	spa_pod_builder_add_struct(b,
+			SPA_POD_Int(size),
+			SPA_POD_Fd(pw_protocol_native_connection_add_fd(conn, fd)));
+	return pw_protocol_native_connection_end(conn, b);
+}
+
+/** Start using a shared memory ring for the messages
  *
- * \param conn the connection object
- * \return 0 on success < 0 error code on error
+ * \param conn the connection
+ * \return 0 on success, < 0 on error
  *
- * Write the queued messages on the connection to the socket
+ * Called by the server. This offers the client a memfd with two rings,
+ * one for each direction. The server writes its messages in the ring
+ * right after the offer, the client switches when it has seen the offer.
+ * The socket is then only used for fds and wakeups.
  *
  * \memberof pw_protocol_native_connection
  */
-int pw_protocol_native_connection_flush(struct pw_protocol_native_connection *conn)
+int pw_protocol_native_connection_start_ring(struct pw_protocol_native_connection *conn)
 {
 	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
-	ssize_t sent, outsize;
-	struct msghdr msg = { 0 };
-	struct iovec iov[1];
+	struct pw_memblock *mem;
+	struct ring_area *area;
+	int res;
+
+	if (impl->version < 3)
+		return -ENOTSUP;
+	if (impl->pool != NULL)
+		return -EBUSY;
+
+	if ((impl->pool = pw_mempool_new(NULL)) == NULL)
+		return -errno;
+
+	mem = pw_mempool_alloc(impl->pool,
+			PW_MEMBLOCK_FLAG_READWRITE | PW_MEMBLOCK_FLAG_SEAL,
+			SPA_DATA_MemFd, RING_HDR_SIZE + 2 * RING_SIZE);
+	if (mem == NULL)
+		return -errno;
+
+	if ((res = setup_ring(impl, mem, RING_SIZE, true)) < 0)
+		return res;
+
+	/* both readers sleep until they had a first look at the ring */
+	area = impl->ring_map->ptr;
+	spa_ringbuffer_init(&area[0].rb);
+	spa_ringbuffer_init(&area[1].rb);
+	area[0].sleeping = area[1].sleeping = 1;
+
+	if ((res = write_ring_message(conn, RING_OFFER, RING_SIZE, mem->fd)) < 0)
+		return res;
+
+	switch_out_to_ring(impl);
+
+	pw_log_debug("connection %p: offer ring size:%u", conn, RING_SIZE);
+	return 0;
+}
+
+/** Allow the peer to switch to a shared memory ring
+ *
+ * \param conn the connection
+ *
+ * Called by the client. Only connections that allow it accept a ring
+ * offer from the peer.
+ *
+ * \memberof pw_protocol_native_connection
+ */
+void pw_protocol_native_connection_allow_ring(struct pw_protocol_native_connection *conn)
+{
+	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
+	impl->allow_ring = true;
+}
+
+static int handle_ring_offer(struct pw_protocol_native_connection *conn,
+		uint32_t size, int fd)
+{
+	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
+	struct pw_memblock *mem;
+	int res;
+
+	if (!impl->allow_ring || impl->pool != NULL || fd < 0 ||
+	    size == 0 || size > RING_MAX_SIZE || (size & (size - 1)) != 0)
+		return -EPROTO;
+
+	if ((impl->pool = pw_mempool_new(NULL)) == NULL)
+		return -errno;
+
+	mem = pw_mempool_import(impl->pool, PW_MEMBLOCK_FLAG_READWRITE,
+			SPA_DATA_MemFd, fd);
+	if (mem == NULL)
+		return -errno;
+
+	if ((res = setup_ring(impl, mem, size, false)) < 0)
+		return res;
+
+	switch_in_to_ring(impl);
+
+	if ((res = write_ring_message(conn, RING_ACCEPT, size, -1)) < 0)
+		return res;
+
+	switch_out_to_ring(impl);
+
+	pw_log_debug("connection %p: accept ring size:%u", conn, size);
+	return 0;
+}
+
+static int handle_ring_message(struct pw_protocol_native_connection *conn,
+		const struct pw_protocol_native_message *msg)
+{
+	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
+	struct spa_pod_parser prs;
+	uint32_t size;
+	int64_t idx;
+	int fd;
+
+	spa_pod_parser_init(&prs, msg->data, msg->size);
+	if (spa_pod_parser_get_struct(&prs,
+			SPA_POD_Int(&size),
+			SPA_POD_Fd(&idx)) < 0)
+		return -EPROTO;
+
+	switch (msg->opcode) {
+	case RING_OFFER:
+		fd = pw_protocol_native_connection_get_fd(conn, idx);
+		if (fd < 0)
+			return -EPROTO;
+		/* the pool now owns the fd */
+		msg->fds[idx] = -1;
+		return handle_ring_offer(conn, size, fd);
+
+	case RING_ACCEPT:
+		if (impl->pool == NULL || !impl->ring_out || impl->ring_in)
+			return -EPROTO;
+		switch_in_to_ring(impl);
+		pw_log_debug("connection %p: ring accepted", conn);
+		return 0;
+
+	default:
+		return -EPROTO;
+	}
+}
+
+/* Get the size and number of fds of the message at offset in the out
+ * buffer. */
+static inline size_t out_message(struct impl *impl, size_t offset, uint32_t *n_fds)
+{
+	uint32_t *p = SPA_MEMBER(impl->out.buffer_data, offset, uint32_t);
+	*n_fds = impl->version >= 3 ? p[3] : 0;
+	return impl->hdr_size + (p[1] & 0xffffff);
+}
+
+/* Split the first size bytes of the out buffer in parts to send with
+ * sendmmsg. Each part carries at most MAX_FDS_MSG fds and as much data as
+ * possible, a message may only be completed after all its fds are sent
+ * because that is what the receiver expects. With the old protocol the
+ * fds are not in the header and all fds are sent first.
+ *
+ * Only the last part can be sent partially, the others are small enough
+ * to be sent in one piece or not at all. Otherwise a following part could
+ * still be sent when a part was cut short. */
+static uint32_t make_parts(struct impl *impl, size_t size, uint32_t n_fds,
+		struct mmsghdr *msgs, struct iovec *iov, uint32_t *part_fds,
+		char (*cmsgbuf)[CMSG_SPACE(MAX_FDS_MSG * sizeof(int))])
+{
+	struct buffer *buf = &impl->out;
+	size_t offset = 0, end, covered = 0, msg_end = buf->offset;
+	uint32_t i, outfds, sent_fds = 0, need_fds, msg_fds;
 	struct cmsghdr *cmsg;
-	char cmsgbuf[CMSG_SPACE(MAX_FDS_MSG * sizeof(int))];
-	int res = 0, *fds;
-	uint32_t fds_len, to_close, n_fds, outfds, i;
-	struct buffer *buf;
-	void *data;
-	size_t size;
 
-	buf = &impl->out;
-	data = buf->buffer_data;
-	size = buf->buffer_size;
-	fds = buf->fds;
-	n_fds = buf->n_fds;
-	to_close = 0;
+	if (n_fds == 0) {
+		iov[0].iov_base = buf->buffer_data;
+		iov[0].iov_len = size;
+		spa_zero(msgs[0]);
+		msgs[0].msg_hdr.msg_iov = &iov[0];
+		msgs[0].msg_hdr.msg_iovlen = 1;
+		part_fds[0] = 0;
+		return 1;
+	}
 
-	while (size > 0) {
-		if (n_fds > MAX_FDS_MSG) {
-			outfds = MAX_FDS_MSG;
-			outsize = SPA_MIN(sizeof(uint32_t), size);
-		} else {
-			outfds = n_fds;
-			outsize = size;
+	/* the message that was partially sent still needs fds_offset fds */
+	need_fds = impl->version >= 3 ? buf->fds_offset : n_fds;
+	if (impl->version < 3)
+		msg_end = size;
+
+	for (i = 0; i < MAX_BATCH && offset < size; i++) {
+		outfds = 0;
+		if (offset >= covered) {
+			outfds = SPA_MIN(n_fds - sent_fds, MAX_FDS_MSG);
+			sent_fds += outfds;
+
+			/* add all messages that have their fds */
+			while (need_fds <= sent_fds) {
+				covered = msg_end;
+				if (msg_end >= size)
+					break;
+				msg_end += out_message(impl, msg_end, &msg_fds);
+				need_fds += msg_fds;
+			}
+			if (covered <= offset)
+				covered = offset + SPA_MIN(sizeof(uint32_t), msg_end - offset);
+			covered = SPA_MIN(covered, size);
 		}
+		end = covered;
+		if (i < MAX_BATCH - 1 && end - offset > MAX_PART_SIZE)
+			end = offset + MAX_PART_SIZE;
 
-		fds_len = outfds * sizeof(int);
-
-		iov[0].iov_base = data;
-		iov[0].iov_len = outsize;
-		msg.msg_iov = iov;
-		msg.msg_iovlen = 1;
+		iov[i].iov_base = buf->buffer_data + offset;
+		iov[i].iov_len = end - offset;
+		spa_zero(msgs[i]);
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		part_fds[i] = outfds;
 
 		if (outfds > 0) {
-			msg.msg_control = cmsgbuf;
-			msg.msg_controllen = CMSG_SPACE(fds_len);
-			cmsg = CMSG_FIRSTHDR(&msg);
+			size_t fds_len = outfds * sizeof(int);
+			msgs[i].msg_hdr.msg_control = cmsgbuf[i];
+			msgs[i].msg_hdr.msg_controllen = CMSG_SPACE(fds_len);
+			cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr);
 			cmsg->cmsg_level = SOL_SOCKET;
 			cmsg->cmsg_type = SCM_RIGHTS;
 			cmsg->cmsg_len = CMSG_LEN(fds_len);
-			memcpy(CMSG_DATA(cmsg), fds, fds_len);
-			msg.msg_controllen = cmsg->cmsg_len;
-		} else {
-			msg.msg_control = NULL;
-			msg.msg_controllen = 0;
+			memcpy(CMSG_DATA(cmsg), &buf->fds[sent_fds - outfds], fds_len);
+			msgs[i].msg_hdr.msg_controllen = cmsg->cmsg_len;
 		}
+		offset = end;
+	}
+	return i;
+}
+
+static int flush_socket(struct pw_protocol_native_connection *conn,
+		size_t *max_size, uint32_t *max_fds)
+{
+	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
+	struct mmsghdr msgs[MAX_BATCH];
+	struct iovec iov[MAX_BATCH];
+	char cmsgbuf[MAX_BATCH][CMSG_SPACE(MAX_FDS_MSG * sizeof(int))];
+	struct buffer *buf = &impl->out;
+	size_t size = *max_size, sent, pos, len;
+	uint32_t i, n_fds = *max_fds, n_parts, part_fds[MAX_BATCH], sent_fds, need_fds, msg_fds;
+	int res = 0, n_sent;
+
+	while (size > 0) {
+		n_parts = make_parts(impl, size, n_fds, msgs, iov, part_fds, cmsgbuf);
 
 		while (true) {
-			sent = sendmsg(conn->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
-			if (sent < 0) {
+			n_sent = sendmmsg(conn->fd, msgs, n_parts, MSG_NOSIGNAL | MSG_DONTWAIT);
+			if (n_sent < 0) {
 				if (errno == EINTR)
 					continue;
-				else {
-					res = -errno;
-					goto exit;
-				}
+				res = -errno;
+				goto exit;
 			}
 			break;
 		}
-		pw_log_trace("connection %p: %d written %zd bytes and %u fds", conn, conn->fd, sent,
-			     outfds);
 
+		/* the fds of a part are sent with its first byte */
+		for (i = 0, sent = 0, sent_fds = 0; i < (uint32_t)n_sent; i++) {
+			if (msgs[i].msg_len < iov[i].iov_len && i + 1 < (uint32_t)n_sent) {
+				pw_log_error("connection %p: part %u was sent partially", conn, i);
+				res = -EPIPE;
+				goto exit;
+			}
+			sent += msgs[i].msg_len;
+			sent_fds += part_fds[i];
+		}
+		pw_log_trace("connection %p: %d written %zd bytes and %u fds in %d parts", conn,
+				conn->fd, sent, sent_fds, n_sent);
+
+		/* find the next message header and the fds it still needs */
+		if (sent == size) {
+			buf->offset = 0;
+			buf->fds_offset = 0;
+		} else {
+			pos = buf->offset;
+			need_fds = buf->fds_offset;
+			while (pos < sent) {
+				pos += out_message(impl, pos, &msg_fds);
+				need_fds += msg_fds;
+			}
+			buf->offset = pos - sent;
+			buf->fds_offset = need_fds > sent_fds ? need_fds - sent_fds : 0;
+		}
+
+		len = buf->buffer_size - sent;
+		if (len > 0)
+			memmove(buf->buffer_data, buf->buffer_data + sent, len);
+		buf->buffer_size = len;
 		size -= sent;
-		data = SPA_MEMBER(data, sent, void);
-		n_fds -= outfds;
-		fds += outfds;
-		to_close += outfds;
-	}
 
-	res = 0;
+		for (i = 0; i < sent_fds; i++)
+			close(buf->fds[i]);
+		buf->n_fds -= sent_fds;
+		if (buf->n_fds > 0)
+			memmove(buf->fds, &buf->fds[sent_fds], buf->n_fds * sizeof(int));
+		n_fds -= sent_fds;
 
+		if (n_sent < (int)n_parts) {
+			res = -EAGAIN;
+			break;
+		}
+	}
 exit:
-	if (size > 0)
-		memmove(buf->buffer_data, data, size);
-	buf->buffer_size = size;
-	for (i = 0; i < to_close; i++)
-		close(buf->fds[i]);
-	if (n_fds > 0)
-		memmove(buf->fds, fds, n_fds * sizeof(int));
-	buf->n_fds = n_fds;
+	*max_size = size;
+	*max_fds = n_fds;
 	return res;
 }
 
+/* Send the fds over the socket and copy the data into the ring. The peer
+ * is only woken up when it went to sleep. When the ring is full, the
+ * remaining data is kept until the peer wakes us up again. */
+static int flush_ring(struct pw_protocol_native_connection *conn)
+{
+	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
+	struct buffer *buf = &impl->out;
+	struct ring *r = &impl->out_ring;
+	uint32_t i, len, sent = 0;
+	int32_t filled;
+	bool waiting = false;
+	int res = 0;
+
+	while (buf->n_fds > 0) {
+		if ((res = send_wakeup(conn, buf->fds, buf->n_fds)) < 0)
+			return res;
+		for (i = 0; i < (uint32_t)res; i++)
+			close(buf->fds[i]);
+		buf->n_fds -= res;
+		memmove(buf->fds, &buf->fds[res], buf->n_fds * sizeof(int));
+	}
+
+	while (sent < buf->buffer_size) {
+		filled = r->index - __atomic_load_n(&r->area->rb.readindex, __ATOMIC_SEQ_CST);
+		if (filled < 0 || filled > (int32_t)r->size) {
+			pw_log_error("connection %p: invalid ring index %d", conn, filled);
+			return -EPROTO;
+		}
+		if (filled == (int32_t)r->size) {
+			/* ask for a wakeup, check again to not miss a read */
+			if (waiting)
+				break;
+			__atomic_store_n(&r->area->waiting, 1, __ATOMIC_SEQ_CST);
+			waiting = true;
+			continue;
+		}
+		len = SPA_MIN(r->size - filled, buf->buffer_size - sent);
+		spa_ringbuffer_write_data(&r->area->rb, r->data, r->size,
+				r->index & (r->size - 1),
+				buf->buffer_data + sent, len);
+		r->index += len;
+		sent += len;
+		__atomic_store_n(&r->area->rb.writeindex, r->index, __ATOMIC_SEQ_CST);
+	}
+	pw_log_trace("connection %p: %d written %u bytes to ring, %zd pending", conn,
+			conn->fd, sent, buf->buffer_size - sent);
+
+	if (sent > 0 && __atomic_exchange_n(&r->area->sleeping, 0, __ATOMIC_SEQ_CST))
+		res = send_wakeup(conn, NULL, 0);
+
+	if (buf->buffer_size > sent)
+		memmove(buf->buffer_data, buf->buffer_data + sent, buf->buffer_size - sent);
+	buf->buffer_size -= sent;
+
+	return res < 0 ? res : 0;
+}
+
+/** Flush the connection object
+ *
+ * \param conn the connection object
+ * \return 0 on success < 0 error code on error
+ *
+ * Write the queued messages on the connection to the socket or, when
+ * enabled, to the shared memory ring
+ *
+ * \memberof pw_protocol_native_connection
+ */
+int pw_protocol_native_connection_flush(struct pw_protocol_native_connection *conn)
+{
+	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
+	struct buffer *buf = &impl->out;
+	size_t size;
+	uint32_t n_fds;
+	int res;
+
+	if (!impl->ring_out) {
+		size = buf->buffer_size;
+		n_fds = buf->n_fds;
+		return flush_socket(conn, &size, &n_fds);
+	}
+	/* first send what was queued before we switched to the ring */
+	if (impl->sock_size > 0 || impl->sock_fds > 0) {
+		res = flush_socket(conn, &impl->sock_size, &impl->sock_fds);
+		if (res < 0)
+			return res;
+	}
+	return flush_ring(conn);
+}
+
 /** Clear the connection object
  *
  * \param conn the connection object
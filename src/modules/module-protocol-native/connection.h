@@ -99,6 +99,13 @@ pw_protocol_native_connection_flush(struct pw_protocol_native_connection *conn);
 int
 pw_protocol_native_connection_clear(struct pw_protocol_native_connection *conn);
 
+/** client property to ask for the shared memory ring, off by default */
+#define PW_PROTOCOL_NATIVE_KEY_RING	"pipewire.protocol.ring"
+
+int pw_protocol_native_connection_start_ring(struct pw_protocol_native_connection *conn);
+
+void pw_protocol_native_connection_allow_ring(struct pw_protocol_native_connection *conn);
+
 #ifdef __cplusplus
 }  /* extern "C" */
 #endif
@@ -22,7 +22,10 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <unistd.h>
+#include <fcntl.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 
 #include <spa/pod/builder.h>
 #include <spa/pod/parser.h>
@@ -119,6 +122,237 @@ static void test_read_write(struct pw_protocol_native_connection *in,
 	spa_assert(read_message(in) == -1);
 }
 
+#define N_PIPES		40
+#define N_FD_MESSAGES	200
+#define FD_MESSAGE_SIZE	(4 * 1024)
+
+/* write a message with the write side of the pipes first to first+n_fds
+ * and some padding */
+static void write_fds(struct pw_protocol_native_connection *conn, int pipes[][2],
+		uint32_t first, uint32_t n_fds, uint32_t size)
+{
+	static uint8_t data[FD_MESSAGE_SIZE];
+	struct spa_pod_builder *b;
+	struct spa_pod_frame f;
+	uint32_t i;
+
+	b = pw_protocol_native_connection_begin(conn, 1, 7, NULL);
+	spa_pod_builder_push_struct(b, &f);
+	spa_pod_builder_add(b,
+			SPA_POD_Int(first),
+			SPA_POD_Int(n_fds),
+			SPA_POD_Bytes(data, size), NULL);
+	for (i = 0; i < n_fds; i++)
+		spa_pod_builder_add(b,
+			SPA_POD_Fd(pw_protocol_native_connection_add_fd(conn,
+					pipes[(first + i) % N_PIPES][1])), NULL);
+	spa_pod_builder_pop(b, &f);
+	pw_protocol_native_connection_end(conn, b);
+}
+
+static uint32_t read_fds(struct pw_protocol_native_connection *conn, int pipes[][2])
+{
+	const struct pw_protocol_native_message *msg;
+	struct spa_pod_parser prs;
+	struct spa_pod_frame f;
+	struct stat st1, st2;
+	const void *data;
+	uint32_t i, first, n_fds, size, count = 0;
+	int64_t idx;
+	int fd;
+
+	while (pw_protocol_native_connection_get_next(conn, &msg) == 1) {
+		spa_assert(msg->opcode == 7);
+		spa_pod_parser_init(&prs, msg->data, msg->size);
+		spa_assert(spa_pod_parser_push_struct(&prs, &f) >= 0);
+		spa_assert(spa_pod_parser_get(&prs,
+				SPA_POD_Int(&first),
+				SPA_POD_Int(&n_fds),
+				SPA_POD_Bytes(&data, &size), NULL) >= 0);
+		spa_assert(msg->n_fds == n_fds);
+
+		/* the fds arrived with their message and in order */
+		for (i = 0; i < n_fds; i++) {
+			spa_assert(spa_pod_parser_get(&prs, SPA_POD_Fd(&idx), NULL) >= 0);
+			fd = pw_protocol_native_connection_get_fd(conn, idx);
+			spa_assert(fd >= 0);
+			spa_assert(fstat(fd, &st1) == 0);
+			spa_assert(fstat(pipes[(first + i) % N_PIPES][1], &st2) == 0);
+			spa_assert(st1.st_ino == st2.st_ino);
+			close(fd);
+		}
+		count++;
+	}
+	return count;
+}
+
+static void test_fds(struct pw_protocol_native_connection *in,
+		struct pw_protocol_native_connection *out)
+{
+	int pipes[N_PIPES][2];
+	uint32_t i, n_read;
+
+	for (i = 0; i < N_PIPES; i++)
+		spa_assert(pipe2(pipes[i], O_CLOEXEC) == 0);
+
+	/* many small messages with fds, some without fds and one with
+	 * more fds than can be sent at once */
+	for (i = 0; i < 3 * N_PIPES; i++)
+		write_fds(out, pipes, i, i % 3 ? 1 : 0, 16);
+	write_fds(out, pipes, 0, N_PIPES, 16);
+	for (i = 0; i < 3 * N_PIPES; i++)
+		write_fds(out, pipes, i, 1, 16);
+	spa_assert(pw_protocol_native_connection_flush(out) == 0);
+	spa_assert(read_fds(in, pipes) == 6 * N_PIPES + 1);
+
+	/* more than fits in the socket, the flush is done in many parts */
+	for (i = 0; i < N_FD_MESSAGES; i++)
+		write_fds(out, pipes, i, (i % 5) + 1, FD_MESSAGE_SIZE);
+	for (n_read = 0; n_read < N_FD_MESSAGES;) {
+		pw_protocol_native_connection_flush(out);
+		n_read += read_fds(in, pipes);
+	}
+	spa_assert(n_read == N_FD_MESSAGES);
+
+	for (i = 0; i < N_PIPES; i++) {
+		close(pipes[i][0]);
+		close(pipes[i][1]);
+	}
+}
+
+#define LARGE_SIZE	(16 * 1024)
+#define LARGE_COUNT	64
+
+struct flush_data {
+	struct spa_hook listener;
+	int need_flush;
+};
+
+static void on_need_flush(void *data)
+{
+	struct flush_data *d = data;
+	d->need_flush++;
+}
+
+static const struct pw_protocol_native_connection_events flush_events = {
+	PW_VERSION_PROTOCOL_NATIVE_CONNECTION_EVENTS,
+	.need_flush = on_need_flush,
+};
+
+static void write_large(struct pw_protocol_native_connection *conn, uint32_t index)
+{
+	static uint8_t data[LARGE_SIZE];
+	struct spa_pod_builder *b;
+
+	memset(data, index, sizeof(data));
+	b = pw_protocol_native_connection_begin(conn, 1, 6, NULL);
+	spa_pod_builder_add_struct(b,
+			SPA_POD_Int(index),
+			SPA_POD_Bytes(data, sizeof(data)));
+	pw_protocol_native_connection_end(conn, b);
+}
+
+static uint32_t read_large(struct pw_protocol_native_connection *conn, uint32_t index)
+{
+	const struct pw_protocol_native_message *msg;
+        struct spa_pod_parser prs;
+	const uint8_t *data;
+	uint32_t v_int, size;
+
+	while (pw_protocol_native_connection_get_next(conn, &msg) == 1) {
+		spa_assert(msg->opcode == 6);
+		spa_pod_parser_init(&prs, msg->data, msg->size);
+		spa_assert(spa_pod_parser_get_struct(&prs,
+				SPA_POD_Int(&v_int),
+				SPA_POD_Bytes(&data, &size)) >= 0);
+		spa_assert(v_int == index);
+		spa_assert(size == LARGE_SIZE);
+		spa_assert(data[0] == (uint8_t)index && data[size-1] == (uint8_t)index);
+		index++;
+	}
+	return index;
+}
+
+static void test_ring_large(struct pw_protocol_native_connection *in,
+		struct pw_protocol_native_connection *out)
+{
+	struct flush_data d = { 0 };
+	uint32_t i, n_read = 0;
+
+	pw_protocol_native_connection_add_listener(out, &d.listener, &flush_events, &d);
+
+	/* more than fits in the ring */
+	for (i = 0; i < LARGE_COUNT; i++)
+		write_large(out, i);
+
+	for (i = 0; n_read < LARGE_COUNT; i++) {
+		spa_assert(i < LARGE_COUNT);
+		spa_assert(pw_protocol_native_connection_flush(out) == 0);
+		n_read = read_large(in, n_read);
+		if (n_read == LARGE_COUNT)
+			break;
+		/* the reader made room and woke up the writer */
+		d.need_flush = 0;
+		spa_assert(read_message(out) == -1);
+		spa_assert(d.need_flush > 0);
+	}
+	spa_hook_remove(&d.listener);
+}
+
+static void test_ring(struct pw_context *context)
+{
+	struct pw_protocol_native_connection *server, *client;
+	int fds[2];
+
+	spa_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+	server = pw_protocol_native_connection_new(context, fds[0]);
+	spa_assert(server != NULL);
+	client = pw_protocol_native_connection_new(context, fds[1]);
+	spa_assert(client != NULL);
+
+	/* the server does not accept an offer */
+	spa_assert(pw_protocol_native_connection_start_ring(client) == 0);
+	spa_assert(pw_protocol_native_connection_flush(client) == 0);
+	spa_assert(pw_protocol_native_connection_get_next(server, NULL) == -EPROTO);
+
+	pw_protocol_native_connection_destroy(server);
+	pw_protocol_native_connection_destroy(client);
+	close(fds[0]);
+	close(fds[1]);
+
+	spa_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	server = pw_protocol_native_connection_new(context, fds[0]);
+	client = pw_protocol_native_connection_new(context, fds[1]);
+	pw_protocol_native_connection_allow_ring(client);
+
+	/* messages before the offer go over the socket, after the offer
+	 * over the ring */
+	write_message(server, 1);
+	spa_assert(pw_protocol_native_connection_start_ring(server) == 0);
+	write_message(server, 2);
+	spa_assert(pw_protocol_native_connection_flush(server) == 0);
+	spa_assert(read_message(client) == 0);
+	spa_assert(read_message(client) == 0);
+	spa_assert(read_message(client) == -1);
+
+	/* the client accepts over the socket and switches */
+	write_message(client, 1);
+	spa_assert(pw_protocol_native_connection_flush(client) == 0);
+	spa_assert(read_message(server) == 0);
+	spa_assert(read_message(server) == -1);
+
+	test_read_write(server, client);
+	test_read_write(client, server);
+	test_ring_large(server, client);
+	test_ring_large(client, server);
+
+	pw_protocol_native_connection_destroy(server);
+	pw_protocol_native_connection_destroy(client);
+	close(fds[0]);
+	close(fds[1]);
+}
+
 int main(int argc, char *argv[])
 {
 	struct pw_main_loop *loop;
@@ -144,6 +378,8 @@ int main(int argc, char *argv[])
 	test_create(in);
 	test_create(out);
 	test_read_write(in, out);
+	test_fds(in, out);
+	test_ring(context);
 
 	pw_protocol_native_connection_destroy(in);
 	pw_protocol_native_connection_destroy(out);
@@ -0,0 +1,474 @@
+/* PipeWire
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+
+#include <spa/node/node.h>
+#include <spa/node/utils.h>
+#include <spa/param/param.h>
+#include <spa/param/props.h>
+#include <spa/param/audio/format-utils.h>
+#include <spa/pod/builder.h>
+#include <spa/pod/filter.h>
+#include <spa/utils/hook.h>
+#include <spa/utils/result.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/impl.h>
+
+/* Measures the introspection requests that volume applets and status bars
+ * poll on the pulse server. A daemon context with the native and the pulse
+ * protocol has a number of sinks, a client on the pulse socket asks for
+ * the lists of sinks, sources, clients and modules and reads the replies.
+ *
+ * The sinks are implemented here, they only have the format and props
+ * params that the pulse server needs for the sink info.
+ */
+
+#define N_SINKS		200
+#define N_REQUESTS	10000
+#define MAX_WAIT	500
+
+#define PROTOCOL_VERSION	34
+#define NATIVE_COOKIE_LENGTH	256
+
+/* from defs.h */
+#define COMMAND_REPLY			2
+#define COMMAND_AUTH			8
+#define COMMAND_SET_CLIENT_NAME		9
+#define COMMAND_GET_SINK_INFO_LIST	22
+#define COMMAND_GET_SOURCE_INFO_LIST	24
+#define COMMAND_GET_MODULE_INFO_LIST	26
+#define COMMAND_GET_CLIENT_INFO_LIST	28
+
+struct sink {
+	struct spa_node node;
+	struct spa_hook_list hooks;
+	struct spa_node_info info;
+	struct spa_param_info params[2];
+	struct pw_impl_node *impl;
+};
+
+struct data {
+	struct pw_thread_loop *loop;
+	struct pw_context *context;
+	struct sink sinks[N_SINKS];
+
+	char dir[64];
+	int fd;
+	uint32_t tag;
+
+	uint8_t *buffer;
+	uint32_t size;
+	uint32_t length;
+};
+
+static const struct {
+	const char *name;
+	uint32_t command;
+} requests[] = {
+	{ "sinks", COMMAND_GET_SINK_INFO_LIST },
+	{ "sources", COMMAND_GET_SOURCE_INFO_LIST },
+	{ "clients", COMMAND_GET_CLIENT_INFO_LIST },
+	{ "modules", COMMAND_GET_MODULE_INFO_LIST },
+};
+
+static inline uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static int sink_add_listener(void *object, struct spa_hook *listener,
+		const struct spa_node_events *events, void *data)
+{
+	struct sink *s = object;
+	struct spa_hook_list save;
+
+	spa_hook_list_isolate(&s->hooks, &save, listener, events, data);
+	spa_node_emit_info(&s->hooks, &s->info);
+	spa_hook_list_join(&s->hooks, &save);
+	return 0;
+}
+
+static int sink_set_callbacks(void *object,
+		const struct spa_node_callbacks *callbacks, void *data)
+{
+	return 0;
+}
+
+static int sink_enum_params(void *object, int seq,
+		uint32_t id, uint32_t start, uint32_t num,
+		const struct spa_pod *filter)
+{
+	struct sink *s = object;
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[1024];
+	struct spa_pod *param;
+	struct spa_result_node_params result;
+	float volumes[2] = { 1.0f, 1.0f };
+
+	if (start > 0)
+		return 0;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+
+	switch (id) {
+	case SPA_PARAM_EnumFormat:
+		param = spa_format_audio_raw_build(&b, id,
+			&SPA_AUDIO_INFO_RAW_INIT(
+				.format = SPA_AUDIO_FORMAT_F32P,
+				.rate = 48000,
+				.channels = 2,
+				.position = { SPA_AUDIO_CHANNEL_FL, SPA_AUDIO_CHANNEL_FR }));
+		break;
+	case SPA_PARAM_Props:
+		param = spa_pod_builder_add_object(&b,
+			SPA_TYPE_OBJECT_Props, id,
+			SPA_PROP_mute,           SPA_POD_Bool(false),
+			SPA_PROP_channelVolumes, SPA_POD_Array(sizeof(float),
+							SPA_TYPE_Float, 2, volumes));
+		break;
+	default:
+		return 0;
+	}
+
+	result.id = id;
+	result.index = 0;
+	result.next = 1;
+	if (spa_pod_filter(&b, &result.param, param, filter) < 0)
+		return 0;
+
+	spa_node_emit_result(&s->hooks, seq, 0, SPA_RESULT_TYPE_NODE_PARAMS, &result);
+	return 0;
+}
+
+static int sink_set_param(void *object, uint32_t id, uint32_t flags,
+		const struct spa_pod *param)
+{
+	return 0;
+}
+
+static int sink_set_io(void *object, uint32_t id, void *data, size_t size)
+{
+	return 0;
+}
+
+static int sink_send_command(void *object, const struct spa_command *command)
+{
+	return 0;
+}
+
+static const struct spa_node_methods sink_methods = {
+	SPA_VERSION_NODE_METHODS,
+	.add_listener = sink_add_listener,
+	.set_callbacks = sink_set_callbacks,
+	.enum_params = sink_enum_params,
+	.set_param = sink_set_param,
+	.set_io = sink_set_io,
+	.send_command = sink_send_command,
+};
+
+static int add_sink(struct data *d, uint32_t index)
+{
+	struct sink *s = &d->sinks[index];
+	struct pw_properties *props;
+
+	s->node.iface = SPA_INTERFACE_INIT(SPA_TYPE_INTERFACE_Node,
+			SPA_VERSION_NODE, &sink_methods, s);
+	spa_hook_list_init(&s->hooks);
+
+	s->info = SPA_NODE_INFO_INIT();
+	s->info.max_input_ports = 1;
+	s->info.change_mask = SPA_NODE_CHANGE_MASK_PARAMS;
+	s->params[0] = SPA_PARAM_INFO(SPA_PARAM_EnumFormat, SPA_PARAM_INFO_READ);
+	s->params[1] = SPA_PARAM_INFO(SPA_PARAM_Props, SPA_PARAM_INFO_READWRITE);
+	s->info.params = s->params;
+	s->info.n_params = 2;
+
+	props = pw_properties_new(
+			PW_KEY_MEDIA_CLASS, "Audio/Sink",
+			PW_KEY_NODE_GROUP, "benchmark",
+			NULL);
+	pw_properties_setf(props, PW_KEY_NODE_NAME, "benchmark-sink-%03u", index);
+	pw_properties_setf(props, PW_KEY_NODE_DESCRIPTION, "Benchmark Sink %u", index);
+
+	if ((s->impl = pw_context_create_node(d->context, props, 0)) == NULL)
+		return -errno;
+	pw_impl_node_set_implementation(s->impl, &s->node);
+	return pw_impl_node_register(s->impl, NULL);
+}
+
+static void put_8(struct data *d, uint8_t val)
+{
+	d->buffer[d->length++] = val;
+}
+
+static void put_32(struct data *d, uint32_t val)
+{
+	val = htonl(val);
+	memcpy(&d->buffer[d->length], &val, 4);
+	d->length += 4;
+}
+
+static void put_u32(struct data *d, uint32_t val)
+{
+	put_8(d, 'L');
+	put_32(d, val);
+}
+
+static void put_string(struct data *d, const char *str)
+{
+	put_8(d, 't');
+	strcpy((char *)&d->buffer[d->length], str);
+	d->length += strlen(str) + 1;
+}
+
+static void put_arbitrary(struct data *d, const void *data, uint32_t size)
+{
+	put_8(d, 'x');
+	put_32(d, size);
+	memcpy(&d->buffer[d->length], data, size);
+	d->length += size;
+}
+
+static void begin_command(struct data *d, uint32_t command)
+{
+	d->length = 0;
+	put_u32(d, command);
+	put_u32(d, ++d->tag);
+}
+
+/* send the command and read the reply in the buffer */
+static int do_command(struct data *d)
+{
+	uint32_t desc[5] = { htonl(d->length), htonl(-1), 0, 0, 0 }, val;
+	struct iovec iov[2] = { { desc, sizeof(desc) }, { d->buffer, d->length } };
+	struct msghdr msg = { .msg_iov = iov, .msg_iovlen = 2 };
+
+	if (sendmsg(d->fd, &msg, MSG_NOSIGNAL) < 0)
+		return -errno;
+
+	if (recv(d->fd, desc, sizeof(desc), MSG_WAITALL) != sizeof(desc))
+		return -EPIPE;
+
+	d->length = ntohl(desc[0]);
+	if (d->length > d->size) {
+		uint8_t *buffer;
+		if ((buffer = realloc(d->buffer, d->length)) == NULL)
+			return -errno;
+		d->buffer = buffer;
+		d->size = d->length;
+	}
+	if (recv(d->fd, d->buffer, d->length, MSG_WAITALL) != (ssize_t)d->length)
+		return -EPIPE;
+
+	if (d->length < 10 || d->buffer[0] != 'L')
+		return -EPROTO;
+	memcpy(&val, &d->buffer[1], 4);
+	if (ntohl(val) != COMMAND_REPLY)
+		return -EIO;
+	return 0;
+}
+
+static int connect_client(struct data *d)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	uint8_t cookie[NATIVE_COOKIE_LENGTH] = { 0, };
+	const char *name = "benchmark-info";
+	int res;
+
+	if ((d->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+		return -errno;
+
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/pulse/native", d->dir);
+	if (connect(d->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+		return -errno;
+
+	begin_command(d, COMMAND_AUTH);
+	put_u32(d, PROTOCOL_VERSION);
+	put_arbitrary(d, cookie, sizeof(cookie));
+	if ((res = do_command(d)) < 0)
+		return res;
+
+	/* the reply comes when the client is connected to PipeWire */
+	begin_command(d, COMMAND_SET_CLIENT_NAME);
+	put_8(d, 'P');
+	put_string(d, PW_KEY_APP_NAME);
+	put_u32(d, strlen(name) + 1);
+	put_arbitrary(d, name, strlen(name) + 1);
+	put_8(d, 'N');
+	return do_command(d);
+}
+
+/* count the sink names, the monitor names have a suffix */
+static uint32_t count_sinks(struct data *d)
+{
+	const char *name = "tbenchmark-sink-";
+	size_t len = strlen(name) + 4;
+	uint32_t i, count = 0;
+
+	for (i = 0; i + len <= d->length; i++) {
+		if (memcmp(&d->buffer[i], name, len - 4) == 0 &&
+		    d->buffer[i + len - 1] == '\0')
+			count++;
+	}
+	return count;
+}
+
+/* wait until the params of all sinks are collected */
+static int wait_sinks(struct data *d)
+{
+	uint32_t i;
+	int res;
+
+	for (i = 0; i < MAX_WAIT; i++) {
+		begin_command(d, COMMAND_GET_SINK_INFO_LIST);
+		if ((res = do_command(d)) < 0)
+			return res;
+		if (count_sinks(d) == N_SINKS)
+			return 0;
+		usleep(10 * 1000);
+	}
+	return -ETIMEDOUT;
+}
+
+static void run(struct data *d, const char *name, uint32_t command)
+{
+	uint32_t i;
+	uint64_t t1, t2, bytes = 0;
+	int res;
+
+	t1 = get_time_ns();
+	for (i = 0; i < N_REQUESTS; i++) {
+		begin_command(d, command);
+		if ((res = do_command(d)) < 0) {
+			fprintf(stderr, "%s request failed: %s\n", name, spa_strerror(res));
+			return;
+		}
+		bytes += d->length;
+	}
+	t2 = get_time_ns();
+
+	fprintf(stderr, "%-8s requests:%u reply:%6u time:%8"PRIu64"us "
+			"requests/sec:%6"PRIu64" MB/sec:%5"PRIu64"\n",
+			name, N_REQUESTS, d->length,
+			(uint64_t)((t2 - t1) / SPA_NSEC_PER_USEC),
+			(uint64_t)(N_REQUESTS * SPA_NSEC_PER_SEC / SPA_MAX(t2 - t1, 1u)),
+			(uint64_t)(bytes * SPA_NSEC_PER_SEC / SPA_MAX(t2 - t1, 1u) / (1024 * 1024)));
+}
+
+int main(int argc, char *argv[])
+{
+	struct data d;
+	struct pw_properties *props;
+	char path[128];
+	uint32_t i;
+	int res;
+
+	pw_init(&argc, &argv);
+
+	spa_zero(d);
+	d.fd = -1;
+	d.size = 4096;
+	if ((d.buffer = malloc(d.size)) == NULL) {
+		fprintf(stderr, "can't allocate buffer: %m\n");
+		return -1;
+	}
+
+	/* keep the sockets of the daemon and the pulse server out of the
+	 * runtime dir of the user */
+	snprintf(d.dir, sizeof(d.dir), "/tmp/pw-benchmark-XXXXXX");
+	if (mkdtemp(d.dir) == NULL) {
+		fprintf(stderr, "can't make runtime dir: %m\n");
+		return -1;
+	}
+	setenv("XDG_RUNTIME_DIR", d.dir, 1);
+	setenv("PULSE_RUNTIME_PATH", d.dir, 1);
+	setenv("PIPEWIRE_REMOTE", "pipewire-benchmark", 1);
+
+	props = pw_properties_new(
+			PW_KEY_CONTEXT_PROFILE_MODULES, "none",
+			PW_KEY_CORE_DAEMON, "true",
+			PW_KEY_CORE_NAME, "pipewire-benchmark",
+			NULL);
+
+	d.loop = pw_thread_loop_new("benchmark", NULL);
+	d.context = pw_context_new(pw_thread_loop_get_loop(d.loop), props, 0);
+	spa_assert(d.context != NULL);
+
+	pw_thread_loop_lock(d.loop);
+	if (pw_context_load_module(d.context,
+			"libpipewire-module-protocol-native", NULL, NULL) == NULL ||
+	    pw_context_load_module(d.context,
+			"libpipewire-module-access", NULL, NULL) == NULL ||
+	    pw_context_load_module(d.context,
+			"libpipewire-module-protocol-pulse",
+			"server.address=\"unix:native\"", NULL) == NULL) {
+		fprintf(stderr, "can't load modules: %m\n");
+		pw_thread_loop_unlock(d.loop);
+		goto exit;
+	}
+	for (i = 0; i < N_SINKS; i++) {
+		if ((res = add_sink(&d, i)) < 0) {
+			fprintf(stderr, "can't add sink: %s\n", spa_strerror(res));
+			pw_thread_loop_unlock(d.loop);
+			goto exit;
+		}
+	}
+	pw_thread_loop_start(d.loop);
+	pw_thread_loop_unlock(d.loop);
+
+	if ((res = connect_client(&d)) < 0 ||
+	    (res = wait_sinks(&d)) < 0) {
+		fprintf(stderr, "can't connect client: %s\n", spa_strerror(res));
+		goto exit;
+	}
+
+	for (i = 0; i < SPA_N_ELEMENTS(requests); i++)
+		run(&d, requests[i].name, requests[i].command);
+
+exit:
+	if (d.fd >= 0)
+		close(d.fd);
+	pw_thread_loop_stop(d.loop);
+	pw_context_destroy(d.context);
+	pw_thread_loop_destroy(d.loop);
+	free(d.buffer);
+
+	/* the servers removed their sockets */
+	snprintf(path, sizeof(path), "%s/pulse", d.dir);
+	rmdir(path);
+	rmdir(d.dir);
+
+	return 0;
+}
@@ -37,7 +37,14 @@
 
 #define FRAME_SIZE_MAX_ALLOW (1024*1024*16)
 
+#define SHM_INFO_SIZE	(4 * sizeof(uint32_t))	/* block_id, shm_id, offset, length */
+#define MAX_SHM_POOLS	16
+#define MAX_FDS		4
+#define MAX_FLUSH	128	/* messages in one sendmsg */
+
 #define PROTOCOL_FLAG_MASK	0xffff0000u
+#define PROTOCOL_FLAG_SHM	0x80000000u
+#define PROTOCOL_FLAG_MEMFD	0x40000000u
 #define PROTOCOL_VERSION_MASK	0x0000ffffu
 #define PROTOCOL_VERSION	34
 
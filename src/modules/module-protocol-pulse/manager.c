@@ -54,6 +54,13 @@ struct object_info {
 	void (*destroy) (struct object *object);
 };
 
+struct object_cache {
+	struct spa_list link;
+	uint32_t key;
+	uint64_t serial;
+	size_t size;
+};
+
 struct object {
 	struct pw_manager_object this;
 
@@ -62,6 +69,7 @@ struct object {
 	const struct object_info *info;
 
 	struct spa_list pending_list;
+	struct spa_list cache_list;
 
 	struct spa_hook proxy_listener;
 	struct spa_hook object_listener;
@@ -124,6 +132,26 @@ static uint32_t clear_params(struct spa_list *param_list, uint32_t id)
 }
 
 
+static void clear_cache(struct object *o)
+{
+	struct object_cache *c;
+
+	spa_list_consume(c, &o->cache_list, link) {
+		spa_list_remove(&c->link);
+		free(c);
+	}
+}
+
+static void object_changed(struct object *o, int changed)
+{
+	struct manager *m = o->manager;
+
+	o->this.changed += changed;
+	o->this.serial = ++m->this.serial;
+	clear_cache(o);
+	core_sync(m);
+}
+
 static struct object *find_object(struct manager *m, uint32_t id)
 {
 	struct object *o;
@@ -160,6 +188,7 @@ static void object_destroy(struct object *o)
 		pw_properties_free(o->this.props);
 	clear_params(&o->this.param_list, SPA_ID_INVALID);
 	clear_params(&o->pending_list, SPA_ID_INVALID);
+	clear_cache(o);
 	free(o);
 }
 
@@ -182,10 +211,8 @@ static void client_event_info(void *object, const struct pw_client_info *info)
 	if (info->change_mask & PW_CLIENT_CHANGE_MASK_PROPS)
 		changed++;
 
-	if (changed) {
-		o->this.changed += changed;
-		core_sync(o->manager);
-	}
+	if (changed)
+		object_changed(o, changed);
 }
 
 static const struct pw_client_events client_events = {
@@ -221,10 +248,8 @@ static void module_event_info(void *object, const struct pw_module_info *info)
 	if (info->change_mask & PW_MODULE_CHANGE_MASK_PROPS)
 		changed++;
 
-	if (changed) {
-		o->this.changed += changed;
-		core_sync(o->manager);
-	}
+	if (changed)
+		object_changed(o, changed);
 }
 
 static const struct pw_module_events module_events = {
@@ -285,10 +310,8 @@ static void device_event_info(void *object, const struct pw_device_info *info)
 					0, id, 0, -1, NULL);
 		}
 	}
-	if (changed) {
-		o->this.changed += changed;
-		core_sync(o->manager);
-	}
+	if (changed)
+		object_changed(o, changed);
 }
 static struct object *find_device(struct manager *m, uint32_t card_id, uint32_t device)
 {
@@ -329,10 +352,8 @@ static void device_event_param(void *object, int seq,
 				SPA_PARAM_ROUTE_device,  SPA_POD_Int(&device)) < 0)
 			return;
 
-		if ((dev = find_device(m, o->this.id, device)) != NULL) {
-			dev->this.changed++;
-			core_sync(o->manager);
-		}
+		if ((dev = find_device(m, o->this.id, device)) != NULL)
+			object_changed(dev, 1);
 	}
 }
 
@@ -390,10 +411,8 @@ static void node_event_info(void *object, const struct pw_node_info *info)
 					0, id, 0, -1, NULL);
 		}
 	}
-	if (changed) {
-		o->this.changed += changed;
-		core_sync(o->manager);
-	}
+	if (changed)
+		object_changed(o, changed);
 }
 
 static void node_event_param(void *object, int seq,
@@ -454,6 +473,7 @@ static void metadata_init(struct object *object)
 	struct object *o = object;
 	struct manager *m = o->manager;
 	o->this.creating = false;
+	o->this.serial = m->this.topology_serial = ++m->this.serial;
 	manager_emit_added(m, &o->this);
 }
 
@@ -547,6 +567,7 @@ static void registry_event_global(void *data, uint32_t id,
 	o->this.creating = true;
 	spa_list_init(&o->this.param_list);
 	spa_list_init(&o->pending_list);
+	spa_list_init(&o->cache_list);
 
 	o->manager = m;
 	o->info = info;
@@ -575,6 +596,7 @@ static void registry_event_global_remove(void *object, uint32_t id)
 	if ((o = find_object(m, id)) == NULL)
 		return;
 
+	m->this.topology_serial = ++m->this.serial;
 	manager_emit_removed(m, &o->this);
 
 	object_destroy(o);
@@ -611,9 +633,12 @@ static void on_core_done(void *data, uint32_t id, int seq)
 		spa_list_for_each(o, &m->this.object_list, this.link) {
 			if (o->this.creating) {
 				o->this.creating = false;
+				o->this.serial = m->this.topology_serial = ++m->this.serial;
 				manager_emit_added(m, &o->this);
 				o->this.changed = 0;
 			} else if (o->this.changed > 0) {
+				o->this.serial = ++m->this.serial;
+				clear_cache(o);
 				manager_emit_updated(m, &o->this);
 				o->this.changed = 0;
 			}
@@ -695,6 +720,47 @@ int pw_manager_set_metadata(struct pw_manager *manager,
 	return 0;
 }
 
+const void *pw_manager_object_get_cache(struct pw_manager_object *object,
+		uint32_t key, uint64_t serial, size_t *size)
+{
+	struct object *o = SPA_CONTAINER_OF(object, struct object, this);
+	struct object_cache *c;
+
+	spa_list_for_each(c, &o->cache_list, link) {
+		if (c->key != key)
+			continue;
+		if (c->serial < serial)
+			return NULL;
+		*size = c->size;
+		return SPA_MEMBER(c, sizeof(*c), void);
+	}
+	return NULL;
+}
+
+int pw_manager_object_set_cache(struct pw_manager_object *object,
+		uint32_t key, uint64_t serial, const void *data, size_t size)
+{
+	struct object *o = SPA_CONTAINER_OF(object, struct object, this);
+	struct object_cache *c, *t;
+
+	spa_list_for_each_safe(c, t, &o->cache_list, link) {
+		if (c->key == key) {
+			spa_list_remove(&c->link);
+			free(c);
+		}
+	}
+	if ((c = malloc(sizeof(*c) + size)) == NULL)
+		return -errno;
+
+	c->key = key;
+	c->serial = serial;
+	c->size = size;
+	if (size > 0)
+		memcpy(SPA_MEMBER(c, sizeof(*c), void), data, size);
+	spa_list_append(&o->cache_list, &c->link);
+	return 0;
+}
+
 int pw_manager_for_each_object(struct pw_manager *manager,
 		int (*callback) (void *data, struct pw_manager_object *object),
 		void *data)
@@ -63,6 +63,9 @@ struct pw_manager {
 
 	uint32_t n_objects;
 	struct spa_list object_list;
+
+	uint64_t serial;		/**< incremented for each change */
+	uint64_t topology_serial;	/**< serial of the last added or removed object */
 };
 
 struct pw_manager_param {
@@ -81,6 +84,7 @@ struct pw_manager_object {
 	struct pw_proxy *proxy;
 
 	int changed;
+	uint64_t serial;		/**< manager serial of the last change */
 	void *info;
 	struct spa_list param_list;
 	unsigned int creating:1;
@@ -99,6 +103,14 @@ int pw_manager_set_metadata(struct pw_manager *manager,
 		uint32_t subject, const char *key, const char *type,
 		const char *format, ...) SPA_PRINTF_FUNC(6,7);
 
+/** get the data cached with \a key when it was made at or after \a serial */
+const void *pw_manager_object_get_cache(struct pw_manager_object *o,
+		uint32_t key, uint64_t serial, size_t *size);
+
+/** cache \a data with \a key, the cache is cleared when the object changes */
+int pw_manager_object_set_cache(struct pw_manager_object *o,
+		uint32_t key, uint64_t serial, const void *data, size_t size);
+
 int pw_manager_for_each_object(struct pw_manager *manager,
 		int (*callback) (void *data, struct pw_manager_object *object),
 		void *data);
@@ -120,6 +120,9 @@ struct message {
 	struct spa_list link;
 	uint32_t extra[4];
 	uint32_t channel;
+	uint32_t flags;		/* descriptor flags */
+	uint32_t block_id;	/* released shm block */
+	unsigned int creds:1;	/* send our credentials along */
 	uint32_t allocated;
 	uint32_t length;
 	uint32_t offset;
@@ -699,6 +702,18 @@ static int message_put(struct message *m, ...)
 	return 0;
 }
 
+static int message_append(struct message *m, const void *data, uint32_t size)
+{
+	if (ensure_size(m, size) > 0)
+		memcpy(m->data + m->length, data, size);
+	m->length += size;
+
+	if (m->length > m->allocated)
+		return -ENOMEM;
+
+	return 0;
+}
+
 static int message_dump(enum spa_log_level level, struct message *m)
 {
 	int res;
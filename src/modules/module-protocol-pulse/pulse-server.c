@@ -36,7 +36,9 @@
 #include <math.h>
 #include <time.h>
 #include <limits.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/time.h>
 #include <arpa/inet.h>
@@ -78,6 +80,19 @@
 
 #define NAME	"pulse-server"
 
+#ifndef F_LINUX_SPECIFIC_BASE
+#define F_LINUX_SPECIFIC_BASE 1024
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS (F_LINUX_SPECIFIC_BASE + 9)
+#define F_GET_SEALS (F_LINUX_SPECIFIC_BASE + 10)
+#define F_SEAL_SEAL     0x0001
+#define F_SEAL_SHRINK   0x0002
+#endif
+
+/* the seals that keep a client from shrinking a pool under our mapping */
+#define SHM_POOL_SEALS	(F_SEAL_SHRINK | F_SEAL_SEAL)
+
 static bool debug_messages = false;
 
 struct impl;
@@ -93,6 +108,14 @@ struct operation {
 	void (*callback) (struct operation *op);
 };
 
+/* a memfd pool of the client, its memblocks are sent as references
+ * into the pool instead of over the socket */
+struct shm_pool {
+	uint32_t id;
+	uint32_t size;
+	void *data;
+};
+
 struct client {
 	struct spa_list link;
 	struct impl *impl;
@@ -125,6 +148,11 @@ struct client {
 	uint32_t out_index;
 	struct descriptor desc;
 	struct message *message;
+	int fds[MAX_FDS];
+	uint32_t n_fds;
+
+	struct shm_pool pools[MAX_SHM_POOLS];
+	uint32_t n_pools;
 
 	struct pw_map streams;
 	struct spa_list free_messages;
@@ -135,8 +163,12 @@ struct client {
 
 	struct spa_list samples;
 
+	uint32_t process_pending;	/* main loop is invoked for the streams */
+
 	unsigned int disconnecting:1;
 	unsigned int need_flush:1;
+	unsigned int use_shm:1;
+	unsigned int batching:1;	/* don't flush for each message */
 };
 
 struct buffer_attr {
@@ -147,6 +179,15 @@ struct buffer_attr {
 	uint32_t fragsize;
 };
 
+struct process_data {
+	struct pw_time pwt;
+	uint32_t read_index;
+	uint32_t write_index;
+	uint32_t underrun_for;
+	uint32_t playing_for;
+	unsigned int underrun:1;
+};
+
 struct stream {
 	uint32_t create_tag;
 	uint32_t channel;	/* index in map */
@@ -179,6 +220,14 @@ struct stream {
 	uint32_t missing;
 	uint32_t requested;
 
+	/* written by the data thread, the main thread reads it when the
+	 * seq changed. underrun_for and playing_for are running totals */
+	uint32_t process_seq;
+	struct process_data process;
+	/* last values seen by the main thread */
+	uint32_t process_seen;
+	struct process_data process_last;
+
 	struct sample_spec ss;
 	struct channel_map map;
 	struct buffer_attr attr;
@@ -300,58 +349,105 @@ static struct message *message_alloc(struct client *client, uint32_t channel, ui
 	ensure_size(msg, size);
 	spa_zero(msg->extra);
 	msg->channel = channel;
+	msg->flags = 0;
+	msg->block_id = 0;
+	msg->creds = false;
 	msg->offset = 0;
 	msg->length = size;
 	return msg;
 }
 
+/* write as many messages as possible with one sendmsg */
 static int flush_messages(struct client *client)
 {
-	int res;
+	struct descriptor desc[MAX_FLUSH];
+	struct iovec iov[MAX_FLUSH * 2], *v;
+	struct msghdr msg;
+	struct message *m, *t;
+	ssize_t res;
+	uint32_t i, n_iov, skip;
+	bool creds;
+#if defined(__linux__)
+	char cmsgbuf[CMSG_SPACE(sizeof(struct ucred))];
+	struct ucred ucred;
+	struct cmsghdr *cmsg;
+#endif
 
-	while (true) {
-		struct message *m;
-		struct descriptor desc;
-		void *data;
-		size_t size;
+	while (!spa_list_is_empty(&client->out_messages)) {
+		i = n_iov = 0;
+		creds = false;
 
-		if (spa_list_is_empty(&client->out_messages))
-			break;
-		m = spa_list_first(&client->out_messages, struct message, link);
-
-		if (client->out_index < sizeof(desc)) {
-			desc.length = htonl(m->length);
-			desc.channel = htonl(m->channel);
-			desc.offset_hi = 0;
-			desc.offset_lo = 0;
-			desc.flags = 0;
-
-			data = SPA_MEMBER(&desc, client->out_index, void);
-			size = sizeof(desc) - client->out_index;
-		} else if (client->out_index < m->length + sizeof(desc)) {
-			uint32_t idx = client->out_index - sizeof(desc);
-			data = m->data + idx;
-			size = m->length - idx;
-		} else {
-			if (debug_messages && m->channel == SPA_ID_INVALID)
-				message_dump(SPA_LOG_LEVEL_INFO, m);
-			message_free(client, m, true, false);
-			client->out_index = 0;
-			continue;
+		spa_list_for_each(m, &client->out_messages, link) {
+			if (i == MAX_FLUSH)
+				break;
+			if (m->creds) {
+				/* credentials go with the first byte of the message */
+				if (i > 0)
+					break;
+				creds = client->out_index == 0;
+			}
+			desc[i].length = htonl(m->length);
+			desc[i].channel = htonl(m->channel);
+			desc[i].offset_hi = htonl(m->block_id);
+			desc[i].offset_lo = 0;
+			desc[i].flags = htonl(m->flags);
+
+			iov[n_iov].iov_base = &desc[i];
+			iov[n_iov++].iov_len = sizeof(struct descriptor);
+			if (m->length > 0) {
+				iov[n_iov].iov_base = m->data;
+				iov[n_iov++].iov_len = m->length;
+			}
+			i++;
 		}
 
+		/* skip what was already sent of the first message */
+		v = iov;
+		for (skip = client->out_index; skip >= v->iov_len; v++, n_iov--)
+			skip -= v->iov_len;
+		v->iov_base = SPA_MEMBER(v->iov_base, skip, void);
+		v->iov_len -= skip;
+
+		spa_zero(msg);
+		msg.msg_iov = v;
+		msg.msg_iovlen = n_iov;
+#if defined(__linux__)
+		if (creds) {
+			ucred.pid = getpid();
+			ucred.uid = getuid();
+			ucred.gid = getgid();
+
+			msg.msg_control = cmsgbuf;
+			msg.msg_controllen = sizeof(cmsgbuf);
+			cmsg = CMSG_FIRSTHDR(&msg);
+			cmsg->cmsg_level = SOL_SOCKET;
+			cmsg->cmsg_type = SCM_CREDENTIALS;
+			cmsg->cmsg_len = CMSG_LEN(sizeof(struct ucred));
+			memcpy(CMSG_DATA(cmsg), &ucred, sizeof(struct ucred));
+		}
+#endif
 		while (true) {
-			res = send(client->source->fd, data, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+			res = sendmsg(client->source->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
 			if (res < 0) {
 				if (errno == EINTR)
 					continue;
 				if (errno != EAGAIN && errno != EWOULDBLOCK)
-					pw_log_warn("send channel:%d %zu, res %d: %m", m->channel, size, res);
+					pw_log_warn("sendmsg %u messages, res %zd: %m", i, res);
 				return -errno;
 			}
-			client->out_index += res;
 			break;
 		}
+
+		client->out_index += res;
+		spa_list_for_each_safe(m, t, &client->out_messages, link) {
+			size_t size = sizeof(struct descriptor) + m->length;
+			if (client->out_index < size)
+				break;
+			client->out_index -= size;
+			if (debug_messages && m->channel == SPA_ID_INVALID)
+				message_dump(SPA_LOG_LEVEL_INFO, m);
+			message_free(client, m, true, false);
+		}
 	}
 	return 0;
 }
@@ -364,7 +460,7 @@ static int send_message(struct client *client, struct message *m)
 	if (m == NULL)
 		return -EINVAL;
 
-	if (m->length == 0) {
+	if (m->length == 0 && m->flags == 0) {
 		res = 0;
 		goto error;
 	} else if (m->length > m->allocated) {
@@ -375,6 +471,9 @@ static int send_message(struct client *client, struct message *m)
 	m->offset = 0;
 	spa_list_append(&client->out_messages, &m->link);
 
+	if (client->batching)
+		return 0;
+
 	mask = client->source->mask;
 	if (!SPA_FLAG_IS_SET(mask, SPA_IO_OUT)) {
 		client->need_flush = true;
@@ -387,6 +486,26 @@ error:
 	return res;
 }
 
+/* flush now, only wait for the socket when it is full */
+static int client_flush(struct client *client)
+{
+	struct impl *impl = client->impl;
+	int res, mask = client->source->mask;
+
+	res = flush_messages(client);
+	if (res == -EAGAIN) {
+		if (SPA_FLAG_IS_SET(mask, SPA_IO_OUT))
+			return 0;
+		SPA_FLAG_SET(mask, SPA_IO_OUT);
+	} else if (SPA_FLAG_IS_SET(mask, SPA_IO_OUT)) {
+		SPA_FLAG_CLEAR(mask, SPA_IO_OUT);
+	} else {
+		return res;
+	}
+	pw_loop_update_io(impl->loop, client->source, mask);
+	return res == -EAGAIN ? 0 : res;
+}
+
 static struct message *reply_new(struct client *client, uint32_t tag)
 {
 	struct message *reply;
@@ -571,6 +690,37 @@ static int send_stream_started(struct stream *stream)
 	return send_message(client, reply);
 }
 
+static int send_release(struct client *client, uint32_t block_id)
+{
+	struct message *reply;
+
+	pw_log_trace(NAME" %p: [%s] RELEASE block:%u", client, client->name, block_id);
+
+	reply = message_alloc(client, -1, 0);
+	reply->flags = FLAG_SHMRELEASE;
+	reply->block_id = block_id;
+	return send_message(client, reply);
+}
+
+/* memory is only shared with clients of the same user on the unix socket */
+static bool client_can_share_memory(struct client *client)
+{
+#if defined(__linux__)
+	struct ucred ucred;
+	socklen_t len = sizeof(ucred);
+
+	if (client->server->type != SERVER_TYPE_UNIX)
+		return false;
+	if (getsockopt(client->source->fd, SOL_SOCKET, SO_PEERCRED, &ucred, &len) < 0) {
+		pw_log_warn(NAME" %p: no peercred: %m", client);
+		return false;
+	}
+	return ucred.uid == getuid();
+#else
+	return false;
+#endif
+}
+
 static int do_command_auth(struct client *client, uint32_t command, uint32_t tag, struct message *m)
 {
 	struct impl *impl = client->impl;
@@ -578,6 +728,7 @@ static int do_command_auth(struct client *client, uint32_t command, uint32_t tag
 	uint32_t version;
 	const void *cookie;
 	size_t len;
+	bool do_shm = false, do_memfd = false;
 
 	if (message_get(m,
 			TAG_U32, &version,
@@ -590,17 +741,28 @@ static int do_command_auth(struct client *client, uint32_t command, uint32_t tag
 	if (len != NATIVE_COOKIE_LENGTH)
 		return -EINVAL;
 
-	if ((version & PROTOCOL_VERSION_MASK) >= 13)
+	if ((version & PROTOCOL_VERSION_MASK) >= 13) {
+		do_shm = SPA_FLAG_IS_SET(version, PROTOCOL_FLAG_SHM);
+		do_memfd = (version & PROTOCOL_VERSION_MASK) >= 31 &&
+			SPA_FLAG_IS_SET(version, PROTOCOL_FLAG_MEMFD);
 		version &= PROTOCOL_VERSION_MASK;
+	}
 
 	client->version = version;
+	/* we can only import memfd pools, without them the client sends
+	 * the data over the socket */
+	client->use_shm = do_shm && do_memfd && client_can_share_memory(client);
 
-	pw_log_info(NAME" %p: client:%p AUTH tag:%u version:%d", impl, client, tag, version);
+	pw_log_info(NAME" %p: client:%p AUTH tag:%u version:%d shm:%d", impl, client,
+			tag, version, client->use_shm);
 
 	reply = reply_new(client, tag);
 	message_put(reply,
-			TAG_U32, PROTOCOL_VERSION,
+			TAG_U32, PROTOCOL_VERSION |
+				(client->use_shm ? PROTOCOL_FLAG_SHM | PROTOCOL_FLAG_MEMFD : 0),
 			TAG_INVALID);
+	/* the client checks that we are the same user before it uses shm */
+	reply->creds = client->use_shm;
 
 	return send_message(client, reply);
 }
@@ -1323,22 +1485,9 @@ static void stream_param_changed(void *data, uint32_t id, const struct spa_pod *
 	pw_stream_update_params(stream->stream, params, n_params);
 }
 
-struct process_data {
-	struct pw_time pwt;
-	uint32_t read_index;
-	uint32_t write_index;
-	uint32_t underrun_for;
-	uint32_t playing_for;
-	unsigned int underrun:1;
-};
-
-static int
-do_process_done(struct spa_loop *loop,
-                 bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+static int stream_process_done(struct stream *stream, const struct process_data *pd)
 {
-	struct stream *stream = user_data;
 	struct client *client = stream->client;
-	const struct process_data *pd = data;
 	uint32_t index;
 	int32_t avail;
 
@@ -1405,6 +1554,49 @@ do_process_done(struct spa_loop *loop,
 	return 0;
 }
 
+static int client_process_done_stream(void *item, void *data)
+{
+	struct stream *stream = item;
+	struct process_data pd;
+	uint32_t seq1, seq2;
+
+	do {
+		seq1 = SEQ_READ(stream->process_seq);
+		pd = stream->process;
+		seq2 = SEQ_READ(stream->process_seq);
+	} while (!SEQ_READ_SUCCESS(seq1, seq2));
+
+	if (seq1 == stream->process_seen)
+		return 0;
+	stream->process_seen = seq1;
+
+	/* what was played since the last time */
+	pd.underrun_for -= stream->process_last.underrun_for;
+	pd.playing_for -= stream->process_last.playing_for;
+	stream->process_last.underrun_for += pd.underrun_for;
+	stream->process_last.playing_for += pd.playing_for;
+
+	stream_process_done(stream, &pd);
+	return 0;
+}
+
+/* collect the progress of all streams of the client, the messages
+ * are written with one sendmsg */
+static int
+do_client_process_done(struct spa_loop *loop,
+                 bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct client *client = user_data;
+
+	ATOMIC_STORE(client->process_pending, 0);
+
+	client->batching = true;
+	pw_map_for_each(&client->streams, client_process_done_stream, client);
+	client->batching = false;
+
+	client_flush(client);
+	return 0;
+}
 
 static void stream_process(void *data)
 {
@@ -1502,8 +1694,19 @@ static void stream_process(void *data)
 
 	pw_stream_get_time(stream->stream, &pd.pwt);
 
-	pw_loop_invoke(impl->loop,
-			do_process_done, 1, &pd, sizeof(pd), false, stream);
+	SEQ_WRITE(stream->process_seq);
+	stream->process.pwt = pd.pwt;
+	stream->process.read_index = pd.read_index;
+	stream->process.write_index = pd.write_index;
+	stream->process.underrun_for += pd.underrun_for;
+	stream->process.playing_for += pd.playing_for;
+	stream->process.underrun = pd.underrun;
+	SEQ_WRITE(stream->process_seq);
+
+	/* one wakeup of the main loop for all streams of the client */
+	if (ATOMIC_CAS(client->process_pending, 0, 1))
+		pw_loop_invoke(impl->loop,
+				do_client_process_done, 1, NULL, 0, false, client);
 }
 
 static void stream_drained(void *data)
@@ -3828,6 +4031,68 @@ static int fill_source_output_info(struct client *client, struct message *m,
 	return 0;
 }
 
+/* the encoded info of an object is cached in the object with the GET_*_INFO
+ * command as the key. The info is valid as long as the object and the objects
+ * it was made from did not change. */
+static uint64_t info_serial(struct client *client, uint32_t command,
+		struct pw_manager_object *o)
+{
+	struct pw_manager *manager = client->manager;
+	struct pw_node_info *info = o->info;
+	struct pw_manager_object *card;
+	struct selector sel;
+	uint64_t serial = o->serial;
+	const char *str;
+
+	switch (command) {
+	case COMMAND_GET_SINK_INFO:
+	case COMMAND_GET_SOURCE_INFO:
+		/* the ports and volumes come from the card */
+		if (strcmp(o->type, PW_TYPE_INTERFACE_Node) != 0 ||
+		    info == NULL || info->props == NULL ||
+		    (str = spa_dict_lookup(info->props, PW_KEY_DEVICE_ID)) == NULL)
+			break;
+		serial = SPA_MAX(serial, manager->topology_serial);
+
+		spa_zero(sel);
+		sel.id = (uint32_t)atoi(str);
+		sel.type = object_is_card;
+		if ((card = select_object(manager, &sel)) != NULL)
+			serial = SPA_MAX(serial, card->serial);
+		break;
+	case COMMAND_GET_SINK_INPUT_INFO:
+	case COMMAND_GET_SOURCE_OUTPUT_INFO:
+		/* the peer is found with the links */
+		serial = SPA_MAX(serial, manager->topology_serial);
+		break;
+	}
+	return serial;
+}
+
+static int fill_info_cached(struct client *client, uint32_t command, struct message *m,
+		struct pw_manager_object *o,
+		int (*fill_func) (struct client *client, struct message *m, struct pw_manager_object *o))
+{
+	const void *data;
+	size_t size;
+	uint32_t offset = m->length;
+	int res;
+
+	if ((data = pw_manager_object_get_cache(o, command,
+				info_serial(client, command, o), &size)) != NULL) {
+		if (size == 0)
+			return -ENOENT;
+		return message_append(m, data, size);
+	}
+
+	res = fill_func(client, m, o);
+
+	if (m->length <= m->allocated)
+		pw_manager_object_set_cache(o, command, client->manager->serial,
+				m->data + offset, res < 0 ? 0 : m->length - offset);
+	return res;
+}
+
 static int do_get_info(struct client *client, uint32_t command, uint32_t tag, struct message *m)
 {
 	struct impl *impl = client->impl;
@@ -3915,7 +4180,7 @@ static int do_get_info(struct client *client, uint32_t command, uint32_t tag, st
 		goto error_noentity;
 
 	reply = reply_new(client, tag);
-	if ((res = fill_func(client, reply, o)) < 0)
+	if ((res = fill_info_cached(client, command, reply, o, fill_func)) < 0)
 		goto error;
 
 	return send_message(client, reply);
@@ -4028,13 +4293,14 @@ static int do_get_sample_info_list(struct client *client, uint32_t command, uint
 struct info_list_data {
 	struct client *client;
 	struct message *reply;
+	uint32_t command;
 	int (*fill_func) (struct client *client, struct message *m, struct pw_manager_object *o);
 };
 
 static int do_list_info(void *data, struct pw_manager_object *object)
 {
 	struct info_list_data *info = data;
-	info->fill_func(info->client, info->reply, object);
+	fill_info_cached(info->client, info->command, info->reply, object, info->fill_func);
 	return 0;
 }
 
@@ -4052,24 +4318,31 @@ static int do_get_info_list(struct client *client, uint32_t command, uint32_t ta
 
 	switch (command) {
 	case COMMAND_GET_CLIENT_INFO_LIST:
+		info.command = COMMAND_GET_CLIENT_INFO;
 		info.fill_func = fill_client_info;
 		break;
 	case COMMAND_GET_MODULE_INFO_LIST:
+		info.command = COMMAND_GET_MODULE_INFO;
 		info.fill_func = fill_module_info;
 		break;
 	case COMMAND_GET_CARD_INFO_LIST:
+		info.command = COMMAND_GET_CARD_INFO;
 		info.fill_func = fill_card_info;
 		break;
 	case COMMAND_GET_SINK_INFO_LIST:
+		info.command = COMMAND_GET_SINK_INFO;
 		info.fill_func = fill_sink_info;
 		break;
 	case COMMAND_GET_SOURCE_INFO_LIST:
+		info.command = COMMAND_GET_SOURCE_INFO;
 		info.fill_func = fill_source_info;
 		break;
 	case COMMAND_GET_SINK_INPUT_INFO_LIST:
+		info.command = COMMAND_GET_SINK_INPUT_INFO;
 		info.fill_func = fill_sink_input_info;
 		break;
 	case COMMAND_GET_SOURCE_OUTPUT_INFO_LIST:
+		info.command = COMMAND_GET_SOURCE_OUTPUT_INFO;
 		info.fill_func = fill_source_output_info;
 		break;
 	default:
@@ -4495,6 +4768,72 @@ static int do_unload_module(struct client *client, uint32_t command, uint32_t ta
 	return reply_simple_ack(client, tag);
 }
 
+static struct shm_pool *find_shm_pool(struct client *client, uint32_t id)
+{
+	uint32_t i;
+	for (i = 0; i < client->n_pools; i++) {
+		if (client->pools[i].id == id)
+			return &client->pools[i];
+	}
+	return NULL;
+}
+
+static int do_register_memfd_shmid(struct client *client, uint32_t command, uint32_t tag, struct message *m)
+{
+	struct impl *impl = client->impl;
+	struct shm_pool *pool;
+	struct stat st;
+	uint32_t shm_id;
+	void *data;
+	int fd, seals;
+
+	if (message_get(m,
+			TAG_U32, &shm_id,
+			TAG_INVALID) < 0)
+		return -EPROTO;
+
+	if (!client->use_shm || client->n_fds != 1)
+		return -EPROTO;
+
+	/* the fd is closed after the command, the mapping stays */
+	fd = client->fds[0];
+
+	pw_log_info(NAME" %p: [%s] %s tag:%u shm_id:%u fd:%d", impl, client->name,
+			commands[command].name, tag, shm_id, fd);
+
+	/* there is no reply, the client sends the data over the socket
+	 * when we don't know the pool */
+	if (client->n_pools >= MAX_SHM_POOLS || find_shm_pool(client, shm_id) != NULL) {
+		pw_log_warn(NAME" %p: [%s] can't add pool %u", impl, client->name, shm_id);
+		return 0;
+	}
+	/* a pool that shrinks makes us SIGBUS when we copy from it. Add the
+	 * seals when the client did not and reject the pool when that fails */
+	seals = fcntl(fd, F_GET_SEALS);
+	if (seals >= 0 && (seals & SHM_POOL_SEALS) != SHM_POOL_SEALS &&
+	    fcntl(fd, F_ADD_SEALS, SHM_POOL_SEALS) == 0)
+		seals = fcntl(fd, F_GET_SEALS);
+	if (seals < 0 || (seals & SHM_POOL_SEALS) != SHM_POOL_SEALS) {
+		pw_log_warn(NAME" %p: [%s] pool %u is not sealed", impl, client->name, shm_id);
+		return 0;
+	}
+	if (fstat(fd, &st) < 0 || st.st_size <= 0 || st.st_size > UINT32_MAX) {
+		pw_log_warn(NAME" %p: [%s] invalid pool %u: %m", impl, client->name, shm_id);
+		return 0;
+	}
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED) {
+		pw_log_warn(NAME" %p: [%s] can't map pool %u: %m", impl, client->name, shm_id);
+		return 0;
+	}
+	pool = &client->pools[client->n_pools++];
+	pool->id = shm_id;
+	pool->size = st.st_size;
+	pool->data = data;
+
+	return 0;
+}
+
 static int do_error_access(struct client *client, uint32_t command, uint32_t tag, struct message *m)
 {
 	return -EACCES;
@@ -4662,7 +5001,7 @@ static const struct command commands[COMMAND_MAX] =
 
 	/* Supported since protocol v31 (9.0)
 	 * BOTH DIRECTIONS */
-	[COMMAND_REGISTER_MEMFD_SHMID] = { "REGISTER_MEMFD_SHMID", do_error_access, },
+	[COMMAND_REGISTER_MEMFD_SHMID] = { "REGISTER_MEMFD_SHMID", do_register_memfd_shmid, },
 };
 
 static int client_free_stream(void *item, void *data)
@@ -4672,12 +5011,21 @@ static int client_free_stream(void *item, void *data)
 	return 0;
 }
 
+static void client_close_fds(struct client *client)
+{
+	uint32_t i;
+	for (i = 0; i < client->n_fds; i++)
+		close(client->fds[i]);
+	client->n_fds = 0;
+}
+
 static void client_free(struct client *client)
 {
 	struct impl *impl = client->impl;
 	struct message *msg;
 	struct module *module, *tmp;
 	struct pending_sample *p, *t;
+	uint32_t i;
 
 	pw_log_debug(NAME" %p: client %p free", impl, client);
 	spa_list_remove(&client->link);
@@ -4708,6 +5056,9 @@ static void client_free(struct client *client)
 		pw_loop_destroy_source(impl->loop, client->source);
 	if (client->cleanup)
 		pw_loop_destroy_source(impl->loop, client->cleanup);
+	client_close_fds(client);
+	for (i = 0; i < client->n_pools; i++)
+		munmap(client->pools[i].data, client->pools[i].size);
 	free(client);
 }
 
@@ -4751,14 +5102,14 @@ finish:
 	return 0;
 }
 
-static int handle_memblock(struct client *client, struct message *msg)
+/* write the data of a memblock in the ringbuffer of the stream */
+static int write_memblock(struct client *client, const void *data, uint32_t length)
 {
 	struct impl *impl = client->impl;
 	struct stream *stream;
 	uint32_t channel, flags, index;
 	int64_t offset;
 	int32_t filled;
-	int res = 0;
 
 	channel = ntohl(client->desc.channel);
 	offset = (int64_t) (
@@ -4768,17 +5119,15 @@ static int handle_memblock(struct client *client, struct message *msg)
 
 	pw_log_debug(NAME" %p: Received memblock channel:%d offset:%"PRIi64
 			" flags:%08x size:%u", impl, channel, offset,
-			flags, msg->length);
+			flags, length);
 
 	stream = pw_map_lookup(&client->streams, channel);
-	if (stream == NULL || stream->type == STREAM_TYPE_RECORD) {
-		res = -EINVAL;
-		goto finish;
-	}
+	if (stream == NULL || stream->type == STREAM_TYPE_RECORD)
+		return -EINVAL;
 
 	filled = spa_ringbuffer_get_write_index(&stream->ring, &index);
-	pw_log_debug("new block %p %p/%u filled:%d index:%d flags:%02x offset:%08"PRIx64,
-			msg, msg->data, msg->length, filled, index, flags, offset);
+	pw_log_debug("new block %p/%u filled:%d index:%d flags:%02x offset:%08"PRIx64,
+			data, length, filled, index, flags, offset);
 
 	switch (flags & FLAG_SEEKMASK) {
 	case SEEK_RELATIVE:
@@ -4798,7 +5147,7 @@ static int handle_memblock(struct client *client, struct message *msg)
 
 	if (filled < 0) {
 		/* underrun, reported on reader side */
-	} else if (filled + msg->length > stream->attr.maxlength) {
+	} else if (filled + length > stream->attr.maxlength) {
 		/* overrun */
 		send_overflow(stream);
 	}
@@ -4808,16 +5157,91 @@ static int handle_memblock(struct client *client, struct message *msg)
 	spa_ringbuffer_write_data(&stream->ring,
 			stream->buffer, stream->attr.maxlength,
 			index % stream->attr.maxlength,
-			msg->data,
-			SPA_MIN(msg->length, stream->attr.maxlength));
-	stream->write_index = index + msg->length;
+			data,
+			SPA_MIN(length, stream->attr.maxlength));
+	stream->write_index = index + length;
 	spa_ringbuffer_write_update(&stream->ring, stream->write_index);
-	stream->requested -= msg->length;
-finish:
+	stream->requested -= length;
+	return 0;
+}
+
+static int handle_memblock(struct client *client, struct message *msg)
+{
+	int res;
+
+	res = write_memblock(client, msg->data, msg->length);
 	message_free(client, msg, false, false);
 	return res;
 }
 
+/* the data is in a pool of the client, copy it straight from there */
+static int handle_shm_memblock(struct client *client, struct message *msg)
+{
+	struct impl *impl = client->impl;
+	struct shm_pool *pool;
+	uint32_t info[4], block_id, shm_id, offset, length;
+	int res;
+
+	memcpy(info, msg->data, SHM_INFO_SIZE);
+	message_free(client, msg, false, false);
+
+	block_id = ntohl(info[0]);
+	shm_id = ntohl(info[1]);
+	offset = ntohl(info[2]);
+	length = ntohl(info[3]);
+
+	pool = find_shm_pool(client, shm_id);
+	if (pool == NULL || offset > pool->size || length > pool->size - offset) {
+		pw_log_warn(NAME" %p: [%s] invalid block:%u shm_id:%u offset:%u length:%u",
+				impl, client->name, block_id, shm_id, offset, length);
+		res = -EINVAL;
+	} else {
+		res = write_memblock(client, SPA_MEMBER(pool->data, offset, void), length);
+	}
+	/* the data is copied, the client can reuse the block */
+	send_release(client, block_id);
+	return res;
+}
+
+/* receive data and the fds that come with it */
+static ssize_t client_recv(struct client *client, void *data, size_t size)
+{
+	struct iovec iov;
+	struct msghdr msg = { 0, };
+	char cmsgbuf[CMSG_SPACE(MAX_FDS * sizeof(int))];
+	struct cmsghdr *cmsg;
+	ssize_t r;
+
+	iov.iov_base = data;
+	iov.iov_len = size;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cmsgbuf;
+	msg.msg_controllen = sizeof(cmsgbuf);
+
+	r = recvmsg(client->source->fd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+	if (r <= 0)
+		return r;
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		uint32_t i, n_fds;
+		int fd;
+
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+
+		n_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		for (i = 0; i < n_fds; i++) {
+			memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+			if (client->n_fds < MAX_FDS)
+				client->fds[client->n_fds++] = fd;
+			else
+				close(fd);
+		}
+	}
+	return r;
+}
+
 static int do_read(struct client *client)
 {
 	struct impl *impl = client->impl;
@@ -4840,7 +5264,7 @@ static int do_read(struct client *client)
 		size = client->message->length - idx;
 	}
 	while (true) {
-		r = recv(client->source->fd, data, size, MSG_DONTWAIT);
+		r = client_recv(client, data, size);
 		if (r == 0 && size != 0) {
 			res = -EPIPE;
 			goto exit;
@@ -4861,8 +5285,16 @@ static int do_read(struct client *client)
 
 		flags = ntohl(client->desc.flags);
 		if ((flags & FLAG_SHMMASK) != 0) {
-			res = -ENOTSUP;
-			goto exit;
+			if (!client->use_shm) {
+				res = -ENOTSUP;
+				goto exit;
+			}
+			if (flags == FLAG_SHMRELEASE || flags == FLAG_SHMREVOKE) {
+				/* we don't export memory to the client,
+				 * these frames have no payload */
+				client->in_index = 0;
+				goto exit;
+			}
 		}
 
 		length = ntohl(client->desc.length);
@@ -4881,6 +5313,12 @@ static int do_read(struct client *client)
 				goto exit;
 			}
 		}
+		if ((flags & FLAG_SHMDATA) && length != SHM_INFO_SIZE) {
+			pw_log_warn(NAME" %p: Received invalid shm frame size: %u",
+					impl, length);
+			res = -EPROTO;
+			goto exit;
+		}
 		if (client->message)
 			message_free(client, client->message, false, false);
 		client->message = message_alloc(client, channel, length);
@@ -4893,8 +5331,13 @@ static int do_read(struct client *client)
 
 		if (msg->channel == (uint32_t)-1)
 			res = handle_packet(client, msg);
+		else if (ntohl(client->desc.flags) & FLAG_SHMDATA)
+			res = handle_shm_memblock(client, msg);
 		else
 			res = handle_memblock(client, msg);
+
+		/* fds that were not used by the message */
+		client_close_fds(client);
 	}
 exit:
 	return res;
@@ -0,0 +1,328 @@
+/* PipeWire
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+
+#include <spa/utils/defs.h>
+#include <spa/utils/result.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/impl.h>
+
+/* Talks the shm part of the native pulse protocol to the pulse server:
+ * the negotiation of the memfd transport, the registration of memfd pools
+ * and the release of the blocks that the client references in them.
+ */
+
+#define POOL_SIZE	(64 * 1024)
+
+/* from defs.h */
+#define FLAG_SHMDATA			0x80000000u
+#define FLAG_SHMDATA_MEMFD_BLOCK	0x20000000u
+#define FLAG_SHMRELEASE			0x40000000u
+#define PROTOCOL_FLAG_SHM		0x80000000u
+#define PROTOCOL_FLAG_MEMFD		0x40000000u
+#define PROTOCOL_VERSION		34
+#define NATIVE_COOKIE_LENGTH		256
+#define COMMAND_AUTH			8
+#define COMMAND_REGISTER_MEMFD_SHMID	103
+
+#ifndef F_LINUX_SPECIFIC_BASE
+#define F_LINUX_SPECIFIC_BASE 1024
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS (F_LINUX_SPECIFIC_BASE + 9)
+#define F_GET_SEALS (F_LINUX_SPECIFIC_BASE + 10)
+#define F_SEAL_SEAL     0x0001
+#define F_SEAL_SHRINK   0x0002
+#endif
+
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+
+struct data {
+	struct pw_thread_loop *loop;
+	struct pw_context *context;
+	char dir[64];
+	int fd;
+	uint32_t tag;
+	uint8_t buffer[1024];
+	uint32_t length;
+};
+
+static void put_8(struct data *d, uint8_t val)
+{
+	d->buffer[d->length++] = val;
+}
+
+static void put_32(struct data *d, uint32_t val)
+{
+	val = htonl(val);
+	memcpy(&d->buffer[d->length], &val, 4);
+	d->length += 4;
+}
+
+static void put_u32(struct data *d, uint32_t val)
+{
+	put_8(d, 'L');
+	put_32(d, val);
+}
+
+static void put_arbitrary(struct data *d, const void *data, uint32_t size)
+{
+	put_8(d, 'x');
+	put_32(d, size);
+	memcpy(&d->buffer[d->length], data, size);
+	d->length += size;
+}
+
+static void begin_command(struct data *d, uint32_t command)
+{
+	d->length = 0;
+	put_u32(d, command);
+	put_u32(d, ++d->tag);
+}
+
+/* send the command with an optional fd */
+static void send_command(struct data *d, int fd)
+{
+	uint32_t desc[5] = { htonl(d->length), htonl(-1), 0, 0, 0 };
+	struct iovec iov[2] = { { desc, sizeof(desc) }, { d->buffer, d->length } };
+	struct msghdr msg = { .msg_iov = iov, .msg_iovlen = 2 };
+	char cmsgbuf[CMSG_SPACE(sizeof(int))];
+	struct cmsghdr *cmsg;
+
+	if (fd >= 0) {
+		msg.msg_control = cmsgbuf;
+		msg.msg_controllen = sizeof(cmsgbuf);
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+	}
+	spa_assert(sendmsg(d->fd, &msg, MSG_NOSIGNAL) == (ssize_t)(sizeof(desc) + d->length));
+}
+
+/* receive a frame in the buffer, returns if it came with our credentials */
+static bool recv_frame(struct data *d, uint32_t desc[5])
+{
+	struct iovec iov = { desc, 5 * sizeof(uint32_t) };
+	char cmsgbuf[CMSG_SPACE(sizeof(struct ucred))];
+	struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1,
+		.msg_control = cmsgbuf, .msg_controllen = sizeof(cmsgbuf) };
+	struct cmsghdr *cmsg;
+	struct ucred ucred;
+	bool creds = false;
+
+	spa_assert(recvmsg(d->fd, &msg, MSG_WAITALL) == 5 * sizeof(uint32_t));
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_CREDENTIALS)
+			continue;
+		memcpy(&ucred, CMSG_DATA(cmsg), sizeof(ucred));
+		creds = ucred.uid == getuid();
+	}
+	d->length = ntohl(desc[0]);
+	spa_assert(d->length <= sizeof(d->buffer));
+	if (d->length > 0)
+		spa_assert(recv(d->fd, d->buffer, d->length, MSG_WAITALL) == (ssize_t)d->length);
+	return creds;
+}
+
+static void send_block(struct data *d, uint32_t block_id, uint32_t shm_id,
+		uint32_t offset, uint32_t length)
+{
+	uint32_t desc[5] = { htonl(4 * sizeof(uint32_t)), htonl(0), 0, 0,
+		htonl(FLAG_SHMDATA | FLAG_SHMDATA_MEMFD_BLOCK) };
+	uint32_t info[4] = { htonl(block_id), htonl(shm_id), htonl(offset), htonl(length) };
+	struct iovec iov[2] = { { desc, sizeof(desc) }, { info, sizeof(info) } };
+	struct msghdr msg = { .msg_iov = iov, .msg_iovlen = 2 };
+
+	spa_assert(sendmsg(d->fd, &msg, MSG_NOSIGNAL) == sizeof(desc) + sizeof(info));
+}
+
+/* every block is handed back, also the ones that we can't use */
+static void check_release(struct data *d, uint32_t block_id)
+{
+	uint32_t desc[5];
+
+	recv_frame(d, desc);
+	spa_assert(d->length == 0);
+	spa_assert(ntohl(desc[4]) == FLAG_SHMRELEASE);
+	spa_assert(ntohl(desc[2]) == block_id);
+}
+
+static int make_pool(unsigned int flags)
+{
+	int fd;
+
+	fd = memfd_create("pipewire-test-shm", MFD_CLOEXEC | flags);
+	spa_assert(fd >= 0);
+	spa_assert(ftruncate(fd, POOL_SIZE) == 0);
+	return fd;
+}
+
+static void register_pool(struct data *d, uint32_t shm_id, int fd)
+{
+	begin_command(d, COMMAND_REGISTER_MEMFD_SHMID);
+	put_u32(d, shm_id);
+	send_command(d, fd);
+}
+
+static void test_auth(struct data *d)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	uint8_t cookie[NATIVE_COOKIE_LENGTH] = { 0, };
+	uint32_t desc[5], version;
+	int on = 1;
+
+	d->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	spa_assert(d->fd >= 0);
+	spa_assert(setsockopt(d->fd, SOL_SOCKET, SO_PASSCRED, &on, sizeof(on)) == 0);
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/pulse/native", d->dir);
+	spa_assert(connect(d->fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+
+	begin_command(d, COMMAND_AUTH);
+	put_u32(d, PROTOCOL_VERSION | PROTOCOL_FLAG_SHM | PROTOCOL_FLAG_MEMFD);
+	put_arbitrary(d, cookie, sizeof(cookie));
+	send_command(d, -1);
+
+	/* the server enables shm for a client of the same user and sends
+	 * its credentials along */
+	spa_assert(recv_frame(d, desc));
+	spa_assert(d->length >= 15 && d->buffer[10] == 'L');
+	memcpy(&version, &d->buffer[11], 4);
+	version = ntohl(version);
+	spa_assert(version & PROTOCOL_FLAG_SHM);
+	spa_assert(version & PROTOCOL_FLAG_MEMFD);
+}
+
+static void test_sealed_pool(struct data *d)
+{
+	int fd, seals;
+
+	/* the server seals a pool that the client did not seal */
+	fd = make_pool(MFD_ALLOW_SEALING);
+	register_pool(d, 1, fd);
+	send_block(d, 1, 1, 0, 1024);
+	check_release(d, 1);
+
+	seals = fcntl(fd, F_GET_SEALS);
+	spa_assert(seals >= 0);
+	spa_assert((seals & (F_SEAL_SHRINK | F_SEAL_SEAL)) == (F_SEAL_SHRINK | F_SEAL_SEAL));
+	spa_assert(ftruncate(fd, 0) < 0 && errno == EPERM);
+
+	/* blocks out of the pool */
+	send_block(d, 2, 1, POOL_SIZE - 512, 1024);
+	check_release(d, 2);
+	send_block(d, 3, 1, POOL_SIZE + 1, 0);
+	check_release(d, 3);
+	close(fd);
+}
+
+static void test_unsealed_pool(struct data *d)
+{
+	int fd, fd2, seals;
+
+	/* a memfd without sealing can still shrink, it is not used */
+	fd = make_pool(0);
+	register_pool(d, 2, fd);
+	send_block(d, 4, 2, 0, 1024);
+	check_release(d, 4);
+	spa_assert(ftruncate(fd, 0) == 0);
+
+	/* the id is still free, a sealable pool can take it */
+	fd2 = make_pool(MFD_ALLOW_SEALING);
+	register_pool(d, 2, fd2);
+	send_block(d, 5, 2, 0, 1024);
+	check_release(d, 5);
+	seals = fcntl(fd2, F_GET_SEALS);
+	spa_assert((seals & (F_SEAL_SHRINK | F_SEAL_SEAL)) == (F_SEAL_SHRINK | F_SEAL_SEAL));
+
+	/* a block of an unknown pool */
+	send_block(d, 6, 3, 0, 1024);
+	check_release(d, 6);
+
+	close(fd2);
+	close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data d;
+	struct pw_properties *props;
+	char path[128];
+
+	pw_init(&argc, &argv);
+
+	spa_zero(d);
+	d.fd = -1;
+
+	/* keep the socket of the pulse server out of the runtime dir of
+	 * the user */
+	snprintf(d.dir, sizeof(d.dir), "/tmp/pw-test-shm-XXXXXX");
+	spa_assert(mkdtemp(d.dir) != NULL);
+	setenv("XDG_RUNTIME_DIR", d.dir, 1);
+	setenv("PULSE_RUNTIME_PATH", d.dir, 1);
+
+	props = pw_properties_new(
+			PW_KEY_CONTEXT_PROFILE_MODULES, "none",
+			NULL);
+
+	d.loop = pw_thread_loop_new("test-shm", NULL);
+	d.context = pw_context_new(pw_thread_loop_get_loop(d.loop), props, 0);
+	spa_assert(d.context != NULL);
+
+	pw_thread_loop_lock(d.loop);
+	spa_assert(pw_context_load_module(d.context,
+			"libpipewire-module-protocol-pulse",
+			"server.address=\"unix:native\"", NULL) != NULL);
+	pw_thread_loop_start(d.loop);
+	pw_thread_loop_unlock(d.loop);
+
+	test_auth(&d);
+	test_sealed_pool(&d);
+	test_unsealed_pool(&d);
+
+	close(d.fd);
+	pw_thread_loop_stop(d.loop);
+	pw_context_destroy(d.context);
+	pw_thread_loop_destroy(d.loop);
+
+	snprintf(path, sizeof(path), "%s/pulse", d.dir);
+	rmdir(path);
+	rmdir(d.dir);
+
+	return 0;
+}
@@ -23,7 +23,7 @@
  */
 
 #include <spa/node/utils.h>
-#include <spa/pod/parser.h>
+#include <spa/pod/layout.h>
 #include <spa/param/param.h>
 #include <spa/buffer/alloc.h>
 
@@ -41,6 +41,22 @@
 #define MAX_ALIGN	32
 #define MAX_BLOCKS	64u
 
+#define PARAM_META_FIELDS(F)						\
+	F(SPA_PARAM_META_type,		Id,	type)			\
+	F(SPA_PARAM_META_size,		Int,	size)
+
+SPA_POD_OBJECT_LAYOUT(param_meta, SPA_TYPE_OBJECT_ParamMeta, PARAM_META_FIELDS);
+
+#define PARAM_BUFFERS_FIELDS(F)						\
+	F(SPA_PARAM_BUFFERS_buffers,	Int,	buffers)		\
+	F(SPA_PARAM_BUFFERS_blocks,	Int,	blocks)			\
+	F(SPA_PARAM_BUFFERS_size,	Int,	size)			\
+	F(SPA_PARAM_BUFFERS_stride,	Int,	stride)			\
+	F(SPA_PARAM_BUFFERS_align,	Int,	align)			\
+	F(SPA_PARAM_BUFFERS_dataType,	Int,	data_type)
+
+SPA_POD_OBJECT_LAYOUT(param_buffers, SPA_TYPE_OBJECT_ParamBuffers, PARAM_BUFFERS_FIELDS);
+
 struct port {
 	struct spa_node *node;
 	enum spa_direction direction;
@@ -48,7 +64,7 @@ struct port {
 };
 
 /* Allocate an array of buffers that can be shared */
-static int alloc_buffers(struct pw_mempool *pool,
+static int alloc_buffers(struct pw_context *context,
 			 uint32_t n_buffers,
 			 uint32_t n_params,
 			 struct spa_pod **params,
@@ -68,6 +84,7 @@ static int alloc_buffers(struct pw_mempool *pool,
 	struct spa_data *datas;
 	struct pw_memblock *m;
 	struct spa_buffer_alloc_info info = { 0, };
+	size_t size;
 
 	if (!SPA_FLAG_IS_SET(flags, PW_BUFFERS_FLAG_SHARED))
 		SPA_FLAG_SET(info.flags, SPA_BUFFER_ALLOC_FLAG_INLINE_ALL);
@@ -80,18 +97,15 @@ static int alloc_buffers(struct pw_mempool *pool,
 	/* collect metadata */
 	for (i = 0; i < n_params; i++) {
 		if (spa_pod_is_object_type (params[i], SPA_TYPE_OBJECT_ParamMeta)) {
-			uint32_t type, size;
+			struct param_meta meta = { 0, };
 
-			if (spa_pod_parse_object(params[i],
-				SPA_TYPE_OBJECT_ParamMeta, NULL,
-				SPA_PARAM_META_type, SPA_POD_Id(&type),
-				SPA_PARAM_META_size, SPA_POD_Int(&size)) < 0)
+			if (param_meta_parse(params[i], NULL, &meta) != 2)
 				continue;
 
-			pw_log_debug(NAME" %p: enable meta %d %d", allocation, type, size);
+			pw_log_debug(NAME" %p: enable meta %d %d", allocation, meta.type, meta.size);
 
-			metas[n_metas].type = type;
-			metas[n_metas].size = size;
+			metas[n_metas].type = meta.type;
+			metas[n_metas].size = (uint32_t)meta.size;
 			n_metas++;
 		}
 	}
@@ -117,7 +131,8 @@ static int alloc_buffers(struct pw_mempool *pool,
 
         spa_buffer_alloc_fill_info(&info, n_metas, metas, n_datas, datas, data_aligns);
 
-	buffers = calloc(1, info.max_align + n_buffers * (sizeof(struct spa_buffer *) + info.skel_size));
+	size = info.max_align + n_buffers * (sizeof(struct spa_buffer *) + info.skel_size);
+	buffers = calloc(1, size);
 	if (buffers == NULL)
 		return -errno;
 
@@ -125,11 +140,20 @@ static int alloc_buffers(struct pw_mempool *pool,
 	skel = SPA_PTR_ALIGN(skel, info.max_align, void);
 
 	if (SPA_FLAG_IS_SET(flags, PW_BUFFERS_FLAG_SHARED)) {
-		/* pointer to buffer structures */
-		m = pw_mempool_alloc(pool,
-				PW_MEMBLOCK_FLAG_READWRITE |
+		enum pw_memblock_flags mem_flags = PW_MEMBLOCK_FLAG_READWRITE |
 				PW_MEMBLOCK_FLAG_SEAL |
-				PW_MEMBLOCK_FLAG_MAP,
+				PW_MEMBLOCK_FLAG_MAP;
+
+		if (SPA_FLAG_IS_SET(flags, PW_BUFFERS_FLAG_PREFAULT)) {
+			mem_flags |= PW_MEMBLOCK_FLAG_PREFAULT;
+			if (context->defaults.mem_allow_mlock)
+				mem_flags |= PW_MEMBLOCK_FLAG_MLOCK;
+		}
+		if (SPA_FLAG_IS_SET(flags, PW_BUFFERS_FLAG_HUGEPAGES))
+			mem_flags |= PW_MEMBLOCK_FLAG_HUGEPAGES;
+
+		/* pointer to buffer structures */
+		m = pw_mempool_alloc(context->pool, mem_flags,
 				SPA_DATA_MemFd,
 				n_buffers * info.mem_size);
 		if (m == NULL) {
@@ -139,6 +163,10 @@ static int alloc_buffers(struct pw_mempool *pool,
 
 		data = m->map->ptr;
 	} else {
+		/* the data is inline, calloc does not fault in the pages */
+		if (SPA_FLAG_IS_SET(flags, PW_BUFFERS_FLAG_PREFAULT))
+			memset(buffers, 0, size);
+
 		m = NULL;
 		data = NULL;
 	}
@@ -290,18 +318,24 @@ int pw_buffers_negotiate(struct pw_context *context, uint32_t flags,
 
 	param = find_param(params, n_params, SPA_TYPE_OBJECT_ParamBuffers);
 	if (param) {
-		uint32_t qmax_buffers = max_buffers,
-		    qminsize = minsize, qstride = stride, qalign = align;
-		uint32_t qtypes = types, qblocks = blocks;
-
-		spa_pod_parse_object(param,
-			SPA_TYPE_OBJECT_ParamBuffers, NULL,
-			SPA_PARAM_BUFFERS_buffers,  SPA_POD_OPT_Int(&qmax_buffers),
-			SPA_PARAM_BUFFERS_blocks,   SPA_POD_OPT_Int(&qblocks),
-			SPA_PARAM_BUFFERS_size,     SPA_POD_OPT_Int(&qminsize),
-			SPA_PARAM_BUFFERS_stride,   SPA_POD_OPT_Int(&qstride),
-			SPA_PARAM_BUFFERS_align,    SPA_POD_OPT_Int(&qalign),
-			SPA_PARAM_BUFFERS_dataType, SPA_POD_OPT_Int(&qtypes));
+		struct param_buffers q = {
+			.buffers = max_buffers,
+			.blocks = blocks,
+			.size = minsize,
+			.stride = stride,
+			.align = align,
+			.data_type = types,
+		};
+		uint32_t qmax_buffers, qminsize, qstride, qalign, qtypes, qblocks;
+
+		param_buffers_parse(param, NULL, &q);
+
+		qmax_buffers = q.buffers;
+		qblocks = q.blocks;
+		qminsize = q.size;
+		qstride = q.stride;
+		qalign = q.align;
+		qtypes = q.data_type;
 
 		max_buffers =
 		    qmax_buffers == 0 ? max_buffers : SPA_MIN(qmax_buffers,
@@ -336,7 +370,7 @@ int pw_buffers_negotiate(struct pw_context *context, uint32_t flags,
 		data_types[i] = types;
 	}
 
-	if ((res = alloc_buffers(context->pool,
+	if ((res = alloc_buffers(context,
 				 max_buffers,
 				 n_params,
 				 params,
@@ -351,6 +385,26 @@ int pw_buffers_negotiate(struct pw_context *context, uint32_t flags,
 	return res;
 }
 
+uint32_t pw_buffers_get_node_flags(struct pw_impl_node *node)
+{
+	struct pw_context *context = node->context;
+	uint32_t flags = 0;
+	bool prefault = context->defaults.mem_prefault;
+	bool hugepages = context->defaults.mem_hugepages;
+	const char *str;
+
+	if ((str = pw_properties_get(node->properties, "mem.prefault")) != NULL)
+		prefault = pw_properties_parse_bool(str);
+	if ((str = pw_properties_get(node->properties, "mem.hugepages")) != NULL)
+		hugepages = pw_properties_parse_bool(str);
+
+	if (prefault)
+		flags |= PW_BUFFERS_FLAG_PREFAULT;
+	if (hugepages)
+		flags |= PW_BUFFERS_FLAG_HUGEPAGES;
+	return flags;
+}
+
 SPA_EXPORT
 void pw_buffers_clear(struct pw_buffers *buffers)
 {
@@ -38,6 +38,8 @@ extern "C" {
 #define PW_BUFFERS_FLAG_NO_MEM		(1<<0)	/**< don't allocate buffer memory */
 #define PW_BUFFERS_FLAG_SHARED		(1<<1)	/**< buffers can be shared */
 #define PW_BUFFERS_FLAG_DYNAMIC		(1<<2)	/**< buffers have dynamic data */
+#define PW_BUFFERS_FLAG_PREFAULT	(1<<3)	/**< fault in and lock the buffer memory */
+#define PW_BUFFERS_FLAG_HUGEPAGES	(1<<4)	/**< use huge pages for the buffer memory */
 
 struct pw_buffers {
 	struct pw_memblock *mem;	/**< allocated buffer memory */
@@ -57,12 +57,17 @@
 #define DEFAULT_VIDEO_RATE_DENOM	1u
 #define DEFAULT_LINK_MAX_BUFFERS	64u
 #define DEFAULT_MEM_ALLOW_MLOCK		true
+#define DEFAULT_MEM_SLAB_SIZE		0
+#define DEFAULT_MEM_PREFAULT		false
+#define DEFAULT_MEM_HUGEPAGES		false
+#define DEFAULT_DATA_LOOP_WORKERS	0u
 
 /** \cond */
 struct impl {
 	struct pw_context this;
 	struct spa_handle *dbus_handle;
 	unsigned int recalc;
+	uint32_t path_seq;
 };
 
 
@@ -142,6 +147,19 @@ static uint32_t get_default_int(struct pw_properties *properties, const char *na
 	return val;
 }
 
+static int64_t get_default_int64(struct pw_properties *properties, const char *name, int64_t def)
+{
+	int64_t val;
+	const char *str;
+	if ((str = pw_properties_get(properties, name)) != NULL)
+		val = pw_properties_parse_int64(str);
+	else {
+		val = def;
+		pw_properties_setf(properties, name, "%"PRIi64, val);
+	}
+	return val;
+}
+
 static bool get_default_bool(struct pw_properties *properties, const char *name, bool def)
 {
 	bool val;
@@ -168,6 +186,10 @@ static void fill_defaults(struct pw_context *this)
 	this->defaults.video_rate.denom = get_default_int(p, "default.video.rate.denom", DEFAULT_VIDEO_RATE_DENOM);
 	this->defaults.link_max_buffers = get_default_int(p, "link.max-buffers", DEFAULT_LINK_MAX_BUFFERS);
 	this->defaults.mem_allow_mlock = get_default_bool(p, "mem.allow-mlock", DEFAULT_MEM_ALLOW_MLOCK);
+	this->defaults.mem_slab_size = get_default_int64(p, "mem.slab-size", DEFAULT_MEM_SLAB_SIZE);
+	this->defaults.mem_prefault = get_default_bool(p, "mem.prefault", DEFAULT_MEM_PREFAULT);
+	this->defaults.mem_hugepages = get_default_bool(p, "mem.hugepages", DEFAULT_MEM_HUGEPAGES);
+	this->defaults.data_loop_workers = get_default_int(p, "context.data-loop.workers", DEFAULT_DATA_LOOP_WORKERS);
 
 	this->defaults.clock_max_quantum = SPA_CLAMP(this->defaults.clock_max_quantum,
 			CLOCK_MIN_QUANTUM, CLOCK_MAX_QUANTUM);
@@ -175,6 +197,53 @@ static void fill_defaults(struct pw_context *this)
 			CLOCK_MIN_QUANTUM, this->defaults.clock_max_quantum);
 	this->defaults.clock_quantum = SPA_CLAMP(this->defaults.clock_quantum,
 			this->defaults.clock_min_quantum, this->defaults.clock_max_quantum);
+	this->defaults.data_loop_workers = SPA_MIN(this->defaults.data_loop_workers,
+			MAX_DATA_LOOP_WORKERS);
+}
+
+static int create_data_workers(struct pw_context *this, const struct spa_dict *props,
+		uint32_t n_cpus)
+{
+	struct pw_properties *pr;
+	uint32_t i;
+	int res = 0;
+
+	pr = pw_properties_new_dict(props);
+	if (pr == NULL)
+		return -errno;
+
+	for (i = 0; i < this->defaults.data_loop_workers; i++) {
+		/* the primary data loop runs the drivers, pin the workers to
+		 * the other cores */
+		if (n_cpus > 1)
+			pw_properties_setf(pr, "loop.cpu", "%u", (i + 1) % n_cpus);
+
+		this->data_workers[i] = pw_data_loop_new(&pr->dict);
+		if (this->data_workers[i] == NULL) {
+			res = -errno;
+			break;
+		}
+		this->n_data_workers++;
+	}
+	pw_properties_free(pr);
+
+	pw_log_debug(NAME" %p: created %u data loop workers", this, this->n_data_workers);
+	return res;
+}
+
+static void destroy_data_workers(struct pw_context *this)
+{
+	uint32_t i;
+	for (i = 0; i < this->n_data_workers; i++)
+		pw_data_loop_destroy(this->data_workers[i]);
+	this->n_data_workers = 0;
+}
+
+struct pw_data_loop *pw_context_get_data_worker(struct pw_context *context)
+{
+	if (context->n_data_workers == 0)
+		return context->data_loop_impl;
+	return context->data_workers[context->data_worker_index++ % context->n_data_workers];
 }
 
 /** Create a new context object
@@ -198,6 +267,8 @@ struct pw_context *pw_context_new(struct pw_loop *main_loop,
 	uint32_t n_support;
 	struct pw_properties *pr;
 	struct spa_cpu *cpu;
+	char slab_size[32];
+	uint32_t i;
 	int res = 0;
 
 	impl = calloc(1, sizeof(struct impl) + user_data_size);
@@ -227,15 +298,22 @@ struct pw_context *pw_context_new(struct pw_loop *main_loop,
 	pr = pw_properties_copy(properties);
 	if ((str = pw_properties_get(pr, "context.data-loop." PW_KEY_LIBRARY_NAME_SYSTEM)))
 		pw_properties_set(pr, PW_KEY_LIBRARY_NAME_SYSTEM, str);
+	if ((str = pw_properties_get(pr, "context.data-loop.spin")))
+		pw_properties_set(pr, "loop.spin", str);
 
 	this->data_loop_impl = pw_data_loop_new(&pr->dict);
-	pw_properties_free(pr);
 	if (this->data_loop_impl == NULL)  {
 		res = -errno;
+		pw_properties_free(pr);
 		goto error_free;
 	}
 
-	this->pool = pw_mempool_new(NULL);
+	/* 0 or less disables the slabs */
+	snprintf(slab_size, sizeof(slab_size), "%"PRIi64,
+			SPA_MAX(this->defaults.mem_slab_size, 0));
+	this->pool = pw_mempool_new(pw_properties_new(
+				PW_KEY_MEMPOOL_SLAB_SIZE, slab_size,
+				NULL));
 	if (this->pool == NULL) {
 		res = -errno;
 		goto error_free_loop;
@@ -255,6 +333,11 @@ struct pw_context *pw_context_new(struct pw_loop *main_loop,
 	if ((cpu = spa_support_find(this->support, n_support, SPA_TYPE_INTERFACE_CPU)) != NULL)
 		pw_properties_setf(properties, PW_KEY_CPU_MAX_ALIGN, "%u", spa_cpu_get_max_align(cpu));
 
+	res = create_data_workers(this, &pr->dict, cpu ? spa_cpu_get_count(cpu) : 0);
+	pw_properties_free(pr);
+	if (res < 0)
+		goto error_free_loop;
+
 	lib = pw_properties_get(properties, PW_KEY_LIBRARY_NAME_DBUS);
 	if (lib == NULL)
 		lib = "support/libspa-dbus";
@@ -306,6 +389,11 @@ struct pw_context *pw_context_new(struct pw_loop *main_loop,
 	if ((res = pw_data_loop_start(this->data_loop_impl)) < 0)
 		goto error_free_loop;
 
+	for (i = 0; i < this->n_data_workers; i++) {
+		if ((res = pw_data_loop_start(this->data_workers[i])) < 0)
+			goto error_free_loop;
+	}
+
 	this->sc_pagesize = sysconf(_SC_PAGESIZE);
 
 	str = pw_properties_get(properties, PW_KEY_CONTEXT_PROFILE_MODULES);
@@ -326,6 +414,7 @@ struct pw_context *pw_context_new(struct pw_loop *main_loop,
 	return this;
 
 error_free_loop:
+	destroy_data_workers(this);
 	pw_data_loop_destroy(this->data_loop_impl);
 error_free:
 	free(this);
@@ -388,6 +477,7 @@ void pw_context_destroy(struct pw_context *context)
 
 	pw_mempool_destroy(context->pool);
 
+	destroy_data_workers(context);
 	pw_data_loop_destroy(context->data_loop_impl);
 
 	pw_properties_free(context->properties);
@@ -877,6 +967,87 @@ static int collect_nodes(struct pw_context *context, struct pw_impl_node *driver
 	return 0;
 }
 
+/* Calculate the depth and the process time of the longest chain of
+ * followers that starts at node. The process time is the one of the
+ * previous cycle as kept in the activation. */
+static void calc_path(struct pw_impl_node *node, struct pw_impl_node *driver, uint32_t seq)
+{
+	struct pw_node_activation *a = node->rt.activation;
+	struct pw_impl_port *p;
+	struct pw_impl_link *l;
+	uint64_t time = 0;
+	uint32_t depth = 0;
+
+	/* already done or in progress when there is a cycle */
+	if (node->path_seq == seq)
+		return;
+
+	node->path_seq = seq;
+	node->path_depth = 0;
+	node->path_time = 0;
+
+	spa_list_for_each(p, &node->output_ports, link) {
+		spa_list_for_each(l, &p->links, output_link) {
+			struct pw_impl_node *t = l->input->node;
+
+			if (t == node || t == driver || t->driver_node != driver)
+				continue;
+
+			calc_path(t, driver, seq);
+			time = SPA_MAX(time, t->path_time);
+			depth = SPA_MAX(depth, t->path_depth);
+		}
+	}
+	if (a->finish_time > a->awake_time)
+		time += a->finish_time - a->awake_time;
+
+	node->path_time = time;
+	node->path_depth = depth + 1;
+}
+
+/* Sort the targets of the driver so that the nodes at the start of the
+ * longest chains are signaled first. This is a stable insertion sort so that
+ * it does not need to allocate in the data thread. */
+static int
+do_sort_targets(struct spa_loop *loop,
+		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct pw_impl_node *driver = user_data;
+	struct pw_node_target *t, *s;
+	struct spa_list sorted;
+
+	spa_list_init(&sorted);
+
+	spa_list_consume(t, &driver->rt.target_list, link) {
+		spa_list_remove(&t->link);
+		spa_list_for_each(s, &sorted, link) {
+			if (pw_node_target_cmp(t, s) > 0)
+				break;
+		}
+		spa_list_append(&s->link, &t->link);
+	}
+	spa_list_insert_list(&driver->rt.target_list, &sorted);
+	return 0;
+}
+
+static void sort_targets(struct pw_context *context, struct pw_impl_node *driver)
+{
+	struct impl *impl = SPA_CONTAINER_OF(context, struct impl, this);
+	struct pw_impl_node *s;
+	uint32_t seq = ++impl->path_seq;
+
+	driver->path_seq = seq;
+	driver->path_time = 0;
+	driver->path_depth = 0;
+
+	spa_list_for_each(s, &driver->follower_list, follower_link) {
+		if (s != driver)
+			calc_path(s, driver, seq);
+	}
+	pw_loop_invoke(driver->data_loop,
+			do_sort_targets, SPA_ID_INVALID, NULL, 0, true, driver);
+}
+
 int pw_context_recalc_graph(struct pw_context *context, const char *reason)
 {
 	struct impl *impl = SPA_CONTAINER_OF(context, struct impl, this);
@@ -1003,6 +1174,9 @@ int pw_context_recalc_graph(struct pw_context *context, const char *reason)
 			ensure_state(s, running);
 		}
 		ensure_state(n, running);
+
+		if (running)
+			sort_targets(context, n);
 	}
 	impl->recalc = false;
 	return 0;
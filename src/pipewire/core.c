@@ -103,6 +103,10 @@ static void core_event_add_mem(void *data, uint32_t id, uint32_t type, int fd, u
 
 	pw_log_debug(NAME" %p: add mem %u type:%u fd:%d flags:%u", this, id, type, fd, flags);
 
+	/* only lock the memory when we are allowed to */
+	if (!this->context->defaults.mem_allow_mlock)
+		flags &= ~PW_MEMBLOCK_FLAG_MLOCK;
+
 	m = pw_mempool_import(this->pool, flags, type, fd);
 	if (m->id != id) {
 		pw_log_error(NAME" %p: invalid mem id %u, expected %u",
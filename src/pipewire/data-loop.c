@@ -119,6 +119,11 @@ static struct pw_data_loop *loop_new(struct pw_loop *loop, const struct spa_dict
 		goto error_free;
 	}
 	this->loop = loop;
+	this->cpu = -1;
+
+	if (props != NULL &&
+	    (str = spa_dict_lookup(props, "loop.cpu")) != NULL)
+		this->cpu = atoi(str);
 
 	if (props == NULL ||
 	    (str = spa_dict_lookup(props, "loop.cancel")) == NULL ||
@@ -214,6 +219,15 @@ int pw_data_loop_start(struct pw_data_loop *loop)
 			loop->running = false;
 			return -err;
 		}
+		if (loop->cpu >= 0) {
+			cpu_set_t set;
+
+			CPU_ZERO(&set);
+			CPU_SET(loop->cpu, &set);
+			if ((err = pthread_setaffinity_np(loop->thread, sizeof(set), &set)) != 0)
+				pw_log_warn(NAME" %p: can't pin thread to cpu %d: %s", loop,
+						loop->cpu, strerror(err));
+		}
 	}
 	return 0;
 }
@@ -49,7 +49,9 @@ struct pw_data_loop_events {
 	void (*destroy) (void *data);
 };
 
-/** Make a new loop. */
+/** Make a new loop. The loop.cpu property pins the thread to a cpu, the
+ * loop.spin property polls for events for the given usec, at most 10000,
+ * before sleeping. */
 struct pw_data_loop *
 pw_data_loop_new(const struct spa_dict *props);
 
@@ -439,6 +439,8 @@ static int do_allocation(struct pw_impl_link *this)
 		flags = 0;
 		/* always shared buffers for the link */
 		alloc_flags = PW_BUFFERS_FLAG_SHARED;
+		alloc_flags |= pw_buffers_get_node_flags(output->node);
+		alloc_flags |= pw_buffers_get_node_flags(input->node);
 		/* if output port can alloc buffers, alloc skeleton buffers */
 		if (SPA_FLAG_IS_SET(out_flags, SPA_PORT_FLAG_CAN_ALLOC_BUFFERS)) {
 			SPA_FLAG_SET(alloc_flags, PW_BUFFERS_FLAG_NO_MEM);
@@ -500,6 +502,22 @@ error:
 	return res;
 }
 
+/* with data loop workers, the input and output node can be processed on
+ * different data loops. The mix of each port is only changed from the
+ * loop of its node and the required counter of the input is updated
+ * atomically because the driver loop also changes it. */
+static int
+do_activate_input(struct spa_loop *loop,
+		 bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct pw_impl_link *this = user_data;
+
+	pw_log_trace(NAME" %p: activate input", this);
+
+	spa_list_append(&this->input->rt.mix_list, &this->rt.in_mix.rt_link);
+	return 0;
+}
+
 static int
 do_activate_link(struct spa_loop *loop,
 		 bool async, uint32_t seq, const void *data, size_t size, void *user_data)
@@ -510,7 +528,8 @@ do_activate_link(struct spa_loop *loop,
 	pw_log_trace(NAME" %p: activate", this);
 
 	spa_list_append(&this->output->rt.mix_list, &this->rt.out_mix.rt_link);
-	spa_list_append(&this->input->rt.mix_list, &this->rt.in_mix.rt_link);
+	if (impl->inode->data_loop == impl->onode->data_loop)
+		spa_list_append(&this->input->rt.mix_list, &this->rt.in_mix.rt_link);
 
 	if (impl->inode != impl->onode) {
 		struct pw_node_activation_state *state;
@@ -519,7 +538,7 @@ do_activate_link(struct spa_loop *loop,
 		spa_list_append(&impl->onode->rt.target_list, &this->rt.target.link);
 
 		state = &this->rt.target.activation->state[0];
-		state->required++;
+		ATOMIC_INC(state->required);
 
 		pw_log_trace(NAME" %p: node:%p state:%p pending:%d/%d", this, impl->inode,
 				state, state->pending, state->required);
@@ -548,6 +567,10 @@ int pw_impl_link_activate(struct pw_impl_link *this)
 			return res;
 		impl->io_set = true;
 	}
+	/* the input mix is added before the output can signal the input */
+	if (impl->inode->data_loop != impl->onode->data_loop)
+		pw_loop_invoke(impl->inode->data_loop,
+		       do_activate_input, SPA_ID_INVALID, NULL, 0, true, this);
 	pw_loop_invoke(this->output->node->data_loop,
 	       do_activate_link, SPA_ID_INVALID, NULL, 0, false, this);
 
@@ -676,6 +699,18 @@ int pw_impl_link_prepare(struct pw_impl_link *this)
 	return 0;
 }
 
+static int
+do_deactivate_input(struct spa_loop *loop,
+		   bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+        struct pw_impl_link *this = user_data;
+
+	pw_log_trace(NAME" %p: disable %p", this, &this->rt.in_mix);
+
+	spa_list_remove(&this->rt.in_mix.rt_link);
+	return 0;
+}
+
 static int
 do_deactivate_link(struct spa_loop *loop,
 		   bool async, uint32_t seq, const void *data, size_t size, void *user_data)
@@ -686,14 +721,15 @@ do_deactivate_link(struct spa_loop *loop,
 	pw_log_trace(NAME" %p: disable %p and %p", this, &this->rt.in_mix, &this->rt.out_mix);
 
 	spa_list_remove(&this->rt.out_mix.rt_link);
-	spa_list_remove(&this->rt.in_mix.rt_link);
+	if (impl->inode->data_loop == impl->onode->data_loop)
+		spa_list_remove(&this->rt.in_mix.rt_link);
 
 	if (this->input->node != this->output->node) {
 		struct pw_node_activation_state *state;
 
 		spa_list_remove(&this->rt.target.link);
 		state = &this->rt.target.activation->state[0];
-		state->required--;
+		ATOMIC_DEC(state->required);
 
 		pw_log_trace(NAME" %p: node:%p state:%p pending:%d/%d", this, impl->inode,
 				state, state->pending, state->required);
@@ -713,6 +749,9 @@ int pw_impl_link_deactivate(struct pw_impl_link *this)
 
 	pw_loop_invoke(this->output->node->data_loop,
 		       do_deactivate_link, SPA_ID_INVALID, NULL, 0, true, this);
+	if (impl->inode->data_loop != impl->onode->data_loop)
+		pw_loop_invoke(impl->inode->data_loop,
+		       do_deactivate_input, SPA_ID_INVALID, NULL, 0, true, this);
 
 	port_set_io(this, this->output, SPA_IO_Buffers, NULL, 0,
 			&this->rt.out_mix);
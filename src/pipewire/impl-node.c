@@ -98,10 +98,50 @@ static void node_deactivate(struct pw_impl_node *this)
 	}
 }
 
-static void add_node(struct pw_impl_node *this, struct pw_impl_node *driver)
+/* the driver part of the scheduling state, this is only touched from
+ * the data loop of the driver. The required counters are also changed by
+ * links from the loop of their output node and are updated atomically. */
+static void add_driver_target(struct pw_impl_node *this, struct pw_impl_node *driver)
+{
+	struct pw_node_activation_state *dstate, *nstate;
+	struct pw_node_target *t;
+
+	dstate = &driver->rt.activation->state[0];
+	ATOMIC_INC(dstate->required);
+
+	/* followers are usually added after the recalc that sorted the
+	 * targets, keep them in the same order as sort_targets() */
+	spa_list_for_each(t, &driver->rt.target_list, link) {
+		if (pw_node_target_cmp(&this->rt.target, t) > 0)
+			break;
+	}
+	spa_list_append(&t->link, &this->rt.target.link);
+	nstate = &this->rt.activation->state[0];
+	ATOMIC_INC(nstate->required);
+
+	pw_log_trace(NAME" %p: driver state:%p pending:%d/%d, node state:%p pending:%d/%d",
+			this, dstate, dstate->pending, dstate->required,
+			nstate, nstate->pending, nstate->required);
+}
+
+static void remove_driver_target(struct pw_impl_node *this, struct pw_impl_node *driver)
 {
 	struct pw_node_activation_state *dstate, *nstate;
 
+	dstate = &driver->rt.activation->state[0];
+	ATOMIC_DEC(dstate->required);
+
+	spa_list_remove(&this->rt.target.link);
+	nstate = &this->rt.activation->state[0];
+	ATOMIC_DEC(nstate->required);
+
+	pw_log_trace(NAME" %p: driver state:%p pending:%d/%d, node state:%p pending:%d/%d",
+			this, dstate, dstate->pending, dstate->required,
+			nstate, nstate->pending, nstate->required);
+}
+
+static void add_node(struct pw_impl_node *this, struct pw_impl_node *driver)
+{
 	if (this->exported)
 		return;
 
@@ -114,40 +154,61 @@ static void add_node(struct pw_impl_node *this, struct pw_impl_node *driver)
 	this->rt.driver_target.data = driver;
 	spa_list_append(&this->rt.target_list, &this->rt.driver_target.link);
 
-	dstate = &this->rt.driver_target.activation->state[0];
-	dstate->required++;
-
-	spa_list_append(&driver->rt.target_list, &this->rt.target.link);
-	nstate = &this->rt.activation->state[0];
-	nstate->required++;
-
-	pw_log_trace(NAME" %p: driver state:%p pending:%d/%d, node state:%p pending:%d/%d",
-			this, dstate, dstate->pending, dstate->required,
-			nstate, nstate->pending, nstate->required);
+	/* followers on a worker loop get added to the driver from the
+	 * driver loop, see invoke_driver_target() */
+	if (this->data_loop == driver->data_loop)
+		add_driver_target(this, driver);
 }
 
 static void remove_node(struct pw_impl_node *this)
 {
-	struct pw_node_activation_state *dstate, *nstate;
+	struct pw_impl_node *driver = this->rt.driver_target.node;
 
 	if (this->exported)
 		return;
 
 	pw_log_trace(NAME" %p: remove from driver %p %p %p",
-			this, this->rt.driver_target.data,
-			this->rt.driver_target.activation, this->rt.activation);
+			this, driver, this->rt.driver_target.activation,
+			this->rt.activation);
 
 	spa_list_remove(&this->rt.driver_target.link);
-	dstate = &this->rt.driver_target.activation->state[0];
-	dstate->required--;
 
-	spa_list_remove(&this->rt.target.link);
-	nstate = &this->rt.activation->state[0];
-	nstate->required--;
+	if (this->data_loop == driver->data_loop)
+		remove_driver_target(this, driver);
+}
 
-	pw_log_trace(NAME" %p: driver state:%p pending:%d/%d, node state:%p pending:%d/%d",
-			this, dstate, dstate->pending, dstate->required,
-			nstate, nstate->pending, nstate->required);
+static int
+do_add_driver_target(struct spa_loop *loop,
+	       bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct pw_impl_node *driver = user_data;
+	struct pw_impl_node *this = *(struct pw_impl_node **)data;
+	add_driver_target(this, driver);
+	return 0;
+}
+
+static int
+do_remove_driver_target(struct spa_loop *loop,
+	       bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct pw_impl_node *driver = user_data;
+	struct pw_impl_node *this = *(struct pw_impl_node **)data;
+	remove_driver_target(this, driver);
+	return 0;
+}
+
+/* When the node is processed on a worker loop, the driver part of the
+ * scheduling state is updated with a separate invoke on the driver loop.
+ * Nodes are added to the driver after they are added to their own loop and
+ * removed from the driver before they are removed from their own loop. */
+static void invoke_driver_target(struct pw_impl_node *this, struct pw_impl_node *driver,
+		spa_invoke_func_t func)
+{
+	if (this->exported || this->data_loop == driver->data_loop)
+		return;
+
+	pw_loop_invoke(driver->data_loop, func, SPA_ID_INVALID,
+			&this, sizeof(struct pw_impl_node *), true, driver);
 }
 
 static int
@@ -175,6 +236,9 @@ static int pause_node(struct pw_impl_node *this)
 
 	node_deactivate(this);
 
+	if (this->source.loop != NULL)
+		invoke_driver_target(this, this->rt.driver_target.node,
+				do_remove_driver_target);
 	pw_loop_invoke(this->data_loop, do_node_remove, 1, NULL, 0, true, this);
 
 	res = spa_node_send_command(this->node,
@@ -292,6 +356,30 @@ do_node_add(struct spa_loop *loop,
 	return 0;
 }
 
+/* Move followers to one of the data loop workers, if any. Drivers and nodes
+ * that can become a driver stay on the primary data loop, as do remote and
+ * exported nodes that are processed elsewhere. This is only done when the
+ * node is not scheduled. */
+static void update_data_loop(struct pw_impl_node *node)
+{
+	struct pw_context *context = node->context;
+	struct pw_data_loop *loop;
+
+	if (context->n_data_workers == 0 ||
+	    node->driver || node->remote || node->exported ||
+	    node->data_loop_impl != context->data_loop_impl)
+		return;
+
+	loop = pw_context_get_data_worker(context);
+
+	/* flush pending port and link updates on the old loop */
+	pw_loop_invoke(node->data_loop, NULL, SPA_ID_INVALID, NULL, 0, true, NULL);
+
+	pw_log_debug(NAME" %p: process on data loop %p", node, loop);
+	node->data_loop_impl = loop;
+	node->data_loop = pw_data_loop_get_loop(loop);
+}
+
 static void node_update_state(struct pw_impl_node *node, enum pw_node_state state, int res, char *error)
 {
 	struct impl *impl = SPA_CONTAINER_OF(node, struct impl, this);
@@ -318,7 +406,11 @@ static void node_update_state(struct pw_impl_node *node, enum pw_node_state stat
 
 	switch (state) {
 	case PW_NODE_STATE_RUNNING:
-		pw_loop_invoke(node->data_loop, do_node_add, 1, NULL, 0, true, node);
+		if (node->source.loop == NULL) {
+			update_data_loop(node);
+			pw_loop_invoke(node->data_loop, do_node_add, 1, NULL, 0, true, node);
+			invoke_driver_target(node, node->driver_node, do_add_driver_target);
+		}
 		break;
 	default:
 		break;
@@ -766,9 +858,13 @@ int pw_impl_node_set_driver(struct pw_impl_node *node, struct pw_impl_node *driv
 	pw_log_trace(NAME" %p: set position %p", node, &driver->rt.activation->position);
 	node->rt.position = &driver->rt.activation->position;
 
+	if (node->source.loop != NULL)
+		invoke_driver_target(node, old, do_remove_driver_target);
 	pw_loop_invoke(node->data_loop,
 		       do_move_nodes, SPA_ID_INVALID, &driver, sizeof(struct pw_impl_node *),
 		       true, impl);
+	if (node->source.loop != NULL)
+		invoke_driver_target(node, driver, do_add_driver_target);
 	return 0;
 }
 
@@ -961,6 +1057,15 @@ static inline void calculate_stats(struct pw_impl_node *this,  struct pw_node_ac
 	}
 }
 
+/* with data loop workers, a node can be signaled from another data loop.
+ * It is then woken up on its own loop with its eventfd. */
+static inline bool node_in_data_loop(struct pw_impl_node *this)
+{
+	if (SPA_LIKELY(this->context->n_data_workers == 0))
+		return true;
+	return pw_data_loop_in_thread(this->data_loop_impl);
+}
+
 static inline int process_node(void *data)
 {
 	struct pw_impl_node *this = data;
@@ -970,6 +1075,12 @@ static inline int process_node(void *data)
 	struct spa_system *data_system = this->context->data_system;
 	int status;
 
+	if (SPA_UNLIKELY(!node_in_data_loop(this))) {
+		if (SPA_UNLIKELY(spa_system_eventfd_write(data_system, this->source.fd, 1) < 0))
+			pw_log_warn(NAME" %p: write failed %m", this);
+		return 0;
+	}
+
 	spa_system_clock_gettime(data_system, CLOCK_MONOTONIC, &ts);
 	a->status = PW_NODE_ACTIVATION_AWAKE;
 	a->awake_time = SPA_TIMESPEC_TO_NSEC(&ts);
@@ -1137,6 +1248,7 @@ struct pw_impl_node *pw_context_create_node(struct pw_context *context,
 	impl->pending_id = SPA_ID_INVALID;
 
 	this->data_loop = context->data_loop;
+	this->data_loop_impl = context->data_loop_impl;
 
 	spa_list_init(&this->follower_list);
 
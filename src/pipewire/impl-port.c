@@ -1310,6 +1310,7 @@ static int negotiate_mixer_buffers(struct pw_impl_port *port, uint32_t flags,
 
 		/* try dynamic data */
 		alloc_flags = PW_BUFFERS_FLAG_DYNAMIC;
+		alloc_flags |= pw_buffers_get_node_flags(node);
 
 		pw_log_debug(NAME" %p: %d.%d negotiate %d buffers on node: %p",
 				port, port->direction, port->port_id, n_buffers, node->node);
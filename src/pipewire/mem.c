@@ -87,12 +87,26 @@ static inline int memfd_create(const char *name, unsigned int flags)
 #endif
 
 static struct spa_list _mempools = SPA_LIST_INIT(&_mempools);
+static bool mlock_warned = false;
 
 #define pw_mempool_emit(p,m,v,...) spa_hook_list_call(&p->listener_list, struct pw_mempool_events, m, v, ##__VA_ARGS__)
 #define pw_mempool_emit_destroy(p)	pw_mempool_emit(p, destroy, 0)
 #define pw_mempool_emit_added(p,b)	pw_mempool_emit(p, added, 0, b)
 #define pw_mempool_emit_removed(p,b)	pw_mempool_emit(p, removed, 0, b)
 
+#define MAX_SLAB_PAGES	1024u
+
+/* a sealed memfd that small blocks are carved from */
+struct slab {
+	struct spa_list link;		/* link in mempool */
+	int fd;
+	void *ptr;
+	uint32_t n_pages;
+	uint32_t used_pages;
+	uint32_t n_blocks;
+	uint64_t used[MAX_SLAB_PAGES / 64];	/* bitmap of used pages */
+};
+
 struct mempool {
 	struct pw_mempool this;
 
@@ -103,6 +117,15 @@ struct mempool {
 	struct pw_map map;		/* map memblock to id */
 	struct spa_list blocks;		/* list of memblock */
 	uint32_t pagesize;
+
+	uint32_t slab_pages;		/* pages in a slab, 0 when disabled */
+	struct spa_list slabs;		/* list of slab */
+
+	struct pw_array mappings;	/* mappings sorted on ptr */
+	struct pw_array fds;		/* memblock indexed by fd */
+	struct spa_list *tags;		/* memmaps hashed on the first tag */
+	uint32_t tag_bits;
+	uint32_t n_memmaps;
 };
 
 struct memblock {
@@ -110,6 +133,7 @@ struct memblock {
 	struct spa_list link;		/* link in mempool */
 	struct spa_list mappings;	/* list of struct mapping */
 	struct spa_list memmaps;	/* list of struct memmap */
+	struct slab *slab;		/* slab of the block or NULL */
 };
 
 /* a mapped region of a block */
@@ -128,8 +152,142 @@ struct memmap {
 	struct pw_memmap this;
 	struct mapping *mapping;
 	struct spa_list link;
+	struct spa_list tag_link;	/* link in mempool tags */
 };
 
+#define TAG_BITS_MIN	6
+
+static void slab_free(struct mempool *impl, struct slab *s);
+
+/* index of the first mapping that starts after ptr */
+static uint32_t mappings_search(struct mempool *impl, const void *ptr)
+{
+	struct mapping **m = impl->mappings.data;
+	uint32_t lo = 0, hi = pw_array_get_len(&impl->mappings, struct mapping *);
+
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+		if ((uintptr_t)m[mid]->ptr <= (uintptr_t)ptr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static int mappings_insert(struct mempool *impl, struct mapping *m)
+{
+	uint32_t idx = mappings_search(impl, m->ptr);
+	struct mapping **p;
+
+	if (pw_array_add(&impl->mappings, sizeof(struct mapping *)) == NULL)
+		return -errno;
+
+	p = pw_array_get_unchecked(&impl->mappings, idx, struct mapping *);
+	memmove(p + 1, p, SPA_PTRDIFF(pw_array_end(&impl->mappings), p + 1));
+	*p = m;
+	return 0;
+}
+
+static void mappings_remove(struct mempool *impl, struct mapping *m)
+{
+	uint32_t idx = mappings_search(impl, m->ptr);
+	struct mapping **p;
+
+	for (; idx > 0; idx--) {
+		p = pw_array_get_unchecked(&impl->mappings, idx - 1, struct mapping *);
+		if (*p == m) {
+			pw_array_remove(&impl->mappings, p);
+			break;
+		}
+		if ((*p)->ptr != m->ptr)
+			break;
+	}
+}
+
+static inline struct memblock **fds_lookup(struct mempool *impl, int fd)
+{
+	if (fd < 0 || !pw_array_check_index(&impl->fds, (size_t)fd, struct memblock *))
+		return NULL;
+	return pw_array_get_unchecked(&impl->fds, fd, struct memblock *);
+}
+
+static int fds_insert(struct mempool *impl, struct memblock *b)
+{
+	int fd = b->this.fd;
+	size_t len = pw_array_get_len(&impl->fds, struct memblock *);
+	struct memblock **p;
+
+	if (fd < 0)
+		return 0;
+
+	if ((size_t)fd >= len) {
+		size_t extra = (fd + 1 - len) * sizeof(struct memblock *);
+		if (pw_array_ensure_size(&impl->fds, extra) < 0)
+			return -errno;
+		memset(pw_array_end(&impl->fds), 0, extra);
+		impl->fds.size += extra;
+	}
+	p = fds_lookup(impl, fd);
+	if (*p == NULL)
+		*p = b;
+	return 0;
+}
+
+static void fds_remove(struct mempool *impl, struct memblock *b)
+{
+	struct memblock **p = fds_lookup(impl, b->this.fd);
+	if (p != NULL && *p == b)
+		*p = NULL;
+}
+
+static inline struct spa_list *tags_bucket(struct mempool *impl, uint32_t tag)
+{
+	return &impl->tags[(tag * 2654435761u) >> (32 - impl->tag_bits)];
+}
+
+static int tags_resize(struct mempool *impl, uint32_t bits)
+{
+	struct spa_list *tags, *old = impl->tags;
+	uint32_t i, n_old = old ? 1u << impl->tag_bits : 0;
+	struct memmap *mm;
+
+	tags = calloc(1u << bits, sizeof(struct spa_list));
+	if (tags == NULL)
+		return -errno;
+
+	for (i = 0; i < 1u << bits; i++)
+		spa_list_init(&tags[i]);
+
+	impl->tags = tags;
+	impl->tag_bits = bits;
+
+	for (i = 0; i < n_old; i++) {
+		spa_list_consume(mm, &old[i], tag_link) {
+			spa_list_remove(&mm->tag_link);
+			spa_list_append(tags_bucket(impl, mm->this.tag[0]), &mm->tag_link);
+		}
+	}
+	free(old);
+	return 0;
+}
+
+static void tags_insert(struct mempool *impl, struct memmap *mm)
+{
+	/* keep the average chain short, the old table is still
+	 * fine when we can't grow */
+	if (++impl->n_memmaps > 2u << impl->tag_bits)
+		tags_resize(impl, impl->tag_bits + 1);
+	spa_list_append(tags_bucket(impl, mm->this.tag[0]), &mm->tag_link);
+}
+
+static void tags_remove(struct mempool *impl, struct memmap *mm)
+{
+	spa_list_remove(&mm->tag_link);
+	impl->n_memmaps--;
+}
+
+SPA_EXPORT
 struct pw_mempool *pw_mempool_new(struct pw_properties *props)
 {
 	struct mempool *impl;
@@ -139,16 +297,35 @@ struct pw_mempool *pw_mempool_new(struct pw_properties *props)
 	if (impl == NULL)
 		return NULL;
 
+	if (tags_resize(impl, TAG_BITS_MIN) < 0) {
+		free(impl);
+		return NULL;
+	}
+
 	this = &impl->this;
 	this->props = props;
 
 	impl->pagesize = sysconf(_SC_PAGESIZE);
 
-	pw_log_debug(NAME" %p: new", this);
+	if (props) {
+		const char *str;
+		if ((str = pw_properties_get(props, PW_KEY_MEMPOOL_SLAB_SIZE)) != NULL) {
+			int64_t size = pw_properties_parse_int64(str);
+			/* 0 or less disables the slabs */
+			if (size > 0)
+				impl->slab_pages = SPA_MIN((uint64_t)size / impl->pagesize,
+						MAX_SLAB_PAGES);
+		}
+	}
+
+	pw_log_debug(NAME" %p: new slab-pages:%u", this, impl->slab_pages);
 
 	spa_hook_list_init(&impl->listener_list);
 	pw_map_init(&impl->map, 64, 64);
 	spa_list_init(&impl->blocks);
+	spa_list_init(&impl->slabs);
+	pw_array_init(&impl->mappings, 64);
+	pw_array_init(&impl->fds, 64);
 
 	spa_list_append(&_mempools, &impl->link);
 
@@ -167,9 +344,11 @@ void pw_mempool_clear(struct pw_mempool *pool)
 	pw_map_reset(&impl->map);
 }
 
+SPA_EXPORT
 void pw_mempool_destroy(struct pw_mempool *pool)
 {
 	struct mempool *impl = SPA_CONTAINER_OF(pool, struct mempool, this);
+	struct slab *s;
 
 	pw_log_debug(NAME" %p: destroy", pool);
 
@@ -177,11 +356,17 @@ void pw_mempool_destroy(struct pw_mempool *pool)
 
 	pw_mempool_clear(pool);
 
+	spa_list_consume(s, &impl->slabs, link)
+		slab_free(impl, s);
+
 	spa_list_remove(&impl->link);
 
 	spa_hook_list_clean(&impl->listener_list);
 
 	pw_map_clear(&impl->map);
+	pw_array_clear(&impl->mappings);
+	pw_array_clear(&impl->fds);
+	free(impl->tags);
 	if (pool->props)
 		pw_properties_free(pool->props);
 	free(impl);
@@ -278,6 +463,50 @@ static struct mapping * memblock_find_mapping(struct memblock *b,
 	return NULL;
 }
 
+static void mapping_prefault(struct mempool *p, void *ptr, uint32_t size, int prot)
+{
+	uint32_t i;
+
+#ifdef MADV_POPULATE_WRITE
+	if (madvise(ptr, size, prot & PROT_WRITE ?
+				MADV_POPULATE_WRITE : MADV_POPULATE_READ) == 0)
+		return;
+#endif
+	if (!(prot & PROT_READ))
+		return;
+
+	/* reading a page of a shared mapping maps it writable */
+	for (i = 0; i < size; i += p->pagesize)
+		(void)*(volatile uint8_t *)SPA_MEMBER(ptr, i, void);
+}
+
+/* apply the memory hints of the block to a new mapping */
+static void mapping_setup(struct mempool *p, struct memblock *b,
+		void *ptr, uint32_t size, int prot)
+{
+	uint32_t flags = b->this.flags;
+
+#ifdef MADV_HUGEPAGE
+	/* before the memory is faulted in */
+	if ((flags & PW_MEMBLOCK_FLAG_HUGEPAGES) &&
+	    madvise(ptr, size, MADV_HUGEPAGE) < 0)
+		pw_log_debug(NAME" %p: can't use huge pages for %p %u: %m", p, ptr, size);
+#endif
+	if (flags & PW_MEMBLOCK_FLAG_PREFAULT)
+		mapping_prefault(p, ptr, size, prot);
+
+	if ((flags & PW_MEMBLOCK_FLAG_MLOCK) && mlock(ptr, size) < 0) {
+		if (errno != ENOMEM || !mlock_warned) {
+			pw_log_warn(NAME" %p: Failed to mlock memory %p %u: %s", p,
+					ptr, size,
+					errno == ENOMEM ?
+					"This is not a problem but for best performance, "
+					"consider increasing RLIMIT_MEMLOCK" : strerror(errno));
+			mlock_warned |= errno == ENOMEM;
+		}
+	}
+}
+
 static struct mapping * memblock_map(struct memblock *b,
 		enum pw_memmap_flags flags, uint32_t offset, uint32_t size)
 {
@@ -303,12 +532,13 @@ static struct mapping * memblock_map(struct memblock *b,
 	}
 
 
-	ptr = mmap(NULL, size, prot, fl, b->this.fd, offset);
+	ptr = mmap(NULL, size, prot, fl, b->this.fd, b->this.offset + offset);
 	if (ptr == MAP_FAILED) {
 		pw_log_error(NAME" %p: Failed to mmap memory fd:%d offset:%u size:%u: %m",
-				p, b->this.fd, offset, size);
+				p, b->this.fd, b->this.offset + offset, size);
 		return NULL;
 	}
+	mapping_setup(p, b, ptr, size, prot);
 
 	m = calloc(1, sizeof(struct mapping));
 	if (m == NULL) {
@@ -320,6 +550,11 @@ static struct mapping * memblock_map(struct memblock *b,
 	m->block = b;
 	m->offset = offset;
 	m->size = size;
+	if (mappings_insert(p, m) < 0) {
+		munmap(ptr, size);
+		free(m);
+		return NULL;
+	}
 	b->this.ref++;
 	spa_list_append(&b->mappings, &m->link);
 
@@ -329,6 +564,34 @@ static struct mapping * memblock_map(struct memblock *b,
 	return m;
 }
 
+/* add a mapping of memory that is mapped elsewhere, the mapping keeps a
+ * ref on the block but does not unmap the memory */
+static struct mapping * memblock_add_mapping(struct memblock *b,
+		void *ptr, uint32_t offset, uint32_t size)
+{
+	struct mempool *p = SPA_CONTAINER_OF(b->this.pool, struct mempool, this);
+	struct mapping *m;
+
+	m = calloc(1, sizeof(struct mapping));
+	if (m == NULL)
+		return NULL;
+
+	m->ptr = ptr;
+	m->block = b;
+	m->offset = offset;
+	m->size = size;
+	if (mappings_insert(p, m) < 0) {
+		free(m);
+		return NULL;
+	}
+	b->this.ref++;
+	spa_list_append(&b->mappings, &m->link);
+
+	pw_log_debug(NAME" %p: mapping:%p block:%p offset:%u size:%u ref:%u",
+			b->this.pool, m, b, offset, size, b->this.ref);
+	return m;
+}
+
 static void mapping_free(struct mapping *m)
 {
 	struct memblock *b = m->block;
@@ -339,6 +602,7 @@ static void mapping_free(struct mapping *m)
 
 	if (m->do_unmap)
 		munmap(m->ptr, m->size);
+	mappings_remove(p, m);
 	spa_list_remove(&m->link);
 	free(m);
 }
@@ -396,6 +660,7 @@ struct pw_memmap * pw_memblock_map(struct pw_memblock *block,
 	}
 
 	spa_list_append(&b->memmaps, &mm->link);
+	tags_insert(p, mm);
 
 	return &mm->this;
 }
@@ -427,6 +692,7 @@ int pw_memmap_free(struct pw_memmap *map)
 			&mm->this, b, b->this.fd, mm->this.ptr, m, m->ref);
 
 	spa_list_remove(&mm->link);
+	tags_remove(p, mm);
 
 	if (--m->ref == 0)
 		mapping_unmap(m);
@@ -456,64 +722,238 @@ static inline enum pw_memmap_flags block_flags_to_mem(enum pw_memblock_flags fla
  * \return a memblock structure or NULL with errno on error
  * \memberof pw_memblock
  */
-SPA_EXPORT
-struct pw_memblock * pw_mempool_alloc(struct pw_mempool *pool, enum pw_memblock_flags flags,
-		uint32_t type, size_t size)
+static int create_fd(struct pw_mempool *pool, enum pw_memblock_flags flags, size_t size)
 {
-	struct mempool *impl = SPA_CONTAINER_OF(pool, struct mempool, this);
-	struct memblock *b;
-	int res;
-
-	b = calloc(1, sizeof(struct memblock));
-	if (b == NULL)
-		return NULL;
-
-	b->this.ref = 1;
-	b->this.pool = pool;
-	b->this.flags = flags;
-	b->this.type = type;
-	b->this.size = size;
-	spa_list_init(&b->mappings);
-	spa_list_init(&b->memmaps);
+	int fd, res;
 
 #ifdef HAVE_MEMFD_CREATE
-	b->this.fd = memfd_create("pipewire-memfd", MFD_CLOEXEC | MFD_ALLOW_SEALING);
-	if (b->this.fd == -1) {
+	fd = memfd_create("pipewire-memfd", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd == -1) {
 		res = -errno;
 		pw_log_error(NAME" %p: Failed to create memfd: %m", pool);
-		goto error_free;
+		return res;
 	}
 #elif defined(__FreeBSD__)
-	b->this.fd = shm_open(SHM_ANON, O_CREAT | O_RDWR | O_CLOEXEC, 0);
-	if (b->this.fd == -1) {
+	fd = shm_open(SHM_ANON, O_CREAT | O_RDWR | O_CLOEXEC, 0);
+	if (fd == -1) {
 		res = -errno;
 		pw_log_error(NAME" %p: Failed to create SHM_ANON fd: %m", pool);
-		goto error_free;
+		return res;
 	}
 #else
 	char filename[] = "/dev/shm/pipewire-tmpfile.XXXXXX";
-	b->this.fd = mkostemp(filename, O_CLOEXEC);
-	if (b->this.fd == -1) {
+	fd = mkostemp(filename, O_CLOEXEC);
+	if (fd == -1) {
 		res = -errno;
 		pw_log_error(NAME" %p: Failed to create temporary file: %m", pool);
-		goto error_free;
+		return res;
 	}
 	unlink(filename);
 #endif
 
-	if (ftruncate(b->this.fd, size) < 0) {
+	if (ftruncate(fd, size) < 0) {
 		res = -errno;
 		pw_log_warn(NAME" %p: Failed to truncate temporary file: %m", pool);
-		goto error_close;
+		close(fd);
+		return res;
 	}
 #ifdef HAVE_MEMFD_CREATE
 	if (flags & PW_MEMBLOCK_FLAG_SEAL) {
 		unsigned int seals = F_SEAL_GROW | F_SEAL_SHRINK | F_SEAL_SEAL;
-		if (fcntl(b->this.fd, F_ADD_SEALS, seals) == -1) {
+		if (fcntl(fd, F_ADD_SEALS, seals) == -1) {
 			pw_log_warn(NAME" %p: Failed to add seals: %m", pool);
 		}
 	}
 #endif
+	return fd;
+}
+
+static inline bool slab_page_used(struct slab *s, uint32_t page)
+{
+	return s->used[page / 64] & (1ULL << (page % 64));
+}
+
+static void slab_mark(struct slab *s, uint32_t page, uint32_t n_pages, bool used)
+{
+	uint32_t i;
+	for (i = page; i < page + n_pages; i++) {
+		if (used)
+			s->used[i / 64] |= 1ULL << (i % 64);
+		else
+			s->used[i / 64] &= ~(1ULL << (i % 64));
+	}
+}
+
+/* first fit of n_pages free pages, returns the first page or -1 */
+static int slab_find_free(struct slab *s, uint32_t n_pages)
+{
+	uint32_t i, start = 0, count = 0;
+
+	if (s->n_pages - s->used_pages < n_pages)
+		return -1;
+
+	for (i = 0; i < s->n_pages; i++) {
+		if (i % 64 == 0 && s->used[i / 64] == UINT64_MAX &&
+		    i + 64 <= s->n_pages) {
+			i += 63;
+			count = 0;
+			continue;
+		}
+		if (slab_page_used(s, i)) {
+			count = 0;
+			continue;
+		}
+		if (count++ == 0)
+			start = i;
+		if (count == n_pages)
+			return start;
+	}
+	return -1;
+}
+
+static struct slab *slab_new(struct mempool *impl)
+{
+	struct pw_mempool *pool = &impl->this;
+	size_t size = (size_t)impl->slab_pages * impl->pagesize;
+	struct slab *s;
+	int res;
+
+	s = calloc(1, sizeof(struct slab));
+	if (s == NULL)
+		return NULL;
+
+	if ((s->fd = create_fd(pool, PW_MEMBLOCK_FLAG_SEAL, size)) < 0) {
+		res = s->fd;
+		goto error_free;
+	}
+	s->ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0);
+	if (s->ptr == MAP_FAILED) {
+		res = -errno;
+		pw_log_error(NAME" %p: Failed to mmap slab fd:%d size:%zd: %m",
+				pool, s->fd, size);
+		goto error_close;
+	}
+	s->n_pages = impl->slab_pages;
+	spa_list_append(&impl->slabs, &s->link);
+
+	pw_log_debug(NAME" %p: new slab:%p fd:%d size:%zd", pool, s, s->fd, size);
+	return s;
+
+error_close:
+	close(s->fd);
+error_free:
+	free(s);
+	errno = -res;
+	return NULL;
+}
+
+static void slab_free(struct mempool *impl, struct slab *s)
+{
+	pw_log_debug(NAME" %p: free slab:%p fd:%d", impl, s, s->fd);
+	spa_list_remove(&s->link);
+	munmap(s->ptr, (size_t)s->n_pages * impl->pagesize);
+	close(s->fd);
+	free(s);
+}
+
+static inline bool slab_can_alloc(struct mempool *impl, enum pw_memblock_flags flags,
+		uint32_t type, size_t size)
+{
+	/* only small mapped memfd blocks without memory hints, a block
+	 * must not use more than a quarter of the slab */
+	return impl->slab_pages > 0 &&
+		type == SPA_DATA_MemFd &&
+		(flags & PW_MEMBLOCK_FLAG_MAP) &&
+		!(flags & (PW_MEMBLOCK_FLAG_MLOCK |
+			   PW_MEMBLOCK_FLAG_PREFAULT |
+			   PW_MEMBLOCK_FLAG_HUGEPAGES)) &&
+		(flags & PW_MEMBLOCK_FLAG_READWRITE) == PW_MEMBLOCK_FLAG_READWRITE &&
+		size > 0 &&
+		size <= (size_t)impl->slab_pages * impl->pagesize / 4;
+}
+
+static void slab_release(struct mempool *impl, struct memblock *b)
+{
+	struct slab *s = b->slab;
+	uint32_t n_pages = SPA_ROUND_UP_N(b->this.size, impl->pagesize) / impl->pagesize;
+
+	slab_mark(s, b->this.offset / impl->pagesize, n_pages, false);
+	s->used_pages -= n_pages;
+	b->slab = NULL;
+
+	/* keep the last slab around for the next allocations */
+	if (--s->n_blocks == 0 &&
+	    !(s->link.prev == &impl->slabs && s->link.next == &impl->slabs))
+		slab_free(impl, s);
+}
+
+static int slab_alloc(struct mempool *impl, struct memblock *b)
+{
+	uint32_t n_pages = SPA_ROUND_UP_N(b->this.size, impl->pagesize) / impl->pagesize;
+	struct slab *s;
+	int page = -1;
+	void *ptr;
+
+	spa_list_for_each(s, &impl->slabs, link) {
+		if ((page = slab_find_free(s, n_pages)) >= 0)
+			break;
+	}
+	if (page < 0) {
+		if ((s = slab_new(impl)) == NULL)
+			return -errno;
+		page = 0;
+	}
+	slab_mark(s, page, n_pages, true);
+	s->used_pages += n_pages;
+	s->n_blocks++;
+
+	ptr = SPA_MEMBER(s->ptr, page * impl->pagesize, void);
+	/* reused pages, make it look like a new memfd */
+	memset(ptr, 0, n_pages * impl->pagesize);
+
+	b->slab = s;
+	b->this.fd = s->fd;
+	b->this.offset = page * impl->pagesize;
+
+	if (memblock_add_mapping(b, ptr, 0, n_pages * impl->pagesize) == NULL) {
+		slab_release(impl, b);
+		return -errno;
+	}
+	return 0;
+}
+
+SPA_EXPORT
+struct pw_memblock * pw_mempool_alloc(struct pw_mempool *pool, enum pw_memblock_flags flags,
+		uint32_t type, size_t size)
+{
+	struct mempool *impl = SPA_CONTAINER_OF(pool, struct mempool, this);
+	struct memblock *b;
+	int res;
+
+	b = calloc(1, sizeof(struct memblock));
+	if (b == NULL)
+		return NULL;
+
+	b->this.ref = 1;
+	b->this.pool = pool;
+	b->this.flags = flags;
+	b->this.type = type;
+	b->this.size = size;
+	spa_list_init(&b->mappings);
+	spa_list_init(&b->memmaps);
+
+	if (slab_can_alloc(impl, flags, type, size)) {
+		if ((res = slab_alloc(impl, b)) < 0)
+			goto error_free;
+	} else {
+		if ((b->this.fd = create_fd(pool, flags, size)) < 0) {
+			res = b->this.fd;
+			goto error_free;
+		}
+		if ((res = fds_insert(impl, b)) < 0)
+			goto error_close;
+	}
+
 	if (flags & PW_MEMBLOCK_FLAG_MAP && size > 0) {
 		b->this.map = pw_memblock_map(&b->this,
 				block_flags_to_mem(flags), 0, size, NULL);
@@ -535,7 +975,15 @@ struct pw_memblock * pw_mempool_alloc(struct pw_mempool *pool, enum pw_memblock_
 	return &b->this;
 
 error_close:
-	close(b->this.fd);
+	if (b->slab) {
+		struct mapping *m;
+		spa_list_consume(m, &b->mappings, link)
+			mapping_free(m);
+		slab_release(impl, b);
+	} else {
+		fds_remove(impl, b);
+		close(b->this.fd);
+	}
 error_free:
 	free(b);
 	errno = -res;
@@ -545,16 +993,16 @@ error_free:
 static struct memblock * mempool_find_fd(struct pw_mempool *pool, int fd)
 {
 	struct mempool *impl = SPA_CONTAINER_OF(pool, struct mempool, this);
-	struct memblock *b;
+	struct memblock **b;
 
-	spa_list_for_each(b, &impl->blocks, link) {
-		if (fd == b->this.fd) {
-			pw_log_debug(NAME" %p: found %p id:%d fd:%d ref:%d",
-					pool, &b->this, b->this.id, fd, b->this.ref);
-			return b;
-		}
-	}
-	return NULL;
+	/* blocks from a slab share the fd, they are not in the index */
+	b = fds_lookup(impl, fd);
+	if (b == NULL || *b == NULL)
+		return NULL;
+
+	pw_log_debug(NAME" %p: found %p id:%d fd:%d ref:%d",
+			pool, &(*b)->this, (*b)->this.id, fd, (*b)->this.ref);
+	return *b;
 }
 
 SPA_EXPORT
@@ -582,6 +1030,10 @@ struct pw_memblock * pw_mempool_import(struct pw_mempool *pool,
 	b->this.type = type;
 	b->this.fd = fd;
 	b->this.flags = flags;
+	if (fds_insert(impl, b) < 0) {
+		free(b);
+		return NULL;
+	}
 	b->this.id = pw_map_insert_new(&impl->map, b);
 	spa_list_append(&impl->blocks, &b->link);
 
@@ -624,28 +1076,21 @@ struct pw_memmap * pw_mempool_import_map(struct pw_mempool *pool,
 	if (block == NULL)
 		return NULL;
 
-	if (block->ref == 1) {
-		struct mapping *m;
+	b = SPA_CONTAINER_OF(block, struct memblock, this);
 
-		b = SPA_CONTAINER_OF(block, struct memblock, this);
+	/* the imported block is the complete fd, blocks from a slab
+	 * are somewhere in the fd */
+	offset = old->offset + old->map->offset;
 
-		m = calloc(1, sizeof(struct mapping));
-		if (m == NULL) {
-			pw_memblock_unref(block);
-			return NULL;
-		}
-		m->ptr = old->map->ptr;
-		m->block = b;
-		m->offset = old->map->offset;
-		m->size = old->map->size;
-		spa_list_append(&b->mappings, &m->link);
-		pw_log_debug(NAME" %p: mapping:%p block:%p offset:%u size:%u ref:%u",
-				pool, m, block, m->offset, m->size, block->ref);
-	} else {
-		block->ref--;
+	if (memblock_find_mapping(b, 0, offset, old->map->size) == NULL &&
+	    memblock_add_mapping(b, old->map->ptr, offset, old->map->size) == NULL) {
+		pw_memblock_unref(block);
+		return NULL;
 	}
+	/* the import ref is kept by the mapping */
+	block->ref--;
 
-	offset = SPA_PTRDIFF(data, old->map->ptr);
+	offset += SPA_PTRDIFF(data, old->map->ptr);
 
 	map = pw_memblock_map(block,
 			block_flags_to_mem(block->flags), offset, size, tag);
@@ -702,6 +1147,8 @@ void pw_memblock_free(struct pw_memblock *block)
 	if (block->id != SPA_ID_INVALID)
 		pw_map_remove(&impl->map, block->id);
 	spa_list_remove(&b->link);
+	if (b->slab == NULL)
+		fds_remove(impl, b);
 
 	if (!SPA_FLAG_IS_SET(block->flags, PW_MEMBLOCK_FLAG_DONT_NOTIFY))
 		pw_mempool_emit_removed(impl, block);
@@ -714,7 +1161,9 @@ void pw_memblock_free(struct pw_memblock *block)
 		mapping_free(m);
 	}
 
-	if (block->fd != -1 && !(block->flags & PW_MEMBLOCK_FLAG_DONT_CLOSE)) {
+	if (b->slab != NULL) {
+		slab_release(impl, b);
+	} else if (block->fd != -1 && !(block->flags & PW_MEMBLOCK_FLAG_DONT_CLOSE)) {
 		pw_log_debug(NAME" %p: close fd:%d", pool, block->fd);
 		close(block->fd);
 	}
@@ -725,19 +1174,22 @@ SPA_EXPORT
 struct pw_memblock * pw_mempool_find_ptr(struct pw_mempool *pool, const void *ptr)
 {
 	struct mempool *impl = SPA_CONTAINER_OF(pool, struct mempool, this);
-	struct memblock *b;
 	struct mapping *m;
+	uint32_t idx;
 
-	spa_list_for_each(b, &impl->blocks, link) {
-		spa_list_for_each(m, &b->mappings, link) {
-			if (ptr >= m->ptr && ptr < SPA_MEMBER(m->ptr, m->size, void)) {
-				pw_log_debug(NAME" %p: block:%p id:%d for %p", pool,
-						b, b->this.id, ptr);
-				return &b->this;
-			}
-		}
-	}
-	return NULL;
+	/* mappings don't overlap, only the last mapping that starts
+	 * before ptr can contain it */
+	idx = mappings_search(impl, ptr);
+	if (idx == 0)
+		return NULL;
+
+	m = *pw_array_get_unchecked(&impl->mappings, idx - 1, struct mapping *);
+	if ((uintptr_t)ptr >= (uintptr_t)SPA_MEMBER(m->ptr, m->size, void))
+		return NULL;
+
+	pw_log_debug(NAME" %p: block:%p id:%d for %p", pool,
+			m->block, m->block->this.id, ptr);
+	return &m->block->this;
 }
 
 SPA_EXPORT
@@ -776,6 +1228,16 @@ struct pw_memmap * pw_mempool_find_tag(struct pw_mempool *pool, uint32_t tag[5],
 	pw_log_debug(NAME" %p: find tag %d:%d:%d:%d:%d size:%zd", pool,
 			tag[0], tag[1], tag[2], tag[3], tag[4], size);
 
+	if (size >= sizeof(uint32_t)) {
+		spa_list_for_each(mm, tags_bucket(impl, tag[0]), tag_link) {
+			if (memcmp(tag, mm->this.tag, size) == 0) {
+				pw_log_debug(NAME" %p: found %p", pool, mm);
+				return &mm->this;
+			}
+		}
+		return NULL;
+	}
+
 	spa_list_for_each(b, &impl->blocks, link) {
 		spa_list_for_each(mm, &b->memmaps, link) {
 			if (memcmp(tag, mm->this.tag, size) == 0) {
@@ -786,3 +1248,22 @@ struct pw_memmap * pw_mempool_find_tag(struct pw_mempool *pool, uint32_t tag[5],
 	}
 	return NULL;
 }
+
+SPA_EXPORT
+int pw_mempool_get_stats(struct pw_mempool *pool, struct pw_mempool_stats *stats)
+{
+	struct mempool *impl = SPA_CONTAINER_OF(pool, struct mempool, this);
+	struct memblock *b;
+	struct slab *s;
+
+	spa_zero(*stats);
+	spa_list_for_each(b, &impl->blocks, link)
+		stats->n_blocks++;
+	spa_list_for_each(s, &impl->slabs, link) {
+		stats->n_slabs++;
+		stats->n_slab_blocks += s->n_blocks;
+		stats->slab_size += (uint64_t)s->n_pages * impl->pagesize;
+		stats->slab_used += (uint64_t)s->used_pages * impl->pagesize;
+	}
+	return 0;
+}
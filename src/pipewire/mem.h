@@ -40,6 +40,10 @@ enum pw_memblock_flags {
 	PW_MEMBLOCK_FLAG_MAP =		(1 << 3),	/**< mmap the fd */
 	PW_MEMBLOCK_FLAG_DONT_CLOSE =	(1 << 4),	/**< don't close fd */
 	PW_MEMBLOCK_FLAG_DONT_NOTIFY =	(1 << 5),	/**< don't notify events */
+	PW_MEMBLOCK_FLAG_MLOCK =	(1 << 6),	/**< lock the memory in RAM when mapped */
+	PW_MEMBLOCK_FLAG_PREFAULT =	(1 << 7),	/**< fault in the memory when mapped */
+	PW_MEMBLOCK_FLAG_HUGEPAGES =	(1 << 8),	/**< use transparent huge pages for
+							  *  the memory when mapped */
 
 	PW_MEMBLOCK_FLAG_READWRITE = PW_MEMBLOCK_FLAG_READABLE | PW_MEMBLOCK_FLAG_WRITABLE,
 };
@@ -74,6 +78,8 @@ struct pw_memblock {
 	int fd;				/**< fd */
 	uint32_t size;			/**< size of memory */
 	struct pw_memmap *map;		/**< optional map when PW_MEMBLOCK_FLAG_MAP was given */
+	uint32_t offset;		/**< offset of the memory in the fd, not 0 when the
+					  *  block was allocated from a slab */
 };
 
 /** a mapped region of a pw_memblock */
@@ -100,6 +106,20 @@ struct pw_mempool_events {
 	void (*removed) (void *data, struct pw_memblock *block);
 };
 
+/** statistics of a pool */
+struct pw_mempool_stats {
+	uint32_t n_blocks;		/**< number of blocks in the pool */
+	uint32_t n_slabs;		/**< number of slabs */
+	uint32_t n_slab_blocks;		/**< number of blocks allocated from a slab */
+	uint64_t slab_size;		/**< total size of the slabs */
+	uint64_t slab_used;		/**< used size of the slabs */
+};
+
+/** The size of the slabs of a pool. Small memfd blocks are allocated from
+ * a shared slab memfd instead of a memfd of their own. Everybody who gets
+ * a block can map the complete slab. The default is 0, no slabs. */
+#define PW_KEY_MEMPOOL_SLAB_SIZE	"mempool.slab-size"
+
 /** Create a new memory pool */
 struct pw_mempool *pw_mempool_new(struct pw_properties *props);
 
@@ -112,6 +132,9 @@ void pw_mempool_add_listener(struct pw_mempool *pool,
 /** Clear a pool */
 void pw_mempool_clear(struct pw_mempool *pool);
 
+/** Get the statistics of a pool */
+int pw_mempool_get_stats(struct pw_mempool *pool, struct pw_mempool_stats *stats);
+
 /** Clear and destroy a pool */
 void pw_mempool_destroy(struct pw_mempool *pool);
 
@@ -57,6 +57,10 @@ struct defaults {
 	struct spa_fraction video_rate;
 	uint32_t link_max_buffers;
 	unsigned int mem_allow_mlock;
+	int64_t mem_slab_size;
+	unsigned int mem_prefault;
+	unsigned int mem_hugepages;
+	uint32_t data_loop_workers;
 };
 
 struct ratelimit {
@@ -395,6 +399,12 @@ struct pw_context {
         struct pw_data_loop *data_loop_impl;
 	struct spa_system *data_system;	/**< data system for data passing */
 
+#define MAX_DATA_LOOP_WORKERS	32u
+	struct pw_data_loop *data_workers[MAX_DATA_LOOP_WORKERS];	/**< extra data loops to
+									  *  process followers on */
+	uint32_t n_data_workers;
+	uint32_t data_worker_index;	/**< next worker to assign a follower to */
+
 	struct spa_support support[16];	/**< support for spa plugins */
 	uint32_t n_support;		/**< number of support items */
 	struct pw_array factory_lib;	/**< mapping of factory_name regexp to library */
@@ -418,6 +428,7 @@ struct pw_data_loop {
 	struct spa_source *event;
 
 	pthread_t thread;
+	int cpu;			/**< cpu to pin the thread to or -1 */
 	unsigned int created:1;
 	unsigned int running:1;
 };
@@ -492,7 +503,7 @@ struct pw_node_activation_state {
 
 static inline void pw_node_activation_state_reset(struct pw_node_activation_state *state)
 {
-        state->pending = state->required;
+        state->pending = __atomic_load_n(&state->required, __ATOMIC_SEQ_CST);
 }
 
 #define pw_node_activation_state_dec(s,c) (__atomic_sub_fetch(&(s)->pending, c, __ATOMIC_SEQ_CST) == 0)
@@ -555,6 +566,18 @@ struct pw_node_activation {
 	uint32_t command;				/* next command */
 	uint32_t reposition_owner;			/* owner id with new reposition info, last one
 							 * to update wins */
+
+	/* the fields below were added later, new fields go at the end so that
+	 * peers that are not rebuilt keep working, see
+	 * PW_NODE_ACTIVATION_FUTEX_SIZE */
+#define PW_NODE_ACTIVATION_WAIT_EVENTFD	0
+#define PW_NODE_ACTIVATION_WAIT_FUTEX	1
+	uint32_t wait_mode;				/* how the node waits for a signal. With
+							 * WAIT_EVENTFD the eventfd is always written,
+							 * with WAIT_FUTEX signal_seq is incremented and
+							 * the eventfd is only written when sleeping */
+	uint32_t signal_seq;				/* futex word, incremented for each signal */
+	uint32_t sleeping;				/* the node waits on the eventfd */
 };
 
 #define ATOMIC_CAS(v,ov,nv)						\
@@ -570,6 +593,32 @@ struct pw_node_activation {
 #define ATOMIC_STORE(s,v)		__atomic_store_n(&(s), (v), __ATOMIC_SEQ_CST)
 #define ATOMIC_XCHG(s,v)		__atomic_exchange_n(&(s), (v), __ATOMIC_SEQ_CST)
 
+/** Activations of peers that are not rebuilt are smaller and don't have the
+ * futex fields. These peers are always signaled with the eventfd and don't
+ * increment signal_seq so the futex wait mode must not be used with them. */
+#define PW_NODE_ACTIVATION_FUTEX_SIZE	(offsetof(struct pw_node_activation, sleeping) + sizeof(uint32_t))
+
+/** Signal the node of \a a. Returns true when the node needs to be woken up
+ * by writing its eventfd */
+static inline bool pw_node_activation_signal(struct pw_node_activation *a)
+{
+	if (SPA_LIKELY(a->wait_mode != PW_NODE_ACTIVATION_WAIT_FUTEX))
+		return true;
+	ATOMIC_INC(a->signal_seq);
+	return ATOMIC_XCHG(a->sleeping, 0) != 0;
+}
+
+/** Prepare the node of \a a to sleep on its eventfd after it has seen
+ * \a seq. Returns false when a signal arrived in the meantime and no
+ * eventfd write will follow */
+static inline bool pw_node_activation_sleep(struct pw_node_activation *a, uint32_t seq)
+{
+	ATOMIC_STORE(a->sleeping, 1);
+	if (SPA_LIKELY(ATOMIC_LOAD(a->signal_seq) == seq))
+		return true;
+	return ATOMIC_XCHG(a->sleeping, 0) == 0;
+}
+
 #define SEQ_WRITE(s)			ATOMIC_INC(s)
 #define SEQ_WRITE_SUCCESS(s1,s2)	((s1) + 1 == (s2) && ((s2) & 1) == 0)
 
@@ -632,6 +681,11 @@ struct pw_impl_node {
 	struct spa_list follower_link;
 
 	struct spa_list sort_link;	/**< link used to sort nodes */
+	uint32_t path_seq;		/**< recalc sequence of the path stats */
+	uint32_t path_depth;		/**< number of nodes in the longest chain of
+					  *  followers starting at this node */
+	uint64_t path_time;		/**< estimated process time of that chain, used to
+					  *  order the targets of the driver */
 
 	struct spa_node *node;		/**< SPA node implementation */
 	struct spa_hook listener;
@@ -644,6 +698,7 @@ struct pw_impl_node {
 	struct spa_hook_list listener_list;
 
 	struct pw_loop *data_loop;		/**< the data loop for this node */
+	struct pw_data_loop *data_loop_impl;	/**< the data loop that processes this node */
 
 	struct spa_fraction latency;		/**< requested latency */
 	uint32_t quantum_size;			/**< desired quantum */
@@ -670,6 +725,22 @@ struct pw_impl_node {
         void *user_data;                /**< extra user data */
 };
 
+/* order of the targets of a driver, the nodes heading the longest
+ * chains of followers go first */
+static inline int pw_node_target_cmp(struct pw_node_target *a, struct pw_node_target *b)
+{
+	uint64_t ta = a->node ? a->node->path_time : 0;
+	uint64_t tb = b->node ? b->node->path_time : 0;
+	uint32_t da = a->node ? a->node->path_depth : 0;
+	uint32_t db = b->node ? b->node->path_depth : 0;
+
+	if (ta != tb)
+		return ta > tb ? 1 : -1;
+	if (da != db)
+		return da > db ? 1 : -1;
+	return 0;
+}
+
 struct pw_impl_port_mix {
 	struct spa_list link;
 	struct spa_list rt_link;
@@ -1074,6 +1145,10 @@ void pw_proxy_remove(struct pw_proxy *proxy);
 
 int pw_context_recalc_graph(struct pw_context *context, const char *reason);
 
+/** Get the next data loop to process a follower on, this is the primary
+ * data loop when no workers are configured */
+struct pw_data_loop *pw_context_get_data_worker(struct pw_context *context);
+
 void pw_impl_port_update_info(struct pw_impl_port *port, const struct spa_port_info *info);
 
 int pw_impl_port_register(struct pw_impl_port *port,
@@ -1145,6 +1220,10 @@ int pw_impl_node_update_ports(struct pw_impl_node *node);
 
 int pw_impl_node_set_driver(struct pw_impl_node *node, struct pw_impl_node *driver);
 
+/** Get the PW_BUFFERS_FLAG_* memory flags for the buffers of a node from
+ * the node properties or the context defaults */
+uint32_t pw_buffers_get_node_flags(struct pw_impl_node *node);
+
 /** Prepare a link \memberof pw_impl_link
   * Starts the negotiation of formats and buffers on \a link */
 int pw_impl_link_prepare(struct pw_impl_link *link);
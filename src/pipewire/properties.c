@@ -27,6 +27,7 @@
 #include <spa/utils/json.h>
 
 #include "pipewire/array.h"
+#include "pipewire/keys.h"
 #include "pipewire/utils.h"
 #include "pipewire/properties.h"
 
@@ -38,39 +39,282 @@ struct properties {
 };
 /** \endcond */
 
-static int add_func(struct pw_properties *this, char *key, char *value)
+/* The well-known keys, sorted. Items with one of these keys point to the
+ * string here instead of to a copy. The keys are stored inline so that
+ * an interned key can be recognized from its address. */
+#define MAX_INTERNED_LEN	32
+static const char interned_keys[][MAX_INTERNED_LEN] = {
+	PW_KEY_APP_ICON,
+	PW_KEY_APP_ICON_NAME,
+	PW_KEY_APP_ID,
+	PW_KEY_APP_LANGUAGE,
+	PW_KEY_APP_NAME,
+	PW_KEY_APP_PROCESS_BINARY,
+	PW_KEY_APP_PROCESS_HOST,
+	PW_KEY_APP_PROCESS_ID,
+	PW_KEY_APP_PROCESS_MACHINE_ID,
+	PW_KEY_APP_PROCESS_SESSION_ID,
+	PW_KEY_APP_PROCESS_USER,
+	PW_KEY_APP_VERSION,
+	PW_KEY_AUDIO_CHANNEL,
+	PW_KEY_AUDIO_CHANNELS,
+	PW_KEY_AUDIO_FORMAT,
+	PW_KEY_AUDIO_RATE,
+	PW_KEY_CLIENT_API,
+	PW_KEY_CLIENT_ID,
+	PW_KEY_CLIENT_NAME,
+	PW_KEY_HOST_NAME,
+	PW_KEY_CONTEXT_PROFILE_MODULES,
+	PW_KEY_USER_NAME,
+	PW_KEY_CORE_DAEMON,
+	PW_KEY_CORE_ID,
+	PW_KEY_CORE_MONITORS,
+	PW_KEY_CORE_NAME,
+	PW_KEY_CORE_VERSION,
+	PW_KEY_CPU_CORES,
+	PW_KEY_CPU_MAX_ALIGN,
+	PW_KEY_DEVICE_API,
+	PW_KEY_DEVICE_BUS,
+	PW_KEY_DEVICE_BUS_PATH,
+	PW_KEY_DEVICE_CACHE_PARAMS,
+	PW_KEY_DEVICE_CLASS,
+	PW_KEY_DEVICE_DESCRIPTION,
+	PW_KEY_DEVICE_FORM_FACTOR,
+	PW_KEY_DEVICE_ICON,
+	PW_KEY_DEVICE_ICON_NAME,
+	PW_KEY_DEVICE_ID,
+	PW_KEY_DEVICE_INTENDED_ROLES,
+	PW_KEY_DEVICE_NAME,
+	PW_KEY_DEVICE_NICK,
+	PW_KEY_DEVICE_PLUGGED,
+	PW_KEY_DEVICE_PRODUCT_ID,
+	PW_KEY_DEVICE_PRODUCT_NAME,
+	PW_KEY_DEVICE_SERIAL,
+	PW_KEY_DEVICE_STRING,
+	PW_KEY_DEVICE_SUBSYSTEM,
+	PW_KEY_DEVICE_VENDOR_ID,
+	PW_KEY_DEVICE_VENDOR_NAME,
+	PW_KEY_FACTORY_ID,
+	PW_KEY_FACTORY_NAME,
+	PW_KEY_FACTORY_TYPE_NAME,
+	PW_KEY_FACTORY_TYPE_VERSION,
+	PW_KEY_FACTORY_USAGE,
+	PW_KEY_FORMAT_DSP,
+	PW_KEY_LIBRARY_NAME_DBUS,
+	PW_KEY_LIBRARY_NAME_LOOP,
+	PW_KEY_LIBRARY_NAME_SYSTEM,
+	PW_KEY_LINK_FEEDBACK,
+	PW_KEY_LINK_ID,
+	PW_KEY_LINK_INPUT_NODE,
+	PW_KEY_LINK_INPUT_PORT,
+	PW_KEY_LINK_OUTPUT_NODE,
+	PW_KEY_LINK_OUTPUT_PORT,
+	PW_KEY_LINK_PASSIVE,
+	PW_KEY_MEDIA_ARTIST,
+	PW_KEY_MEDIA_CATEGORY,
+	PW_KEY_MEDIA_CLASS,
+	PW_KEY_MEDIA_COMMENT,
+	PW_KEY_MEDIA_COPYRIGHT,
+	PW_KEY_MEDIA_DATE,
+	PW_KEY_MEDIA_FILENAME,
+	PW_KEY_MEDIA_FORMAT,
+	PW_KEY_MEDIA_ICON,
+	PW_KEY_MEDIA_ICON_NAME,
+	PW_KEY_MEDIA_LANGUAGE,
+	PW_KEY_MEDIA_NAME,
+	PW_KEY_MEDIA_ROLE,
+	PW_KEY_MEDIA_SOFTWARE,
+	PW_KEY_MEDIA_TITLE,
+	PW_KEY_MEDIA_TYPE,
+	PW_KEY_MODULE_AUTHOR,
+	PW_KEY_MODULE_DESCRIPTION,
+	PW_KEY_MODULE_ID,
+	PW_KEY_MODULE_NAME,
+	PW_KEY_MODULE_USAGE,
+	PW_KEY_MODULE_VERSION,
+	PW_KEY_NODE_ALWAYS_PROCESS,
+	PW_KEY_NODE_AUTOCONNECT,
+	PW_KEY_NODE_CACHE_PARAMS,
+	PW_KEY_NODE_DESCRIPTION,
+	PW_KEY_NODE_DONT_RECONNECT,
+	PW_KEY_NODE_DRIVER,
+	PW_KEY_NODE_EXCLUSIVE,
+	PW_KEY_NODE_GROUP,
+	PW_KEY_NODE_ID,
+	PW_KEY_NODE_LATENCY,
+	PW_KEY_NODE_NAME,
+	PW_KEY_NODE_NICK,
+	PW_KEY_NODE_PAUSE_ON_IDLE,
+	PW_KEY_NODE_PLUGGED,
+	PW_KEY_NODE_SESSION,
+	PW_KEY_NODE_STREAM,
+	PW_KEY_NODE_TARGET,
+	PW_KEY_OBJECT_ID,
+	PW_KEY_OBJECT_LINGER,
+	PW_KEY_OBJECT_PATH,
+	PW_KEY_ACCESS,
+	PW_KEY_CLIENT_ACCESS,
+	PW_KEY_PROTOCOL,
+	PW_KEY_SEC_GID,
+	PW_KEY_SEC_LABEL,
+	PW_KEY_SEC_PID,
+	PW_KEY_SEC_UID,
+	PW_KEY_PORT_ALIAS,
+	PW_KEY_PORT_CACHE_PARAMS,
+	PW_KEY_PORT_CONTROL,
+	PW_KEY_PORT_DIRECTION,
+	PW_KEY_PORT_ID,
+	PW_KEY_PORT_MONITOR,
+	PW_KEY_PORT_NAME,
+	PW_KEY_PORT_PHYSICAL,
+	PW_KEY_PORT_TERMINAL,
+	PW_KEY_PRIORITY_DRIVER,
+	PW_KEY_PRIORITY_SESSION,
+	PW_KEY_REMOTE_INTENTION,
+	PW_KEY_REMOTE_NAME,
+	PW_KEY_STREAM_CAPTURE_SINK,
+	PW_KEY_STREAM_DONT_REMIX,
+	PW_KEY_STREAM_IS_LIVE,
+	PW_KEY_STREAM_LATENCY_MAX,
+	PW_KEY_STREAM_LATENCY_MIN,
+	PW_KEY_STREAM_MONITOR,
+	PW_KEY_VIDEO_FORMAT,
+	PW_KEY_VIDEO_RATE,
+	PW_KEY_VIDEO_SIZE,
+	PW_KEY_WINDOW_X11_DISPLAY,
+};
+
+static inline bool is_interned(const char *key)
+{
+	return (uintptr_t) key >= (uintptr_t) interned_keys[0] &&
+		(uintptr_t) key < (uintptr_t) interned_keys[SPA_N_ELEMENTS(interned_keys)];
+}
+
+#ifndef NDEBUG
+/* find_interned() bisects the table, catch a key added out of order */
+static void check_interned(void) __attribute__ ((constructor));
+static void check_interned(void)
+{
+	uint32_t i;
+	for (i = 1; i < SPA_N_ELEMENTS(interned_keys); i++)
+		spa_assert(strcmp(interned_keys[i - 1], interned_keys[i]) < 0);
+}
+#endif
+
+static const char *find_interned(const char *key)
+{
+	uint32_t lo = 0, hi = SPA_N_ELEMENTS(interned_keys);
+
+	if (is_interned(key))
+		return key;
+
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+		int cmp = strcmp(interned_keys[mid], key);
+		if (cmp == 0)
+			return interned_keys[mid];
+		if (cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return NULL;
+}
+
+static char *intern_key(const char *key)
+{
+	const char *k = find_interned(key);
+	return k ? (char *) k : strdup(key);
+}
+
+static void free_key(const char *key)
+{
+	if (!is_interned(key))
+		free((char *) key);
+}
+
+/* The items are kept sorted on the key so that lookups in the dict can
+ * bisect. Returns the index of key or where it should be inserted. */
+static uint32_t find_pos(const struct spa_dict *dict, const char *key, bool *found)
+{
+	uint32_t lo = 0, hi = dict->n_items;
+
+	/* fast path for adding the items of a sorted dict */
+	if (hi > 0 && strcmp(dict->items[hi - 1].key, key) < 0) {
+		*found = false;
+		return hi;
+	}
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+		int cmp = strcmp(dict->items[mid].key, key);
+		if (cmp == 0) {
+			*found = true;
+			return mid;
+		}
+		if (cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	*found = false;
+	return lo;
+}
+
+static int insert_item(struct pw_properties *this, uint32_t pos, char *key, char *value)
 {
-	struct spa_dict_item *item;
 	struct properties *impl = SPA_CONTAINER_OF(this, struct properties, this);
+	struct spa_dict_item *items;
 
-	item = pw_array_add(&impl->items, sizeof(struct spa_dict_item));
-	if (item == NULL) {
-		free(key);
+	if (pw_array_add(&impl->items, sizeof(struct spa_dict_item)) == NULL) {
+		free_key(key);
 		free(value);
 		return -errno;
 	}
+	items = impl->items.data;
+	memmove(&items[pos + 1], &items[pos],
+			(this->dict.n_items - pos) * sizeof(struct spa_dict_item));
+	items[pos].key = key;
+	items[pos].value = value;
 
-	item->key = key;
-	item->value = value;
-
-	this->dict.items = impl->items.data;
+	this->dict.items = items;
 	this->dict.n_items++;
 	return 0;
 }
 
-static void clear_item(struct spa_dict_item *item)
+/* add a new item, an existing key keeps its value */
+static int add_func(struct pw_properties *this, const char *key, const char *value)
 {
-	free((char *) item->key);
-	free((char *) item->value);
+	uint32_t pos;
+	bool found;
+	char *v;
+
+	pos = find_pos(&this->dict, key, &found);
+	if (found)
+		return 0;
+
+	if ((v = strdup(value)) == NULL)
+		return -errno;
+
+	return insert_item(this, pos, intern_key(key), v);
 }
 
-static int find_index(const struct pw_properties *this, const char *key)
+static void remove_item(struct pw_properties *this, uint32_t pos)
 {
-	const struct spa_dict_item *item;
-	item = spa_dict_lookup_item(&this->dict, key);
-	if (item == NULL)
-		return -1;
-	return item - this->dict.items;
+	struct properties *impl = SPA_CONTAINER_OF(this, struct properties, this);
+	struct spa_dict_item *items = impl->items.data;
+
+	free_key(items[pos].key);
+	free((char *) items[pos].value);
+	memmove(&items[pos], &items[pos + 1],
+			(this->dict.n_items - pos - 1) * sizeof(struct spa_dict_item));
+	impl->items.size -= sizeof(struct spa_dict_item);
+	this->dict.n_items--;
+}
+
+static void clear_item(struct spa_dict_item *item)
+{
+	free_key(item->key);
+	free((char *) item->value);
 }
 
 static struct properties *properties_new(int prealloc)
@@ -83,6 +327,7 @@ static struct properties *properties_new(int prealloc)
 
 	pw_array_init(&impl->items, 16);
 	pw_array_ensure_size(&impl->items, sizeof(struct spa_dict_item) * prealloc);
+	impl->this.dict.flags = SPA_DICT_FLAG_SORTED;
 
 	return impl;
 }
@@ -110,7 +355,7 @@ struct pw_properties *pw_properties_new(const char *key, ...)
 	while (key != NULL) {
 		value = va_arg(varargs, char *);
 		if (value && key[0])
-			add_func(&impl->this, strdup(key), strdup(value));
+			add_func(&impl->this, key, value);
 		key = va_arg(varargs, char *);
 	}
 	va_end(varargs);
@@ -138,8 +383,7 @@ struct pw_properties *pw_properties_new_dict(const struct spa_dict *dict)
 	for (i = 0; i < dict->n_items; i++) {
 		const struct spa_dict_item *it = &dict->items[i];
 		if (it->key != NULL && it->key[0] && it->value != NULL)
-			add_func(&impl->this, strdup(it->key),
-				 strdup(it->value));
+			add_func(&impl->this, it->key, it->value);
 	}
 
 	return &impl->this;
@@ -225,7 +469,34 @@ error:
 SPA_EXPORT
 struct pw_properties *pw_properties_copy(const struct pw_properties *properties)
 {
-	return pw_properties_new_dict(&properties->dict);
+	const struct spa_dict_item *it;
+	struct properties *impl;
+	char *key, *value;
+	int res;
+
+	impl = properties_new(SPA_ROUND_UP_N(properties->dict.n_items, 16));
+	if (impl == NULL)
+		return NULL;
+
+	/* the items are sorted and unique, append them without lookups */
+	spa_dict_for_each(it, &properties->dict) {
+		key = is_interned(it->key) ? (char *) it->key : strdup(it->key);
+		value = strdup(it->value);
+		if (key == NULL || value == NULL) {
+			res = -errno;
+			free_key(key);
+			free(value);
+			goto error;
+		}
+		if ((res = insert_item(&impl->this, impl->this.dict.n_items, key, value)) < 0)
+			goto error;
+	}
+	return &impl->this;
+
+error:
+	pw_properties_free(&impl->this);
+	errno = -res;
+	return NULL;
 }
 
 /** Copy multiple keys from one property to another
@@ -364,33 +635,27 @@ void pw_properties_free(struct pw_properties *properties)
 static int do_replace(struct pw_properties *properties, const char *key, char *value, bool copy)
 {
 	struct properties *impl = SPA_CONTAINER_OF(properties, struct properties, this);
-	int index;
+	uint32_t pos;
+	bool found;
 
 	if (key == NULL || key[0] == 0)
 		goto exit_noupdate;
 
-	index = find_index(properties, key);
+	pos = find_pos(&properties->dict, key, &found);
 
-	if (index == -1) {
+	if (!found) {
 		if (value == NULL)
 			return 0;
-		add_func(properties, strdup(key), copy ? strdup(value) : value);
+		insert_item(properties, pos, intern_key(key), copy ? strdup(value) : value);
 	} else {
 		struct spa_dict_item *item =
-		    pw_array_get_unchecked(&impl->items, index, struct spa_dict_item);
+		    pw_array_get_unchecked(&impl->items, pos, struct spa_dict_item);
 
 		if (value && strcmp(item->value, value) == 0)
 			goto exit_noupdate;
 
 		if (value == NULL) {
-			struct spa_dict_item *last = pw_array_get_unchecked(&impl->items,
-						     pw_array_get_len(&impl->items, struct spa_dict_item) - 1,
-						     struct spa_dict_item);
-			clear_item(item);
-			item->key = last->key;
-			item->value = last->value;
-			impl->items.size -= sizeof(struct spa_dict_item);
-			properties->dict.n_items--;
+			remove_item(properties, pos);
 		} else {
 			free((char *) item->value);
 			item->value = copy ? strdup(value) : value;
@@ -477,13 +742,17 @@ int pw_properties_setf(struct pw_properties *properties, const char *key, const
 SPA_EXPORT
 const char *pw_properties_get(const struct pw_properties *properties, const char *key)
 {
-	struct properties *impl = SPA_CONTAINER_OF(properties, struct properties, this);
-	int index = find_index(properties, key);
+	uint32_t pos;
+	bool found;
+
+	if (key == NULL)
+		return NULL;
 
-	if (index == -1)
+	pos = find_pos(&properties->dict, key, &found);
+	if (!found)
 		return NULL;
 
-	return pw_array_get_unchecked(&impl->items, index, struct spa_dict_item)->value;
+	return properties->dict.items[pos].value;
 }
 
 /** Iterate property values
@@ -41,6 +41,10 @@ extern "C" {
  * Both keys and values are strings which keeps things simple.
  * Encoding of arbitrary values should be done by using a string
  * serialization such as base64 for binary blobs.
+ *
+ * The items are kept sorted on the key in strcmp() order, not in the
+ * order they were added. Iterating the properties or the items of the
+ * dict gives the keys in that order.
  */
 struct pw_properties {
 	struct spa_dict dict;	/**< dictionary of key/values */
@@ -144,6 +144,7 @@ struct stream {
 	unsigned int drained:1;
 	unsigned int allow_mlock:1;
 	unsigned int process_rt:1;
+	unsigned int prefault:1;
 };
 
 static int get_param_index(uint32_t id)
@@ -580,7 +581,9 @@ static int map_data(struct stream *impl, struct spa_data *data, int prot)
 
 	pw_map_range_init(&range, data->mapoffset, data->maxsize, impl->context->sc_pagesize);
 
-	ptr = mmap(NULL, range.size, prot, MAP_SHARED, data->fd, range.offset);
+	ptr = mmap(NULL, range.size, prot,
+			MAP_SHARED | (impl->prefault ? MAP_POPULATE : 0),
+			data->fd, range.offset);
 	if (ptr == MAP_FAILED) {
 		pw_log_error(NAME" %p: failed to mmap buffer mem: %m", impl);
 		return -errno;
@@ -1201,6 +1204,9 @@ stream_new(struct pw_context *context, const char *name,
 
 	impl->context = context;
 	impl->allow_mlock = context->defaults.mem_allow_mlock;
+	impl->prefault = context->defaults.mem_prefault;
+	if ((str = pw_properties_get(props, "mem.prefault")) != NULL)
+		impl->prefault = pw_properties_parse_bool(str);
 
 	spa_hook_list_append(&impl->context->driver_listener_list,
 			&impl->context_listener,
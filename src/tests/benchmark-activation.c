@@ -0,0 +1,181 @@
+/* PipeWire
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/private.h>
+
+/* Measures the round trip time of signalling a node through its
+ * activation and getting a signal back, like a driver and a follower
+ * in another process do every cycle.
+ *
+ * The eventfd transport writes and reads the eventfd for each signal.
+ * The futex transport spins on the signal_seq word of the activation
+ * for a while and only sleeps on the eventfd when no signal arrived.
+ */
+
+#define N_CYCLES	100000
+
+struct peer {
+	struct pw_node_activation *activation;
+	int fd;
+	uint32_t seq;
+	bool sleeping;
+	uint64_t spin_nsec;
+	uint64_t n_writes;
+	uint64_t n_reads;
+};
+
+struct data {
+	struct peer peer[2];
+	uint32_t n_cycles;
+};
+
+static inline uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void peer_signal(struct peer *p)
+{
+	if (pw_node_activation_signal(p->activation)) {
+		if (eventfd_write(p->fd, 1) < 0)
+			fprintf(stderr, "write failed: %m\n");
+		p->n_writes++;
+	}
+}
+
+static bool peer_spin(struct peer *p)
+{
+	uint64_t end = get_time_ns() + p->spin_nsec;
+	do {
+		if (ATOMIC_LOAD(p->activation->signal_seq) != p->seq)
+			return true;
+	} while (get_time_ns() < end);
+	return false;
+}
+
+static void peer_wait(struct peer *p)
+{
+	eventfd_t count;
+
+	if (p->activation->wait_mode == PW_NODE_ACTIVATION_WAIT_FUTEX &&
+	    !p->sleeping) {
+		if (peer_spin(p))
+			goto done;
+		if (!pw_node_activation_sleep(p->activation, p->seq))
+			goto done;
+		p->sleeping = true;
+	}
+	if (eventfd_read(p->fd, &count) < 0)
+		fprintf(stderr, "read failed: %m\n");
+	p->n_reads++;
+	p->sleeping = false;
+done:
+	p->seq = ATOMIC_LOAD(p->activation->signal_seq);
+}
+
+static void *follower_thread(void *user_data)
+{
+	struct data *d = user_data;
+	uint32_t i;
+
+	for (i = 0; i < d->n_cycles; i++) {
+		peer_wait(&d->peer[1]);
+		peer_signal(&d->peer[0]);
+	}
+	return NULL;
+}
+
+static void run(struct data *d, const char *name, uint32_t wait_mode, uint64_t spin_nsec)
+{
+	struct pw_node_activation activation[2];
+	pthread_t thread;
+	uint64_t t, start, total = 0, max = 0;
+	uint32_t i;
+
+	spa_zero(activation);
+	for (i = 0; i < 2; i++) {
+		activation[i].wait_mode = wait_mode;
+		activation[i].sleeping = 1;
+		d->peer[i].activation = &activation[i];
+		d->peer[i].seq = 0;
+		d->peer[i].sleeping = wait_mode == PW_NODE_ACTIVATION_WAIT_FUTEX;
+		d->peer[i].spin_nsec = spin_nsec;
+		d->peer[i].n_writes = d->peer[i].n_reads = 0;
+	}
+
+	pthread_create(&thread, NULL, follower_thread, d);
+
+	for (i = 0; i < d->n_cycles; i++) {
+		start = get_time_ns();
+		peer_signal(&d->peer[1]);
+		peer_wait(&d->peer[0]);
+		t = get_time_ns() - start;
+		total += t;
+		max = SPA_MAX(max, t);
+	}
+	pthread_join(thread, NULL);
+
+	fprintf(stderr, "%-8s spin:%"PRIu64"us cycles:%u avg:%"PRIu64"ns max:%"PRIu64"us "
+			"syscalls/cycle:%.2f\n",
+			name, (uint64_t)(spin_nsec / SPA_NSEC_PER_USEC), d->n_cycles,
+			total / d->n_cycles, (uint64_t)(max / SPA_NSEC_PER_USEC),
+			(double)(d->peer[0].n_writes + d->peer[0].n_reads +
+				 d->peer[1].n_writes + d->peer[1].n_reads) / d->n_cycles);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data d;
+	uint32_t i;
+
+	spa_zero(d);
+	d.n_cycles = argc > 1 ? atoi(argv[1]) : N_CYCLES;
+
+	for (i = 0; i < 2; i++) {
+		if ((d.peer[i].fd = eventfd(0, EFD_CLOEXEC)) < 0) {
+			fprintf(stderr, "eventfd failed: %m\n");
+			return -1;
+		}
+	}
+
+	run(&d, "eventfd", PW_NODE_ACTIVATION_WAIT_EVENTFD, 0);
+	run(&d, "futex", PW_NODE_ACTIVATION_WAIT_FUTEX, 0);
+	run(&d, "futex", PW_NODE_ACTIVATION_WAIT_FUTEX, 5 * SPA_NSEC_PER_USEC);
+	run(&d, "futex", PW_NODE_ACTIVATION_WAIT_FUTEX, 50 * SPA_NSEC_PER_USEC);
+
+	for (i = 0; i < 2; i++)
+		close(d.peer[i].fd);
+
+	return 0;
+}
@@ -0,0 +1,418 @@
+/* PipeWire
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <spa/node/node.h>
+#include <spa/node/io.h>
+#include <spa/node/utils.h>
+#include <spa/param/param.h>
+#include <spa/param/format.h>
+#include <spa/pod/builder.h>
+#include <spa/pod/filter.h>
+#include <spa/utils/hook.h>
+#include <spa/utils/names.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/impl.h>
+
+/* Builds a fan-out/fan-in graph driven by the dummy driver:
+ *
+ *               +-> work 0 -+
+ *   source -----+-> work 1 -+----> sink
+ *               +-> ...    -+
+ *               +-> work N -+
+ *
+ * Every work node burns a fixed amount of cpu time. The time between the
+ * source and the sink is measured for a number of data loop workers.
+ *
+ * The nodes are implemented here because the fakesrc and fakesink test
+ * plugins time themselves and can't be scheduled as followers.
+ */
+
+#define N_WORK		16
+#define WORK_NSEC	(150 * SPA_NSEC_PER_USEC)
+#define N_CYCLES	256
+
+struct port {
+	struct spa_io_buffers *io;
+	struct spa_param_info params[3];
+	struct spa_port_info info;
+	uint32_t n_buffers;
+	bool have_format;
+};
+
+struct node {
+	struct spa_node node;
+	struct spa_hook_list hooks;
+	struct spa_node_info info;
+
+	struct port ports[2];	/* indexed by direction */
+	uint32_t n_ports[2];
+
+	struct data *data;
+	uint64_t work;
+};
+
+struct data {
+	struct pw_main_loop *loop;
+	struct pw_context *context;
+	struct spa_source *timer;
+
+	struct spa_handle *driver_handle;
+	struct node nodes[N_WORK + 2];
+
+	uint64_t source_time;
+	uint64_t total;
+	uint64_t max;
+	uint32_t count;
+};
+
+static inline uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static int node_add_listener(void *object, struct spa_hook *listener,
+		const struct spa_node_events *events, void *data)
+{
+	struct node *n = object;
+	struct spa_hook_list save;
+	uint32_t i;
+
+	spa_hook_list_isolate(&n->hooks, &save, listener, events, data);
+
+	spa_node_emit_info(&n->hooks, &n->info);
+	for (i = 0; i < 2; i++) {
+		if (n->n_ports[i] > 0)
+			spa_node_emit_port_info(&n->hooks, i, 0, &n->ports[i].info);
+	}
+	spa_hook_list_join(&n->hooks, &save);
+	return 0;
+}
+
+static int node_set_callbacks(void *object,
+		const struct spa_node_callbacks *callbacks, void *data)
+{
+	return 0;
+}
+
+static int node_set_io(void *object, uint32_t id, void *data, size_t size)
+{
+	return 0;
+}
+
+static int node_send_command(void *object, const struct spa_command *command)
+{
+	return 0;
+}
+
+static int node_port_enum_params(void *object, int seq,
+		enum spa_direction direction, uint32_t port_id,
+		uint32_t id, uint32_t start, uint32_t num,
+		const struct spa_pod *filter)
+{
+	struct node *n = object;
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[1024];
+	struct spa_pod *param;
+	struct spa_result_node_params result;
+
+	if (start > 0)
+		return 0;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+
+	switch (id) {
+	case SPA_PARAM_EnumFormat:
+	case SPA_PARAM_Format:
+		if (id == SPA_PARAM_Format && !n->ports[direction].have_format)
+			return -EIO;
+		param = spa_pod_builder_add_object(&b,
+			SPA_TYPE_OBJECT_Format, id,
+			SPA_FORMAT_mediaType,    SPA_POD_Id(SPA_MEDIA_TYPE_application),
+			SPA_FORMAT_mediaSubtype, SPA_POD_Id(SPA_MEDIA_SUBTYPE_control));
+		break;
+	case SPA_PARAM_Buffers:
+		param = spa_pod_builder_add_object(&b,
+			SPA_TYPE_OBJECT_ParamBuffers, id,
+			SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(2, 1, 8),
+			SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(1),
+			SPA_PARAM_BUFFERS_size,    SPA_POD_Int(1024),
+			SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(4),
+			SPA_PARAM_BUFFERS_align,   SPA_POD_Int(16));
+		break;
+	default:
+		return 0;
+	}
+
+	result.id = id;
+	result.index = 0;
+	result.next = 1;
+	if (spa_pod_filter(&b, &result.param, param, filter) < 0)
+		return 0;
+
+	spa_node_emit_result(&n->hooks, seq, 0, SPA_RESULT_TYPE_NODE_PARAMS, &result);
+	return 0;
+}
+
+static int node_port_set_param(void *object,
+		enum spa_direction direction, uint32_t port_id,
+		uint32_t id, uint32_t flags, const struct spa_pod *param)
+{
+	struct node *n = object;
+
+	if (id != SPA_PARAM_Format)
+		return -ENOENT;
+	n->ports[direction].have_format = param != NULL;
+	return 0;
+}
+
+static int node_port_use_buffers(void *object,
+		enum spa_direction direction, uint32_t port_id, uint32_t flags,
+		struct spa_buffer **buffers, uint32_t n_buffers)
+{
+	struct node *n = object;
+	n->ports[direction].n_buffers = n_buffers;
+	return 0;
+}
+
+static int node_port_set_io(void *object,
+		enum spa_direction direction, uint32_t port_id,
+		uint32_t id, void *data, size_t size)
+{
+	struct node *n = object;
+
+	if (id != SPA_IO_Buffers)
+		return -ENOENT;
+	n->ports[direction].io = data;
+	return 0;
+}
+
+static int node_port_reuse_buffer(void *object, uint32_t port_id, uint32_t buffer_id)
+{
+	return 0;
+}
+
+static int node_process(void *object)
+{
+	struct node *n = object;
+	struct port *in = &n->ports[SPA_DIRECTION_INPUT];
+	struct port *out = &n->ports[SPA_DIRECTION_OUTPUT];
+	struct data *d = n->data;
+	uint64_t now, start = get_time_ns();
+
+	while ((now = get_time_ns()) - start < n->work);
+
+	if (n == &d->nodes[0]) {
+		/* the source runs first */
+		d->source_time = now;
+	} else if (n == &d->nodes[1] && d->count < N_CYCLES) {
+		/* the sink runs when all work nodes completed */
+		d->total += now - d->source_time;
+		d->max = SPA_MAX(d->max, now - d->source_time);
+		d->count++;
+	}
+
+	if (in->io)
+		in->io->status = SPA_STATUS_NEED_DATA;
+	if (out->io && out->n_buffers > 0) {
+		out->io->buffer_id = 0;
+		out->io->status = SPA_STATUS_HAVE_DATA;
+	}
+	return SPA_STATUS_HAVE_DATA | SPA_STATUS_NEED_DATA;
+}
+
+static const struct spa_node_methods node_methods = {
+	SPA_VERSION_NODE_METHODS,
+	.add_listener = node_add_listener,
+	.set_callbacks = node_set_callbacks,
+	.set_io = node_set_io,
+	.send_command = node_send_command,
+	.port_enum_params = node_port_enum_params,
+	.port_set_param = node_port_set_param,
+	.port_use_buffers = node_port_use_buffers,
+	.port_set_io = node_port_set_io,
+	.port_reuse_buffer = node_port_reuse_buffer,
+	.process = node_process,
+};
+
+static void init_node(struct data *d, struct node *n,
+		uint32_t n_inputs, uint32_t n_outputs, uint64_t work)
+{
+	uint32_t i;
+
+	spa_zero(*n);
+	n->data = d;
+	n->node.iface = SPA_INTERFACE_INIT(SPA_TYPE_INTERFACE_Node,
+			SPA_VERSION_NODE, &node_methods, n);
+	spa_hook_list_init(&n->hooks);
+
+	n->n_ports[SPA_DIRECTION_INPUT] = n_inputs;
+	n->n_ports[SPA_DIRECTION_OUTPUT] = n_outputs;
+	n->work = work;
+
+	n->info = SPA_NODE_INFO_INIT();
+	n->info.max_input_ports = n_inputs;
+	n->info.max_output_ports = n_outputs;
+	n->info.change_mask = SPA_NODE_CHANGE_MASK_FLAGS;
+	n->info.flags = SPA_NODE_FLAG_RT;
+
+	for (i = 0; i < 2; i++) {
+		struct port *p = &n->ports[i];
+		p->info = SPA_PORT_INFO_INIT();
+		p->info.change_mask = SPA_PORT_CHANGE_MASK_FLAGS |
+			SPA_PORT_CHANGE_MASK_PARAMS;
+		p->info.flags = SPA_PORT_FLAG_NO_REF;
+		p->params[0] = SPA_PARAM_INFO(SPA_PARAM_EnumFormat, SPA_PARAM_INFO_READ);
+		p->params[1] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_READWRITE);
+		p->params[2] = SPA_PARAM_INFO(SPA_PARAM_Buffers, SPA_PARAM_INFO_READ);
+		p->info.params = p->params;
+		p->info.n_params = 3;
+	}
+}
+
+static struct pw_impl_node *add_node(struct data *d, struct spa_node *node)
+{
+	struct pw_impl_node *n;
+
+	n = pw_context_create_node(d->context,
+			pw_properties_new(
+				PW_KEY_NODE_GROUP, "benchmark",
+				NULL), 0);
+	spa_assert(n != NULL);
+	pw_impl_node_set_implementation(n, node);
+	pw_impl_node_register(n, NULL);
+	pw_impl_node_set_active(n, true);
+	return n;
+}
+
+static void link_nodes(struct data *d, struct pw_impl_node *out, struct pw_impl_node *in)
+{
+	struct pw_impl_link *link;
+
+	link = pw_context_create_link(d->context,
+			pw_impl_node_find_port(out, PW_DIRECTION_OUTPUT, 0),
+			pw_impl_node_find_port(in, PW_DIRECTION_INPUT, 0),
+			NULL, NULL, 0);
+	spa_assert(link != NULL);
+	pw_impl_link_register(link, NULL);
+}
+
+static void on_timeout(void *data, uint64_t expirations)
+{
+	struct data *d = data;
+	if (d->count >= N_CYCLES)
+		pw_main_loop_quit(d->loop);
+}
+
+static void run_graph(uint32_t n_workers)
+{
+	struct data d;
+	struct pw_impl_node *driver, *source, *sink, *work;
+	struct pw_properties *props;
+	struct timespec value, interval;
+	void *iface;
+	uint32_t i;
+
+	spa_zero(d);
+
+	props = pw_properties_new(
+			PW_KEY_CONTEXT_PROFILE_MODULES, "none",
+			"default.clock.quantum", "512",
+			NULL);
+	pw_properties_setf(props, "context.data-loop.workers", "%u", n_workers);
+
+	d.loop = pw_main_loop_new(NULL);
+	d.context = pw_context_new(pw_main_loop_get_loop(d.loop), props, 0);
+	spa_assert(d.context != NULL);
+	pw_context_add_spa_lib(d.context, "support.*", "support/libspa-support");
+
+	d.driver_handle = pw_context_load_spa_handle(d.context,
+			SPA_NAME_SUPPORT_NODE_DRIVER, NULL);
+	spa_assert(d.driver_handle != NULL);
+	spa_handle_get_interface(d.driver_handle, SPA_TYPE_INTERFACE_Node, &iface);
+
+	driver = pw_context_create_node(d.context,
+			pw_properties_new(
+				PW_KEY_NODE_GROUP, "benchmark",
+				PW_KEY_NODE_DRIVER, "true",
+				NULL), 0);
+	pw_impl_node_set_implementation(driver, iface);
+	pw_impl_node_register(driver, NULL);
+	pw_impl_node_set_active(driver, true);
+
+	init_node(&d, &d.nodes[0], 0, 1, 0);
+	source = add_node(&d, &d.nodes[0].node);
+
+	init_node(&d, &d.nodes[1], 1, 0, 0);
+	sink = add_node(&d, &d.nodes[1].node);
+
+	for (i = 0; i < N_WORK; i++) {
+		init_node(&d, &d.nodes[i + 2], 1, 1, WORK_NSEC);
+		work = add_node(&d, &d.nodes[i + 2].node);
+		link_nodes(&d, source, work);
+		link_nodes(&d, work, sink);
+	}
+
+	d.timer = pw_loop_add_timer(pw_main_loop_get_loop(d.loop), on_timeout, &d);
+	value.tv_sec = 0;
+	value.tv_nsec = 100 * SPA_NSEC_PER_MSEC;
+	interval = value;
+	pw_loop_update_timer(pw_main_loop_get_loop(d.loop), d.timer, &value, &interval, false);
+
+	pw_main_loop_run(d.loop);
+
+	fprintf(stderr, "workers:%u nodes:%u work:%"PRIu64"us cycles:%u avg:%"PRIu64"us max:%"PRIu64"us\n",
+			n_workers, N_WORK, (uint64_t)(WORK_NSEC / SPA_NSEC_PER_USEC), d.count,
+			(uint64_t)(d.count ? d.total / d.count / SPA_NSEC_PER_USEC : 0),
+			(uint64_t)(d.max / SPA_NSEC_PER_USEC));
+
+	pw_context_destroy(d.context);
+	pw_unload_spa_handle(d.driver_handle);
+	pw_main_loop_destroy(d.loop);
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t n_workers, max_workers;
+
+	pw_init(&argc, &argv);
+
+	if (argc > 1)
+		max_workers = atoi(argv[1]);
+	else
+		max_workers = SPA_MIN(sysconf(_SC_NPROCESSORS_ONLN) - 1, 8);
+
+	run_graph(0);
+	for (n_workers = 1; n_workers <= max_workers; n_workers *= 2)
+		run_graph(n_workers);
+
+	return 0;
+}
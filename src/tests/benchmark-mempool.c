@@ -0,0 +1,157 @@
+/* PipeWire
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <spa/buffer/buffer.h>
+
+#include <pipewire/pipewire.h>
+
+/* Measures the lookups that client-node does on the pools when buffers
+ * are negotiated and cleared with many blocks in the pools:
+ *
+ *  find_ptr: find the block of the buffer memory in the context pool
+ *  import:   import the block in the client pool, it is found on the fd
+ *  tag:      find the io area of a port with its tag
+ *  clear:    free all maps of a node with the node id tag
+ *
+ * The blocks are allocated from slabs so that no fds are used, the fds
+ * of the imported blocks are not used for anything.
+ */
+
+#define SLAB_SIZE	(4 * 1024 * 1024)
+#define FD_BASE		1000
+#define MAPS_PER_NODE	4
+
+#define BLOCK_FLAGS	(PW_MEMBLOCK_FLAG_READWRITE | \
+			 PW_MEMBLOCK_FLAG_SEAL | \
+			 PW_MEMBLOCK_FLAG_MAP)
+
+static const uint32_t block_counts[] = { 100, 1000, 10000 };
+
+static inline uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void report(const char *name, uint32_t n_blocks, uint64_t t)
+{
+	fprintf(stderr, "%-8s blocks:%5u time:%8"PRIu64"us ns/op:%6"PRIu64"\n",
+			name, n_blocks, (uint64_t)(t / SPA_NSEC_PER_USEC), t / n_blocks);
+}
+
+static void run(uint32_t n_blocks)
+{
+	struct pw_mempool *pool, *client;
+	struct pw_memblock **blocks, *b;
+	struct pw_memmap *mm;
+	uint32_t i, tag[5] = { 0, };
+	uint64_t t1, t2;
+	char str[16];
+
+	snprintf(str, sizeof(str), "%u", SLAB_SIZE);
+	pool = pw_mempool_new(pw_properties_new(PW_KEY_MEMPOOL_SLAB_SIZE, str, NULL));
+	client = pw_mempool_new(NULL);
+	blocks = calloc(n_blocks, sizeof(struct pw_memblock *));
+	if (pool == NULL || client == NULL || blocks == NULL) {
+		fprintf(stderr, "can't allocate: %m\n");
+		return;
+	}
+
+	for (i = 0; i < n_blocks; i++) {
+		if ((blocks[i] = pw_mempool_alloc(pool, BLOCK_FLAGS, SPA_DATA_MemFd, 64)) == NULL) {
+			fprintf(stderr, "can't allocate block: %m\n");
+			return;
+		}
+	}
+
+	t1 = get_time_ns();
+	for (i = 0; i < n_blocks; i++) {
+		b = pw_mempool_find_ptr(pool, SPA_MEMBER(blocks[i]->map->ptr, 32, void));
+		spa_assert(b == blocks[i]);
+	}
+	t2 = get_time_ns();
+	report("find_ptr", n_blocks, t2 - t1);
+
+	t1 = get_time_ns();
+	for (i = 0; i < n_blocks; i++) {
+		b = pw_mempool_import(client, PW_MEMBLOCK_FLAG_DONT_CLOSE,
+				SPA_DATA_MemFd, FD_BASE + i);
+		spa_assert(b != NULL);
+	}
+	for (i = 0; i < n_blocks; i++) {
+		b = pw_mempool_import(client, PW_MEMBLOCK_FLAG_DONT_CLOSE,
+				SPA_DATA_MemFd, FD_BASE + i);
+		spa_assert(b != NULL && b->ref == 2);
+		pw_memblock_unref(b);
+	}
+	t2 = get_time_ns();
+	report("import", n_blocks, t2 - t1);
+
+	for (i = 0; i < n_blocks; i++) {
+		tag[0] = i / MAPS_PER_NODE;
+		tag[1] = i % MAPS_PER_NODE;
+		mm = pw_mempool_import_map(client, pool, blocks[i]->map->ptr, 64, tag);
+		spa_assert(mm != NULL);
+	}
+
+	t1 = get_time_ns();
+	for (i = 0; i < n_blocks; i++) {
+		tag[0] = i / MAPS_PER_NODE;
+		tag[1] = i % MAPS_PER_NODE;
+		mm = pw_mempool_find_tag(client, tag, sizeof(tag));
+		spa_assert(mm != NULL && mm->ptr == blocks[i]->map->ptr);
+	}
+	t2 = get_time_ns();
+	report("tag", n_blocks, t2 - t1);
+
+	t1 = get_time_ns();
+	for (i = 0; i < n_blocks / MAPS_PER_NODE; i++) {
+		tag[0] = i;
+		while ((mm = pw_mempool_find_tag(client, tag, sizeof(uint32_t))) != NULL)
+			pw_memmap_free(mm);
+	}
+	t2 = get_time_ns();
+	report("clear", n_blocks, t2 - t1);
+
+	pw_mempool_destroy(client);
+	pw_mempool_destroy(pool);
+	free(blocks);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t i;
+
+	pw_init(&argc, &argv);
+
+	for (i = 0; i < SPA_N_ELEMENTS(block_counts); i++)
+		run(block_counts[i]);
+
+	return 0;
+}
@@ -0,0 +1,156 @@
+/* PipeWire
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <pipewire/pipewire.h>
+
+/* Measures the operations on the properties of an object with a
+ * realistic mix of well-known and custom keys:
+ *
+ *  get:    pw_properties_get of every key
+ *  lookup: spa_dict_lookup of every key on the dict of the properties
+ *  set:    pw_properties_set of an existing key with a new value
+ *  copy:   pw_properties_copy of the properties
+ */
+
+#define MAX_OPS		1000000
+
+static const uint32_t key_counts[] = { 10, 50, 200 };
+
+static const char * const well_known[] = {
+	PW_KEY_NODE_NAME,
+	PW_KEY_NODE_DESCRIPTION,
+	PW_KEY_MEDIA_CLASS,
+	PW_KEY_OBJECT_PATH,
+	PW_KEY_DEVICE_ID,
+	PW_KEY_FACTORY_ID,
+	PW_KEY_CLIENT_ID,
+	PW_KEY_PRIORITY_SESSION,
+	PW_KEY_PRIORITY_DRIVER,
+	PW_KEY_NODE_LATENCY,
+	PW_KEY_AUDIO_CHANNELS,
+	PW_KEY_AUDIO_RATE,
+	PW_KEY_MEDIA_ROLE,
+	PW_KEY_APP_NAME,
+	PW_KEY_APP_PROCESS_ID,
+	PW_KEY_SEC_PID,
+};
+
+static const char * const prefixes[] = {
+	"api.alsa.", "api.bluez5.", "alsa.", "device.", "node.", "audio.",
+};
+
+static inline uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void report(const char *name, uint32_t n_keys, uint64_t t, uint32_t n_ops)
+{
+	fprintf(stderr, "%-6s keys:%4u time:%8"PRIu64"us ns/op:%6"PRIu64"\n",
+			name, n_keys, (uint64_t)(t / SPA_NSEC_PER_USEC), t / n_ops);
+}
+
+static void run(uint32_t n_keys)
+{
+	struct pw_properties *props, *copy;
+	char **keys;
+	uint32_t i, n_ops, n_copies;
+	uint64_t t1, t2;
+	const char *str;
+
+	keys = calloc(n_keys, sizeof(char *));
+	props = pw_properties_new(NULL, NULL);
+	if (keys == NULL || props == NULL) {
+		fprintf(stderr, "can't allocate: %m\n");
+		return;
+	}
+
+	for (i = 0; i < n_keys; i++) {
+		if (i < SPA_N_ELEMENTS(well_known) && i % 2 == 0)
+			keys[i] = strdup(well_known[i]);
+		else
+			keys[i] = spa_aprintf("%sprop-%u",
+					prefixes[i % SPA_N_ELEMENTS(prefixes)], i);
+		pw_properties_setf(props, keys[i], "value-%u", i);
+	}
+	spa_assert(props->dict.n_items == n_keys);
+
+	n_ops = MAX_OPS / n_keys * n_keys;
+
+	t1 = get_time_ns();
+	for (i = 0; i < n_ops; i++) {
+		str = pw_properties_get(props, keys[i % n_keys]);
+		spa_assert(str != NULL);
+	}
+	t2 = get_time_ns();
+	report("get", n_keys, t2 - t1, n_ops);
+
+	t1 = get_time_ns();
+	for (i = 0; i < n_ops; i++) {
+		str = spa_dict_lookup(&props->dict, keys[i % n_keys]);
+		spa_assert(str != NULL);
+	}
+	t2 = get_time_ns();
+	report("lookup", n_keys, t2 - t1, n_ops);
+
+	t1 = get_time_ns();
+	for (i = 0; i < n_ops; i++)
+		pw_properties_set(props, keys[i % n_keys], i & 1 ? "odd" : "even");
+	t2 = get_time_ns();
+	report("set", n_keys, t2 - t1, n_ops);
+
+	n_copies = n_ops / n_keys;
+
+	t1 = get_time_ns();
+	for (i = 0; i < n_copies; i++) {
+		copy = pw_properties_copy(props);
+		spa_assert(copy != NULL && copy->dict.n_items == n_keys);
+		pw_properties_free(copy);
+	}
+	t2 = get_time_ns();
+	report("copy", n_keys, t2 - t1, n_copies);
+
+	for (i = 0; i < n_keys; i++)
+		free(keys[i]);
+	free(keys);
+	pw_properties_free(props);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t i;
+
+	pw_init(&argc, &argv);
+
+	for (i = 0; i < SPA_N_ELEMENTS(key_counts); i++)
+		run(key_counts[i]);
+
+	return 0;
+}
@@ -0,0 +1,454 @@
+/* PipeWire
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include <spa/buffer/buffer.h>
+
+#include <pipewire/pipewire.h>
+
+#define N_PAGES		16
+#define N_BLOCKS	1000
+#define MAX_SLAB_SIZE	(4 * 1024 * 1024)
+
+#define N_BUFFERS	4
+#define BUFFER_SIZE	(512 * 1024)
+#define PERIOD_SIZE	(16 * 1024)
+#define N_CYCLES	100
+
+#define BLOCK_FLAGS	(PW_MEMBLOCK_FLAG_READWRITE | \
+			 PW_MEMBLOCK_FLAG_SEAL | \
+			 PW_MEMBLOCK_FLAG_MAP)
+
+static uint32_t pagesize;
+
+static struct pw_mempool *make_pool(uint32_t slab_size)
+{
+	char str[16];
+
+	snprintf(str, sizeof(str), "%u", slab_size);
+	return pw_mempool_new(pw_properties_new(
+				PW_KEY_MEMPOOL_SLAB_SIZE, str,
+				NULL));
+}
+
+/* check the memory of the block with a new mapping of the fd */
+static void check_fd(struct pw_memblock *b, uint8_t val)
+{
+	uint8_t *ptr;
+	uint32_t i;
+
+	ptr = mmap(NULL, b->size, PROT_READ, MAP_SHARED, b->fd, b->offset);
+	spa_assert(ptr != MAP_FAILED);
+	for (i = 0; i < b->size; i++)
+		spa_assert(ptr[i] == val);
+	munmap(ptr, b->size);
+}
+
+static void test_abi(void)
+{
+#if defined(__x86_64__) && defined(__LP64__)
+	spa_assert(sizeof(struct pw_memblock) == 48);
+	spa_assert(sizeof(struct pw_mempool_stats) == 32);
+#else
+	fprintf(stderr, "%zd %zd\n", sizeof(struct pw_memblock),
+			sizeof(struct pw_mempool_stats));
+#endif
+}
+
+static void test_plain(void)
+{
+	struct pw_mempool *pool;
+	struct pw_mempool_stats stats;
+	struct pw_memblock *b;
+
+	pool = pw_mempool_new(NULL);
+	spa_assert(pool != NULL);
+
+	b = pw_mempool_alloc(pool, BLOCK_FLAGS, SPA_DATA_MemFd, 100);
+	spa_assert(b != NULL);
+	spa_assert(b->fd >= 0);
+	spa_assert(b->offset == 0);
+	spa_assert(b->map != NULL);
+	memset(b->map->ptr, 0x11, b->size);
+	check_fd(b, 0x11);
+
+	spa_assert(pw_mempool_get_stats(pool, &stats) == 0);
+	spa_assert(stats.n_blocks == 1);
+	spa_assert(stats.n_slabs == 0);
+	spa_assert(stats.n_slab_blocks == 0);
+
+	pw_memblock_unref(b);
+	pw_mempool_destroy(pool);
+}
+
+static void test_slab(void)
+{
+	struct pw_mempool *pool;
+	struct pw_mempool_stats stats;
+	struct pw_memblock *b[N_PAGES + 1], *big, *nomap;
+	uint32_t i, offset;
+
+	pool = make_pool(N_PAGES * pagesize);
+	spa_assert(pool != NULL);
+
+	/* blocks of one page share the fd of the slab */
+	for (i = 0; i < 4; i++) {
+		b[i] = pw_mempool_alloc(pool, BLOCK_FLAGS, SPA_DATA_MemFd, 100);
+		spa_assert(b[i] != NULL);
+		spa_assert(b[i]->map != NULL);
+		spa_assert(b[i]->fd == b[0]->fd);
+		spa_assert(b[i]->offset == i * pagesize);
+		spa_assert(pw_mempool_find_ptr(pool, b[i]->map->ptr) == b[i]);
+		spa_assert(pw_mempool_find_id(pool, b[i]->id) == b[i]);
+		memset(b[i]->map->ptr, 0x20 + i, b[i]->size);
+	}
+	for (i = 0; i < 4; i++)
+		check_fd(b[i], 0x20 + i);
+
+	/* too big and unmapped blocks get their own fd */
+	big = pw_mempool_alloc(pool, BLOCK_FLAGS, SPA_DATA_MemFd, N_PAGES * pagesize / 2);
+	spa_assert(big != NULL);
+	spa_assert(big->fd != b[0]->fd);
+	spa_assert(big->offset == 0);
+	nomap = pw_mempool_alloc(pool, PW_MEMBLOCK_FLAG_READWRITE, SPA_DATA_MemFd, 100);
+	spa_assert(nomap != NULL);
+	spa_assert(nomap->fd != b[0]->fd);
+	spa_assert(nomap->offset == 0);
+
+	spa_assert(pw_mempool_get_stats(pool, &stats) == 0);
+	spa_assert(stats.n_blocks == 6);
+	spa_assert(stats.n_slabs == 1);
+	spa_assert(stats.n_slab_blocks == 4);
+	spa_assert(stats.slab_size == N_PAGES * pagesize);
+	spa_assert(stats.slab_used == 4 * pagesize);
+
+	/* a freed range is reused and cleared */
+	offset = b[1]->offset;
+	pw_memblock_unref(b[1]);
+	b[1] = pw_mempool_alloc(pool, BLOCK_FLAGS, SPA_DATA_MemFd, 200);
+	spa_assert(b[1] != NULL);
+	spa_assert(b[1]->offset == offset);
+	check_fd(b[1], 0);
+	check_fd(b[2], 0x22);
+
+	/* a block of more pages does not fit in the hole */
+	pw_memblock_unref(b[1]);
+	b[1] = pw_mempool_alloc(pool, BLOCK_FLAGS, SPA_DATA_MemFd, 2 * pagesize);
+	spa_assert(b[1] != NULL);
+	spa_assert(b[1]->offset == 4 * pagesize);
+
+	/* fill the slab, the next block goes to a new slab */
+	for (i = 4; i < N_PAGES - 1; i++) {
+		b[i] = pw_mempool_alloc(pool, BLOCK_FLAGS, SPA_DATA_MemFd, pagesize);
+		spa_assert(b[i] != NULL);
+		spa_assert(b[i]->fd == b[0]->fd);
+	}
+	spa_assert(pw_mempool_get_stats(pool, &stats) == 0);
+	spa_assert(stats.n_slabs == 1);
+	spa_assert(stats.slab_used == N_PAGES * pagesize);
+
+	b[i] = pw_mempool_alloc(pool, BLOCK_FLAGS, SPA_DATA_MemFd, pagesize);
+	spa_assert(b[i] != NULL);
+	spa_assert(b[i]->fd != b[0]->fd);
+	spa_assert(b[i]->offset == 0);
+
+	spa_assert(pw_mempool_get_stats(pool, &stats) == 0);
+	spa_assert(stats.n_slabs == 2);
+	spa_assert(stats.n_slab_blocks == N_PAGES);
+
+	/* an empty slab is freed when it is not the last one */
+	pw_memblock_unref(b[i]);
+	spa_assert(pw_mempool_get_stats(pool, &stats) == 0);
+	spa_assert(stats.n_slabs == 1);
+	spa_assert(stats.slab_used == N_PAGES * pagesize);
+
+	for (i = 0; i < N_PAGES - 1; i++)
+		pw_memblock_unref(b[i]);
+	pw_memblock_unref(big);
+	pw_memblock_unref(nomap);
+
+	spa_assert(pw_mempool_get_stats(pool, &stats) == 0);
+	spa_assert(stats.n_blocks == 0);
+	spa_assert(stats.n_slabs == 1);
+	spa_assert(stats.n_slab_blocks == 0);
+	spa_assert(stats.slab_used == 0);
+
+	pw_mempool_destroy(pool);
+}
+
+/* a negative slab size disables the slabs */
+static void test_slab_negative(void)
+{
+	struct pw_mempool *pool;
+	struct pw_mempool_stats stats;
+	struct pw_memblock *b;
+
+	pool = pw_mempool_new(pw_properties_new(
+				PW_KEY_MEMPOOL_SLAB_SIZE, "-1",
+				NULL));
+	spa_assert(pool != NULL);
+
+	b = pw_mempool_alloc(pool, BLOCK_FLAGS, SPA_DATA_MemFd, 100);
+	spa_assert(b != NULL);
+	spa_assert(b->offset == 0);
+
+	spa_assert(pw_mempool_get_stats(pool, &stats) == 0);
+	spa_assert(stats.n_blocks == 1);
+	spa_assert(stats.n_slabs == 0);
+	spa_assert(stats.n_slab_blocks == 0);
+
+	pw_memblock_unref(b);
+	pw_mempool_destroy(pool);
+}
+
+static void test_import_map(void)
+{
+	struct pw_mempool *pool, *other;
+	struct pw_memblock *b[2], *ib;
+	struct pw_memmap *map, *map2;
+
+	pool = make_pool(N_PAGES * pagesize);
+	spa_assert(pool != NULL);
+	other = pw_mempool_new(NULL);
+	spa_assert(other != NULL);
+
+	b[0] = pw_mempool_alloc(pool, BLOCK_FLAGS, SPA_DATA_MemFd, 100);
+	b[1] = pw_mempool_alloc(pool, BLOCK_FLAGS, SPA_DATA_MemFd, 100);
+	spa_assert(b[0] != NULL && b[1] != NULL);
+	spa_assert(b[1]->offset == pagesize);
+	memset(b[1]->map->ptr, 0x42, b[1]->size);
+
+	/* the imported block is the complete slab */
+	map = pw_mempool_import_map(other, pool,
+			SPA_MEMBER(b[1]->map->ptr, 16, void), 32, NULL);
+	spa_assert(map != NULL);
+	spa_assert(map->ptr == SPA_MEMBER(b[1]->map->ptr, 16, void));
+	spa_assert(map->offset == pagesize + 16);
+	ib = map->block;
+	spa_assert(ib->fd == b[1]->fd);
+	spa_assert(ib->offset == 0);
+
+	/* a new mapping of the imported block sees the same memory */
+	map2 = pw_mempool_map_id(other, ib->id, PW_MEMMAP_FLAG_READ,
+			pagesize + 16, 32, NULL);
+	spa_assert(map2 != NULL);
+	spa_assert(memcmp(map->ptr, map2->ptr, 32) == 0);
+	spa_assert(((uint8_t*)map2->ptr)[0] == 0x42);
+
+	/* the same block is used for the other block of the slab */
+	map2 = pw_mempool_import_map(other, pool, b[0]->map->ptr, 16, NULL);
+	spa_assert(map2 != NULL);
+	spa_assert(map2->block == ib);
+	spa_assert(map2->offset == 0);
+
+	pw_mempool_destroy(other);
+	pw_memblock_unref(b[0]);
+	pw_memblock_unref(b[1]);
+	pw_mempool_destroy(pool);
+}
+
+static void test_find(void)
+{
+	struct pw_mempool *pool, *other;
+	struct pw_memblock *b[N_BLOCKS], *fb[N_BLOCKS];
+	struct pw_memmap *mm;
+	uint32_t i, tag[5] = { 0, };
+
+	pool = make_pool(MAX_SLAB_SIZE);
+	spa_assert(pool != NULL);
+	other = pw_mempool_new(NULL);
+	spa_assert(other != NULL);
+
+	for (i = 0; i < N_BLOCKS; i++) {
+		b[i] = pw_mempool_alloc(pool, BLOCK_FLAGS, SPA_DATA_MemFd, 100);
+		spa_assert(b[i] != NULL);
+	}
+	for (i = 0; i < N_BLOCKS; i++) {
+		uint8_t *ptr = b[i]->map->ptr;
+		spa_assert(pw_mempool_find_ptr(pool, ptr) == b[i]);
+		spa_assert(pw_mempool_find_ptr(pool, ptr + 99) == b[i]);
+		spa_assert(pw_mempool_find_ptr(other, ptr) == NULL);
+	}
+	spa_assert(pw_mempool_find_ptr(pool, NULL) == NULL);
+	spa_assert(pw_mempool_find_ptr(pool, &i) == NULL);
+
+	/* the fds are not mapped or closed */
+	for (i = 0; i < N_BLOCKS; i++) {
+		fb[i] = pw_mempool_import(other, PW_MEMBLOCK_FLAG_DONT_CLOSE,
+				SPA_DATA_MemFd, 1000 + i);
+		spa_assert(fb[i] != NULL);
+		spa_assert(pw_mempool_import(other, PW_MEMBLOCK_FLAG_DONT_CLOSE,
+				SPA_DATA_MemFd, 1000 + i) == fb[i]);
+		pw_memblock_unref(fb[i]);
+	}
+	for (i = 0; i < N_BLOCKS; i += 2)
+		pw_memblock_unref(fb[i]);
+	for (i = 0; i < N_BLOCKS; i++)
+		spa_assert(pw_mempool_find_fd(other, 1000 + i) == (i & 1 ? fb[i] : NULL));
+	spa_assert(pw_mempool_find_fd(other, -1) == NULL);
+	spa_assert(pw_mempool_find_fd(other, 1000 + N_BLOCKS) == NULL);
+	for (i = 1; i < N_BLOCKS; i += 2)
+		pw_memblock_unref(fb[i]);
+
+	/* tags of 4 maps for each node, like client-node */
+	for (i = 0; i < N_BLOCKS; i++) {
+		tag[0] = i / 4;
+		tag[1] = i % 4;
+		mm = pw_mempool_import_map(other, pool, b[i]->map->ptr, 100, tag);
+		spa_assert(mm != NULL);
+	}
+	for (i = 0; i < N_BLOCKS; i++) {
+		tag[0] = i / 4;
+		tag[1] = i % 4;
+		mm = pw_mempool_find_tag(other, tag, sizeof(tag));
+		spa_assert(mm != NULL);
+		spa_assert(mm->ptr == b[i]->map->ptr);
+	}
+	for (i = 0; i < N_BLOCKS / 4; i++) {
+		uint32_t n = 0;
+		tag[0] = i;
+		while ((mm = pw_mempool_find_tag(other, tag, sizeof(uint32_t))) != NULL) {
+			spa_assert(mm->tag[0] == i);
+			pw_memmap_free(mm);
+			n++;
+		}
+		spa_assert(n == 4);
+	}
+
+	pw_mempool_destroy(other);
+	for (i = 0; i < N_BLOCKS; i++)
+		pw_memblock_unref(b[i]);
+	pw_mempool_destroy(pool);
+}
+
+static long get_minor_faults(void)
+{
+	struct rusage usage;
+	spa_assert(getrusage(RUSAGE_SELF, &usage) == 0);
+	return usage.ru_minflt;
+}
+
+/* write a period in one of the buffers every cycle, like a realtime
+ * client does, and count the page faults */
+static long run_cycles(struct pw_memmap *maps[N_BUFFERS])
+{
+	long faults;
+	uint32_t i;
+
+	faults = get_minor_faults();
+	for (i = 0; i < N_CYCLES; i++) {
+		struct pw_memmap *mm = maps[i % N_BUFFERS];
+		uint32_t offset = (i / N_BUFFERS * PERIOD_SIZE) % BUFFER_SIZE;
+		memset(SPA_MEMBER(mm->ptr, offset, void), i, PERIOD_SIZE);
+	}
+	return get_minor_faults() - faults;
+}
+
+static void test_prefault_flags(uint32_t mem_flags, long *faults, long *client_faults)
+{
+	struct pw_mempool *pool, *client;
+	struct pw_memblock *b[N_BUFFERS], *cb;
+	struct pw_memmap *maps[N_BUFFERS], *cmaps[N_BUFFERS];
+	uint32_t i;
+
+	/* no slab, buffers are never allocated from it */
+	pool = pw_mempool_new(NULL);
+	spa_assert(pool != NULL);
+	client = pw_mempool_new(NULL);
+	spa_assert(client != NULL);
+
+	for (i = 0; i < N_BUFFERS; i++) {
+		b[i] = pw_mempool_alloc(pool, BLOCK_FLAGS | mem_flags,
+				SPA_DATA_MemFd, BUFFER_SIZE);
+		spa_assert(b[i] != NULL);
+		spa_assert(b[i]->flags == (BLOCK_FLAGS | mem_flags));
+		maps[i] = b[i]->map;
+	}
+	*faults = run_cycles(maps);
+
+	/* the client imports the block with the flags it got from the server
+	 * and maps it in its own address space */
+	for (i = 0; i < N_BUFFERS; i++) {
+		cb = pw_mempool_import(client, PW_MEMBLOCK_FLAG_READWRITE | mem_flags |
+				PW_MEMBLOCK_FLAG_DONT_CLOSE, SPA_DATA_MemFd, b[i]->fd);
+		spa_assert(cb != NULL);
+		cmaps[i] = pw_mempool_map_id(client, cb->id, PW_MEMMAP_FLAG_READWRITE,
+				0, BUFFER_SIZE, NULL);
+		spa_assert(cmaps[i] != NULL);
+	}
+	*client_faults = run_cycles(cmaps);
+
+	pw_mempool_destroy(client);
+	for (i = 0; i < N_BUFFERS; i++)
+		pw_memblock_unref(b[i]);
+	pw_mempool_destroy(pool);
+}
+
+static void test_prefault(void)
+{
+	long faults, client_faults, pf_faults, pf_client_faults;
+	long hp_faults, hp_client_faults;
+
+	test_prefault_flags(0, &faults, &client_faults);
+	test_prefault_flags(PW_MEMBLOCK_FLAG_PREFAULT,
+			&pf_faults, &pf_client_faults);
+	test_prefault_flags(PW_MEMBLOCK_FLAG_PREFAULT |
+			PW_MEMBLOCK_FLAG_MLOCK |
+			PW_MEMBLOCK_FLAG_HUGEPAGES,
+			&hp_faults, &hp_client_faults);
+
+	fprintf(stderr, "minor faults in %d cycles: default %ld/%ld prefault %ld/%ld "
+			"prefault+mlock+hugepages %ld/%ld\n", N_CYCLES,
+			faults, client_faults, pf_faults, pf_client_faults,
+			hp_faults, hp_client_faults);
+
+	/* every period touches new pages without prefault */
+	spa_assert(faults >= N_CYCLES);
+	spa_assert(client_faults >= N_CYCLES);
+	spa_assert(pf_faults < N_CYCLES / 10);
+	spa_assert(pf_client_faults < N_CYCLES / 10);
+	spa_assert(hp_faults < N_CYCLES / 10);
+	spa_assert(hp_client_faults < N_CYCLES / 10);
+}
+
+int main(int argc, char *argv[])
+{
+	pw_init(&argc, &argv);
+
+	pagesize = sysconf(_SC_PAGESIZE);
+
+	test_abi();
+	test_plain();
+	test_slab();
+	test_slab_negative();
+	test_import_map();
+	test_find();
+	test_prefault();
+
+	return 0;
+}
@@ -23,6 +23,7 @@
  */
 
 #include <pipewire/properties.h>
+#include <pipewire/keys.h>
 
 static void test_abi(void)
 {
@@ -347,6 +348,99 @@ static void test_new_json(void)
 	pw_properties_free(props);
 }
 
+/* the items are sorted on the key, whatever the order they were set in */
+static void check_order(struct pw_properties *props, const char * const *keys, uint32_t n_keys)
+{
+	const char *str;
+	void *state = NULL;
+	uint32_t i;
+
+	spa_assert(SPA_FLAG_IS_SET(props->dict.flags, SPA_DICT_FLAG_SORTED));
+	spa_assert(props->dict.n_items == n_keys);
+	for (i = 0; i < n_keys; i++) {
+		str = pw_properties_iterate(props, &state);
+		spa_assert(str != NULL && !strcmp(str, keys[i]));
+		spa_assert(spa_dict_lookup(&props->dict, keys[i]) != NULL);
+	}
+	spa_assert(pw_properties_iterate(props, &state) == NULL);
+}
+
+static void test_order(void)
+{
+	struct pw_properties *props, *copy;
+	const char * const keys1[] = { "a.b", "bar", "foo", "him", PW_KEY_NODE_NAME };
+	const char * const keys2[] = { "a.b", "bar", "him", PW_KEY_NODE_NAME };
+	const char * const keys3[] = { "a.b", "bar", "him", PW_KEY_MEDIA_CLASS, PW_KEY_NODE_NAME, "zz" };
+
+	props = pw_properties_new(NULL, NULL);
+	spa_assert(pw_properties_set(props, "him", "too") == 1);
+	spa_assert(pw_properties_set(props, PW_KEY_NODE_NAME, "node") == 1);
+	spa_assert(pw_properties_set(props, "foo", "bar") == 1);
+	spa_assert(pw_properties_set(props, "bar", "foo") == 1);
+	spa_assert(pw_properties_set(props, "a.b", "c") == 1);
+	check_order(props, keys1, SPA_N_ELEMENTS(keys1));
+
+	spa_assert(pw_properties_set(props, "foo", NULL) == 1);
+	check_order(props, keys2, SPA_N_ELEMENTS(keys2));
+
+	copy = pw_properties_copy(props);
+	check_order(copy, keys2, SPA_N_ELEMENTS(keys2));
+
+	spa_assert(pw_properties_update(copy, &SPA_DICT_INIT_ARRAY(((struct spa_dict_item[]) {
+			{ "zz", "last" },
+			{ PW_KEY_MEDIA_CLASS, "Audio/Sink" },
+			{ "bar", "other" } }))) == 3);
+	check_order(copy, keys3, SPA_N_ELEMENTS(keys3));
+	spa_assert(!strcmp(pw_properties_get(copy, "bar"), "other"));
+	check_order(props, keys2, SPA_N_ELEMENTS(keys2));
+
+	pw_properties_free(props);
+	pw_properties_free(copy);
+}
+
+static const char *get_key(struct pw_properties *props, const char *key)
+{
+	const struct spa_dict_item *it = spa_dict_lookup_item(&props->dict, key);
+	spa_assert(it != NULL);
+	return it->key;
+}
+
+static void test_interned(void)
+{
+	struct pw_properties *props1, *props2, *copy;
+	char key[64];
+
+	props1 = pw_properties_new(PW_KEY_NODE_NAME, "one", "custom.key", "1", NULL);
+	/* the key is not a string constant but is the same well-known key */
+	snprintf(key, sizeof(key), "%s", PW_KEY_NODE_NAME);
+	props2 = pw_properties_new(key, "two", "custom.key", "2", NULL);
+	memset(key, 0, sizeof(key));
+
+	/* well-known keys are shared, other keys are copied */
+	spa_assert(get_key(props1, PW_KEY_NODE_NAME) == get_key(props2, PW_KEY_NODE_NAME));
+	spa_assert(get_key(props1, PW_KEY_NODE_NAME) != (const char *) PW_KEY_NODE_NAME);
+	spa_assert(get_key(props1, "custom.key") != get_key(props2, "custom.key"));
+	spa_assert(!strcmp(pw_properties_get(props1, PW_KEY_NODE_NAME), "one"));
+	spa_assert(!strcmp(pw_properties_get(props2, PW_KEY_NODE_NAME), "two"));
+
+	copy = pw_properties_copy(props1);
+	spa_assert(get_key(copy, PW_KEY_NODE_NAME) == get_key(props1, PW_KEY_NODE_NAME));
+	spa_assert(get_key(copy, "custom.key") != get_key(props1, "custom.key"));
+
+	/* removing and setting again keeps the shared key */
+	spa_assert(pw_properties_set(props1, PW_KEY_NODE_NAME, NULL) == 1);
+	spa_assert(pw_properties_get(props1, PW_KEY_NODE_NAME) == NULL);
+	spa_assert(!strcmp(pw_properties_get(copy, PW_KEY_NODE_NAME), "one"));
+	spa_assert(pw_properties_set(props1, PW_KEY_NODE_NAME, "again") == 1);
+	spa_assert(get_key(props1, PW_KEY_NODE_NAME) == get_key(props2, PW_KEY_NODE_NAME));
+
+	pw_properties_free(props1);
+	pw_properties_free(props2);
+	spa_assert(!strcmp(pw_properties_get(copy, PW_KEY_NODE_NAME), "one"));
+	spa_assert(!strcmp(pw_properties_get(copy, "custom.key"), "1"));
+	pw_properties_free(copy);
+}
+
 int main(int argc, char *argv[])
 {
 	test_abi();
@@ -359,6 +453,8 @@ int main(int argc, char *argv[])
 	test_update();
 	test_parse();
 	test_new_json();
+	test_order();
+	test_interned();
 
 	return 0;
 }